@@ -20,6 +20,7 @@ require "mkmf"
 
 
 $CFLAGS = "-g -std=gnu99 -D_GNU_SOURCE -fno-strict-aliasing -Wall -Wextra -Wformat=2 -Wcast-qual -Wcast-align -Wwrite-strings -Wconversion -Wfloat-equal -Wpointer-arith"
+$CFLAGS << " -DLOG_MAX_LEVEL=#{ ENV[ "TREMA_LOG_MAX_LEVEL" ] }" if ENV[ "TREMA_LOG_MAX_LEVEL" ]
 $LDFLAGS = "-Wl,-Bsymbolic"
 
 
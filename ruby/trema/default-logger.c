@@ -26,7 +26,11 @@ VALUE mDefaultLogger;
 
 
 static VALUE
-do_log( void ( *log_function )( const char *format, ... ), int argc, VALUE *argv ) {
+do_log( int level, void ( *log_function )( const char *format, ... ), int argc, VALUE *argv ) {
+  // Disabled messages are not even formatted.
+  if ( !LOGGING_LEVEL_ENABLED( level ) ) {
+    return Qnil;
+  }
   VALUE message = rb_f_sprintf( argc, argv );
   log_function( RSTRING_PTR( message ) );
   return message;
@@ -41,13 +45,13 @@ do_log( void ( *log_function )( const char *format, ... ), int argc, VALUE *argv
  *   @example
  *     critical "Trema blue screen. Memory dump = %s", memory
  *
- *   @return [String] the string resulting from applying format to any
- *     additional arguments.
+ *   @return [String, nil] the string resulting from applying format to any
+ *     additional arguments, or nil if the logging level is lower.
  */
 static VALUE
 default_logger_critical( int argc, VALUE *argv, VALUE self ) {
   UNUSED( self );
-  return( do_log( critical, argc, argv ) );
+  return( do_log( LOG_CRIT, critical, argc, argv ) );
 }
 
 
@@ -59,13 +63,13 @@ default_logger_critical( int argc, VALUE *argv, VALUE self ) {
  *   @example
  *     error "Failed to accept %s", app_socket
  *
- *   @return [String] the string resulting from applying format to any
- *     additional arguments.
+ *   @return [String, nil] the string resulting from applying format to any
+ *     additional arguments, or nil if the logging level is lower.
  */
 static VALUE
 default_logger_error( int argc, VALUE *argv, VALUE self ) {
   UNUSED( self );
-  return( do_log( error, argc, argv ) );
+  return( do_log( LOG_ERR, error, argc, argv ) );
 }
 
 
@@ -77,13 +81,13 @@ default_logger_error( int argc, VALUE *argv, VALUE self ) {
  *   @example
  *     warn "%s: trema is already initialized", app_name
  *
- *   @return [String] the string resulting from applying format to any
- *     additional arguments.
+ *   @return [String, nil] the string resulting from applying format to any
+ *     additional arguments, or nil if the logging level is lower.
  */
 static VALUE
 default_logger_warn( int argc, VALUE *argv, VALUE self ) {
   UNUSED( self );
-  return( do_log( warn, argc, argv ) );
+  return( do_log( LOG_WARNING, warn, argc, argv ) );
 }
 
 
@@ -95,13 +99,13 @@ default_logger_warn( int argc, VALUE *argv, VALUE self ) {
  *   @example
  *     notice "The switch %s disconnected its secure channel connection", datapath_id
  *
- *   @return [String] the string resulting from applying format to any
- *     additional arguments.
+ *   @return [String, nil] the string resulting from applying format to any
+ *     additional arguments, or nil if the logging level is lower.
  */
 static VALUE
 default_logger_notice( int argc, VALUE *argv, VALUE self ) {
   UNUSED( self );
-  return( do_log( notice, argc, argv ) );
+  return( do_log( LOG_NOTICE, notice, argc, argv ) );
 }
 
 
@@ -112,13 +116,13 @@ default_logger_notice( int argc, VALUE *argv, VALUE self ) {
  *   @example
  *     info "Hello world from %s!", datapath_id
  *
- *   @return [String] the string resulting from applying format to any
- *     additional arguments.
+ *   @return [String, nil] the string resulting from applying format to any
+ *     additional arguments, or nil if the logging level is lower.
  */
 static VALUE
 default_logger_info( int argc, VALUE *argv, VALUE self ) {
   UNUSED( self );
-  return( do_log( info, argc, argv ) );
+  return( do_log( LOG_INFO, info, argc, argv ) );
 }
 
 
@@ -129,13 +133,13 @@ default_logger_info( int argc, VALUE *argv, VALUE self ) {
  *   @example
  *     debug "Setting a packet_in handler: %s", method
  *
- *   @return [String] the string resulting from applying format to any
- *     additional arguments.
+ *   @return [String, nil] the string resulting from applying format to any
+ *     additional arguments, or nil if the logging level is lower.
  */
 static VALUE
 default_logger_debug( int argc, VALUE *argv, VALUE self ) {
   UNUSED( self );
-  return( do_log( debug, argc, argv ) );
+  return( do_log( LOG_DEBUG, debug, argc, argv ) );
 }
 
 
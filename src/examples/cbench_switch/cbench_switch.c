@@ -21,15 +21,43 @@
 #include "trema.h"
 
 
+// Packed "output to port N" actions, created on first use.
+static buffer *output_actions[ OFPP_MAX + 1 ];
+
+
+static const buffer *
+get_output_actions( uint16_t port ) {
+  if ( output_actions[ port ] == NULL ) {
+    output_actions[ port ] = create_packed_actions();
+    append_packed_action_output( output_actions[ port ], port, UINT16_MAX );
+  }
+
+  return output_actions[ port ];
+}
+
+
+static void
+free_output_actions() {
+  for ( int i = 0; i <= OFPP_MAX; i++ ) {
+    if ( output_actions[ i ] != NULL ) {
+      free_buffer( output_actions[ i ] );
+      output_actions[ i ] = NULL;
+    }
+  }
+}
+
+
 static void
 handle_packet_in( uint64_t datapath_id, packet_in message ) {
-  openflow_actions *actions = create_actions();
-  append_action_output( actions, ( uint16_t ) ( message.in_port + 1 ), UINT16_MAX );
+  uint16_t out_port = ( uint16_t ) ( message.in_port + 1 );
+  if ( out_port > OFPP_MAX ) {
+    return;
+  }
 
   struct ofp_match match;
   set_match_from_packet( &match, message.in_port, 0, message.data );
 
-  buffer *flow_mod = create_flow_mod(
+  buffer *flow_mod = create_flow_mod_with_packed_actions(
     get_transaction_id(),
     match,
     get_cookie(),
@@ -40,12 +68,11 @@ handle_packet_in( uint64_t datapath_id, packet_in message ) {
     message.buffer_id,
     OFPP_NONE,
     0,
-    actions
+    get_output_actions( out_port )
   );
   send_openflow_message( datapath_id, flow_mod );
 
   free_buffer( flow_mod );
-  delete_actions( actions );
 }
 
 
@@ -54,6 +81,7 @@ main( int argc, char *argv[] ) {
   init_trema( &argc, &argv );
   set_packet_in_handler( handle_packet_in, NULL );
   start_trema();
+  free_output_actions();
   return 0;
 }
 
@@ -60,7 +60,7 @@ aged_out( forwarding_entry *entry ) {
 static void
 age_forwarding_db( void *key, void *forwarding_entry, void *forwarding_db ) {
   if ( aged_out( forwarding_entry ) ) {
-    delete_hash_entry( forwarding_db, key );
+    delete_flat_hash_entry( forwarding_db, key );
     xfree( forwarding_entry );
   }
 }
@@ -68,19 +68,19 @@ age_forwarding_db( void *key, void *forwarding_entry, void *forwarding_db ) {
 
 static void
 update_forwarding_db( void *forwarding_db ) {
-  foreach_hash( forwarding_db, age_forwarding_db, forwarding_db );
+  foreach_flat_hash( forwarding_db, age_forwarding_db, forwarding_db );
 }
 
 
 static void
-learn( hash_table *forwarding_db, struct key new_key, uint16_t port_no ) {
-  forwarding_entry *entry = lookup_hash_entry( forwarding_db, &new_key );
+learn( flat_hash_table *forwarding_db, struct key new_key, uint16_t port_no ) {
+  forwarding_entry *entry = lookup_flat_hash_entry( forwarding_db, &new_key );
 
   if ( entry == NULL ) {
     entry = xmalloc( sizeof( forwarding_entry ) );
     memcpy( entry->key.mac, new_key.mac, OFP_ETH_ALEN );
     entry->key.datapath_id = new_key.datapath_id;
-    insert_hash_entry( forwarding_db, &entry->key, entry );
+    insert_flat_hash_entry( forwarding_db, &entry->key, entry );
   }
   entry->port_no = port_no;
   entry->last_update = now();
@@ -173,13 +173,13 @@ handle_packet_in( uint64_t datapath_id, packet_in message ) {
   packet_info packet_info = get_packet_info( message.data );
   memcpy( new_key.mac, packet_info.eth_macsa, OFP_ETH_ALEN );
   new_key.datapath_id = datapath_id;
-  hash_table *forwarding_db = message.user_data;
+  flat_hash_table *forwarding_db = message.user_data;
   learn( forwarding_db, new_key, message.in_port );
 
   struct key search_key;
   memcpy( search_key.mac, packet_info.eth_macda, OFP_ETH_ALEN );
   search_key.datapath_id = datapath_id;
-  forwarding_entry *destination = lookup_hash_entry( forwarding_db, &search_key );
+  forwarding_entry *destination = lookup_flat_hash_entry( forwarding_db, &search_key );
 
   if ( destination == NULL ) {
     do_flooding( message );
@@ -216,7 +216,7 @@ int
 main( int argc, char *argv[] ) {
   init_trema( &argc, &argv );
 
-  hash_table *forwarding_db = create_hash( compare_forwarding_entry, hash_forwarding_entry );
+  flat_hash_table *forwarding_db = create_flat_hash( compare_forwarding_entry, hash_forwarding_entry, FLAT_HASH_NO_LOCK );
   add_periodic_event_callback( AGING_INTERVAL, update_forwarding_db, forwarding_db );
   set_packet_in_handler( handle_packet_in, forwarding_db );
 
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/ip.h>
+#include <string.h>
+#include "action.h"
+
+
+#define VLAN_TAG_LENGTH 4
+#define VLAN_TCI_OFFSET ( ETH_ADDRLEN * 2 + 2 )
+#define VLAN_VID_MASK 0x0fff
+#define VLAN_PCP_MASK 0x07
+#define VLAN_PCP_SHIFT 13
+#define NW_TOS_MASK 0xfc
+
+
+static void
+reparse( buffer *frame ) {
+  if ( frame->user_data != NULL ) {
+    free_packet_info( frame );
+  }
+  parse_packet( frame );
+}
+
+
+static uint16_t
+get_vlan_tci( const buffer *frame ) {
+  uint16_t tci;
+  memcpy( &tci, ( const char * ) frame->data + VLAN_TCI_OFFSET, sizeof( tci ) );
+
+  return ntohs( tci );
+}
+
+
+static void
+set_vlan_tci( buffer *frame, uint16_t tci ) {
+  tci = htons( tci );
+  memcpy( ( char * ) frame->data + VLAN_TCI_OFFSET, &tci, sizeof( tci ) );
+}
+
+
+static void
+push_vlan( buffer *frame, uint16_t tci ) {
+  char *p = append_front_buffer( frame, VLAN_TAG_LENGTH );
+  memmove( p, p + VLAN_TAG_LENGTH, ETH_ADDRLEN * 2 );
+  uint16_t tpid = htons( ETH_ETHTYPE_TPID );
+  memcpy( p + ETH_ADDRLEN * 2, &tpid, sizeof( tpid ) );
+  set_vlan_tci( frame, tci );
+  reparse( frame );
+}
+
+
+static void
+strip_vlan( buffer *frame ) {
+  char *p = frame->data;
+  memmove( p + VLAN_TAG_LENGTH, p, ETH_ADDRLEN * 2 );
+  remove_front_buffer( frame, VLAN_TAG_LENGTH );
+  reparse( frame );
+}
+
+
+static void
+set_vlan_vid( buffer *frame, uint16_t vid ) {
+  if ( packet_type_eth_vtag( frame ) ) {
+    uint16_t tci = get_vlan_tci( frame );
+    set_vlan_tci( frame, ( uint16_t ) ( ( tci & ~VLAN_VID_MASK ) | ( vid & VLAN_VID_MASK ) ) );
+  }
+  else {
+    push_vlan( frame, ( uint16_t ) ( vid & VLAN_VID_MASK ) );
+  }
+}
+
+
+static void
+set_vlan_pcp( buffer *frame, uint8_t pcp ) {
+  uint16_t bits = ( uint16_t ) ( ( pcp & VLAN_PCP_MASK ) << VLAN_PCP_SHIFT );
+  if ( packet_type_eth_vtag( frame ) ) {
+    uint16_t tci = get_vlan_tci( frame );
+    set_vlan_tci( frame, ( uint16_t ) ( ( tci & ~( VLAN_PCP_MASK << VLAN_PCP_SHIFT ) ) | bits ) );
+  }
+  else {
+    push_vlan( frame, bits );
+  }
+}
+
+
+/*
+ * Updates a one's complement checksum for a change of an even number
+ * of bytes ( RFC 1624 ).
+ */
+static void
+adjust_checksum( void *checksum, const void *old_data, const void *new_data, size_t length ) {
+  uint16_t value;
+  memcpy( &value, checksum, sizeof( value ) );
+  uint32_t sum = ( uint16_t ) ~value;
+  for ( size_t i = 0; i < length; i += 2 ) {
+    uint16_t old_word, new_word;
+    memcpy( &old_word, ( const char * ) old_data + i, sizeof( old_word ) );
+    memcpy( &new_word, ( const char * ) new_data + i, sizeof( new_word ) );
+    sum += ( uint16_t ) ~old_word;
+    sum += new_word;
+  }
+  while ( ( sum >> 16 ) != 0 ) {
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+  }
+  value = ( uint16_t ) ~sum;
+  memcpy( checksum, &value, sizeof( value ) );
+}
+
+
+static ipv4_header_t *
+ipv4_header_of( const buffer *frame ) {
+  if ( !packet_type_ipv4( frame ) ) {
+    return NULL;
+  }
+
+  return ( ( packet_info * ) frame->user_data )->l3_header;
+}
+
+
+// Returns the TCP or UDP header unless the frame is a later fragment.
+static void *
+l4_header_of( const buffer *frame, ipv4_header_t *ipv4 ) {
+  packet_info *info = frame->user_data;
+  if ( ( ntohs( ipv4->frag_off ) & IP_OFFMASK ) != 0 || info->l4_header == NULL ) {
+    return NULL;
+  }
+  if ( !packet_type_ipv4_tcp( frame ) && !packet_type_ipv4_udp( frame ) ) {
+    return NULL;
+  }
+
+  return info->l4_header;
+}
+
+
+static void
+adjust_l4_checksum( const buffer *frame, void *l4_header, const void *old_data, const void *new_data, size_t length ) {
+  if ( packet_type_ipv4_tcp( frame ) ) {
+    adjust_checksum( &( ( tcp_header_t * ) l4_header )->csum, old_data, new_data, length );
+    return;
+  }
+
+  udp_header_t *udp = l4_header;
+  if ( udp->csum == 0 ) {
+    return; // no checksum
+  }
+  adjust_checksum( &udp->csum, old_data, new_data, length );
+  if ( udp->csum == 0 ) {
+    udp->csum = 0xffff;
+  }
+}
+
+
+static void
+set_nw_addr( buffer *frame, bool source, uint32_t nw_addr ) {
+  ipv4_header_t *ipv4 = ipv4_header_of( frame );
+  if ( ipv4 == NULL ) {
+    return;
+  }
+
+  uint32_t *addr = source ? &ipv4->saddr : &ipv4->daddr;
+  uint32_t new_addr = htonl( nw_addr );
+  adjust_checksum( &ipv4->csum, addr, &new_addr, sizeof( new_addr ) );
+  void *l4_header = l4_header_of( frame, ipv4 );
+  if ( l4_header != NULL ) {
+    // The address is a part of the pseudo header.
+    adjust_l4_checksum( frame, l4_header, addr, &new_addr, sizeof( new_addr ) );
+  }
+  memcpy( addr, &new_addr, sizeof( new_addr ) );
+}
+
+
+static void
+set_nw_tos( buffer *frame, uint8_t nw_tos ) {
+  ipv4_header_t *ipv4 = ipv4_header_of( frame );
+  if ( ipv4 == NULL ) {
+    return;
+  }
+
+  uint8_t old_word[ 2 ];
+  memcpy( old_word, ipv4, sizeof( old_word ) );
+  ipv4->tos = ( uint8_t ) ( ( ipv4->tos & ~NW_TOS_MASK ) | ( nw_tos & NW_TOS_MASK ) );
+  adjust_checksum( &ipv4->csum, old_word, ipv4, sizeof( old_word ) );
+}
+
+
+static void
+set_tp_port( buffer *frame, bool source, uint16_t tp_port ) {
+  ipv4_header_t *ipv4 = ipv4_header_of( frame );
+  if ( ipv4 == NULL ) {
+    return;
+  }
+  void *l4_header = l4_header_of( frame, ipv4 );
+  if ( l4_header == NULL ) {
+    return;
+  }
+
+  // Source and destination ports come first in both TCP and UDP headers.
+  uint16_t *port = ( uint16_t * ) l4_header + ( source ? 0 : 1 );
+  uint16_t new_port = htons( tp_port );
+  adjust_l4_checksum( frame, l4_header, port, &new_port, sizeof( new_port ) );
+  memcpy( port, &new_port, sizeof( new_port ) );
+}
+
+
+/*
+ * Applies OpenFlow 1.0 actions to a parsed frame in order. Actions must
+ * be in host byte order.
+ */
+void
+execute_actions( buffer *frame, const struct ofp_action_header *actions, uint16_t actions_length,
+                 frame_output_handler output, void *user_data ) {
+  assert( frame != NULL );
+  assert( frame->user_data != NULL );
+  assert( output != NULL );
+
+  const char *p = ( const char * ) actions;
+  const char *end = p + actions_length;
+  while ( p < end ) {
+    const struct ofp_action_header *action = ( const struct ofp_action_header * ) p;
+    if ( action->len == 0 ) {
+      break;
+    }
+    p += action->len;
+
+    switch ( action->type ) {
+      case OFPAT_OUTPUT:
+      {
+        const struct ofp_action_output *action_output = ( const struct ofp_action_output * ) action;
+        output( action_output->port, action_output->max_len, frame, user_data );
+      }
+      break;
+
+      case OFPAT_ENQUEUE:
+        output( ( ( const struct ofp_action_enqueue * ) action )->port, 0, frame, user_data );
+        break;
+
+      case OFPAT_SET_VLAN_VID:
+        set_vlan_vid( frame, ( ( const struct ofp_action_vlan_vid * ) action )->vlan_vid );
+        break;
+
+      case OFPAT_SET_VLAN_PCP:
+        set_vlan_pcp( frame, ( ( const struct ofp_action_vlan_pcp * ) action )->vlan_pcp );
+        break;
+
+      case OFPAT_STRIP_VLAN:
+        if ( packet_type_eth_vtag( frame ) ) {
+          strip_vlan( frame );
+        }
+        break;
+
+      case OFPAT_SET_DL_SRC:
+        memcpy( ( char * ) frame->data + ETH_ADDRLEN, ( ( const struct ofp_action_dl_addr * ) action )->dl_addr, ETH_ADDRLEN );
+        break;
+
+      case OFPAT_SET_DL_DST:
+        memcpy( frame->data, ( ( const struct ofp_action_dl_addr * ) action )->dl_addr, ETH_ADDRLEN );
+        break;
+
+      case OFPAT_SET_NW_SRC:
+        set_nw_addr( frame, true, ( ( const struct ofp_action_nw_addr * ) action )->nw_addr );
+        break;
+
+      case OFPAT_SET_NW_DST:
+        set_nw_addr( frame, false, ( ( const struct ofp_action_nw_addr * ) action )->nw_addr );
+        break;
+
+      case OFPAT_SET_NW_TOS:
+        set_nw_tos( frame, ( ( const struct ofp_action_nw_tos * ) action )->nw_tos );
+        break;
+
+      case OFPAT_SET_TP_SRC:
+        set_tp_port( frame, true, ( ( const struct ofp_action_tp_port * ) action )->tp_port );
+        break;
+
+      case OFPAT_SET_TP_DST:
+        set_tp_port( frame, false, ( ( const struct ofp_action_tp_port * ) action )->tp_port );
+        break;
+
+      default:
+        debug( "Unsupported action ( type = %#x ).", action->type );
+        break;
+    }
+  }
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ACTION_H
+#define ACTION_H
+
+
+#include "chibach.h"
+
+
+// Called for each output action with the frame as modified so far.
+typedef void ( *frame_output_handler )( uint16_t port_no, uint16_t max_len, const buffer *frame, void *user_data );
+
+
+void execute_actions( buffer *frame, const struct ofp_action_header *actions, uint16_t actions_length,
+                      frame_output_handler output, void *user_data );
+
+
+#endif // ACTION_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
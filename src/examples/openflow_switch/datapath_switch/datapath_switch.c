@@ -0,0 +1,772 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * A userspace OpenFlow 1.0 switch on chibach. Frames are received from
+ * the network interfaces given on the command line and forwarded by
+ * the flow table. Unmatched frames are buffered and sent to the
+ * controller in packet_ins.
+ */
+
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chibach.h"
+#include "action.h"
+#include "flow_table.h"
+#include "port.h"
+
+
+#define MAX_SWITCH_PORTS 255
+#define PACKET_BUFFERS 256
+#define NO_BUFFER UINT32_MAX
+#define STATS_REPLY_BODY_LENGTH ( UINT16_MAX - offsetof( struct ofp_stats_reply, body ) )
+
+
+typedef struct {
+  buffer *frame;
+  uint16_t in_port;
+  uint32_t buffer_id;
+} packet_buffer;
+
+// Where the frame that actions are applied to came from.
+typedef struct {
+  uint16_t in_port;
+  bool packet_out;
+} output_context;
+
+
+static switch_port *switch_ports[ MAX_SWITCH_PORTS + 1 ];
+static uint16_t n_switch_ports = 0;
+static uint16_t config_flags = OFPC_FRAG_NORMAL;
+static uint16_t miss_send_len = OFP_DEFAULT_MISS_SEND_LEN;
+static packet_buffer packet_buffers[ PACKET_BUFFERS ];
+static uint32_t next_buffer_seq = 0;
+
+
+void
+usage() {
+  printf(
+    "OpenFlow Switch on AF_PACKET sockets.\n"
+    "Usage: %s [OPTION]... INTERFACE...\n"
+    "\n"
+    "  -i, --datapath_id=DATAPATH_ID   set datapath id\n"
+    "  -c, --controller=IP_ADDR        set controller host\n"
+    "  -p, --port=TCP_PORT             set controller TCP port\n"
+    "  -d, --daemonize                 run in the background\n"
+    "  -l, --logging_level=LEVEL       set logging level\n"
+    "  -h, --help                      display this help and exit\n"
+    "\n"
+    "Interfaces become switch ports 1, 2, ... in the given order.\n",
+    get_chibach_name()
+  );
+}
+
+
+static switch_port *
+lookup_switch_port( uint16_t port_no ) {
+  if ( port_no == 0 || port_no > n_switch_ports ) {
+    return NULL;
+  }
+
+  return switch_ports[ port_no ];
+}
+
+
+/*
+ * Keeps a copy of a frame for a later packet_out or flow_mod. The
+ * oldest frame is overwritten when all buffers are in use.
+ */
+static uint32_t
+store_packet_buffer( const buffer *frame, uint16_t in_port ) {
+  uint32_t slot = next_buffer_seq % PACKET_BUFFERS;
+  uint32_t buffer_id = ( next_buffer_seq / PACKET_BUFFERS ) << 8 | slot;
+  next_buffer_seq++;
+  if ( buffer_id == NO_BUFFER ) {
+    buffer_id = slot;
+  }
+
+  packet_buffer *pb = &packet_buffers[ slot ];
+  if ( pb->frame != NULL ) {
+    free_buffer( pb->frame );
+  }
+  pb->frame = duplicate_buffer( frame );
+  // The packet_info is owned by the original frame.
+  pb->frame->user_data = NULL;
+  pb->frame->user_data_free_function = NULL;
+  pb->in_port = in_port;
+  pb->buffer_id = buffer_id;
+
+  return buffer_id;
+}
+
+
+static buffer *
+take_packet_buffer( uint32_t buffer_id, uint16_t *in_port ) {
+  packet_buffer *pb = &packet_buffers[ buffer_id % PACKET_BUFFERS ];
+  if ( pb->frame == NULL || pb->buffer_id != buffer_id ) {
+    return NULL;
+  }
+
+  buffer *frame = pb->frame;
+  *in_port = pb->in_port;
+  pb->frame = NULL;
+
+  return frame;
+}
+
+
+static void
+free_packet_buffers() {
+  for ( int i = 0; i < PACKET_BUFFERS; i++ ) {
+    if ( packet_buffers[ i ].frame != NULL ) {
+      free_buffer( packet_buffers[ i ].frame );
+      packet_buffers[ i ].frame = NULL;
+    }
+  }
+}
+
+
+static void
+send_packet_in( const buffer *frame, uint16_t in_port, uint8_t reason, uint16_t max_len ) {
+  uint32_t buffer_id = store_packet_buffer( frame, in_port );
+
+  size_t length = frame->length < max_len ? frame->length : max_len;
+  buffer *data = NULL;
+  if ( length > 0 ) {
+    data = alloc_buffer_with_length( length );
+    memcpy( append_back_buffer( data, length ), frame->data, length );
+  }
+  buffer *packet_in = create_packet_in( get_transaction_id(), buffer_id, ( uint16_t ) frame->length, in_port, reason, data );
+  switch_send_openflow_message( packet_in );
+  free_buffer( packet_in );
+  if ( data != NULL ) {
+    free_buffer( data );
+  }
+}
+
+
+static void
+send_to_port( switch_port *port, const buffer *frame ) {
+  if ( ( port->config & OFPPC_NO_FWD ) != 0 ) {
+    return;
+  }
+  send_to_switch_port( port, frame );
+}
+
+
+static void
+flood_frame( const buffer *frame, uint16_t in_port, bool all ) {
+  for ( uint16_t port_no = 1; port_no <= n_switch_ports; port_no++ ) {
+    switch_port *port = switch_ports[ port_no ];
+    if ( port_no == in_port || ( !all && ( port->config & OFPPC_NO_FLOOD ) != 0 ) ) {
+      continue;
+    }
+    send_to_port( port, frame );
+  }
+}
+
+
+static void process_frame( buffer *frame, uint16_t in_port );
+
+
+static void
+output_frame( uint16_t port_no, uint16_t max_len, const buffer *frame, void *user_data ) {
+  output_context *context = user_data;
+
+  switch ( port_no ) {
+    case OFPP_IN_PORT:
+    {
+      switch_port *port = lookup_switch_port( context->in_port );
+      if ( port != NULL ) {
+        send_to_port( port, frame );
+      }
+    }
+    break;
+
+    case OFPP_FLOOD:
+      flood_frame( frame, context->in_port, false );
+      break;
+
+    case OFPP_ALL:
+      flood_frame( frame, context->in_port, true );
+      break;
+
+    case OFPP_CONTROLLER:
+      send_packet_in( frame, context->in_port, OFPR_ACTION, max_len );
+      break;
+
+    case OFPP_TABLE:
+      if ( context->packet_out ) {
+        buffer *copy = duplicate_buffer( frame );
+        copy->user_data = NULL;
+        copy->user_data_free_function = NULL;
+        process_frame( copy, context->in_port );
+        free_buffer( copy );
+      }
+      break;
+
+    default:
+    {
+      // A frame is sent back to its ingress port only by OFPP_IN_PORT.
+      switch_port *port = lookup_switch_port( port_no );
+      if ( port != NULL && port_no != context->in_port ) {
+        send_to_port( port, frame );
+      }
+      else {
+        debug( "Discarding a frame to port %#x.", port_no );
+      }
+    }
+    break;
+  }
+}
+
+
+static void
+process_frame( buffer *frame, uint16_t in_port ) {
+  if ( !parse_packet( frame ) ) {
+    return;
+  }
+
+  struct ofp_match match;
+  set_match_from_packet( &match, in_port, 0, frame );
+  flow_entry *entry = lookup_flow_entry( &match );
+  if ( entry == NULL ) {
+    send_packet_in( frame, in_port, OFPR_NO_MATCH, miss_send_len );
+    return;
+  }
+
+  hit_flow_entry( entry, frame->length );
+  output_context context = { in_port, false };
+  execute_actions( frame, entry->actions, entry->actions_length, output_frame, &context );
+}
+
+
+static void
+handle_frame_received( switch_port *port, buffer *frame, void *user_data ) {
+  UNUSED( user_data );
+
+  process_frame( frame, port->port_no );
+}
+
+
+static void
+handle_hello( uint32_t xid, uint8_t version, void *user_data ) {
+  UNUSED( version );
+  UNUSED( user_data );
+
+  switch_send_openflow_message( create_hello( xid ) );
+}
+
+
+static void
+handle_features_request( uint32_t xid, void *user_data ) {
+  UNUSED( user_data );
+
+  uint32_t capabilities = OFPC_FLOW_STATS | OFPC_TABLE_STATS | OFPC_PORT_STATS;
+  uint32_t supported = ( ( 1 << OFPAT_OUTPUT ) |
+                         ( 1 << OFPAT_SET_VLAN_VID ) |
+                         ( 1 << OFPAT_SET_VLAN_PCP ) |
+                         ( 1 << OFPAT_STRIP_VLAN ) |
+                         ( 1 << OFPAT_SET_DL_SRC ) |
+                         ( 1 << OFPAT_SET_DL_DST ) |
+                         ( 1 << OFPAT_SET_NW_SRC ) |
+                         ( 1 << OFPAT_SET_NW_DST ) |
+                         ( 1 << OFPAT_SET_NW_TOS ) |
+                         ( 1 << OFPAT_SET_TP_SRC ) |
+                         ( 1 << OFPAT_SET_TP_DST ) );
+
+  struct ofp_phy_port phy_ports[ MAX_SWITCH_PORTS ];
+  list_element *ports;
+  create_list( &ports );
+  for ( uint16_t port_no = 1; port_no <= n_switch_ports; port_no++ ) {
+    get_switch_port_description( switch_ports[ port_no ], &phy_ports[ port_no - 1 ] );
+    append_to_tail( &ports, &phy_ports[ port_no - 1 ] );
+  }
+
+  buffer *msg = create_features_reply( xid, get_datapath_id(), PACKET_BUFFERS, 1, capabilities, supported, ports );
+  delete_list( ports );
+
+  switch_send_openflow_message( msg );
+  free_buffer( msg );
+}
+
+
+static void
+handle_echo_request( uint32_t xid, const buffer *body, void *user_data ) {
+  UNUSED( user_data );
+
+  buffer *msg = create_echo_reply( xid, body );
+  switch_send_openflow_message( msg );
+  free_buffer( msg );
+}
+
+
+static void
+handle_get_config_request( uint32_t xid, void *user_data ) {
+  UNUSED( user_data );
+
+  buffer *msg = create_get_config_reply( xid, config_flags, miss_send_len );
+  switch_send_openflow_message( msg );
+  free_buffer( msg );
+}
+
+
+static void
+handle_set_config( uint32_t xid, uint16_t flags, uint16_t new_miss_send_len, void *user_data ) {
+  UNUSED( xid );
+  UNUSED( user_data );
+
+  config_flags = flags;
+  miss_send_len = new_miss_send_len;
+}
+
+
+static void
+flatten_actions( const openflow_actions *actions, struct ofp_action_header **flat, uint16_t *length ) {
+  *flat = NULL;
+  *length = 0;
+  if ( actions == NULL ) {
+    return;
+  }
+
+  size_t total = 0;
+  for ( list_element *element = actions->list; element != NULL; element = element->next ) {
+    total += ( ( struct ofp_action_header * ) element->data )->len;
+  }
+  if ( total == 0 ) {
+    return;
+  }
+  char *p = xmalloc( total );
+  *flat = ( struct ofp_action_header * ) p;
+  for ( list_element *element = actions->list; element != NULL; element = element->next ) {
+    struct ofp_action_header *action = element->data;
+    memcpy( p, action, action->len );
+    p += action->len;
+  }
+  *length = ( uint16_t ) total;
+}
+
+
+static void
+handle_packet_out( uint32_t xid, uint32_t buffer_id, uint16_t in_port, const openflow_actions *actions,
+                   const buffer *data, void *user_data ) {
+  UNUSED( user_data );
+
+  buffer *frame;
+  if ( buffer_id != NO_BUFFER ) {
+    uint16_t buffered_in_port;
+    frame = take_packet_buffer( buffer_id, &buffered_in_port );
+    if ( frame == NULL ) {
+      send_error_message( xid, OFPET_BAD_REQUEST, OFPBRC_BUFFER_UNKNOWN );
+      return;
+    }
+  }
+  else {
+    if ( data == NULL || data->length == 0 ) {
+      return;
+    }
+    frame = duplicate_buffer( data );
+    frame->user_data = NULL;
+    frame->user_data_free_function = NULL;
+  }
+
+  if ( parse_packet( frame ) ) {
+    struct ofp_action_header *flat;
+    uint16_t length;
+    flatten_actions( actions, &flat, &length );
+    output_context context = { in_port, true };
+    execute_actions( frame, flat, length, output_frame, &context );
+    if ( flat != NULL ) {
+      xfree( flat );
+    }
+  }
+  free_buffer( frame );
+}
+
+
+static void
+handle_flow_mod( uint32_t xid, struct ofp_match match, uint64_t cookie, uint16_t command,
+                 uint16_t idle_timeout, uint16_t hard_timeout, uint16_t priority,
+                 uint32_t buffer_id, uint16_t out_port, uint16_t flags,
+                 const openflow_actions *actions, void *user_data ) {
+  UNUSED( user_data );
+
+  uint16_t error_code;
+  switch ( command ) {
+    case OFPFC_ADD:
+      if ( !add_flow_entry( &match, priority, cookie, idle_timeout, hard_timeout, flags, actions, &error_code ) ) {
+        send_error_message( xid, OFPET_FLOW_MOD_FAILED, error_code );
+        return;
+      }
+      break;
+
+    case OFPFC_MODIFY:
+    case OFPFC_MODIFY_STRICT:
+      // Behaves like OFPFC_ADD if no flow is modified.
+      if ( !modify_flow_entries( &match, priority, command == OFPFC_MODIFY_STRICT, actions ) &&
+           !add_flow_entry( &match, priority, cookie, idle_timeout, hard_timeout, flags, actions, &error_code ) ) {
+        send_error_message( xid, OFPET_FLOW_MOD_FAILED, error_code );
+        return;
+      }
+      break;
+
+    case OFPFC_DELETE:
+    case OFPFC_DELETE_STRICT:
+      delete_flow_entries( &match, priority, command == OFPFC_DELETE_STRICT, out_port );
+      return;
+
+    default:
+      send_error_message( xid, OFPET_FLOW_MOD_FAILED, OFPFMFC_BAD_COMMAND );
+      return;
+  }
+
+  if ( buffer_id != NO_BUFFER ) {
+    uint16_t in_port;
+    buffer *frame = take_packet_buffer( buffer_id, &in_port );
+    if ( frame == NULL ) {
+      send_error_message( xid, OFPET_BAD_REQUEST, OFPBRC_BUFFER_UNKNOWN );
+      return;
+    }
+    process_frame( frame, in_port );
+    free_buffer( frame );
+  }
+}
+
+
+static void
+handle_port_mod( uint32_t xid, uint16_t port_no, uint8_t hw_addr[ OFP_ETH_ALEN ],
+                 uint32_t config, uint32_t mask, uint32_t advertise, void *user_data ) {
+  UNUSED( advertise );
+  UNUSED( user_data );
+
+  switch_port *port = lookup_switch_port( port_no );
+  if ( port == NULL ) {
+    send_error_message( xid, OFPET_PORT_MOD_FAILED, OFPPMFC_BAD_PORT );
+    return;
+  }
+  if ( memcmp( port->hw_addr, hw_addr, OFP_ETH_ALEN ) != 0 ) {
+    send_error_message( xid, OFPET_PORT_MOD_FAILED, OFPPMFC_BAD_HW_ADDR );
+    return;
+  }
+
+  port->config = ( port->config & ~mask ) | ( config & mask );
+}
+
+
+static void
+send_stats_reply( buffer *msg ) {
+  switch_send_openflow_message( msg );
+  free_buffer( msg );
+}
+
+
+static void
+handle_desc_stats_request( uint32_t xid ) {
+  char mfr_desc[ DESC_STR_LEN ] = "Trema project";
+  char hw_desc[ DESC_STR_LEN ] = "AF_PACKET";
+  char sw_desc[ DESC_STR_LEN ] = "datapath_switch";
+  char serial_num[ SERIAL_NUM_LEN ] = "";
+  char dp_desc[ DESC_STR_LEN ];
+  snprintf( dp_desc, sizeof( dp_desc ), "%#" PRIx64, get_datapath_id() );
+
+  send_stats_reply( create_desc_stats_reply( xid, 0, mfr_desc, hw_desc, sw_desc, serial_num, dp_desc ) );
+}
+
+
+typedef struct {
+  list_element *flow_stats;
+  size_t length;
+} flow_stats_context;
+
+
+static void
+free_flow_stats( list_element *flow_stats ) {
+  for ( list_element *element = flow_stats; element != NULL; element = element->next ) {
+    xfree( element->data );
+  }
+  delete_list( flow_stats );
+}
+
+
+static void
+get_flow_duration( const flow_entry *entry, uint32_t *sec, uint32_t *nsec ) {
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  if ( now.tv_nsec < entry->created_at.tv_nsec ) {
+    now.tv_sec--;
+    now.tv_nsec += 1000000000;
+  }
+  *sec = ( uint32_t ) ( now.tv_sec - entry->created_at.tv_sec );
+  *nsec = ( uint32_t ) ( now.tv_nsec - entry->created_at.tv_nsec );
+}
+
+
+static void
+append_flow_stats( flow_entry *entry, void *user_data ) {
+  flow_stats_context *context = user_data;
+
+  uint16_t length = ( uint16_t ) ( offsetof( struct ofp_flow_stats, actions ) + entry->actions_length );
+  struct ofp_flow_stats *stats = xcalloc( 1, length );
+  stats->length = length;
+  stats->table_id = 0;
+  stats->match = entry->match;
+  get_flow_duration( entry, &stats->duration_sec, &stats->duration_nsec );
+  stats->priority = entry->priority;
+  stats->idle_timeout = entry->idle_timeout;
+  stats->hard_timeout = entry->hard_timeout;
+  stats->cookie = entry->cookie;
+  stats->packet_count = entry->packet_count;
+  stats->byte_count = entry->byte_count;
+  if ( entry->actions_length > 0 ) {
+    memcpy( stats->actions, entry->actions, entry->actions_length );
+  }
+
+  append_to_tail( &context->flow_stats, stats );
+}
+
+
+// Splits flow stats into replies that fit in an OpenFlow message.
+static void
+handle_flow_stats_request( uint32_t xid, const struct ofp_flow_stats_request *request ) {
+  flow_stats_context context;
+  create_list( &context.flow_stats );
+  if ( request->table_id == 0 || request->table_id == 0xff ) {
+    foreach_flow_entry( &request->match, request->out_port, append_flow_stats, &context );
+  }
+
+  list_element *chunk;
+  create_list( &chunk );
+  size_t length = 0;
+  for ( list_element *element = context.flow_stats; element != NULL; element = element->next ) {
+    struct ofp_flow_stats *stats = element->data;
+    if ( length + stats->length > STATS_REPLY_BODY_LENGTH ) {
+      send_stats_reply( create_flow_stats_reply( xid, OFPSF_REPLY_MORE, chunk ) );
+      delete_list( chunk );
+      create_list( &chunk );
+      length = 0;
+    }
+    append_to_tail( &chunk, stats );
+    length += stats->length;
+  }
+  send_stats_reply( create_flow_stats_reply( xid, 0, chunk ) );
+  delete_list( chunk );
+  free_flow_stats( context.flow_stats );
+}
+
+
+static void
+add_aggregate_stats( flow_entry *entry, void *user_data ) {
+  struct ofp_aggregate_stats_reply *stats = user_data;
+
+  stats->packet_count += entry->packet_count;
+  stats->byte_count += entry->byte_count;
+  stats->flow_count++;
+}
+
+
+static void
+handle_aggregate_stats_request( uint32_t xid, const struct ofp_aggregate_stats_request *request ) {
+  struct ofp_aggregate_stats_reply stats;
+  memset( &stats, 0, sizeof( stats ) );
+  if ( request->table_id == 0 || request->table_id == 0xff ) {
+    foreach_flow_entry( &request->match, request->out_port, add_aggregate_stats, &stats );
+  }
+
+  send_stats_reply( create_aggregate_stats_reply( xid, 0, stats.packet_count, stats.byte_count, stats.flow_count ) );
+}
+
+
+static void
+handle_table_stats_request( uint32_t xid ) {
+  struct ofp_table_stats stats;
+  memset( &stats, 0, sizeof( stats ) );
+  stats.table_id = 0;
+  strncpy( stats.name, "classifier", sizeof( stats.name ) - 1 );
+  stats.wildcards = OFPFW_ALL;
+  stats.max_entries = FLOW_TABLE_MAX_ENTRIES;
+  get_flow_table_stats( &stats.active_count, &stats.lookup_count, &stats.matched_count );
+
+  list_element *table_stats;
+  create_list( &table_stats );
+  append_to_tail( &table_stats, &stats );
+  send_stats_reply( create_table_stats_reply( xid, 0, table_stats ) );
+  delete_list( table_stats );
+}
+
+
+static void
+handle_port_stats_request( uint32_t xid, const struct ofp_port_stats_request *request ) {
+  struct ofp_port_stats stats[ MAX_SWITCH_PORTS ];
+  list_element *port_stats;
+  create_list( &port_stats );
+  for ( uint16_t port_no = 1; port_no <= n_switch_ports; port_no++ ) {
+    if ( request->port_no != OFPP_NONE && request->port_no != port_no ) {
+      continue;
+    }
+    get_switch_port_stats( switch_ports[ port_no ], &stats[ port_no - 1 ] );
+    append_to_tail( &port_stats, &stats[ port_no - 1 ] );
+  }
+
+  send_stats_reply( create_port_stats_reply( xid, 0, port_stats ) );
+  delete_list( port_stats );
+}
+
+
+static void
+handle_stats_request( uint32_t xid, uint16_t type, uint16_t flags, const buffer *body, void *user_data ) {
+  UNUSED( flags );
+  UNUSED( user_data );
+
+  switch ( type ) {
+    case OFPST_DESC:
+      handle_desc_stats_request( xid );
+      break;
+
+    case OFPST_FLOW:
+      if ( body == NULL || body->length < sizeof( struct ofp_flow_stats_request ) ) {
+        send_error_message( xid, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN );
+        break;
+      }
+      handle_flow_stats_request( xid, body->data );
+      break;
+
+    case OFPST_AGGREGATE:
+      if ( body == NULL || body->length < sizeof( struct ofp_aggregate_stats_request ) ) {
+        send_error_message( xid, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN );
+        break;
+      }
+      handle_aggregate_stats_request( xid, body->data );
+      break;
+
+    case OFPST_TABLE:
+      handle_table_stats_request( xid );
+      break;
+
+    case OFPST_PORT:
+      if ( body == NULL || body->length < sizeof( struct ofp_port_stats_request ) ) {
+        send_error_message( xid, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN );
+        break;
+      }
+      handle_port_stats_request( xid, body->data );
+      break;
+
+    default:
+      send_error_message( xid, OFPET_BAD_REQUEST, OFPBRC_BAD_STAT );
+      break;
+  }
+}
+
+
+static void
+handle_barrier_request( uint32_t xid, void *user_data ) {
+  UNUSED( user_data );
+
+  // Messages are handled in order, so everything before is done.
+  buffer *msg = create_barrier_reply( xid );
+  switch_send_openflow_message( msg );
+  free_buffer( msg );
+}
+
+
+static void
+handle_flow_entry_removed( const flow_entry *entry, uint8_t reason, void *user_data ) {
+  UNUSED( user_data );
+
+  uint32_t duration_sec, duration_nsec;
+  get_flow_duration( entry, &duration_sec, &duration_nsec );
+  buffer *msg = create_flow_removed( get_transaction_id(), entry->match, entry->cookie, entry->priority, reason,
+                                     duration_sec, duration_nsec,
+                                     entry->idle_timeout, entry->packet_count, entry->byte_count );
+  switch_send_openflow_message( msg );
+  free_buffer( msg );
+}
+
+
+static void
+update_clock( void *user_data ) {
+  UNUSED( user_data );
+
+  update_flow_table_clock();
+}
+
+
+static void
+close_switch_ports() {
+  for ( uint16_t port_no = 1; port_no <= n_switch_ports; port_no++ ) {
+    close_switch_port( switch_ports[ port_no ] );
+    switch_ports[ port_no ] = NULL;
+  }
+  n_switch_ports = 0;
+}
+
+
+int
+main( int argc, char **argv ) {
+  init_chibach( &argc, &argv );
+
+  if ( argc < 2 || argc - 1 > MAX_SWITCH_PORTS ) {
+    usage();
+    exit( EXIT_FAILURE );
+  }
+
+  init_flow_table( handle_flow_entry_removed, NULL );
+  for ( int i = 1; i < argc; i++ ) {
+    uint16_t port_no = ( uint16_t ) i;
+    switch_ports[ port_no ] = open_switch_port( argv[ i ], port_no, handle_frame_received, NULL );
+    if ( switch_ports[ port_no ] == NULL ) {
+      error( "Failed to open %s.", argv[ i ] );
+      close_switch_ports();
+      finalize_flow_table();
+      exit( EXIT_FAILURE );
+    }
+    n_switch_ports = port_no;
+  }
+
+  set_hello_handler( handle_hello, NULL );
+  set_features_request_handler( handle_features_request, NULL );
+  set_echo_request_handler( handle_echo_request, NULL );
+  set_get_config_request_handler( handle_get_config_request, NULL );
+  set_set_config_handler( handle_set_config, NULL );
+  set_packet_out_handler( handle_packet_out, NULL );
+  set_flow_mod_handler( handle_flow_mod, NULL );
+  set_port_mod_handler( handle_port_mod, NULL );
+  set_stats_request_handler( handle_stats_request, NULL );
+  set_barrier_request_handler( handle_barrier_request, NULL );
+  add_periodic_event_callback( 1, update_clock, NULL );
+
+  start_chibach();
+
+  close_switch_ports();
+  free_packet_buffers();
+  finalize_flow_table();
+
+  stop_chibach();
+
+  return 0;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,528 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+#include "flat_hash_table.h"
+#include "flow_table.h"
+
+
+#define MICROFLOW_CACHE_SIZE 8192 // must be a power of two
+
+
+// A recent packet match and the flow entry it hit.
+typedef struct {
+  struct ofp_match key;
+  flow_entry *entry; // NULL if the packets miss the table
+  uint32_t generation;
+} microflow;
+
+
+static flat_hash_table *exact_flows = NULL;  // flows without wildcards
+static match_table *wildcards_flows = NULL;
+static flow_entry *flows = NULL;             // all flows in insertion order
+static flow_entry *last_flow = NULL;
+static uint32_t n_flows = 0;
+static uint64_t lookup_count = 0;
+static uint64_t matched_count = 0;
+static microflow *microflows = NULL;
+static uint32_t generation = 1;
+static uint64_t now = 0;
+static flow_entry_removed_handler flow_removed_callback = NULL;
+static void *flow_removed_user_data = NULL;
+
+
+static uint64_t
+get_clock() {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+
+  return ( uint64_t ) ts.tv_sec;
+}
+
+
+static bool
+compare_exact_flow( const void *x, const void *y ) {
+  const struct ofp_match *match_x = x;
+  const struct ofp_match *match_y = y;
+
+  return compare_match_strict( match_x, match_y );
+}
+
+
+static unsigned int
+hash_exact_flow( const void *key ) {
+  const struct ofp_match *match = key;
+
+  unsigned int hash = hash_mac( match->dl_src ) ^ ( hash_mac( match->dl_dst ) * 31 );
+  hash ^= ( unsigned int ) match->in_port << 16 | match->dl_vlan;
+  hash ^= ( unsigned int ) match->dl_type << 8 | match->dl_vlan_pcp;
+  hash ^= match->nw_src * 0x9e3779b1U;
+  hash ^= match->nw_dst;
+  hash ^= ( unsigned int ) match->nw_proto << 24 | match->nw_tos;
+  hash ^= ( ( unsigned int ) match->tp_src << 16 | match->tp_dst ) * 0x85ebca6bU;
+
+  return hash;
+}
+
+
+// Any change to the flow table makes all cached lookups stale.
+static void
+invalidate_microflows() {
+  if ( ++generation == 0 ) {
+    memset( microflows, 0, sizeof( microflow ) * MICROFLOW_CACHE_SIZE );
+    generation = 1;
+  }
+}
+
+
+static flow_entry *
+lookup_flow_table( const struct ofp_match *match ) {
+  flow_entry *entry = lookup_flat_hash_entry( exact_flows, match );
+  if ( entry != NULL ) {
+    return entry;
+  }
+
+  return lookup_match_table_entry( wildcards_flows, *match );
+}
+
+
+/*
+ * Returns the flow entry that a packet with the given exact match
+ * hits, or NULL on a table miss.
+ */
+flow_entry *
+lookup_flow_entry( const struct ofp_match *match ) {
+  assert( match != NULL );
+
+  lookup_count++;
+  unsigned int index = hash_core( match, sizeof( struct ofp_match ) ) & ( MICROFLOW_CACHE_SIZE - 1 );
+  microflow *cached = &microflows[ index ];
+  flow_entry *entry;
+  if ( cached->generation == generation && memcmp( &cached->key, match, sizeof( struct ofp_match ) ) == 0 ) {
+    entry = cached->entry;
+  }
+  else {
+    entry = lookup_flow_table( match );
+    cached->key = *match;
+    cached->entry = entry;
+    cached->generation = generation;
+  }
+  if ( entry != NULL ) {
+    matched_count++;
+  }
+
+  return entry;
+}
+
+
+void
+hit_flow_entry( flow_entry *entry, size_t length ) {
+  assert( entry != NULL );
+
+  entry->packet_count++;
+  entry->byte_count += length;
+  entry->last_used_at = now;
+}
+
+
+static void expire_flow_entry( void *user_data );
+
+
+static void
+schedule_expiry( flow_entry *entry ) {
+  uint64_t expires_at = UINT64_MAX;
+  if ( entry->hard_timeout > 0 ) {
+    expires_at = ( uint64_t ) entry->created_at.tv_sec + entry->hard_timeout;
+  }
+  if ( entry->idle_timeout > 0 && entry->last_used_at + entry->idle_timeout < expires_at ) {
+    expires_at = entry->last_used_at + entry->idle_timeout;
+  }
+  if ( expires_at == UINT64_MAX ) {
+    return;
+  }
+
+  struct itimerspec interval;
+  memset( &interval, 0, sizeof( interval ) );
+  if ( expires_at > now ) {
+    interval.it_value.tv_sec = ( time_t ) ( expires_at - now );
+  }
+  else {
+    interval.it_value.tv_nsec = 1; // already due
+  }
+  entry->expiry_timer = add_timer_event_callback( &interval, expire_flow_entry, entry );
+}
+
+
+static void
+cancel_expiry( flow_entry *entry ) {
+  if ( entry->expiry_timer != INVALID_TIMER_ID ) {
+    delete_timer_event_by_id( entry->expiry_timer );
+    entry->expiry_timer = INVALID_TIMER_ID;
+  }
+}
+
+
+static void
+copy_actions( flow_entry *entry, const openflow_actions *actions ) {
+  entry->actions_length = 0;
+  entry->actions = NULL;
+  if ( actions == NULL ) {
+    return;
+  }
+
+  size_t length = 0;
+  for ( list_element *element = actions->list; element != NULL; element = element->next ) {
+    length += ( ( struct ofp_action_header * ) element->data )->len;
+  }
+  if ( length == 0 ) {
+    return;
+  }
+  entry->actions = xmalloc( length );
+  char *p = ( char * ) entry->actions;
+  for ( list_element *element = actions->list; element != NULL; element = element->next ) {
+    struct ofp_action_header *action = element->data;
+    memcpy( p, action, action->len );
+    p += action->len;
+  }
+  entry->actions_length = ( uint16_t ) length;
+}
+
+
+static void
+free_flow_entry( flow_entry *entry ) {
+  if ( entry->actions != NULL ) {
+    xfree( entry->actions );
+  }
+  xfree( entry );
+}
+
+
+static void
+remove_flow_entry( flow_entry *entry, uint8_t reason, bool notify ) {
+  if ( entry->match.wildcards == 0 ) {
+    delete_flat_hash_entry( exact_flows, &entry->match );
+  }
+  else {
+    delete_match_table_strict_entry( wildcards_flows, entry->match, entry->priority );
+  }
+  cancel_expiry( entry );
+  if ( entry->prev != NULL ) {
+    entry->prev->next = entry->next;
+  }
+  else {
+    flows = entry->next;
+  }
+  if ( entry->next != NULL ) {
+    entry->next->prev = entry->prev;
+  }
+  else {
+    last_flow = entry->prev;
+  }
+  n_flows--;
+  invalidate_microflows();
+
+  if ( notify && ( entry->flags & OFPFF_SEND_FLOW_REM ) != 0 && flow_removed_callback != NULL ) {
+    flow_removed_callback( entry, reason, flow_removed_user_data );
+  }
+  free_flow_entry( entry );
+}
+
+
+static flow_entry *
+lookup_flow_entry_strict( const struct ofp_match *match, uint16_t priority ) {
+  if ( match->wildcards == 0 ) {
+    return lookup_flat_hash_entry( exact_flows, match );
+  }
+
+  return lookup_match_table_strict_entry( wildcards_flows, *match, priority );
+}
+
+
+static bool
+overlaps_flow_entry( const struct ofp_match *match, uint16_t priority ) {
+  for ( flow_entry *entry = flows; entry != NULL; entry = entry->next ) {
+    if ( entry->priority == priority && compare_match( &entry->match, match ) ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/*
+ * Adds a flow entry, replacing one with the same match and priority.
+ * Sets an OFPET_FLOW_MOD_FAILED code and returns false on failure.
+ */
+bool
+add_flow_entry( const struct ofp_match *match, uint16_t priority, uint64_t cookie,
+                uint16_t idle_timeout, uint16_t hard_timeout, uint16_t flags,
+                const openflow_actions *actions, uint16_t *error_code ) {
+  assert( match != NULL );
+  assert( error_code != NULL );
+
+  struct ofp_match key = *match;
+  key.wildcards &= OFPFW_ALL;
+  memset( key.pad1, 0, sizeof( key.pad1 ) );
+  memset( key.pad2, 0, sizeof( key.pad2 ) );
+
+  if ( ( flags & OFPFF_CHECK_OVERLAP ) != 0 && overlaps_flow_entry( &key, priority ) ) {
+    *error_code = OFPFMFC_OVERLAP;
+    return false;
+  }
+  flow_entry *old = lookup_flow_entry_strict( &key, priority );
+  if ( old != NULL ) {
+    remove_flow_entry( old, OFPRR_DELETE, false );
+  }
+  if ( n_flows >= FLOW_TABLE_MAX_ENTRIES ) {
+    *error_code = OFPFMFC_ALL_TABLES_FULL;
+    return false;
+  }
+
+  flow_entry *entry = xmalloc( sizeof( flow_entry ) );
+  memset( entry, 0, sizeof( flow_entry ) );
+  entry->match = key;
+  entry->priority = priority;
+  entry->cookie = cookie;
+  entry->idle_timeout = idle_timeout;
+  entry->hard_timeout = hard_timeout;
+  entry->flags = flags;
+  clock_gettime( CLOCK_MONOTONIC, &entry->created_at );
+  now = ( uint64_t ) entry->created_at.tv_sec;
+  entry->last_used_at = now;
+  copy_actions( entry, actions );
+  entry->expiry_timer = INVALID_TIMER_ID;
+
+  if ( key.wildcards == 0 ) {
+    insert_flat_hash_entry( exact_flows, &entry->match, entry );
+  }
+  else {
+    insert_match_table_entry( wildcards_flows, entry->match, priority, entry );
+  }
+  entry->prev = last_flow;
+  if ( last_flow != NULL ) {
+    last_flow->next = entry;
+  }
+  else {
+    flows = entry;
+  }
+  last_flow = entry;
+  n_flows++;
+  invalidate_microflows();
+  schedule_expiry( entry );
+
+  return true;
+}
+
+
+// Whether an entry falls under a flow_mod or stats request match.
+static bool
+covered_by( const struct ofp_match *filter, const struct ofp_match *match ) {
+  uint32_t w_filter = filter->wildcards & OFPFW_ALL;
+  uint32_t w_match = match->wildcards & OFPFW_ALL;
+  uint32_t sm_filter = create_nw_src_mask( w_filter );
+  uint32_t dm_filter = create_nw_dst_mask( w_filter );
+  uint32_t sm_match = create_nw_src_mask( w_match );
+  uint32_t dm_match = create_nw_dst_mask( w_match );
+
+  w_filter &= ( uint32_t ) ~( OFPFW_NW_SRC_MASK | OFPFW_NW_DST_MASK );
+  w_match &= ( uint32_t ) ~( OFPFW_NW_SRC_MASK | OFPFW_NW_DST_MASK );
+  if ( ( ~w_filter & w_match ) != 0 || ( sm_filter & ~sm_match ) != 0 || ( dm_filter & ~dm_match ) != 0 ) {
+    return false;
+  }
+
+  return ( ( w_filter & OFPFW_IN_PORT || filter->in_port == match->in_port )
+           && ( w_filter & OFPFW_DL_VLAN || filter->dl_vlan == match->dl_vlan )
+           && ( w_filter & OFPFW_DL_VLAN_PCP || filter->dl_vlan_pcp == match->dl_vlan_pcp )
+           && ( w_filter & OFPFW_DL_SRC || COMPARE_MAC( filter->dl_src, match->dl_src ) )
+           && ( w_filter & OFPFW_DL_DST || COMPARE_MAC( filter->dl_dst, match->dl_dst ) )
+           && ( w_filter & OFPFW_DL_TYPE || filter->dl_type == match->dl_type )
+           && !( ( filter->nw_src ^ match->nw_src ) & sm_filter )
+           && !( ( filter->nw_dst ^ match->nw_dst ) & dm_filter )
+           && ( w_filter & OFPFW_NW_TOS || filter->nw_tos == match->nw_tos )
+           && ( w_filter & OFPFW_NW_PROTO || filter->nw_proto == match->nw_proto )
+           && ( w_filter & OFPFW_TP_SRC || filter->tp_src == match->tp_src )
+           && ( w_filter & OFPFW_TP_DST || filter->tp_dst == match->tp_dst ) );
+}
+
+
+static bool
+outputs_to( const flow_entry *entry, uint16_t out_port ) {
+  if ( out_port == OFPP_NONE ) {
+    return true;
+  }
+
+  const char *p = ( const char * ) entry->actions;
+  const char *end = p + entry->actions_length;
+  while ( p < end ) {
+    const struct ofp_action_header *action = ( const struct ofp_action_header * ) p;
+    if ( action->type == OFPAT_OUTPUT && ( ( const struct ofp_action_output * ) action )->port == out_port ) {
+      return true;
+    }
+    p += action->len;
+  }
+
+  return false;
+}
+
+
+static bool
+selected( const flow_entry *entry, const struct ofp_match *match, uint16_t priority, bool strict, uint16_t out_port ) {
+  if ( strict ) {
+    if ( entry->priority != priority || !compare_match_strict( &entry->match, match ) ) {
+      return false;
+    }
+  }
+  else if ( !covered_by( match, &entry->match ) ) {
+    return false;
+  }
+
+  return outputs_to( entry, out_port );
+}
+
+
+/*
+ * Replaces the actions of the selected entries, keeping their counters.
+ * Returns false if no entry is selected.
+ */
+bool
+modify_flow_entries( const struct ofp_match *match, uint16_t priority, bool strict, const openflow_actions *actions ) {
+  assert( match != NULL );
+
+  bool modified = false;
+  for ( flow_entry *entry = flows; entry != NULL; entry = entry->next ) {
+    if ( !selected( entry, match, priority, strict, OFPP_NONE ) ) {
+      continue;
+    }
+    if ( entry->actions != NULL ) {
+      xfree( entry->actions );
+    }
+    copy_actions( entry, actions );
+    modified = true;
+  }
+
+  return modified;
+}
+
+
+void
+delete_flow_entries( const struct ofp_match *match, uint16_t priority, bool strict, uint16_t out_port ) {
+  assert( match != NULL );
+
+  flow_entry *next;
+  for ( flow_entry *entry = flows; entry != NULL; entry = next ) {
+    next = entry->next;
+    if ( selected( entry, match, priority, strict, out_port ) ) {
+      remove_flow_entry( entry, OFPRR_DELETE, true );
+    }
+  }
+}
+
+
+void
+foreach_flow_entry( const struct ofp_match *match, uint16_t out_port, void function( flow_entry *entry, void *user_data ), void *user_data ) {
+  assert( match != NULL );
+  assert( function != NULL );
+
+  for ( flow_entry *entry = flows; entry != NULL; entry = entry->next ) {
+    if ( selected( entry, match, 0, false, out_port ) ) {
+      function( entry, user_data );
+    }
+  }
+}
+
+
+static void
+expire_flow_entry( void *user_data ) {
+  flow_entry *entry = user_data;
+  entry->expiry_timer = INVALID_TIMER_ID; // one-shot timers are freed once they fire
+
+  now = get_clock();
+  if ( entry->hard_timeout > 0 && now >= ( uint64_t ) entry->created_at.tv_sec + entry->hard_timeout ) {
+    remove_flow_entry( entry, OFPRR_HARD_TIMEOUT, true );
+  }
+  else if ( entry->idle_timeout > 0 && now >= entry->last_used_at + entry->idle_timeout ) {
+    remove_flow_entry( entry, OFPRR_IDLE_TIMEOUT, true );
+  }
+  else {
+    // Used since it was scheduled.
+    schedule_expiry( entry );
+  }
+}
+
+
+// Called once a second to timestamp the packets that hit flow entries.
+void
+update_flow_table_clock() {
+  now = get_clock();
+}
+
+
+void
+get_flow_table_stats( uint32_t *active_count, uint64_t *lookup, uint64_t *matched ) {
+  *active_count = n_flows;
+  *lookup = lookup_count;
+  *matched = matched_count;
+}
+
+
+void
+init_flow_table( flow_entry_removed_handler callback, void *user_data ) {
+  exact_flows = create_flat_hash( compare_exact_flow, hash_exact_flow, FLAT_HASH_NO_LOCK );
+  wildcards_flows = create_match_table();
+  flows = NULL;
+  last_flow = NULL;
+  n_flows = 0;
+  lookup_count = 0;
+  matched_count = 0;
+  microflows = xmalloc( sizeof( microflow ) * MICROFLOW_CACHE_SIZE );
+  memset( microflows, 0, sizeof( microflow ) * MICROFLOW_CACHE_SIZE );
+  generation = 1;
+  now = get_clock();
+  flow_removed_callback = callback;
+  flow_removed_user_data = user_data;
+}
+
+
+void
+finalize_flow_table() {
+  flow_entry *next;
+  for ( flow_entry *entry = flows; entry != NULL; entry = next ) {
+    next = entry->next;
+    cancel_expiry( entry );
+    free_flow_entry( entry );
+  }
+  flows = NULL;
+  last_flow = NULL;
+  n_flows = 0;
+  delete_flat_hash( exact_flows );
+  exact_flows = NULL;
+  delete_match_table( wildcards_flows );
+  wildcards_flows = NULL;
+  xfree( microflows );
+  microflows = NULL;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
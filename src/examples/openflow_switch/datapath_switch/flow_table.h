@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+
+#include <time.h>
+#include "chibach.h"
+
+
+#define FLOW_TABLE_MAX_ENTRIES 1048576
+
+
+typedef struct flow_entry {
+  struct ofp_match match;
+  uint16_t priority;
+  uint64_t cookie;
+  uint16_t idle_timeout;
+  uint16_t hard_timeout;
+  uint16_t flags;
+  struct timespec created_at;
+  uint64_t last_used_at;             // in seconds of the flow table clock
+  uint64_t packet_count;
+  uint64_t byte_count;
+  uint16_t actions_length;
+  struct ofp_action_header *actions; // in host byte order, back to back
+  timer_id expiry_timer;             // INVALID_TIMER_ID if the entry never expires
+  struct flow_entry *prev;
+  struct flow_entry *next;
+} flow_entry;
+
+typedef void ( *flow_entry_removed_handler )( const flow_entry *entry, uint8_t reason, void *user_data );
+
+
+void init_flow_table( flow_entry_removed_handler callback, void *user_data );
+void finalize_flow_table( void );
+flow_entry *lookup_flow_entry( const struct ofp_match *match );
+void hit_flow_entry( flow_entry *entry, size_t length );
+bool add_flow_entry( const struct ofp_match *match, uint16_t priority, uint64_t cookie,
+                     uint16_t idle_timeout, uint16_t hard_timeout, uint16_t flags,
+                     const openflow_actions *actions, uint16_t *error_code );
+bool modify_flow_entries( const struct ofp_match *match, uint16_t priority, bool strict, const openflow_actions *actions );
+void delete_flow_entries( const struct ofp_match *match, uint16_t priority, bool strict, uint16_t out_port );
+void foreach_flow_entry( const struct ofp_match *match, uint16_t out_port, void function( flow_entry *entry, void *user_data ), void *user_data );
+void update_flow_table_clock( void );
+void get_flow_table_stats( uint32_t *active_count, uint64_t *lookup_count, uint64_t *matched_count );
+
+
+#endif // FLOW_TABLE_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "port.h"
+
+
+#ifdef UNIT_TESTING
+#define static
+#endif // UNIT_TESTING
+
+
+#define RING_BLOCK_SIZE ( 1 << 18 )
+#define RING_BLOCKS 16
+#define RING_FRAME_SIZE 2048
+#define RING_BLOCK_TIMEOUT_MSEC 1
+#define VLAN_TAG_LENGTH 4
+#define SOCKADDR_LL_OFFSET ( ( sizeof( struct tpacket3_hdr ) + TPACKET_ALIGNMENT - 1 ) & ~( ( size_t ) TPACKET_ALIGNMENT - 1 ) )
+
+
+static bool
+set_promiscuous( switch_port *port ) {
+  struct packet_mreq mreq;
+  memset( &mreq, 0, sizeof( mreq ) );
+  mreq.mr_ifindex = port->ifindex;
+  mreq.mr_type = PACKET_MR_PROMISC;
+
+  return setsockopt( port->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof( mreq ) ) == 0;
+}
+
+
+static bool
+setup_ring( switch_port *port ) {
+  int version = TPACKET_V3;
+  if ( setsockopt( port->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof( version ) ) < 0 ) {
+    error( "Failed to use TPACKET_V3 on %s ( errno = %s [%d] ).", port->name, strerror( errno ), errno );
+    return false;
+  }
+
+  struct tpacket_req3 req;
+  memset( &req, 0, sizeof( req ) );
+  req.tp_block_size = RING_BLOCK_SIZE;
+  req.tp_block_nr = RING_BLOCKS;
+  req.tp_frame_size = RING_FRAME_SIZE;
+  req.tp_frame_nr = ( RING_BLOCK_SIZE / RING_FRAME_SIZE ) * RING_BLOCKS;
+  req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT_MSEC;
+  if ( setsockopt( port->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof( req ) ) < 0 ) {
+    error( "Failed to set up a receive ring on %s ( errno = %s [%d] ).", port->name, strerror( errno ), errno );
+    return false;
+  }
+
+  port->ring_size = ( size_t ) RING_BLOCK_SIZE * RING_BLOCKS;
+  port->ring = mmap( NULL, port->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, port->fd, 0 );
+  if ( port->ring == MAP_FAILED ) {
+    port->ring = mmap( NULL, port->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, port->fd, 0 );
+  }
+  if ( port->ring == MAP_FAILED ) {
+    error( "Failed to map a receive ring on %s ( errno = %s [%d] ).", port->name, strerror( errno ), errno );
+    port->ring = NULL;
+    return false;
+  }
+  port->block_size = RING_BLOCK_SIZE;
+  port->n_blocks = RING_BLOCKS;
+  port->current_block = 0;
+
+  return true;
+}
+
+
+static buffer *
+copy_frame( const struct tpacket3_hdr *header ) {
+  const uint8_t *data = ( const uint8_t * ) header + header->tp_mac;
+  size_t length = header->tp_snaplen;
+  buffer *frame = alloc_buffer_with_headroom( VLAN_TAG_LENGTH, length + VLAN_TAG_LENGTH );
+
+  if ( ( header->tp_status & TP_STATUS_VLAN_VALID ) == 0 || length < ETH_ALEN * 2 ) {
+    memcpy( append_back_buffer( frame, length ), data, length );
+    return frame;
+  }
+
+  // The kernel has taken the 802.1Q tag out of the frame.
+  uint8_t *p = append_back_buffer( frame, length + VLAN_TAG_LENGTH );
+  memcpy( p, data, ETH_ALEN * 2 );
+  uint16_t tpid = ( header->tp_status & TP_STATUS_VLAN_TPID_VALID ) != 0 ? header->hv1.tp_vlan_tpid : ETH_P_8021Q;
+  uint16_t tag[ 2 ] = { htons( tpid ), htons( ( uint16_t ) header->hv1.tp_vlan_tci ) };
+  memcpy( p + ETH_ALEN * 2, tag, sizeof( tag ) );
+  memcpy( p + ETH_ALEN * 2 + VLAN_TAG_LENGTH, data + ETH_ALEN * 2, length - ETH_ALEN * 2 );
+
+  return frame;
+}
+
+
+static void
+receive_block( switch_port *port, struct tpacket_block_desc *block ) {
+  const uint8_t *p = ( const uint8_t * ) block + block->hdr.bh1.offset_to_first_pkt;
+  for ( uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++ ) {
+    const struct tpacket3_hdr *header = ( const struct tpacket3_hdr * ) p;
+    const struct sockaddr_ll *sll = ( const struct sockaddr_ll * ) ( p + SOCKADDR_LL_OFFSET );
+    p += header->tp_next_offset;
+
+    if ( sll->sll_pkttype == PACKET_OUTGOING ) {
+      continue;
+    }
+    port->stats.rx_packets++;
+    port->stats.rx_bytes += header->tp_len;
+    if ( ( port->config & OFPPC_NO_RECV ) != 0 ) {
+      continue;
+    }
+    buffer *frame = copy_frame( header );
+    port->received_callback( port, frame, port->received_user_data );
+    free_buffer( frame );
+  }
+}
+
+
+static void
+receive_frames( int fd, void *user_data ) {
+  UNUSED( fd );
+
+  switch_port *port = user_data;
+  // Hands at most one ring of frames to the datapath, so that the other
+  // ports and the secure channel are not starved.
+  for ( unsigned int i = 0; i < port->n_blocks; i++ ) {
+    struct tpacket_block_desc *block = ( struct tpacket_block_desc * ) ( port->ring + ( size_t ) port->current_block * port->block_size );
+    if ( ( __atomic_load_n( &block->hdr.bh1.block_status, __ATOMIC_ACQUIRE ) & TP_STATUS_USER ) == 0 ) {
+      break;
+    }
+    receive_block( port, block );
+    __atomic_store_n( &block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE );
+    port->current_block = ( port->current_block + 1 ) % port->n_blocks;
+  }
+}
+
+
+static bool
+get_hw_addr( switch_port *port ) {
+  struct ifreq ifr;
+  memset( &ifr, 0, sizeof( ifr ) );
+  strncpy( ifr.ifr_name, port->name, IFNAMSIZ - 1 );
+  if ( ioctl( port->fd, SIOCGIFHWADDR, &ifr ) < 0 ) {
+    error( "Failed to get the hardware address of %s ( errno = %s [%d] ).", port->name, strerror( errno ), errno );
+    return false;
+  }
+  memcpy( port->hw_addr, ifr.ifr_hwaddr.sa_data, OFP_ETH_ALEN );
+
+  return true;
+}
+
+
+/*
+ * Opens a network interface as a switch port. Received frames are
+ * read from a TPACKET_V3 ring and passed to the callback.
+ */
+switch_port *
+open_switch_port( const char *name, uint16_t port_no, frame_received_handler callback, void *user_data ) {
+  assert( name != NULL );
+  assert( callback != NULL );
+
+  switch_port *port = xmalloc( sizeof( switch_port ) );
+  memset( port, 0, sizeof( switch_port ) );
+  port->port_no = port_no;
+  strncpy( port->name, name, IFNAMSIZ - 1 );
+  port->stats.port_no = port_no;
+  port->received_callback = callback;
+  port->received_user_data = user_data;
+
+  port->ifindex = ( int ) if_nametoindex( name );
+  if ( port->ifindex == 0 ) {
+    error( "No such interface ( %s ).", name );
+    xfree( port );
+    return NULL;
+  }
+  port->fd = socket( AF_PACKET, SOCK_RAW, htons( ETH_P_ALL ) );
+  if ( port->fd < 0 ) {
+    error( "Failed to create a packet socket ( errno = %s [%d] ).", strerror( errno ), errno );
+    xfree( port );
+    return NULL;
+  }
+
+  if ( !setup_ring( port ) || !get_hw_addr( port ) ) {
+    close_switch_port( port );
+    return NULL;
+  }
+  struct sockaddr_ll sll;
+  memset( &sll, 0, sizeof( sll ) );
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons( ETH_P_ALL );
+  sll.sll_ifindex = port->ifindex;
+  if ( bind( port->fd, ( struct sockaddr * ) &sll, sizeof( sll ) ) < 0 ) {
+    error( "Failed to bind a packet socket to %s ( errno = %s [%d] ).", name, strerror( errno ), errno );
+    close_switch_port( port );
+    return NULL;
+  }
+  if ( !set_promiscuous( port ) ) {
+    warn( "Failed to put %s into promiscuous mode ( errno = %s [%d] ).", name, strerror( errno ), errno );
+  }
+  // Frames are sent straight to the driver, as a hardware switch would.
+  int one = 1;
+  setsockopt( port->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof( one ) );
+
+  set_fd_handler( port->fd, receive_frames, port, NULL, NULL );
+  set_readable( port->fd, true );
+
+  info( "Port %u is attached to %s.", port_no, name );
+
+  return port;
+}
+
+
+void
+close_switch_port( switch_port *port ) {
+  assert( port != NULL );
+
+  if ( port->ring != NULL ) {
+    set_readable( port->fd, false );
+    delete_fd_handler( port->fd );
+    munmap( port->ring, port->ring_size );
+  }
+  close( port->fd );
+  xfree( port );
+}
+
+
+bool
+send_to_switch_port( switch_port *port, const buffer *frame ) {
+  assert( port != NULL );
+  assert( frame != NULL );
+
+  if ( ( port->config & OFPPC_NO_FWD ) != 0 ) {
+    port->stats.tx_dropped++;
+    return false;
+  }
+
+  ssize_t ret = send( port->fd, frame->data, frame->length, MSG_DONTWAIT );
+  if ( ret < 0 ) {
+    if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS ) {
+      port->stats.tx_dropped++;
+    }
+    else {
+      port->stats.tx_errors++;
+    }
+    return false;
+  }
+  port->stats.tx_packets++;
+  port->stats.tx_bytes += frame->length;
+
+  return true;
+}
+
+
+void
+get_switch_port_description( switch_port *port, struct ofp_phy_port *phy_port ) {
+  assert( port != NULL );
+  assert( phy_port != NULL );
+
+  memset( phy_port, 0, sizeof( struct ofp_phy_port ) );
+  phy_port->port_no = port->port_no;
+  memcpy( phy_port->hw_addr, port->hw_addr, OFP_ETH_ALEN );
+  strncpy( phy_port->name, port->name, OFP_MAX_PORT_NAME_LEN - 1 );
+  phy_port->config = port->config;
+
+  struct ifreq ifr;
+  memset( &ifr, 0, sizeof( ifr ) );
+  strncpy( ifr.ifr_name, port->name, IFNAMSIZ - 1 );
+  if ( ioctl( port->fd, SIOCGIFFLAGS, &ifr ) == 0 ) {
+    if ( ( ifr.ifr_flags & IFF_UP ) == 0 ) {
+      phy_port->config |= OFPPC_PORT_DOWN;
+    }
+    if ( ( ifr.ifr_flags & IFF_RUNNING ) == 0 ) {
+      phy_port->state |= OFPPS_LINK_DOWN;
+    }
+  }
+  phy_port->curr = OFPPF_10GB_FD | OFPPF_COPPER;
+  phy_port->supported = phy_port->curr;
+}
+
+
+void
+get_switch_port_stats( switch_port *port, struct ofp_port_stats *stats ) {
+  assert( port != NULL );
+  assert( stats != NULL );
+
+  struct tpacket_stats_v3 ring_stats;
+  socklen_t length = sizeof( ring_stats );
+  if ( getsockopt( port->fd, SOL_PACKET, PACKET_STATISTICS, &ring_stats, &length ) == 0 ) {
+    // Reading the statistics resets them.
+    port->stats.rx_dropped += ring_stats.tp_drops;
+  }
+  *stats = port->stats;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
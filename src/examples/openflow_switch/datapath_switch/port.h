@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef PORT_H
+#define PORT_H
+
+
+#include <net/if.h>
+#include "chibach.h"
+
+
+struct switch_port;
+
+// The frame is freed when the handler returns.
+typedef void ( *frame_received_handler )( struct switch_port *port, buffer *frame, void *user_data );
+
+typedef struct switch_port {
+  uint16_t port_no;
+  char name[ IFNAMSIZ ];
+  int ifindex;
+  uint8_t hw_addr[ OFP_ETH_ALEN ];
+  uint32_t config;              // OFPPC_*
+  int fd;
+  uint8_t *ring;                // TPACKET_V3 receive ring
+  size_t ring_size;
+  unsigned int block_size;
+  unsigned int n_blocks;
+  unsigned int current_block;
+  struct ofp_port_stats stats;  // in host byte order
+  frame_received_handler received_callback;
+  void *received_user_data;
+} switch_port;
+
+
+switch_port *open_switch_port( const char *name, uint16_t port_no, frame_received_handler callback, void *user_data );
+void close_switch_port( switch_port *port );
+bool send_to_switch_port( switch_port *port, const buffer *frame );
+void get_switch_port_description( switch_port *port, struct ofp_phy_port *phy_port );
+void get_switch_port_stats( switch_port *port, struct ofp_port_stats *stats );
+
+
+#endif // PORT_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -16,6 +16,7 @@
  */
 
 
+#include <inttypes.h>
 #include <string.h>
 #include "trema.h"
 #include "utils.h"
@@ -70,7 +71,8 @@ delete_filter_completed( int status, int n_deleted, void *user_data ) {
 
 
 void
-dump_filters( int status, int n_entries, packetin_filter_entry *entries, void *user_data ) {
+dump_filters( int status, int n_entries, packetin_filter_entry *entries, packetin_filter_stats *stats,
+              void *user_data ) {
   handler_data *data = user_data;
   char match_string[ 512 ];
   match_to_string( &data->match, match_string, sizeof( match_string ) );
@@ -84,8 +86,9 @@ dump_filters( int status, int n_entries, packetin_filter_entry *entries, void *u
         data->strict ? "true" : "false" );
   for ( int i = 0; i < n_entries; i++ ) {
     match_to_string( &entries[ i ].match, match_string, sizeof( match_string ) );
-    info( "[#%d] match = [%s], priority = %u, service_name = %s.",
-          i, match_string, entries[ i ].priority, entries[ i ].service_name );
+    info( "[#%d] match = [%s], priority = %u, service_name = %s, n_hits = %" PRIu64 ".",
+          i, match_string, entries[ i ].priority, entries[ i ].service_name,
+          stats != NULL ? stats[ i ].n_hits : 0 );
   }
 
   stop_trema();
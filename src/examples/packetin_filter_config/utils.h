@@ -29,7 +29,8 @@ typedef struct {
 void timeout( void *user_data );
 void add_filter_completed( int status, void *user_data );
 void delete_filter_completed( int status, int n_deleted, void *user_data );
-void dump_filters( int status, int n_entries, packetin_filter_entry *entries, void *user_data );
+void dump_filters( int status, int n_entries, packetin_filter_entry *entries, packetin_filter_stats *stats,
+                   void *user_data );
 
 
 /*
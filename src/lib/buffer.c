@@ -18,6 +18,7 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,14 +28,258 @@
 #include "wrapper.h"
 
 
+typedef struct {
+  void *top;
+  int refcount;
+  bool external;
+} buffer_storage;
+
+
 typedef struct {
   buffer public;
   size_t real_length;
   void *top;
-  pthread_mutex_t *mutex;
+  pthread_mutex_t mutex;
+  buffer_storage *storage;
 } private_buffer;
 
 
+/*
+ * Data areas are preceded by a header that tells which size class of
+ * the pool they belong to. Areas allocated while the pool is disabled,
+ * and the ones larger than the largest class, go back to the heap.
+ */
+typedef struct buffer_data_header {
+  struct buffer_data_header *next; // only used while cached in a pool
+  unsigned int size_class;
+} __attribute__( ( aligned( 16 ) ) ) buffer_data_header;
+
+#define BUFFER_POOL_CLASSES 5
+#define BUFFER_POOL_NO_CLASS BUFFER_POOL_CLASSES
+#define BUFFER_POOL_MAX_PRIVATE_BUFFERS 512
+
+static const size_t size_class_lengths[ BUFFER_POOL_CLASSES ] = { 128, 512, 2048, 8192, 65536 };
+static const unsigned int size_class_limits[ BUFFER_POOL_CLASSES ] = { 512, 256, 128, 32, 8 };
+
+// Each thread keeps its own pool so that no lock is taken. Counters are
+// only written by the owner thread and read by foreach_buffer_pool_stat().
+typedef struct buffer_pool {
+  buffer_data_header *data[ BUFFER_POOL_CLASSES ];
+  unsigned int n_data[ BUFFER_POOL_CLASSES ];
+  private_buffer *buffers; // linked through public.data
+  unsigned int n_buffers;
+  uint64_t n_reused;
+  uint64_t n_allocated;
+  uint64_t n_released;
+  bool registered;
+  struct buffer_pool *next;
+} buffer_pool;
+
+static bool buffer_pool_enabled = false;
+static __thread buffer_pool thread_buffer_pool;
+static buffer_pool *buffer_pools = NULL;
+static uint64_t retired_n_reused = 0;
+static uint64_t retired_n_allocated = 0;
+static uint64_t retired_n_released = 0;
+static pthread_mutex_t buffer_pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t buffer_pool_key;
+static pthread_once_t buffer_pool_key_once = PTHREAD_ONCE_INIT;
+
+
+static pthread_mutex_t *
+mutex_of( const buffer *buf ) {
+  return &( ( private_buffer * ) ( uintptr_t ) buf )->mutex;
+}
+
+
+static void
+count( uint64_t *counter ) {
+  // A relaxed store is enough since only the owner thread writes.
+  __atomic_store_n( counter, *counter + 1, __ATOMIC_RELAXED );
+}
+
+
+static void
+drain_buffer_pool( buffer_pool *pool ) {
+  for ( unsigned int i = 0; i < BUFFER_POOL_CLASSES; i++ ) {
+    while ( pool->data[ i ] != NULL ) {
+      buffer_data_header *header = pool->data[ i ];
+      pool->data[ i ] = header->next;
+      xfree( header );
+    }
+    pool->n_data[ i ] = 0;
+  }
+  while ( pool->buffers != NULL ) {
+    private_buffer *pbuf = pool->buffers;
+    pool->buffers = pbuf->public.data;
+    pthread_mutex_destroy( &pbuf->mutex );
+    xfree( pbuf );
+  }
+  pool->n_buffers = 0;
+}
+
+
+static void
+unregister_buffer_pool( void *value ) {
+  buffer_pool *pool = value;
+
+  drain_buffer_pool( pool );
+
+  pthread_mutex_lock( &buffer_pools_mutex );
+  for ( buffer_pool **p = &buffer_pools; *p != NULL; p = &( *p )->next ) {
+    if ( *p == pool ) {
+      *p = pool->next;
+      break;
+    }
+  }
+  retired_n_reused += pool->n_reused;
+  retired_n_allocated += pool->n_allocated;
+  retired_n_released += pool->n_released;
+  pthread_mutex_unlock( &buffer_pools_mutex );
+
+  pool->registered = false;
+}
+
+
+static void
+create_buffer_pool_key( void ) {
+  // Pools of exiting threads are drained by the key destructor.
+  pthread_key_create( &buffer_pool_key, unregister_buffer_pool );
+}
+
+
+static buffer_pool *
+get_buffer_pool( void ) {
+  buffer_pool *pool = &thread_buffer_pool;
+  if ( !pool->registered ) {
+    pthread_once( &buffer_pool_key_once, create_buffer_pool_key );
+    pthread_setspecific( buffer_pool_key, pool );
+    pthread_mutex_lock( &buffer_pools_mutex );
+    pool->next = buffer_pools;
+    buffer_pools = pool;
+    pthread_mutex_unlock( &buffer_pools_mutex );
+    pool->registered = true;
+  }
+
+  return pool;
+}
+
+
+static unsigned int
+size_class_of( size_t length ) {
+  for ( unsigned int i = 0; i < BUFFER_POOL_CLASSES; i++ ) {
+    if ( length <= size_class_lengths[ i ] ) {
+      return i;
+    }
+  }
+
+  return BUFFER_POOL_NO_CLASS;
+}
+
+
+static void *
+alloc_data( size_t length, size_t *real_length ) {
+  unsigned int size_class = BUFFER_POOL_NO_CLASS;
+  *real_length = length;
+
+  if ( buffer_pool_enabled ) {
+    buffer_pool *pool = get_buffer_pool();
+    size_class = size_class_of( length );
+    if ( size_class != BUFFER_POOL_NO_CLASS ) {
+      *real_length = size_class_lengths[ size_class ];
+      buffer_data_header *header = pool->data[ size_class ];
+      if ( header != NULL ) {
+        pool->data[ size_class ] = header->next;
+        pool->n_data[ size_class ]--;
+        count( &pool->n_reused );
+        return header + 1;
+      }
+    }
+    count( &pool->n_allocated );
+  }
+
+  buffer_data_header *header = xmalloc( sizeof( buffer_data_header ) + *real_length );
+  header->next = NULL;
+  header->size_class = size_class;
+
+  return header + 1;
+}
+
+
+static void
+free_data( void *data ) {
+  buffer_data_header *header = ( buffer_data_header * ) data - 1;
+
+  if ( buffer_pool_enabled ) {
+    buffer_pool *pool = get_buffer_pool();
+    unsigned int size_class = header->size_class;
+    if ( size_class != BUFFER_POOL_NO_CLASS && pool->n_data[ size_class ] < size_class_limits[ size_class ] ) {
+      header->next = pool->data[ size_class ];
+      pool->data[ size_class ] = header;
+      pool->n_data[ size_class ]++;
+      return;
+    }
+    count( &pool->n_released );
+  }
+
+  xfree( header );
+}
+
+
+static void
+free_private_buffer( private_buffer *pbuf ) {
+  if ( buffer_pool_enabled ) {
+    buffer_pool *pool = get_buffer_pool();
+    if ( pool->n_buffers < BUFFER_POOL_MAX_PRIVATE_BUFFERS ) {
+      pbuf->public.data = pool->buffers;
+      pool->buffers = pbuf;
+      pool->n_buffers++;
+      return;
+    }
+    count( &pool->n_released );
+  }
+
+  pthread_mutex_destroy( &pbuf->mutex );
+  xfree( pbuf );
+}
+
+
+void
+init_buffer_pool( void ) {
+  buffer_pool_enabled = true;
+}
+
+
+void
+finalize_buffer_pool( void ) {
+  buffer_pool_enabled = false;
+  if ( thread_buffer_pool.registered ) {
+    drain_buffer_pool( &thread_buffer_pool );
+  }
+}
+
+
+void
+foreach_buffer_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  assert( function != NULL );
+
+  pthread_mutex_lock( &buffer_pools_mutex );
+  uint64_t n_reused = retired_n_reused;
+  uint64_t n_allocated = retired_n_allocated;
+  uint64_t n_released = retired_n_released;
+  for ( buffer_pool *pool = buffer_pools; pool != NULL; pool = pool->next ) {
+    n_reused += __atomic_load_n( &pool->n_reused, __ATOMIC_RELAXED );
+    n_allocated += __atomic_load_n( &pool->n_allocated, __ATOMIC_RELAXED );
+    n_released += __atomic_load_n( &pool->n_released, __ATOMIC_RELAXED );
+  }
+  pthread_mutex_unlock( &buffer_pools_mutex );
+
+  function( "buffer_pool.reused", n_reused, user_data );
+  function( "buffer_pool.allocated", n_allocated, user_data );
+  function( "buffer_pool.released", n_released, user_data );
+}
+
+
 static size_t
 front_length_of( const private_buffer *pbuf ) {
   assert( pbuf != NULL );
@@ -57,10 +302,9 @@ static private_buffer *
 alloc_new_data( private_buffer *pbuf, size_t length ) {
   assert( pbuf != NULL );
 
-  pbuf->public.data = xmalloc( length );
+  pbuf->public.data = alloc_data( length, &pbuf->real_length );
   pbuf->public.length = length;
   pbuf->top = pbuf->public.data;
-  pbuf->real_length = length;
 
   return pbuf;
 }
@@ -68,7 +312,28 @@ alloc_new_data( private_buffer *pbuf, size_t length ) {
 
 static private_buffer *
 alloc_private_buffer() {
-  private_buffer *new_buf = xcalloc( 1, sizeof( private_buffer ) );
+  private_buffer *new_buf = NULL;
+
+  if ( buffer_pool_enabled ) {
+    buffer_pool *pool = get_buffer_pool();
+    if ( pool->buffers != NULL ) {
+      new_buf = pool->buffers;
+      pool->buffers = new_buf->public.data;
+      pool->n_buffers--;
+      count( &pool->n_reused );
+    }
+    else {
+      count( &pool->n_allocated );
+    }
+  }
+  if ( new_buf == NULL ) {
+    // The mutex lives as long as the structure, even while it is pooled.
+    new_buf = xmalloc( sizeof( private_buffer ) );
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
+    pthread_mutex_init( &new_buf->mutex, &attr );
+  }
 
   new_buf->public.data = NULL;
   new_buf->public.length = 0;
@@ -76,28 +341,77 @@ alloc_private_buffer() {
   new_buf->public.user_data_free_function = NULL;
   new_buf->top = NULL;
   new_buf->real_length = 0;
-
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init( &attr );
-  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
-  new_buf->mutex = xmalloc( sizeof( pthread_mutex_t ) );
-  pthread_mutex_init( new_buf->mutex, &attr );
+  new_buf->storage = NULL;
 
   return new_buf;
 }
 
 
+/*
+ * A data area is owned directly by its buffer until it is shared with a
+ * slice or wraps memory owned by someone else. From then on it is
+ * reference counted and released by the last buffer that refers to it.
+ */
+static buffer_storage *
+share_storage( private_buffer *pbuf ) {
+  assert( pbuf != NULL );
+
+  if ( pbuf->storage == NULL ) {
+    pbuf->storage = xmalloc( sizeof( buffer_storage ) );
+    pbuf->storage->top = pbuf->top;
+    pbuf->storage->refcount = 1;
+    pbuf->storage->external = false;
+  }
+  __sync_add_and_fetch( &pbuf->storage->refcount, 1 );
+
+  return pbuf->storage;
+}
+
+
+static bool
+shared( const private_buffer *pbuf ) {
+  assert( pbuf != NULL );
+
+  return ( pbuf->storage != NULL ) && ( pbuf->storage->external || pbuf->storage->refcount > 1 );
+}
+
+
+static void
+release_storage( private_buffer *pbuf ) {
+  assert( pbuf != NULL );
+
+  if ( pbuf->storage == NULL ) {
+    if ( pbuf->top != NULL ) {
+      free_data( pbuf->top );
+    }
+  }
+  else {
+    buffer_storage *storage = pbuf->storage;
+    if ( __sync_sub_and_fetch( &storage->refcount, 1 ) == 0 ) {
+      if ( !storage->external && storage->top != NULL ) {
+        free_data( storage->top );
+      }
+      xfree( storage );
+    }
+    pbuf->storage = NULL;
+  }
+  pbuf->top = NULL;
+}
+
+
 static private_buffer *
 append_front( private_buffer *pbuf, size_t length ) {
   assert( pbuf != NULL );
 
-  size_t new_length = front_length_of( pbuf ) + pbuf->public.length + length;
-  void *new_data = xmalloc( new_length );
-  memcpy( ( char * ) new_data + front_length_of( pbuf ) + length, pbuf->public.data, pbuf->public.length );
-  xfree( pbuf->top );
+  size_t front_length = front_length_of( pbuf );
+  size_t new_length = front_length + pbuf->public.length + length;
+  size_t real_length;
+  void *new_data = alloc_data( new_length, &real_length );
+  memcpy( ( char * ) new_data + front_length + length, pbuf->public.data, pbuf->public.length );
+  release_storage( pbuf );
 
-  pbuf->public.data = ( char * ) new_data + front_length_of( pbuf );
-  pbuf->real_length = new_length;
+  pbuf->public.data = ( char * ) new_data + front_length;
+  pbuf->real_length = real_length;
   pbuf->top = new_data;
 
   return pbuf;
@@ -108,13 +422,15 @@ static private_buffer *
 append_back( private_buffer *pbuf, size_t length ) {
   assert( pbuf != NULL );
 
-  size_t new_length = front_length_of( pbuf ) + pbuf->public.length + length;
-  void *new_data = xmalloc( new_length );
-  memcpy( ( char * ) new_data + front_length_of( pbuf ), pbuf->public.data, pbuf->public.length );
-  xfree( pbuf->top );
+  size_t front_length = front_length_of( pbuf );
+  size_t new_length = front_length + pbuf->public.length + length;
+  size_t real_length;
+  void *new_data = alloc_data( new_length, &real_length );
+  memcpy( ( char * ) new_data + front_length, pbuf->public.data, pbuf->public.length );
+  release_storage( pbuf );
 
-  pbuf->public.data = ( char * ) new_data + front_length_of( pbuf );
-  pbuf->real_length = new_length;
+  pbuf->public.data = ( char * ) new_data + front_length;
+  pbuf->real_length = real_length;
   pbuf->top = new_data;
 
   return pbuf;
@@ -131,19 +447,26 @@ buffer *
 alloc_buffer_with_length( size_t length ) {
   assert( length != 0 );
 
-  private_buffer *new_buf = xcalloc( 1, sizeof( private_buffer ) );
-  new_buf->public.data = xmalloc( length );
-  new_buf->public.length = 0;
-  new_buf->public.user_data = NULL;
-  new_buf->public.user_data_free_function = NULL;
+  private_buffer *new_buf = alloc_private_buffer();
+  new_buf->public.data = alloc_data( length, &new_buf->real_length );
   new_buf->top = new_buf->public.data;
-  new_buf->real_length = length;
 
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init( &attr );
-  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
-  new_buf->mutex = xmalloc( sizeof( pthread_mutex_t ) );
-  pthread_mutex_init( new_buf->mutex, &attr );
+  return ( buffer * ) new_buf;
+}
+
+
+/*
+ * Allocates a buffer whose data starts headroom bytes after the top of
+ * its storage so that append_front_buffer() up to headroom bytes only
+ * moves the data pointer.
+ */
+buffer *
+alloc_buffer_with_headroom( size_t headroom, size_t length ) {
+  assert( headroom + length != 0 );
+
+  private_buffer *new_buf = alloc_private_buffer();
+  new_buf->top = alloc_data( headroom + length, &new_buf->real_length );
+  new_buf->public.data = ( char * ) new_buf->top + headroom;
 
   return ( buffer * ) new_buf;
 }
@@ -158,15 +481,11 @@ free_buffer( buffer *buf ) {
     assert( buf->user_data == NULL );
     assert( buf->user_data_free_function == NULL );
   }
-  pthread_mutex_lock( ( ( private_buffer * ) buf )->mutex );
+  pthread_mutex_lock( mutex_of( buf ) );
   private_buffer *delete_me = ( private_buffer * ) buf;
-  if ( delete_me->top != NULL ) {
-    xfree( delete_me->top );
-  }
-  pthread_mutex_unlock( delete_me->mutex );
-  pthread_mutex_destroy( delete_me->mutex );
-  xfree( delete_me->mutex );
-  xfree( delete_me );
+  release_storage( delete_me );
+  pthread_mutex_unlock( &delete_me->mutex );
+  free_private_buffer( delete_me );
 }
 
 
@@ -175,18 +494,25 @@ append_front_buffer( buffer *buf, size_t length ) {
   assert( buf != NULL );
   assert( length != 0 );
 
-  pthread_mutex_lock( ( ( private_buffer * ) buf )->mutex );
+  pthread_mutex_lock( mutex_of( buf ) );
 
   private_buffer *pbuf = ( private_buffer * ) buf;
 
   if ( pbuf->top == NULL ) {
     alloc_new_data( pbuf, length );
-    pthread_mutex_unlock( pbuf->mutex );
+    pthread_mutex_unlock( &pbuf->mutex );
     return pbuf->public.data;
   }
 
   buffer *b = &( pbuf->public );
-  if ( already_allocated( pbuf, length ) ) {
+  if ( shared( pbuf ) ) {
+    append_front( pbuf, length );
+  }
+  else if ( front_length_of( pbuf ) >= length ) {
+    b->data = ( char * ) b->data - length;
+    memset( b->data, 0, length );
+  }
+  else if ( already_allocated( pbuf, length ) ) {
     memmove( ( char * ) b->data + length, b->data, b->length );
     memset( b->data, 0, length );
   }
@@ -195,7 +521,7 @@ append_front_buffer( buffer *buf, size_t length ) {
   }
   b->length += length;
 
-  pthread_mutex_unlock( pbuf->mutex );
+  pthread_mutex_unlock( &pbuf->mutex );
 
   return b->data;
 }
@@ -206,7 +532,7 @@ remove_front_buffer( buffer *buf, size_t length ) {
   assert( buf != NULL );
   assert( length != 0 );
 
-  pthread_mutex_lock( ( ( private_buffer * ) buf )->mutex );
+  pthread_mutex_lock( mutex_of( buf ) );
 
   private_buffer *pbuf = ( private_buffer * ) buf;
   assert( pbuf->public.length >= length );
@@ -214,7 +540,7 @@ remove_front_buffer( buffer *buf, size_t length ) {
   pbuf->public.data = ( char * ) pbuf->public.data + length;
   pbuf->public.length -= length;
 
-  pthread_mutex_unlock( pbuf->mutex );
+  pthread_mutex_unlock( &pbuf->mutex );
 
   return pbuf->public.data;
 }
@@ -225,40 +551,108 @@ append_back_buffer( buffer *buf, size_t length ) {
   assert( buf != NULL );
   assert( length != 0 );
 
-  pthread_mutex_lock( ( ( private_buffer * ) buf )->mutex );
+  pthread_mutex_lock( mutex_of( buf ) );
 
   private_buffer *pbuf = ( private_buffer * ) buf;
 
   if ( pbuf->real_length == 0 ) {
     alloc_new_data( pbuf, length );
-    pthread_mutex_unlock( pbuf->mutex );
+    pthread_mutex_unlock( &pbuf->mutex );
     return ( char * ) pbuf->public.data;
   }
 
-  if ( !already_allocated( pbuf, length ) ) {
+  if ( shared( pbuf ) || !already_allocated( pbuf, length ) ) {
     append_back( pbuf, length );
   }
 
   void *appended = ( char * ) pbuf->public.data + pbuf->public.length;
   pbuf->public.length += length;
 
-  pthread_mutex_unlock( pbuf->mutex );
+  pthread_mutex_unlock( &pbuf->mutex );
 
   return appended;
 }
 
 
+buffer *
+alloc_buffer_view( void *data, size_t length ) {
+  assert( data != NULL );
+  assert( length != 0 );
+
+  private_buffer *new_buf = alloc_private_buffer();
+  new_buf->public.data = data;
+  new_buf->public.length = length;
+  new_buf->top = data;
+  new_buf->real_length = length;
+  new_buf->storage = xmalloc( sizeof( buffer_storage ) );
+  new_buf->storage->top = data;
+  new_buf->storage->refcount = 1;
+  new_buf->storage->external = true;
+
+  return ( buffer * ) new_buf;
+}
+
+
+buffer *
+slice_buffer( buffer *buf, size_t offset, size_t length ) {
+  assert( buf != NULL );
+  assert( length != 0 );
+
+  pthread_mutex_lock( mutex_of( buf ) );
+
+  private_buffer *pbuf = ( private_buffer * ) buf;
+  assert( offset + length <= pbuf->public.length );
+
+  private_buffer *new_buf = alloc_private_buffer();
+  new_buf->storage = share_storage( pbuf );
+  new_buf->public.data = ( char * ) pbuf->public.data + offset;
+  new_buf->public.length = length;
+  new_buf->top = new_buf->public.data;
+  new_buf->real_length = length;
+
+  pthread_mutex_unlock( &pbuf->mutex );
+
+  return ( buffer * ) new_buf;
+}
+
+
+size_t
+headroom_of_buffer( const buffer *buf ) {
+  assert( buf != NULL );
+
+  pthread_mutex_lock( mutex_of( buf ) );
+
+  const private_buffer *pbuf = ( const private_buffer * ) buf;
+  size_t headroom = 0;
+  if ( pbuf->top != NULL && !shared( pbuf ) ) {
+    headroom = front_length_of( pbuf );
+  }
+
+  pthread_mutex_unlock( mutex_of( buf ) );
+
+  return headroom;
+}
+
+
+bool
+is_shared_buffer( const buffer *buf ) {
+  assert( buf != NULL );
+
+  return shared( ( const private_buffer * ) buf );
+}
+
+
 buffer *
 duplicate_buffer( const buffer *buf ) {
   assert( buf != NULL );
 
-  pthread_mutex_lock( ( ( const private_buffer * ) buf )->mutex );
+  pthread_mutex_lock( mutex_of( buf ) );
 
   private_buffer *new_buffer = alloc_private_buffer();
   const private_buffer *old_buffer = ( const private_buffer * ) buf;
 
   if ( old_buffer->real_length == 0 ) {
-    pthread_mutex_unlock( old_buffer->mutex );
+    pthread_mutex_unlock( mutex_of( buf ) );
     return ( buffer * ) new_buffer;
   }
 
@@ -270,7 +664,7 @@ duplicate_buffer( const buffer *buf ) {
   new_buffer->public.user_data_free_function = NULL;
   new_buffer->public.data = ( char * ) ( new_buffer->public.data ) + front_length_of( old_buffer );
 
-  pthread_mutex_unlock( old_buffer->mutex );
+  pthread_mutex_unlock( mutex_of( buf ) );
 
   return ( buffer * ) new_buffer;
 }
@@ -280,7 +674,7 @@ void
 dump_buffer( const buffer *buf, void dump_function( const char *format, ... ) ) {
   assert( dump_function != NULL );
 
-  pthread_mutex_lock( ( ( const private_buffer * ) buf )->mutex );
+  pthread_mutex_lock( mutex_of( buf ) );
 
   char *hex = xmalloc( sizeof( char ) * ( buf->length * 2 + 1 ) );
   uint8_t *datap = buf->data;
@@ -292,7 +686,7 @@ dump_buffer( const buffer *buf, void dump_function( const char *format, ... ) )
 
   xfree( hex );
 
-  pthread_mutex_unlock( ( ( const private_buffer * ) buf )->mutex );
+  pthread_mutex_unlock( mutex_of( buf ) );
 }
 
 
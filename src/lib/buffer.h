@@ -23,6 +23,8 @@
 
 
 #include <stddef.h>
+#include <stdint.h>
+#include "bool.h"
 
 
 typedef struct buffer {
@@ -35,12 +37,20 @@ typedef struct buffer {
 
 buffer *alloc_buffer( void );
 buffer *alloc_buffer_with_length( size_t length );
+buffer *alloc_buffer_with_headroom( size_t headroom, size_t length );
 void free_buffer( buffer *buf );
 void *append_front_buffer( buffer *buf, size_t length );
 void *remove_front_buffer( buffer *buf, size_t length );
 void *append_back_buffer( buffer *buf, size_t length );
+buffer *alloc_buffer_view( void *data, size_t length );
+buffer *slice_buffer( buffer *buf, size_t offset, size_t length );
+size_t headroom_of_buffer( const buffer *buf );
+bool is_shared_buffer( const buffer *buf );
 buffer *duplicate_buffer( const buffer *buf );
 void dump_buffer( const buffer *buf, void dump_function( const char *format, ... ) );
+void init_buffer_pool( void );
+void finalize_buffer_pool( void );
+void foreach_buffer_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
 
 
 #endif // BUFFER_H
@@ -336,7 +336,7 @@ init_event_forward_interface( void ) {
   // management reply handler
   add_message_replied_callback( efi_queue_name, handle_efi_reply );
 
-  efi_tx_table = create_hash( compare_uint32, hash_uint32 );
+  efi_tx_table = create_small_hash( compare_uint32, hash_uint32 );
   return true;
 }
 
@@ -18,13 +18,16 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include "checks.h"
 #include "event_handler.h"
 #include "log.h"
 #include "timer.h"
+#include "wrapper.h"
 
 
 #ifdef UNIT_TESTING
@@ -70,6 +73,7 @@ typedef struct {
   event_fd_callback write_callback;
   void *read_data;
   void *write_data;
+  uint32_t events; // used by the epoll backend only
 } event_fd;
 
 
@@ -96,9 +100,24 @@ int fd_set_size = 0;
 
 external_callback_t external_callback = ( external_callback_t ) NULL;
 
+static event_handler_backend requested_backend = EVENT_HANDLER_BACKEND_DEFAULT;
+static event_handler_backend current_backend = EVENT_HANDLER_BACKEND_DEFAULT;
+
+#define EPOLL_INITIAL_EVENTS 256
+#define EPOLL_MAX_EVENTS 65536
+#define EPOLL_INITIAL_FDS 1024
+
+int epoll_fd = -1;
+event_fd **epoll_event_fds = NULL;
+int epoll_event_fds_size = 0;
+int epoll_active_count = 0;
+struct epoll_event *epoll_events = NULL;
+int epoll_events_size = 0;
+int epoll_timer_fd = -1;
+
 
 static void
-_init_event_handler() {
+_init_select_event_handler() {
   event_last = event_list;
   event_handler_state = EVENT_HANDLER_INITIALIZED;
 
@@ -108,11 +127,10 @@ _init_event_handler() {
   FD_ZERO( &event_read_set );
   FD_ZERO( &event_write_set );
 }
-void ( *init_event_handler )() = _init_event_handler;
 
 
 static void
-_finalize_event_handler() {
+_finalize_select_event_handler() {
   if ( event_last != event_list ) {
     warn( "Event Handler finalized with %ti fd event handlers still active. (%i, ...)",
           ( event_last - event_list ), ( event_last > event_list ? event_list->fd : -1 ) );
@@ -121,17 +139,22 @@ _finalize_event_handler() {
 
   event_handler_state = EVENT_HANDLER_FINALIZED;
 }
-void ( *finalize_event_handler )() = _finalize_event_handler;
 
 
-static bool
-_run_event_handler_once( int timeout_usec ) {
+static void
+run_external_callback() {
   if ( external_callback != NULL ) {
     external_callback_t callback = external_callback;
     external_callback = NULL;
 
     callback();
   }
+}
+
+
+static bool
+_run_event_handler_once( int timeout_usec ) {
+  run_external_callback();
 
   memcpy( &current_read_set, &event_read_set, sizeof( fd_set ) );
   memcpy( &current_write_set, &event_write_set, sizeof( fd_set ) );
@@ -367,6 +390,400 @@ _writable( int fd ) {
 bool ( *writable )( int fd ) = _writable;
 
 
+/*
+ * epoll(7) backend. Handlers are kept in a table indexed by fd that
+ * grows on demand, so the number of descriptors is not bounded by
+ * FD_SETSIZE, and only the descriptors reported ready are visited on
+ * each wakeup.
+ *
+ * Descriptors are registered level-triggered: existing callbacks (e.g.
+ * messenger's on_recv()) consume a bounded amount of data per call and
+ * rely on being invoked again while data remains. A descriptor is only
+ * registered to the epoll instance while it has a non-empty interest
+ * set, so that EPOLLHUP/EPOLLERR on an idle descriptor cannot make
+ * epoll_wait() spin.
+ *
+ * The timerfd of the timer module is polled as well. It is armed at the
+ * next timer expiration, so the loop wakes up on time rather than at the
+ * millisecond granularity of the epoll_wait() timeout.
+ */
+
+static event_fd *
+lookup_epoll_event_fd( int fd ) {
+  if ( fd < 0 || fd >= epoll_event_fds_size ) {
+    return NULL;
+  }
+  return epoll_event_fds[ fd ];
+}
+
+
+static void
+expand_epoll_event_fds( int fd ) {
+  int new_size = epoll_event_fds_size > 0 ? epoll_event_fds_size : EPOLL_INITIAL_FDS;
+  while ( new_size <= fd ) {
+    new_size *= 2;
+  }
+
+  event_fd **new_fds = xcalloc( ( size_t ) new_size, sizeof( event_fd * ) );
+  if ( epoll_event_fds != NULL ) {
+    memcpy( new_fds, epoll_event_fds, sizeof( event_fd * ) * ( size_t ) epoll_event_fds_size );
+    xfree( epoll_event_fds );
+  }
+  epoll_event_fds = new_fds;
+  epoll_event_fds_size = new_size;
+}
+
+
+static void
+update_epoll_events( event_fd *event, uint32_t events ) {
+  if ( event->events == events ) {
+    return;
+  }
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof( struct epoll_event ) );
+  ev.events = events;
+  ev.data.fd = event->fd;
+
+  int op;
+  if ( event->events == 0 ) {
+    op = EPOLL_CTL_ADD;
+  }
+  else if ( events == 0 ) {
+    op = EPOLL_CTL_DEL;
+  }
+  else {
+    op = EPOLL_CTL_MOD;
+  }
+
+  if ( epoll_ctl( epoll_fd, op, event->fd, &ev ) < 0 ) {
+    // The descriptor may already be closed; it is then gone from the
+    // epoll set anyway.
+    if ( !( op == EPOLL_CTL_DEL && ( errno == EBADF || errno == ENOENT ) ) ) {
+      error( "Failed to update epoll event ( fd = %d, op = %d, errno = %s [%d] ).",
+             event->fd, op, strerror( errno ), errno );
+      return;
+    }
+  }
+  event->events = events;
+}
+
+
+static void
+register_epoll_timer_fd() {
+  int fd = get_timer_fd();
+  if ( fd == epoll_timer_fd || fd < 0 ) {
+    return;
+  }
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof( struct epoll_event ) );
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &ev ) < 0 && errno != EEXIST ) {
+    error( "Failed to add timerfd to epoll ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
+    return;
+  }
+  epoll_timer_fd = fd;
+}
+
+
+static void
+_init_epoll_event_handler() {
+  if ( epoll_fd >= 0 ) {
+    close( epoll_fd );
+  }
+  if ( epoll_event_fds != NULL ) {
+    for ( int i = 0; i < epoll_event_fds_size; i++ ) {
+      if ( epoll_event_fds[ i ] != NULL ) {
+        xfree( epoll_event_fds[ i ] );
+      }
+    }
+    xfree( epoll_event_fds );
+    epoll_event_fds = NULL;
+    epoll_event_fds_size = 0;
+  }
+  if ( epoll_events != NULL ) {
+    xfree( epoll_events );
+  }
+
+  epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+  if ( epoll_fd < 0 ) {
+    die( "Failed to create epoll instance ( errno = %s [%d] ).", strerror( errno ), errno );
+  }
+
+  expand_epoll_event_fds( 0 );
+  epoll_active_count = 0;
+  epoll_timer_fd = -1;
+  epoll_events_size = EPOLL_INITIAL_EVENTS;
+  epoll_events = xmalloc( sizeof( struct epoll_event ) * ( size_t ) epoll_events_size );
+
+  event_handler_state = EVENT_HANDLER_INITIALIZED;
+}
+
+
+static void
+_finalize_epoll_event_handler() {
+  if ( epoll_active_count > 0 ) {
+    int fd = -1;
+    for ( int i = 0; i < epoll_event_fds_size; i++ ) {
+      if ( epoll_event_fds[ i ] != NULL ) {
+        fd = i;
+        break;
+      }
+    }
+    warn( "Event Handler finalized with %d fd event handlers still active. (%i, ...)", epoll_active_count, fd );
+    return;
+  }
+
+  close( epoll_fd );
+  epoll_fd = -1;
+  epoll_timer_fd = -1;
+  xfree( epoll_event_fds );
+  epoll_event_fds = NULL;
+  epoll_event_fds_size = 0;
+  xfree( epoll_events );
+  epoll_events = NULL;
+  epoll_events_size = 0;
+
+  event_handler_state = EVENT_HANDLER_FINALIZED;
+}
+
+
+static bool
+_run_epoll_event_handler_once( int timeout_usec ) {
+  run_external_callback();
+  register_epoll_timer_fd();
+
+  int timeout_msec = timeout_usec > 0 ? ( timeout_usec + 999 ) / 1000 : 0;
+  int n_events = epoll_wait( epoll_fd, epoll_events, epoll_events_size, timeout_msec );
+
+  if ( n_events == -1 ) {
+    if ( errno == EINTR ) {
+      return true;
+    }
+    error( "Failed to epoll_wait ( errno = %s [%d] ).", strerror( errno ), errno );
+    return false;
+  }
+
+  for ( int i = 0; i < n_events; i++ ) {
+    int fd = epoll_events[ i ].data.fd;
+    uint32_t revents = epoll_events[ i ].events;
+
+    if ( fd == epoll_timer_fd ) {
+      uint64_t expirations;
+      ssize_t ret = read( fd, &expirations, sizeof( expirations ) );
+      UNUSED( ret );
+      continue;
+    }
+
+    // Callbacks may delete or re-register any handler, so look the fd
+    // up again before each dispatch.
+    event_fd *event = lookup_epoll_event_fd( fd );
+    if ( event != NULL && ( event->events & EPOLLOUT ) && ( revents & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) ) ) {
+      event->write_callback( fd, event->write_data );
+    }
+
+    event = lookup_epoll_event_fd( fd );
+    if ( event != NULL && ( event->events & EPOLLIN ) && ( revents & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) ) {
+      event->read_callback( fd, event->read_data );
+    }
+  }
+
+  if ( n_events == epoll_events_size && epoll_events_size < EPOLL_MAX_EVENTS ) {
+    xfree( epoll_events );
+    epoll_events_size *= 2;
+    epoll_events = xmalloc( sizeof( struct epoll_event ) * ( size_t ) epoll_events_size );
+  }
+
+  return true;
+}
+
+
+static void
+_set_epoll_fd_handler( int fd,
+                       event_fd_callback read_callback, void *read_data,
+                       event_fd_callback write_callback, void *write_data ) {
+  debug( "Adding event handler for fd %i, %p, %p.", fd, read_callback, write_callback );
+
+  if ( fd < 0 ) {
+    error( "Tried to add an invalid fd." );
+    return;
+  }
+
+  if ( fd >= epoll_event_fds_size ) {
+    expand_epoll_event_fds( fd );
+  }
+
+  if ( epoll_event_fds[ fd ] != NULL ) {
+    error( "Tried to add an already active fd event handler." );
+    return;
+  }
+
+  event_fd *event = xmalloc( sizeof( event_fd ) );
+  event->fd = fd;
+  event->read_callback = read_callback;
+  event->write_callback = write_callback;
+  event->read_data = read_data;
+  event->write_data = write_data;
+  event->events = 0;
+
+  epoll_event_fds[ fd ] = event;
+  epoll_active_count++;
+}
+
+
+static void
+_delete_epoll_fd_handler( int fd ) {
+  debug( "Deleting event handler for fd %i.", fd );
+
+  event_fd *event = lookup_epoll_event_fd( fd );
+  if ( event == NULL ) {
+    error( "Tried to delete an inactive fd event handler." );
+    return;
+  }
+
+  if ( event->events & EPOLLIN ) {
+    error( "Tried to delete an fd event handler with active read notification." );
+  }
+
+  if ( event->events & EPOLLOUT ) {
+    error( "Tried to delete an fd event handler with active write notification." );
+  }
+
+  update_epoll_events( event, 0 );
+
+  epoll_event_fds[ fd ] = NULL;
+  epoll_active_count--;
+  xfree( event );
+}
+
+
+static void
+_set_epoll_readable( int fd, bool state ) {
+  event_fd *event = lookup_epoll_event_fd( fd );
+  if ( event == NULL || event->read_callback == NULL ) {
+    error( "Found fd in invalid state in set_readable; %i, %p.", fd, event );
+    return;
+  }
+
+  update_epoll_events( event, state ? ( event->events | EPOLLIN ) : ( event->events & ~( uint32_t ) EPOLLIN ) );
+}
+
+
+static void
+_set_epoll_writable( int fd, bool state ) {
+  event_fd *event = lookup_epoll_event_fd( fd );
+  if ( event == NULL || event->write_callback == NULL ) {
+    error( "Found fd in invalid state in notify_writeable_event; %i, %p.", fd, event );
+    return;
+  }
+
+  update_epoll_events( event, state ? ( event->events | EPOLLOUT ) : ( event->events & ~( uint32_t ) EPOLLOUT ) );
+}
+
+
+static bool
+_epoll_readable( int fd ) {
+  event_fd *event = lookup_epoll_event_fd( fd );
+  return event != NULL && ( event->events & EPOLLIN ) != 0;
+}
+
+
+static bool
+_epoll_writable( int fd ) {
+  event_fd *event = lookup_epoll_event_fd( fd );
+  return event != NULL && ( event->events & EPOLLOUT ) != 0;
+}
+
+
+/*
+ * Backend selection.
+ */
+
+static event_handler_backend
+resolve_event_handler_backend() {
+  if ( requested_backend != EVENT_HANDLER_BACKEND_DEFAULT ) {
+    return requested_backend;
+  }
+
+  const char *backend = getenv( "TREMA_EVENT_HANDLER" );
+  if ( backend != NULL ) {
+    if ( strcasecmp( backend, "select" ) == 0 ) {
+      return EVENT_HANDLER_BACKEND_SELECT;
+    }
+    if ( strcasecmp( backend, "epoll" ) != 0 ) {
+      warn( "Unknown event handler backend ( %s ). Using epoll.", backend );
+    }
+  }
+
+  return EVENT_HANDLER_BACKEND_EPOLL;
+}
+
+
+static void
+_init_event_handler() {
+  current_backend = resolve_event_handler_backend();
+
+  if ( current_backend == EVENT_HANDLER_BACKEND_SELECT ) {
+    run_event_handler_once = _run_event_handler_once;
+    set_fd_handler = _set_fd_handler;
+    delete_fd_handler = _delete_fd_handler;
+    set_readable = _set_readable;
+    set_writable = _set_writable;
+    readable = _readable;
+    writable = _writable;
+    _init_select_event_handler();
+  }
+  else {
+    run_event_handler_once = _run_epoll_event_handler_once;
+    set_fd_handler = _set_epoll_fd_handler;
+    delete_fd_handler = _delete_epoll_fd_handler;
+    set_readable = _set_epoll_readable;
+    set_writable = _set_epoll_writable;
+    readable = _epoll_readable;
+    writable = _epoll_writable;
+    _init_epoll_event_handler();
+  }
+}
+void ( *init_event_handler )() = _init_event_handler;
+
+
+static void
+_finalize_event_handler() {
+  if ( current_backend == EVENT_HANDLER_BACKEND_EPOLL ) {
+    _finalize_epoll_event_handler();
+  }
+  else {
+    _finalize_select_event_handler();
+  }
+}
+void ( *finalize_event_handler )() = _finalize_event_handler;
+
+
+bool
+set_event_handler_backend( event_handler_backend backend ) {
+  if ( event_handler_state & EVENT_HANDLER_RUNNING ) {
+    error( "Cannot change event handler backend while running." );
+    return false;
+  }
+  if ( backend != EVENT_HANDLER_BACKEND_DEFAULT && backend != EVENT_HANDLER_BACKEND_SELECT &&
+       backend != EVENT_HANDLER_BACKEND_EPOLL ) {
+    error( "Invalid event handler backend ( %d ).", backend );
+    return false;
+  }
+
+  requested_backend = backend;
+  return true;
+}
+
+
+event_handler_backend
+get_event_handler_backend() {
+  return current_backend;
+}
+
+
 static bool
 _set_external_callback( external_callback_t callback ) {
   if ( external_callback != NULL ) {
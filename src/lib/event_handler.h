@@ -29,6 +29,18 @@
 typedef void ( *event_fd_callback )( int, void *data );
 typedef void ( *external_callback_t )( void );
 
+typedef enum {
+  EVENT_HANDLER_BACKEND_DEFAULT = 0,
+  EVENT_HANDLER_BACKEND_SELECT,
+  EVENT_HANDLER_BACKEND_EPOLL,
+} event_handler_backend;
+
+// Selects the backend used by the next init_event_handler() call. With
+// EVENT_HANDLER_BACKEND_DEFAULT, the TREMA_EVENT_HANDLER environment
+// variable ("epoll" or "select") is consulted and epoll is used if unset.
+bool set_event_handler_backend( event_handler_backend backend );
+event_handler_backend get_event_handler_backend( void );
+
 extern void ( *init_event_handler )();
 extern void ( *finalize_event_handler )();
 
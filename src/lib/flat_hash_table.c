@@ -0,0 +1,486 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include "flat_hash_table.h"
+#include "wrapper.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * Slots are split into groups of GROUP_WIDTH. Each slot has a control
+ * byte that is either EMPTY, DELETED or the low 7 bits of the key's
+ * hash, so that a whole group is matched against a key with a few
+ * instructions before any key is compared. A lookup ends at the first
+ * group that has an EMPTY slot.
+ */
+
+#ifdef __SSE2__
+#define GROUP_WIDTH 16
+#else
+#define GROUP_WIDTH 8
+#endif
+
+#define CTRL_EMPTY ( ( uint8_t ) 0x80 )
+#define CTRL_DELETED ( ( uint8_t ) 0xfe )
+#define IS_FULL( ctrl ) ( ( ( ctrl ) & 0x80 ) == 0 )
+
+#define NOT_FOUND UINT32_MAX
+
+
+static unsigned int
+max_length( unsigned int capacity ) {
+  return capacity - capacity / 8;
+}
+
+
+#ifdef __SSE2__
+
+static unsigned int
+match_group( const uint8_t *group, uint8_t ctrl ) {
+  __m128i g = _mm_loadu_si128( ( const __m128i * ) group );
+  return ( unsigned int ) _mm_movemask_epi8( _mm_cmpeq_epi8( g, _mm_set1_epi8( ( char ) ctrl ) ) );
+}
+
+
+static unsigned int
+match_free( const uint8_t *group ) {
+  return ( unsigned int ) _mm_movemask_epi8( _mm_loadu_si128( ( const __m128i * ) group ) );
+}
+
+#else
+
+static unsigned int
+match_group( const uint8_t *group, uint8_t ctrl ) {
+  unsigned int mask = 0;
+  for ( unsigned int i = 0; i < GROUP_WIDTH; i++ ) {
+    if ( group[ i ] == ctrl ) {
+      mask |= 1U << i;
+    }
+  }
+  return mask;
+}
+
+
+static unsigned int
+match_free( const uint8_t *group ) {
+  unsigned int mask = 0;
+  for ( unsigned int i = 0; i < GROUP_WIDTH; i++ ) {
+    if ( !IS_FULL( group[ i ] ) ) {
+      mask |= 1U << i;
+    }
+  }
+  return mask;
+}
+
+#endif
+
+
+static uint64_t
+mix_hash( const flat_hash_table *table, const void *key ) {
+  return ( uint64_t ) ( *table->hash )( key ) * UINT64_C( 0x9e3779b97f4a7c15 );
+}
+
+
+static uint8_t
+hash_tag( uint64_t hash ) {
+  return ( uint8_t ) ( hash >> 57 );
+}
+
+
+static unsigned int
+first_group( const flat_hash_table *table, uint64_t hash ) {
+  return ( unsigned int ) ( hash >> 32 ) & ( table->capacity / GROUP_WIDTH - 1 );
+}
+
+
+static void
+allocate_slots( flat_hash_table *table, unsigned int capacity ) {
+  table->capacity = capacity;
+  table->growth_left = max_length( capacity );
+  table->control = xmalloc( capacity );
+  memset( table->control, CTRL_EMPTY, capacity );
+  table->slots = xmalloc( sizeof( hash_entry ) * capacity );
+  memset( table->slots, 0, sizeof( hash_entry ) * capacity );
+}
+
+
+static unsigned int
+capacity_for( unsigned int size ) {
+  unsigned int capacity = GROUP_WIDTH;
+  while ( max_length( capacity ) < size ) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+
+/**
+ * Creates a new flat_hash_table that grows as entries are inserted.
+ *
+ * @param compare a function to check two keys for equality. If compare
+ *        is NULL, keys are compared by compare_atom().
+ * @param hash a function to create a hash value from a key. If hash is
+ *        NULL, hash_atom() is used.
+ * @param flags FLAT_HASH_NO_LOCK or 0.
+ * @return a new flat_hash_table.
+ */
+flat_hash_table *
+create_flat_hash( const compare_function compare, const hash_function hash, int flags ) {
+  return create_flat_hash_with_size( compare, hash, 0, flags );
+}
+
+
+/**
+ * Creates a new flat_hash_table that holds size entries without
+ * growing.
+ *
+ * @param compare a function to check two keys for equality. If compare
+ *        is NULL, keys are compared by compare_atom().
+ * @param hash a function to create a hash value from a key. If hash is
+ *        NULL, hash_atom() is used.
+ * @param size the number of entries expected.
+ * @param flags FLAT_HASH_NO_LOCK or 0.
+ * @return a new flat_hash_table.
+ */
+flat_hash_table *
+create_flat_hash_with_size( const compare_function compare, const hash_function hash, unsigned int size, int flags ) {
+  flat_hash_table *table = xmalloc( sizeof( flat_hash_table ) );
+
+  table->compare = compare ? compare : compare_atom;
+  table->hash = hash ? hash : hash_atom;
+  table->length = 0;
+  allocate_slots( table, capacity_for( size ) );
+
+  table->mutex = NULL;
+  if ( ( flags & FLAT_HASH_NO_LOCK ) == 0 ) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
+    table->mutex = xmalloc( sizeof( pthread_mutex_t ) );
+    pthread_mutex_init( table->mutex, &attr );
+  }
+
+  return table;
+}
+
+
+#define MUTEX_LOCK( table )                   \
+  do {                                        \
+    if ( ( table )->mutex != NULL ) {         \
+      pthread_mutex_lock( ( table )->mutex ); \
+    }                                         \
+  } while ( 0 )
+
+#define MUTEX_UNLOCK( table )                   \
+  do {                                          \
+    if ( ( table )->mutex != NULL ) {           \
+      pthread_mutex_unlock( ( table )->mutex ); \
+    }                                           \
+  } while ( 0 )
+
+
+static unsigned int
+find_slot( const flat_hash_table *table, const void *key, uint64_t hash ) {
+  unsigned int groups = table->capacity / GROUP_WIDTH;
+  unsigned int group = first_group( table, hash );
+  uint8_t tag = hash_tag( hash );
+
+  // Triangular probing visits every group once.
+  for ( unsigned int step = 1; step <= groups; step++ ) {
+    const uint8_t *control = table->control + group * GROUP_WIDTH;
+    for ( unsigned int match = match_group( control, tag ); match != 0; match &= match - 1 ) {
+      unsigned int i = group * GROUP_WIDTH + ( unsigned int ) __builtin_ctz( match );
+      if ( ( *table->compare )( key, table->slots[ i ].key ) ) {
+        return i;
+      }
+    }
+    if ( match_group( control, CTRL_EMPTY ) != 0 ) {
+      break;
+    }
+    group = ( group + step ) & ( groups - 1 );
+  }
+
+  return NOT_FOUND;
+}
+
+
+static unsigned int
+find_free_slot( const flat_hash_table *table, uint64_t hash ) {
+  unsigned int groups = table->capacity / GROUP_WIDTH;
+  unsigned int group = first_group( table, hash );
+
+  for ( unsigned int step = 1; step <= groups; step++ ) {
+    unsigned int match = match_free( table->control + group * GROUP_WIDTH );
+    if ( match != 0 ) {
+      return group * GROUP_WIDTH + ( unsigned int ) __builtin_ctz( match );
+    }
+    group = ( group + step ) & ( groups - 1 );
+  }
+
+  assert( 0 );
+  return NOT_FOUND;
+}
+
+
+static void
+set_slot( flat_hash_table *table, unsigned int i, void *key, void *value, uint64_t hash ) {
+  if ( table->control[ i ] == CTRL_EMPTY ) {
+    table->growth_left--;
+  }
+  table->control[ i ] = hash_tag( hash );
+  table->slots[ i ].key = key;
+  table->slots[ i ].value = value;
+}
+
+
+/*
+ * Rebuilds the table, doubling its size unless most of the used slots
+ * are deleted ones.
+ */
+static void
+rehash( flat_hash_table *table ) {
+  unsigned int old_capacity = table->capacity;
+  uint8_t *old_control = table->control;
+  hash_entry *old_slots = table->slots;
+
+  unsigned int capacity = old_capacity;
+  if ( table->length >= max_length( old_capacity ) / 2 ) {
+    capacity <<= 1;
+  }
+  allocate_slots( table, capacity );
+
+  for ( unsigned int i = 0; i < old_capacity; i++ ) {
+    if ( IS_FULL( old_control[ i ] ) ) {
+      uint64_t hash = mix_hash( table, old_slots[ i ].key );
+      set_slot( table, find_free_slot( table, hash ), old_slots[ i ].key, old_slots[ i ].value, hash );
+    }
+  }
+
+  xfree( old_control );
+  xfree( old_slots );
+}
+
+
+/**
+ * Inserts a new key and value into a flat_hash_table. If the key
+ * already exists in the table its current value is replaced with the
+ * new value.
+ *
+ * @param table a flat_hash_table.
+ * @param key a key to insert.
+ * @param value the value to associate with the key.
+ * @return the old value associated with the key.
+ */
+void *
+insert_flat_hash_entry( flat_hash_table *table, void *key, void *value ) {
+  assert( table != NULL );
+  assert( key != NULL );
+
+  MUTEX_LOCK( table );
+
+  void *old_value = NULL;
+  uint64_t hash = mix_hash( table, key );
+  unsigned int i = find_slot( table, key, hash );
+  if ( i != NOT_FOUND ) {
+    old_value = table->slots[ i ].value;
+    table->slots[ i ].key = key;
+    table->slots[ i ].value = value;
+  }
+  else {
+    i = find_free_slot( table, hash );
+    if ( table->control[ i ] == CTRL_EMPTY && table->growth_left == 0 ) {
+      rehash( table );
+      i = find_free_slot( table, hash );
+    }
+    set_slot( table, i, key, value, hash );
+    table->length++;
+  }
+
+  MUTEX_UNLOCK( table );
+
+  return old_value;
+}
+
+
+/**
+ * Looks up a key in a flat_hash_table.
+ *
+ * @param table a flat_hash_table.
+ * @param key the key to look up.
+ * @return the associated value, or NULL if the key is not found.
+ */
+void *
+lookup_flat_hash_entry( flat_hash_table *table, const void *key ) {
+  assert( table != NULL );
+  assert( key != NULL );
+
+  MUTEX_LOCK( table );
+
+  void *value = NULL;
+  unsigned int i = find_slot( table, key, mix_hash( table, key ) );
+  if ( i != NOT_FOUND ) {
+    value = table->slots[ i ].value;
+  }
+
+  MUTEX_UNLOCK( table );
+
+  return value;
+}
+
+
+/**
+ * Deletes a key and its associated value from a flat_hash_table.
+ * Entries do not move, so this may be called while iterating.
+ *
+ * @param table a flat_hash_table.
+ * @param key the key to remove
+ * @return the value deleted from the flat_hash_table.
+ */
+void *
+delete_flat_hash_entry( flat_hash_table *table, const void *key ) {
+  assert( table != NULL );
+  assert( key != NULL );
+
+  MUTEX_LOCK( table );
+
+  void *deleted = NULL;
+  unsigned int i = find_slot( table, key, mix_hash( table, key ) );
+  if ( i != NOT_FOUND ) {
+    deleted = table->slots[ i ].value;
+    table->slots[ i ].key = NULL;
+    table->slots[ i ].value = NULL;
+    // A group that has an empty slot has never been full, so no lookup
+    // went past it and the slot can be reused as empty.
+    if ( match_group( table->control + ( i & ~( GROUP_WIDTH - 1U ) ), CTRL_EMPTY ) != 0 ) {
+      table->control[ i ] = CTRL_EMPTY;
+      table->growth_left++;
+    }
+    else {
+      table->control[ i ] = CTRL_DELETED;
+    }
+    table->length--;
+  }
+
+  MUTEX_UNLOCK( table );
+
+  return deleted;
+}
+
+
+/**
+ * Calls the given function for each of the key/value pairs in the
+ * flat_hash_table. The function may delete the entry it is passed.
+ *
+ * @param table a flat_hash_table.
+ * @param function the function to call for each key/value pair.
+ * @param user_data user data to pass to the function.
+ */
+void
+foreach_flat_hash( flat_hash_table *table, void function( void *key, void *value, void *user_data ), void *user_data ) {
+  assert( table != NULL );
+
+  MUTEX_LOCK( table );
+
+  for ( unsigned int i = 0; i < table->capacity; i++ ) {
+    if ( IS_FULL( table->control[ i ] ) ) {
+      function( table->slots[ i ].key, table->slots[ i ].value, user_data );
+    }
+  }
+
+  MUTEX_UNLOCK( table );
+}
+
+
+/**
+ * Initializes a key/value pair iterator and associates it with
+ * flat_hash_table. Inserting an entry after calling this function
+ * invalidates the iterator; deleting one does not.
+ *
+ * @param table a flat_hash_table.
+ * @param iterator an uninitialized flat_hash_iterator
+ */
+void
+init_flat_hash_iterator( flat_hash_table *table, flat_hash_iterator *iterator ) {
+  assert( table != NULL );
+  assert( iterator != NULL );
+
+  iterator->table = table;
+  iterator->index = 0;
+}
+
+
+/**
+ * Advances iterator and retrieves the hash_entry that is now pointed
+ * to. If NULL is returned, the iterator becomes invalid.
+ *
+ * @param iterator a flat_hash_iterator.
+ * @return a hash_entry.
+ */
+hash_entry *
+iterate_flat_hash_next( flat_hash_iterator *iterator ) {
+  assert( iterator != NULL );
+
+  flat_hash_table *table = iterator->table;
+  while ( iterator->index < table->capacity ) {
+    unsigned int i = iterator->index++;
+    if ( IS_FULL( table->control[ i ] ) ) {
+      return &table->slots[ i ];
+    }
+  }
+
+  return NULL;
+}
+
+
+/**
+ * Deletes a flat_hash_table. Keys and values are not freed.
+ *
+ * @param table a flat_hash_table.
+ */
+void
+delete_flat_hash( flat_hash_table *table ) {
+  assert( table != NULL );
+
+  pthread_mutex_t *mutex = table->mutex;
+  if ( mutex != NULL ) {
+    pthread_mutex_lock( mutex );
+  }
+
+  xfree( table->control );
+  xfree( table->slots );
+  xfree( table );
+
+  if ( mutex != NULL ) {
+    pthread_mutex_unlock( mutex );
+    xfree( mutex );
+  }
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+ * @file
+ *
+ * @brief Open addressing hash table with key/value pairs stored inline.
+ *
+ * It has the same semantics as hash_table but needs no allocation per
+ * entry, and probes a group of slots at once. Tables used only from a
+ * single thread can be created with FLAT_HASH_NO_LOCK.
+ *
+ * @code
+ * table = create_flat_hash( compare_string, hash_string, FLAT_HASH_NO_LOCK );
+ *
+ * insert_flat_hash_entry( table, "alpha", &object_a );
+ * lookup_flat_hash_entry( table, "alpha" ); // => object_a
+ *
+ * delete_flat_hash( table );
+ * @endcode
+ */
+
+
+#ifndef FLAT_HASH_TABLE_H
+#define FLAT_HASH_TABLE_H
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include "hash_table.h"
+
+
+/**
+ * Flags for create_flat_hash().
+ */
+enum {
+  FLAT_HASH_NO_LOCK = 0x1, /**< The table is not protected by a mutex. */
+};
+
+
+/**
+ * The flat_hash_table struct is an opaque data structure to represent
+ * a flat_hash_table. It should only be accessed via the following
+ * functions.
+ */
+typedef struct {
+  compare_function compare;
+  hash_function hash;
+  unsigned int length;
+  unsigned int capacity;
+  unsigned int growth_left;
+  uint8_t *control;
+  hash_entry *slots;
+  pthread_mutex_t *mutex;
+} flat_hash_table;
+
+
+/**
+ * A flat_hash_iterator structure represents an iterator that can be
+ * used to iterate over the elements of a flat_hash_table.
+ */
+typedef struct {
+  flat_hash_table *table;
+  unsigned int index;
+} flat_hash_iterator;
+
+
+flat_hash_table *create_flat_hash( const compare_function compare, const hash_function hash, int flags );
+flat_hash_table *create_flat_hash_with_size( const compare_function compare, const hash_function hash, unsigned int size, int flags );
+void *insert_flat_hash_entry( flat_hash_table *table, void *key, void *value );
+void *lookup_flat_hash_entry( flat_hash_table *table, const void *key );
+void *delete_flat_hash_entry( flat_hash_table *table, const void *key );
+void foreach_flat_hash( flat_hash_table *table, void function( void *key, void *value, void *user_data ), void *user_data );
+void init_flat_hash_iterator( flat_hash_table *table, flat_hash_iterator *iterator );
+hash_entry *iterate_flat_hash_next( flat_hash_iterator *iterator );
+void delete_flat_hash( flat_hash_table *table );
+
+
+#endif // FLAT_HASH_TABLE_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -23,11 +23,34 @@
 #include "wrapper.h"
 
 
-static const unsigned int default_hash_size = 65521;
+static const unsigned int default_hash_size = 64;
+static const unsigned int minimum_hash_size = 4;
+
+// Old buckets moved to the new bucket array per operation while resizing.
+#define REHASH_STEP 4
+// Empty old buckets skipped per operation while resizing.
+#define REHASH_EMPTY_VISITS ( REHASH_STEP * 8 )
+
+
+struct hash_node {
+  hash_entry entry;
+  unsigned int hash_value;
+  struct hash_node *chain;
+  struct hash_node *prev;
+  struct hash_node *next;
+};
+
+typedef struct hash_node hash_node;
 
 
 typedef struct {
   hash_table public;
+  hash_node **buckets;
+  hash_node **old_buckets;
+  unsigned int number_of_old_buckets;
+  unsigned int rehash_index;
+  unsigned int minimum_number_of_buckets;
+  hash_node *entries;
   pthread_mutex_t *mutex;
 } private_hash_table;
 
@@ -61,6 +84,25 @@ hash_atom( const void *key ) {
 }
 
 
+static unsigned int
+round_up_hash_size( unsigned int size ) {
+  unsigned int rounded = minimum_hash_size;
+  while ( rounded < size && rounded < ( 1U << 31 ) ) {
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+
+static hash_node **
+allocate_buckets( unsigned int number_of_buckets ) {
+  hash_node **buckets = xmalloc( sizeof( hash_node * ) * number_of_buckets );
+  memset( buckets, 0, sizeof( hash_node * ) * number_of_buckets );
+
+  return buckets;
+}
+
+
 /**
  * Creates a new hash_table.
  *
@@ -80,7 +122,8 @@ create_hash( const compare_function compare, const hash_function hash ) {
 
 
 /**
- * Creates a new hash_table by specifying its bucket size.
+ * Creates a new hash_table by specifying its initial bucket size. The
+ * table never shrinks below this size.
  *
  * @param compare a function to check two keys for equality. This is
  *        used when looking up keys in the hash_table. If compare is
@@ -89,20 +132,24 @@ create_hash( const compare_function compare, const hash_function hash ) {
  *        values are used to determine where keys are stored within
  *        the hash_table data structure. If hash_func is NULL,
  *        hash_atom() is used.
- * @param size the number of hash buckets.
+ * @param size the number of hash buckets. It is rounded up to a
+ *        power of two.
  * @return a new hash_table.
  */
 hash_table *
 create_hash_with_size( const compare_function compare, const hash_function hash, unsigned int size ) {
   private_hash_table *table = xmalloc( sizeof( private_hash_table ) );
 
-  table->public.number_of_buckets = size;
+  table->public.number_of_buckets = round_up_hash_size( size );
   table->public.compare = compare ? compare : compare_atom;
   table->public.hash = hash ? hash : hash_atom;
   table->public.length = 0;
-  table->public.buckets = xmalloc( sizeof( dlist_element * ) * table->public.number_of_buckets );
-  memset( table->public.buckets, 0, sizeof( dlist_element * ) * table->public.number_of_buckets );
-  table->public.nonempty_bucket_index = create_dlist();
+  table->buckets = allocate_buckets( table->public.number_of_buckets );
+  table->old_buckets = NULL;
+  table->number_of_old_buckets = 0;
+  table->rehash_index = 0;
+  table->minimum_number_of_buckets = table->public.number_of_buckets;
+  table->entries = NULL;
 
   pthread_mutexattr_t attr;
   pthread_mutexattr_init( &attr );
@@ -114,19 +161,104 @@ create_hash_with_size( const compare_function compare, const hash_function hash,
 }
 
 
+/**
+ * Creates a new hash_table that starts with the fewest buckets
+ * possible. Use this for tables that usually hold a handful of
+ * entries, such as those created per switch.
+ *
+ * @param compare a function to check two keys for equality. If
+ *        compare is NULL, keys are compared by compare_atom().
+ * @param hash a function to create a hash value from a key. If hash
+ *        is NULL, hash_atom() is used.
+ * @return a new hash_table.
+ */
+hash_table *
+create_small_hash( const compare_function compare, const hash_function hash ) {
+  return create_hash_with_size( compare, hash, minimum_hash_size );
+}
+
+
 static unsigned int
-get_bucket_index( const hash_table *table, const void *key ) {
-  assert( table != NULL );
-  assert( key != NULL );
+get_bucket_index( unsigned int hash_value, unsigned int number_of_buckets ) {
+  // Spread the bits, as many hash functions only vary in a few of them.
+  hash_value ^= hash_value >> 16;
+  hash_value *= 0x85ebca6bU;
+  hash_value ^= hash_value >> 13;
 
-  return ( *table->hash )( key ) % table->number_of_buckets;
+  return hash_value & ( number_of_buckets - 1 );
 }
 
 
 static void
-new_bucket( hash_table *table, unsigned int bucket_index ) {
-  table->buckets[ bucket_index ] = create_dlist();
-  table->buckets[ bucket_index ]->data = insert_after_dlist( table->nonempty_bucket_index, ( void * ) ( unsigned long ) bucket_index );
+rehash_step( private_hash_table *table ) {
+  if ( table->old_buckets == NULL ) {
+    return;
+  }
+
+  unsigned int moved = 0;
+  unsigned int empty_visits = 0;
+  while ( moved < REHASH_STEP && empty_visits < REHASH_EMPTY_VISITS && table->rehash_index < table->number_of_old_buckets ) {
+    hash_node *node = table->old_buckets[ table->rehash_index ];
+    table->old_buckets[ table->rehash_index ] = NULL;
+    table->rehash_index++;
+    if ( node == NULL ) {
+      empty_visits++;
+      continue;
+    }
+    while ( node != NULL ) {
+      hash_node *next = node->chain;
+      unsigned int i = get_bucket_index( node->hash_value, table->public.number_of_buckets );
+      node->chain = table->buckets[ i ];
+      table->buckets[ i ] = node;
+      node = next;
+    }
+    moved++;
+  }
+
+  if ( table->rehash_index == table->number_of_old_buckets ) {
+    xfree( table->old_buckets );
+    table->old_buckets = NULL;
+    table->number_of_old_buckets = 0;
+    table->rehash_index = 0;
+  }
+}
+
+
+static void
+resize( private_hash_table *table, unsigned int number_of_buckets ) {
+  if ( table->old_buckets != NULL || number_of_buckets == table->public.number_of_buckets ) {
+    return;
+  }
+
+  table->old_buckets = table->buckets;
+  table->number_of_old_buckets = table->public.number_of_buckets;
+  table->rehash_index = 0;
+  table->buckets = allocate_buckets( number_of_buckets );
+  table->public.number_of_buckets = number_of_buckets;
+}
+
+
+static hash_node **
+find_in_buckets( hash_node **buckets, unsigned int number_of_buckets, compare_function compare, const void *key, unsigned int hash_value ) {
+  hash_node **link = &buckets[ get_bucket_index( hash_value, number_of_buckets ) ];
+  for ( ; *link != NULL; link = &( *link )->chain ) {
+    if ( ( *link )->hash_value == hash_value && ( *compare )( key, ( *link )->entry.key ) ) {
+      return link;
+    }
+  }
+
+  return NULL;
+}
+
+
+static hash_node **
+find_node( private_hash_table *table, const void *key, unsigned int hash_value ) {
+  hash_node **link = find_in_buckets( table->buckets, table->public.number_of_buckets, table->public.compare, key, hash_value );
+  if ( link == NULL && table->old_buckets != NULL ) {
+    link = find_in_buckets( table->old_buckets, table->number_of_old_buckets, table->public.compare, key, hash_value );
+  }
+
+  return link;
 }
 
 
@@ -151,35 +283,41 @@ insert_hash_entry( hash_table *table, void *key, void *value ) {
 
   MUTEX_LOCK( table );
 
-  void *old_value = NULL;
-  unsigned int i = get_bucket_index( table, key );
+  private_hash_table *ptable = ( private_hash_table * ) table;
+  rehash_step( ptable );
 
-  if ( table->buckets[ i ] != NULL ) {
-    dlist_element *old_element = NULL;
-    for ( old_element = table->buckets[ i ]->next; old_element; old_element = old_element->next ) {
-      if ( ( *table->compare )( key, ( ( hash_entry * ) old_element->data )->key ) ) {
-        break;
-      }
-    }
-    if ( old_element != NULL ) {
-      old_value = ( ( hash_entry * ) old_element->data )->value;
-      delete_hash_entry( table, key );
-    }
+  unsigned int hash_value = ( *table->hash )( key );
+  hash_node **link = find_node( ptable, key, hash_value );
+  if ( link != NULL ) {
+    void *old_value = ( *link )->entry.value;
+    ( *link )->entry.key = key;
+    ( *link )->entry.value = value;
+    MUTEX_UNLOCK( table );
+    return old_value;
   }
 
-  if ( table->buckets[ i ] == NULL ) {
-    new_bucket( table, i );
+  hash_node *node = xmalloc( sizeof( hash_node ) );
+  node->entry.key = key;
+  node->entry.value = value;
+  node->hash_value = hash_value;
+  unsigned int i = get_bucket_index( hash_value, table->number_of_buckets );
+  node->chain = ptable->buckets[ i ];
+  ptable->buckets[ i ] = node;
+  node->prev = NULL;
+  node->next = ptable->entries;
+  if ( ptable->entries != NULL ) {
+    ptable->entries->prev = node;
   }
-
-  hash_entry *new_entry = xmalloc( sizeof( hash_entry ) );
-  new_entry->key = key;
-  new_entry->value = value;
-  insert_after_dlist( table->buckets[ i ], new_entry );
+  ptable->entries = node;
   table->length++;
 
+  if ( table->length > table->number_of_buckets && table->number_of_buckets < ( 1U << 31 ) ) {
+    resize( ptable, table->number_of_buckets << 1 );
+  }
+
   MUTEX_UNLOCK( table );
 
-  return old_value;
+  return NULL;
 }
 
 
@@ -197,15 +335,13 @@ lookup_hash_entry( hash_table *table, const void *key ) {
 
   MUTEX_LOCK( table );
 
+  private_hash_table *ptable = ( private_hash_table * ) table;
+  rehash_step( ptable );
+
   void *value = NULL;
-  unsigned int i = get_bucket_index( table, key );
-  if ( table->buckets[ i ] != NULL ) {
-    for ( dlist_element *e = table->buckets[ i ]->next; e; e = e->next ) {
-      if ( ( *table->compare )( key, ( ( hash_entry * ) e->data )->key ) ) {
-        value = ( ( hash_entry * ) e->data )->value;
-        break;
-      }
-    }
+  hash_node **link = find_node( ptable, key, ( *table->hash )( key ) );
+  if ( link != NULL ) {
+    value = ( *link )->entry.value;
   }
 
   MUTEX_UNLOCK( table );
@@ -214,18 +350,6 @@ lookup_hash_entry( hash_table *table, const void *key ) {
 }
 
 
-static void
-delete_bucket( hash_table *table, unsigned int bucket_index ) {
-  if ( table->buckets[ bucket_index ]->data != NULL ) {
-    delete_dlist_element( table->buckets[ bucket_index ]->data );
-    table->buckets[ bucket_index ]->data = NULL;
-  }
-
-  delete_dlist( table->buckets[ bucket_index ] );
-  table->buckets[ bucket_index ] = NULL;
-}
-
-
 /**
  * Deletes a key and its associated value from a hash_table.
  *
@@ -240,28 +364,36 @@ delete_hash_entry( hash_table *table, const void *key ) {
 
   MUTEX_LOCK( table );
 
-  unsigned int i = get_bucket_index( table, key );
+  private_hash_table *ptable = ( private_hash_table * ) table;
+  rehash_step( ptable );
 
-  if ( table->buckets[ i ] == NULL ) {
+  hash_node **link = find_node( ptable, key, ( *table->hash )( key ) );
+  if ( link == NULL ) {
     MUTEX_UNLOCK( table );
     return NULL;
   }
 
-  void *deleted = NULL;
-  dlist_element *e = NULL;
-  for ( e = table->buckets[ i ]->next; e; e = e->next ) {
-    if ( ( *table->compare )( key, ( ( hash_entry * ) e->data )->key ) ) {
-      hash_entry *delete_me = e->data;
-      deleted = delete_me->value;
-      delete_dlist_element( e );
-      xfree( delete_me );
-      table->length--;
-      break;
-    }
+  hash_node *delete_me = *link;
+  *link = delete_me->chain;
+  if ( delete_me->prev != NULL ) {
+    delete_me->prev->next = delete_me->next;
   }
-
-  if ( table->buckets[ i ]->next == NULL ) {
-    delete_bucket( table, i );
+  else {
+    ptable->entries = delete_me->next;
+  }
+  if ( delete_me->next != NULL ) {
+    delete_me->next->prev = delete_me->prev;
+  }
+  void *deleted = delete_me->entry.value;
+  xfree( delete_me );
+  table->length--;
+
+  if ( table->number_of_buckets > ptable->minimum_number_of_buckets && table->length * 8 < table->number_of_buckets ) {
+    unsigned int number_of_buckets = round_up_hash_size( table->length * 2 );
+    if ( number_of_buckets < ptable->minimum_number_of_buckets ) {
+      number_of_buckets = ptable->minimum_number_of_buckets;
+    }
+    resize( ptable, number_of_buckets );
   }
 
   MUTEX_UNLOCK( table );
@@ -285,19 +417,10 @@ foreach_hash( hash_table *table, void function( void *key, void *value, void *us
 
   MUTEX_LOCK( table );
 
-  for ( dlist_element *nonempty = table->nonempty_bucket_index->next; nonempty; ) {
-    int i = ( int ) ( unsigned long ) nonempty->data;
-    nonempty = nonempty->next;
-
-    if ( table->buckets[ i ] == NULL ) {
-      continue;
-    }
-
-    for ( dlist_element *e = table->buckets[ i ]->next; e != NULL; ) {
-      hash_entry *h = e->data;
-      e = e->next;
-      function( h->key, h->value, user_data );
-    }
+  for ( hash_node *node = ( ( private_hash_table * ) table )->entries; node != NULL; ) {
+    hash_node *next = node->next;
+    function( node->entry.key, node->entry.value, user_data );
+    node = next;
   }
 
   MUTEX_UNLOCK( table );
@@ -307,7 +430,8 @@ foreach_hash( hash_table *table, void function( void *key, void *value, void *us
 /**
  * Initializes a key/value pair iterator and associates it with
  * hash_table. Modifying the hash table after calling this function
- * invalidates the returned iterator.
+ * invalidates the returned iterator, except for deleting the entry
+ * most recently returned by iterate_hash_next().
  *
  * @param table a hash_table.
  * @param iterator an uninitialized hash_iterator
@@ -317,17 +441,7 @@ init_hash_iterator( hash_table *table, hash_iterator *iterator ) {
   assert( table != NULL );
   assert( iterator != NULL );
 
-  iterator->buckets = table->buckets;
-  if ( table->nonempty_bucket_index->next ) {
-    iterator->bucket_index = table->nonempty_bucket_index->next;
-    iterator->next_bucket_index = iterator->bucket_index->next;
-    assert( iterator->buckets[ ( int ) ( unsigned long ) iterator->bucket_index->data ] != NULL );
-    iterator->element = iterator->buckets[ ( int ) ( unsigned long ) iterator->bucket_index->data ]->next;
-  }
-  else {
-    iterator->bucket_index = NULL;
-    iterator->element = NULL;
-  }
+  iterator->next = ( ( private_hash_table * ) table )->entries;
 }
 
 
@@ -343,29 +457,13 @@ hash_entry *
 iterate_hash_next( hash_iterator *iterator ) {
   assert( iterator != NULL );
 
-  for ( ;; ) {
-    if ( iterator->bucket_index == NULL ) {
-      return NULL;
-    }
-
-    dlist_element *e = iterator->element;
-    if ( e == NULL ) {
-      if ( iterator->next_bucket_index != NULL ) {
-        iterator->bucket_index = iterator->next_bucket_index;
-        iterator->next_bucket_index = iterator->next_bucket_index->next;
-        int bucket_index = ( int ) ( unsigned long ) iterator->bucket_index->data;
-        assert( iterator->buckets[ bucket_index ] != NULL );
-        iterator->element = iterator->buckets[ bucket_index ]->next;
-      }
-      else {
-        return NULL;
-      }
-    }
-    else {
-      iterator->element = e->next;
-      return e->data;
-    }
+  hash_node *node = iterator->next;
+  if ( node == NULL ) {
+    return NULL;
   }
+  iterator->next = node->next;
+
+  return &node->entry;
 }
 
 
@@ -381,24 +479,16 @@ delete_hash( hash_table *table ) {
   pthread_mutex_lock( ( ( private_hash_table * ) table )->mutex );
   pthread_mutex_t *mutex = ( ( private_hash_table * ) table )->mutex;
 
-  for ( dlist_element *nonempty = table->nonempty_bucket_index->next; nonempty; ) {
-    unsigned int i = ( unsigned int ) ( unsigned long ) nonempty->data;
-    nonempty = nonempty->next;
-    if ( table->buckets[ i ] == NULL ) {
-      continue;
-    }
-
-    for ( dlist_element *e = table->buckets[ i ]->next; e != NULL; ) {
-      dlist_element *delete_me = e;
-      e = e->next;
-      xfree( delete_me->data );
-    }
-
-    delete_bucket( table, i );
+  private_hash_table *ptable = ( private_hash_table * ) table;
+  for ( hash_node *node = ptable->entries; node != NULL; ) {
+    hash_node *delete_me = node;
+    node = node->next;
+    xfree( delete_me );
+  }
+  xfree( ptable->buckets );
+  if ( ptable->old_buckets != NULL ) {
+    xfree( ptable->old_buckets );
   }
-  xfree( table->buckets );
-
-  delete_dlist( table->nonempty_bucket_index );
 
   xfree( table );
 
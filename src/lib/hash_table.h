@@ -52,9 +52,10 @@
  * value.
  *
  * The hash values should be evenly distributed over a fairly large
- * range. The modulus is taken with the hash table size (a prime
- * number) to find the 'bucket' to place each key into. The function
- * should also be very fast, since it is called for each key lookup.
+ * range. The value is mixed and masked with the number of buckets (a
+ * power of two) to find the 'bucket' to place each key into. The
+ * function is called once per insertion, lookup and deletion, so it
+ * should also be very fast.
  *
  * @param key a key.
  * @return the hash value corresponding to the key.
@@ -86,14 +87,17 @@ typedef struct {
 /**
  * The hash_table struct is an opaque data structure to represent a
  * hash_table. It should only be accessed via the following functions.
+ *
+ * The number of buckets follows the number of entries. When the
+ * table grows or shrinks, entries are moved to the new buckets a few
+ * at a time by subsequent operations, so that no single operation
+ * pays for rehashing the whole table.
  */
 typedef struct {
   unsigned int number_of_buckets;
   compare_function compare;
   hash_function hash;
   unsigned int length;
-  dlist_element **buckets;
-  dlist_element *nonempty_bucket_index;
 } hash_table;
 
 
@@ -104,15 +108,13 @@ typedef struct {
  * initialized with init_hash_iterator().
  */
 typedef struct {
-  dlist_element **buckets;
-  dlist_element *bucket_index;
-  dlist_element *next_bucket_index;
-  dlist_element *element;
+  struct hash_node *next;
 } hash_iterator;
 
 
 hash_table *create_hash( const compare_function compare, const hash_function hash );
 hash_table *create_hash_with_size( const compare_function compare, const hash_function hash, unsigned int size );
+hash_table *create_small_hash( const compare_function compare, const hash_function hash );
 void *insert_hash_entry( hash_table *table, void *key, void *value );
 void *lookup_hash_entry( hash_table *table, const void *key );
 void *delete_hash_entry( hash_table *table, const void *key );
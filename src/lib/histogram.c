@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+#include "histogram.h"
+#include "wrapper.h"
+
+
+#define SUB_BUCKETS ( 1 << HISTOGRAM_SUB_BUCKET_BITS )
+#define HALF_SUB_BUCKETS ( SUB_BUCKETS / 2 )
+
+
+static unsigned int
+bucket_of( uint64_t value ) {
+  if ( value < SUB_BUCKETS ) {
+    return ( unsigned int ) value;
+  }
+
+  // The most significant HISTOGRAM_SUB_BUCKET_BITS bits select the bucket.
+  unsigned int exponent = 63 - ( unsigned int ) __builtin_clzll( value );
+  unsigned int shift = exponent - ( HISTOGRAM_SUB_BUCKET_BITS - 1 );
+  unsigned int mantissa = ( unsigned int ) ( value >> shift );
+
+  return SUB_BUCKETS + ( exponent - HISTOGRAM_SUB_BUCKET_BITS ) * HALF_SUB_BUCKETS + ( mantissa - HALF_SUB_BUCKETS );
+}
+
+
+static void
+bucket_range( unsigned int bucket, uint64_t *lower, uint64_t *upper ) {
+  if ( bucket < SUB_BUCKETS ) {
+    *lower = *upper = bucket;
+    return;
+  }
+
+  unsigned int offset = bucket - SUB_BUCKETS;
+  unsigned int exponent = HISTOGRAM_SUB_BUCKET_BITS + offset / HALF_SUB_BUCKETS;
+  unsigned int shift = exponent - ( HISTOGRAM_SUB_BUCKET_BITS - 1 );
+  uint64_t mantissa = HALF_SUB_BUCKETS + offset % HALF_SUB_BUCKETS;
+  *lower = mantissa << shift;
+  *upper = ( ( mantissa + 1 ) << shift ) - 1;
+}
+
+
+histogram *
+create_histogram( void ) {
+  histogram *h = xmalloc( sizeof( histogram ) );
+  reset_histogram( h );
+
+  return h;
+}
+
+
+void
+delete_histogram( histogram *h ) {
+  assert( h != NULL );
+
+  xfree( h );
+}
+
+
+void
+reset_histogram( histogram *h ) {
+  assert( h != NULL );
+
+  memset( h, 0, sizeof( histogram ) );
+}
+
+
+void
+record_histogram_value( histogram *h, uint64_t value ) {
+  assert( h != NULL );
+
+  if ( value > HISTOGRAM_MAX_VALUE ) {
+    value = HISTOGRAM_MAX_VALUE;
+  }
+  if ( h->n_values == 0 || value < h->min ) {
+    h->min = value;
+  }
+  h->counts[ bucket_of( value ) ]++;
+  h->n_values++;
+  if ( value > h->max ) {
+    h->max = value;
+  }
+}
+
+
+/*
+ * Returns the highest value that falls into the same bucket as the value
+ * at the given percentile, or zero if nothing has been recorded.
+ */
+uint64_t
+histogram_percentile( const histogram *h, double percentile ) {
+  assert( h != NULL );
+  assert( percentile >= 0.0 && percentile <= 100.0 );
+
+  if ( h->n_values == 0 ) {
+    return 0;
+  }
+
+  uint64_t rank = ( uint64_t ) ( percentile / 100.0 * ( double ) h->n_values + 0.5 );
+  if ( rank == 0 ) {
+    rank = 1;
+  }
+  uint64_t n_values = 0;
+  for ( unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++ ) {
+    n_values += h->counts[ i ];
+    if ( n_values >= rank ) {
+      uint64_t lower, upper;
+      bucket_range( i, &lower, &upper );
+      return upper < h->max ? upper : h->max;
+    }
+  }
+
+  return h->max;
+}
+
+
+void
+foreach_histogram_bucket( const histogram *h, void function( uint64_t lower, uint64_t upper, uint64_t count, void *user_data ), void *user_data ) {
+  assert( h != NULL );
+  assert( function != NULL );
+
+  for ( unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++ ) {
+    if ( h->counts[ i ] == 0 ) {
+      continue;
+    }
+    uint64_t lower, upper;
+    bucket_range( i, &lower, &upper );
+    function( lower, upper, h->counts[ i ], user_data );
+  }
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+ * @file
+ *
+ * @brief Fixed-size histogram with logarithmic buckets.
+ *
+ * Values below 2^HISTOGRAM_SUB_BUCKET_BITS have a bucket each. Above that,
+ * every power of two is split into 2^(HISTOGRAM_SUB_BUCKET_BITS - 1)
+ * buckets, so that a value is known within 1/16 of itself. Recording a
+ * value neither allocates nor takes a lock, and a zero-filled histogram
+ * is empty.
+ *
+ * @code
+ * histogram *h = create_histogram();
+ * record_histogram_value( h, 120 );
+ * histogram_percentile( h, 99.0 ); // => 120
+ * delete_histogram( h );
+ * @endcode
+ */
+
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+
+#include <stdint.h>
+
+
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_MAX_VALUE_BITS 36 // values are clamped to 2^36 - 1
+#define HISTOGRAM_MAX_VALUE ( ( ( uint64_t ) 1 << HISTOGRAM_MAX_VALUE_BITS ) - 1 )
+#define HISTOGRAM_BUCKETS ( ( 1 << HISTOGRAM_SUB_BUCKET_BITS ) + \
+                            ( HISTOGRAM_MAX_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS ) * ( 1 << ( HISTOGRAM_SUB_BUCKET_BITS - 1 ) ) )
+
+
+typedef struct {
+  uint64_t n_values;
+  uint64_t min;
+  uint64_t max;
+  uint64_t counts[ HISTOGRAM_BUCKETS ];
+} histogram;
+
+
+histogram *create_histogram( void );
+void delete_histogram( histogram *h );
+void reset_histogram( histogram *h );
+void record_histogram_value( histogram *h, uint64_t value );
+uint64_t histogram_percentile( const histogram *h, double percentile );
+void foreach_histogram_bucket( const histogram *h, void function( uint64_t lower, uint64_t upper, uint64_t count, void *user_data ), void *user_data );
+
+
+#endif // HISTOGRAM_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -18,14 +18,23 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <linux/limits.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <syslog.h>
 #include <time.h>
+#include <unistd.h>
 #include "bool.h"
+#include "checks.h"
 #include "log.h"
 #include "trema_wrapper.h"
 #include "wrapper.h"
@@ -42,11 +51,15 @@ typedef priority facility;
 static bool initialized = false;
 static FILE *fd = NULL;
 static int level = -1;
+int current_logging_level = LOG_DEBUG;
 static int facility_value = -1;
 static char ident_string[ PATH_MAX ];
 static char log_directory[ PATH_MAX ];
 static logging_type output = LOGGING_TYPE_FILE;
 static pthread_mutex_t mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static int requested_async = -1;
+static bool async = false;
+static bool flush_at_exit = false;
 
 
 static priority priorities[][ 3 ] = {
@@ -169,6 +182,450 @@ log_syslog( int priority, const char *format, va_list ap ) {
 }
 
 
+/*
+ * In asynchronous mode each thread formats messages into its own
+ * single-producer/single-consumer ring, and a writer thread copies them
+ * to the outputs. Producers take no lock; a message is dropped and counted
+ * if the ring is full.
+ */
+#define LOG_RING_LENGTH 256
+#define LOG_RECORD_LENGTH ( 1024 + 64 )
+#define LOG_WRITE_BATCH 64
+#define LOG_WRITER_TIMEOUT_MSEC 1000
+
+typedef struct {
+  int priority;
+  size_t message_offset; // the message without date and priority
+  size_t length;
+  char text[ LOG_RECORD_LENGTH ];
+} log_record;
+
+typedef struct log_ring {
+  uint64_t tail __attribute__( ( aligned( 64 ) ) );
+  uint64_t head __attribute__( ( aligned( 64 ) ) );
+  bool closed;
+  bool orphaned;  // detached by finalize_log() while its thread is alive
+  struct log_ring *next;
+  log_record records[ LOG_RING_LENGTH ];
+} log_ring;
+
+static log_ring *log_rings = NULL;
+static unsigned int log_ring_generation = 1;
+static __thread log_ring *thread_log_ring = NULL;
+static __thread unsigned int thread_log_ring_generation = 0;
+static __thread time_t thread_log_time = 0;
+static __thread char thread_log_date[ 26 ];
+// Serializes consumers, i.e., the writer thread and flush_log().
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_t writer_thread;
+static bool writer_running = false;
+static bool writer_stopping = false;
+static uint32_t writer_waiting = 0;
+static int writer_event_fd = -1;
+static uint64_t dropped_records = 0;
+
+
+static void
+close_log_ring( void *value ) {
+  log_ring *ring = value;
+
+  pthread_mutex_lock( &drain_mutex );
+  if ( ring->orphaned ) {
+    // No longer in log_rings, so nobody else refers to it.
+    xfree( ring );
+  }
+  else {
+    // The writer thread frees the ring once it is drained.
+    __atomic_store_n( &ring->closed, true, __ATOMIC_RELEASE );
+  }
+  pthread_mutex_unlock( &drain_mutex );
+}
+
+
+static void
+prepare_fork() {
+  pthread_mutex_lock( &drain_mutex );
+}
+
+
+static void
+unlock_after_fork() {
+  pthread_mutex_unlock( &drain_mutex );
+}
+
+
+static void
+reset_writer_after_fork() {
+  // Only the forking thread survives, so the writer is started again on demand.
+  writer_running = false;
+  writer_waiting = 0;
+  if ( writer_event_fd >= 0 ) {
+    close( writer_event_fd );
+    writer_event_fd = -1;
+  }
+  pthread_mutex_init( &writer_mutex, NULL );
+  pthread_mutex_unlock( &drain_mutex );
+}
+
+
+static void
+create_log_ring_key() {
+  pthread_key_create( &log_ring_key, close_log_ring );
+  pthread_atfork( prepare_fork, unlock_after_fork, reset_writer_after_fork );
+}
+
+
+static log_ring *
+get_log_ring() {
+  if ( thread_log_ring != NULL && thread_log_ring_generation == __atomic_load_n( &log_ring_generation, __ATOMIC_ACQUIRE ) ) {
+    return thread_log_ring;
+  }
+
+  pthread_once( &log_ring_key_once, create_log_ring_key );
+  log_ring *ring = xmalloc( sizeof( log_ring ) );
+  memset( ring, 0, offsetof( log_ring, records ) );
+  pthread_mutex_lock( &drain_mutex );
+  if ( thread_log_ring != NULL ) {
+    // Orphaned by free_log_rings().
+    assert( thread_log_ring->orphaned );
+    xfree( thread_log_ring );
+  }
+  ring->next = log_rings;
+  log_rings = ring;
+  thread_log_ring_generation = log_ring_generation;
+  pthread_mutex_unlock( &drain_mutex );
+  pthread_setspecific( log_ring_key, ring );
+  thread_log_ring = ring;
+
+  return ring;
+}
+
+
+static const char *
+get_log_date() {
+  // Formatting the date is costly, so it is done once per second.
+  time_t now = time( NULL );
+  if ( now != thread_log_time ) {
+    struct tm tm;
+    asctime_r( localtime_r( &now, &tm ), thread_log_date );
+    thread_log_date[ 24 ] = '\0'; // chomp
+    thread_log_time = now;
+  }
+
+  return thread_log_date;
+}
+
+
+static void
+format_log_record( log_record *record, int priority, const char *format, va_list ap ) {
+  int offset = snprintf( record->text, LOG_RECORD_LENGTH, "%s [%s] ", get_log_date(), priority_name_from( priority ) );
+  record->message_offset = ( size_t ) offset;
+  va_list new_ap;
+  va_copy( new_ap, ap );
+  int length = vsnprintf( record->text + offset, max_message_length, format, new_ap );
+  va_end( new_ap );
+  if ( length < 0 ) {
+    length = 0;
+  }
+  else if ( ( size_t ) length >= max_message_length ) {
+    length = ( int ) max_message_length - 1;
+  }
+  record->length = ( size_t ) ( offset + length );
+  record->text[ record->length++ ] = '\n';
+  record->priority = priority;
+}
+
+
+static void
+syslog_record( int priority, const char *format, ... ) {
+  va_list ap;
+  va_start( ap, format );
+  trema_vsyslog( priority, format, ap );
+  va_end( ap );
+}
+
+
+static void
+write_all( int fd, struct iovec *iov, int iovcnt ) {
+  while ( iovcnt > 0 ) {
+    ssize_t written = writev( fd, iov, iovcnt );
+    if ( written < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      return;
+    }
+    while ( iovcnt > 0 && ( size_t ) written >= iov->iov_len ) {
+      written -= ( ssize_t ) iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if ( iovcnt > 0 ) {
+      iov->iov_base = ( char * ) iov->iov_base + written;
+      iov->iov_len -= ( size_t ) written;
+    }
+  }
+}
+
+
+static void
+write_log_records( log_record **records, int count ) {
+  struct iovec iov[ LOG_WRITE_BATCH ];
+
+  pthread_mutex_lock( &mutex );
+  if ( ( output & LOGGING_TYPE_FILE ) && fd != NULL ) {
+    for ( int i = 0; i < count; i++ ) {
+      iov[ i ].iov_base = records[ i ]->text;
+      iov[ i ].iov_len = records[ i ]->length;
+    }
+    write_all( fileno( fd ), iov, count );
+  }
+  if ( output & LOGGING_TYPE_SYSLOG ) {
+    for ( int i = 0; i < count; i++ ) {
+      log_record *record = records[ i ];
+      syslog_record( record->priority, "%.*s", ( int ) ( record->length - record->message_offset - 1 ), record->text + record->message_offset );
+    }
+  }
+  if ( output & LOGGING_TYPE_STDOUT ) {
+    for ( int i = 0; i < count; i++ ) {
+      iov[ i ].iov_base = records[ i ]->text + records[ i ]->message_offset;
+      iov[ i ].iov_len = records[ i ]->length - records[ i ]->message_offset;
+    }
+    write_all( STDOUT_FILENO, iov, count );
+  }
+  pthread_mutex_unlock( &mutex );
+}
+
+
+static void
+report_dropped_log_records() {
+  uint64_t dropped = __atomic_exchange_n( &dropped_records, 0, __ATOMIC_RELAXED );
+  if ( dropped == 0 ) {
+    return;
+  }
+
+  log_record record;
+  log_record *records[ 1 ] = { &record };
+  int offset = snprintf( record.text, LOG_RECORD_LENGTH, "%s [%s] ", get_log_date(), priority_name_from( LOG_WARNING ) );
+  record.message_offset = ( size_t ) offset;
+  record.length = record.message_offset;
+  record.length += ( size_t ) snprintf( record.text + offset, max_message_length, "%" PRIu64 " log messages were dropped.\n", dropped );
+  record.priority = LOG_WARNING;
+  write_log_records( records, 1 );
+}
+
+
+/*
+ * Writes out all records queued so far. Must be called with drain_mutex
+ * held. Rings of exited threads are freed once drained.
+ */
+static void
+drain_log_rings() {
+  log_record *records[ LOG_WRITE_BATCH ];
+
+  for ( log_ring **p = &log_rings; *p != NULL; ) {
+    log_ring *ring = *p;
+    bool closed = __atomic_load_n( &ring->closed, __ATOMIC_ACQUIRE );
+    uint64_t tail = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+    while ( ring->head != tail ) {
+      int count = 0;
+      uint64_t head = ring->head;
+      while ( head != tail && count < LOG_WRITE_BATCH ) {
+        records[ count++ ] = &ring->records[ head % LOG_RING_LENGTH ];
+        head++;
+      }
+      write_log_records( records, count );
+      __atomic_store_n( &ring->head, head, __ATOMIC_RELEASE );
+    }
+    if ( closed ) {
+      *p = ring->next;
+      xfree( ring );
+      continue;
+    }
+    p = &ring->next;
+  }
+  report_dropped_log_records();
+}
+
+
+static bool
+log_rings_empty() {
+  for ( log_ring *ring = log_rings; ring != NULL; ring = ring->next ) {
+    if ( ring->head != __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE ) ) {
+      return false;
+    }
+  }
+
+  return __atomic_load_n( &dropped_records, __ATOMIC_RELAXED ) == 0;
+}
+
+
+static void *
+run_log_writer( void *data ) {
+  UNUSED( data );
+
+  struct pollfd pfd = { .fd = writer_event_fd, .events = POLLIN };
+  while ( !__atomic_load_n( &writer_stopping, __ATOMIC_ACQUIRE ) ) {
+    pthread_mutex_lock( &drain_mutex );
+    drain_log_rings();
+    __atomic_store_n( &writer_waiting, 1, __ATOMIC_SEQ_CST );
+    bool empty = log_rings_empty();
+    pthread_mutex_unlock( &drain_mutex );
+    if ( !empty ) {
+      __atomic_store_n( &writer_waiting, 0, __ATOMIC_RELAXED );
+      continue;
+    }
+    if ( poll( &pfd, 1, LOG_WRITER_TIMEOUT_MSEC ) > 0 ) {
+      uint64_t count;
+      ssize_t ret = read( writer_event_fd, &count, sizeof( count ) );
+      UNUSED( ret );
+    }
+  }
+
+  return NULL;
+}
+
+
+static void
+wake_log_writer() {
+  if ( __atomic_load_n( &writer_waiting, __ATOMIC_RELAXED ) != 0 &&
+       __atomic_exchange_n( &writer_waiting, 0, __ATOMIC_ACQ_REL ) != 0 ) {
+    uint64_t one = 1;
+    ssize_t ret = write( writer_event_fd, &one, sizeof( one ) );
+    UNUSED( ret );
+  }
+}
+
+
+static bool
+start_log_writer() {
+  pthread_mutex_lock( &writer_mutex );
+  if ( !writer_running ) {
+    if ( writer_event_fd < 0 ) {
+      writer_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    }
+    writer_stopping = false;
+    if ( writer_event_fd >= 0 && pthread_create( &writer_thread, NULL, run_log_writer, NULL ) == 0 ) {
+      __atomic_store_n( &writer_running, true, __ATOMIC_RELEASE );
+    }
+  }
+  pthread_mutex_unlock( &writer_mutex );
+
+  return writer_running;
+}
+
+
+static void
+stop_log_writer() {
+  pthread_mutex_lock( &writer_mutex );
+  if ( writer_running ) {
+    __atomic_store_n( &writer_stopping, true, __ATOMIC_RELEASE );
+    uint64_t one = 1;
+    ssize_t ret = write( writer_event_fd, &one, sizeof( one ) );
+    UNUSED( ret );
+    pthread_join( writer_thread, NULL );
+    writer_running = false;
+  }
+  if ( writer_event_fd >= 0 ) {
+    close( writer_event_fd );
+    writer_event_fd = -1;
+  }
+  pthread_mutex_unlock( &writer_mutex );
+}
+
+
+static void
+log_async( int priority, const char *format, va_list ap ) {
+  log_ring *ring = get_log_ring();
+
+  if ( ring->tail - __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) >= LOG_RING_LENGTH ) {
+    __atomic_fetch_add( &dropped_records, 1, __ATOMIC_RELAXED );
+    return;
+  }
+  format_log_record( &ring->records[ ring->tail % LOG_RING_LENGTH ], priority, format, ap );
+  __atomic_store_n( &ring->tail, ring->tail + 1, __ATOMIC_RELEASE );
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+  // The writer is started on demand since the process may fork after init_log().
+  if ( !__atomic_load_n( &writer_running, __ATOMIC_ACQUIRE ) && !start_log_writer() ) {
+    flush_log();
+    return;
+  }
+  if ( priority <= LOG_ERR ) {
+    // Errors are written out at once as the process may be about to abort.
+    flush_log();
+    return;
+  }
+  wake_log_writer();
+}
+
+
+/**
+ * Writes out the messages queued in asynchronous mode. Nothing is done
+ * in synchronous mode since every message is written immediately.
+ */
+void
+flush_log() {
+  if ( !async ) {
+    return;
+  }
+
+  pthread_mutex_lock( &drain_mutex );
+  drain_log_rings();
+  pthread_mutex_unlock( &drain_mutex );
+}
+
+
+static void
+free_log_rings() {
+  pthread_mutex_lock( &drain_mutex );
+  drain_log_rings();
+  while ( log_rings != NULL ) {
+    log_ring *ring = log_rings;
+    log_rings = ring->next;
+    if ( ring == thread_log_ring ) {
+      pthread_setspecific( log_ring_key, NULL );
+      thread_log_ring = NULL;
+      xfree( ring );
+    }
+    else {
+      // Its thread may still log or exit, so the thread frees it.
+      ring->orphaned = true;
+    }
+  }
+  // Rings cached by threads are allocated again.
+  __atomic_add_fetch( &log_ring_generation, 1, __ATOMIC_RELEASE );
+  pthread_mutex_unlock( &drain_mutex );
+}
+
+
+static bool
+resolve_async_logging() {
+  if ( requested_async >= 0 ) {
+    return requested_async != 0;
+  }
+
+  const char *async_string = getenv( "LOGGING_ASYNC" );
+  return async_string != NULL && strcmp( async_string, "1" ) == 0;
+}
+
+
+/**
+ * Selects asynchronous mode, in which messages are written by a
+ * background thread. Unless set explicitly, it is enabled by setting the
+ * LOGGING_ASYNC environment variable to 1. Takes effect on init_log().
+ *
+ * @param enable true to write messages asynchronously.
+ */
+void
+set_async_logging( bool enable ) {
+  requested_async = enable ? 1 : 0;
+}
+
+
 static void
 unset_ident_string() {
   memset( ident_string, '\0', sizeof( ident_string ) );
@@ -305,6 +762,7 @@ init_log( const char *ident, const char *directory, logging_type type ) {
   if ( level < 0 || level > LOG_DEBUG ) {
     level = LOG_INFO;
   }
+  current_logging_level = level;
   char *level_string = getenv( "LOGGING_LEVEL" );
   if ( level_string != NULL ) {
     set_logging_level( level_string );
@@ -323,6 +781,15 @@ init_log( const char *ident, const char *directory, logging_type type ) {
   set_ident_string( ident );
   set_log_directory( directory );
   output = type;
+  async = resolve_async_logging();
+  if ( async ) {
+    // The ring of the main thread is prepared in advance; others get theirs on demand.
+    get_log_ring();
+    if ( !flush_at_exit ) {
+      atexit( flush_log );
+      flush_at_exit = true;
+    }
+  }
   if ( output & LOGGING_TYPE_FILE ) {
     fd = open_log_file( false );
   }
@@ -340,6 +807,8 @@ init_log( const char *ident, const char *directory, logging_type type ) {
 
 void
 restart_log( const char *new_ident ) {
+  flush_log();
+
   pthread_mutex_lock( &mutex );
 
   if ( new_ident != NULL ) {
@@ -365,6 +834,8 @@ void
 rename_log( const char *new_ident ) {
   assert( new_ident != NULL );
 
+  flush_log();
+
   pthread_mutex_lock( &mutex );
 
   if ( output & LOGGING_TYPE_FILE ) {
@@ -399,9 +870,16 @@ rename_log( const char *new_ident ) {
  */
 bool
 finalize_log() {
+  if ( async ) {
+    stop_log_writer();
+    free_log_rings();
+    async = false;
+  }
+
   pthread_mutex_lock( &mutex );
 
   level = -1;
+  current_logging_level = LOG_DEBUG;
   facility_value = -1;
 
   if ( output & LOGGING_TYPE_FILE ) {
@@ -479,6 +957,7 @@ set_logging_level( const char *name ) {
   }
   pthread_mutex_lock( &mutex );
   level = new_level;
+  current_logging_level = new_level;
   pthread_mutex_unlock( &mutex );
 
   return true;
@@ -514,12 +993,18 @@ do_log( int priority, const char *format, va_list ap ) {
       trema_abort();                                    \
     }                                                   \
     if ( get_logging_level() >= _priority ) {           \
-      pthread_mutex_lock( &mutex );                     \
       va_list _args;                                    \
       va_start( _args, _format );                       \
-      do_log( _priority, _format, _args );              \
+      if ( async ) {                                    \
+        assert( started() );                            \
+        log_async( _priority, _format, _args );         \
+      }                                                 \
+      else {                                            \
+        pthread_mutex_lock( &mutex );                   \
+        do_log( _priority, _format, _args );            \
+        pthread_mutex_unlock( &mutex );                 \
+      }                                                 \
       va_end( _args );                                  \
-      pthread_mutex_unlock( &mutex );                   \
     }                                                   \
   }                                                     \
   while ( 0 )
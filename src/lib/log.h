@@ -55,6 +55,8 @@ bool finalize_log( void );
 bool set_logging_level( const char *level );
 bool valid_logging_level( const char *level );
 bool set_syslog_facility( const char *facility );
+void set_async_logging( bool enable );
+void flush_log( void );
 
 extern int ( *get_logging_level )( void );
 
@@ -65,6 +67,32 @@ extern void ( *notice )( const char *format, ... ) __attribute__( ( format( prin
 extern void ( *info )( const char *format, ... ) __attribute__( ( format( printf, 1, 2 ) ) );
 extern void ( *debug )( const char *format, ... ) __attribute__( ( format( printf, 1, 2 ) ) );
 
+/*
+ * notice(), info() and debug() check the logging level inline, so that
+ * disabled messages cost neither a call nor argument marshalling. The
+ * level is LOG_DEBUG until init_log() is called, in which case every
+ * message reaches the log functions above (which may be replaced).
+ *
+ * Messages above LOG_MAX_LEVEL are compiled out. Release builds may be
+ * built with -DLOG_MAX_LEVEL=LOG_INFO to drop debug() calls entirely.
+ */
+extern int current_logging_level;
+
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_DEBUG
+#endif
+
+#define LOGGING_LEVEL_ENABLED( _level ) ( ( _level ) <= LOG_MAX_LEVEL && ( _level ) <= current_logging_level )
+
+// A NULL format is still passed through so that it is caught as before.
+#define LOG_IF_ENABLED( _level, _function, _format, ... )                    \
+  ( ( LOGGING_LEVEL_ENABLED( _level ) || ( _format ) == NULL ) ?            \
+    ( _function )( _format, ##__VA_ARGS__ ) : ( void ) 0 )
+
+#define notice( _format, ... ) LOG_IF_ENABLED( LOG_NOTICE, notice, _format, ##__VA_ARGS__ )
+#define info( _format, ... ) LOG_IF_ENABLED( LOG_INFO, info, _format, ##__VA_ARGS__ )
+#define debug( _format, ... ) LOG_IF_ENABLED( LOG_DEBUG, debug, _format, ##__VA_ARGS__ )
+
 
 #endif // LOG_H
 
@@ -345,6 +345,18 @@ finalize_management_interface() {
 }
 
 
+bool
+add_management_service( const char *service_name ) {
+  return add_message_requested_callback( get_management_service_name( service_name ), handle_request );
+}
+
+
+bool
+delete_management_service( const char *service_name ) {
+  return delete_message_requested_callback( get_management_service_name( service_name ), handle_request );
+}
+
+
 bool *
 _get_management_interface_initialized() {
   return &initialized;
@@ -27,6 +27,9 @@
 
 bool init_management_interface();
 bool finalize_management_interface();
+// Serves management requests for another service name of the process.
+bool add_management_service( const char *service_name );
+bool delete_management_service( const char *service_name );
 
 
 #endif // MANAGEMENT_INTERFACE_H
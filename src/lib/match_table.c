@@ -19,9 +19,11 @@
 #include <assert.h>
 #include <openflow.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "checks.h"
+#include "flat_hash_table.h"
 #include "match.h"
 #include "match_table.h"
 #include "log.h"
@@ -38,15 +40,86 @@
 typedef struct {
   struct ofp_match match; // match data. host byte order
   uint16_t priority;
+  uint64_t sequence; // insertion order among wildcards entries
   void *data;
 } match_entry;
 
 
+// Copy of the entry that wins a lookup in a bucket. It is never
+// modified once published; a change links a new copy into the slot.
+typedef struct published_entry {
+  struct ofp_match key;
+  uint16_t priority;
+  uint64_t sequence;
+  void *data;
+  struct published_entry *next; // in the same slot
+} published_entry;
+
+
+typedef struct {
+  unsigned int n_slots; // power of two
+  published_entry *slots[ 0 ];
+} published_slots;
+
+
+// What lookup_match_table_entry() reads of a tuple. Each slot is
+// replaced on its own, so an update copies only the entries that hash
+// to the same slot.
+typedef struct {
+  uint32_t wildcards;
+  unsigned int n_entries;
+  published_slots *slots;
+} published_tuple;
+
+
+// Wildcards entries with the same masked fields.
+typedef struct {
+  struct ofp_match key; // match masked by the wildcards of the tuple
+  list_element *entries; // sorted by priority
+} match_bucket;
+
+
+// Wildcards entries with the same wildcards.
 typedef struct {
+  uint32_t wildcards;
+  uint16_t max_priority;
+  flat_hash_table *buckets; // masked match -> match_bucket
+  published_tuple *published;
+} match_tuple;
+
+
+typedef struct {
+  list_element *entries; // sorted by priority
+  list_element *tuples; // sorted by max_priority
+  uint64_t next_sequence;
+} wildcards_match_table;
+
+
+typedef struct {
+  published_tuple *tuple;
+  uint16_t max_priority;
+} published_tuple_ref;
+
+
+// The order in which lookup_match_table_entry() visits the tuples. It
+// is replaced only when a tuple is added, removed or reordered.
+typedef struct {
+  unsigned int n_tuples;
+  published_tuple_ref tuples[ 0 ]; // sorted by max_priority
+} match_snapshot;
+
+
+struct match_table {
   hash_table *exact_table; // no wildcards are set
-  list_element *wildcards_table; // wildcards flags are set
-  pthread_mutex_t *mutex;
-} match_table;
+  wildcards_match_table wildcards_table; // wildcards flags are set
+  pthread_mutex_t *mutex; // serializes updates
+  published_tuple *exact;
+  match_snapshot *snapshot;
+  bool snapshot_dirty; // tuples were added, removed or reordered
+  unsigned int epoch;
+  unsigned int readers[ 2 ];
+  list_element *retired[ 2 ]; // unlinked while epoch had the same parity
+};
 
 
 typedef struct {
@@ -72,6 +145,7 @@ allocate_match_entry( struct ofp_match *match, uint16_t priority, void *data ) {
   match_entry *new_entry = xmalloc( sizeof( match_entry ) );
   new_entry->match = *match;
   new_entry->priority = priority;
+  new_entry->sequence = 0;
   new_entry->data = data;
 
   return new_entry;
@@ -220,9 +294,6 @@ lookup_exact_match_strict_entry( hash_table *exact_table, struct ofp_match *matc
 }
 
 
-#define lookup_exact_match_entry( table, match ) lookup_exact_match_strict_entry( table, match )
-
-
 static bool
 update_exact_match_entry( hash_table *exact_table, struct ofp_match *match, void *data ) {
   assert( exact_table != NULL );
@@ -293,99 +364,491 @@ map_exact_match_table( hash_table *exact_table, struct ofp_match *match, void fu
 }
 
 
+static bool
+compare_masked_match( const void *x, const void *y ) {
+  assert( x != NULL );
+  assert( y != NULL );
+
+  return memcmp( x, y, sizeof( struct ofp_match ) ) == 0;
+}
+
+
 static void
-init_wildcards_match_table( list_element **wildcards_table ) {
-  assert( wildcards_table != NULL );
+mask_match( struct ofp_match *masked, const struct ofp_match *match, uint32_t wildcards ) {
+  memset( masked, 0, sizeof( struct ofp_match ) );
+  masked->wildcards = wildcards;
+  if ( !( wildcards & OFPFW_IN_PORT ) ) {
+    masked->in_port = match->in_port;
+  }
+  if ( !( wildcards & OFPFW_DL_VLAN ) ) {
+    masked->dl_vlan = match->dl_vlan;
+  }
+  if ( !( wildcards & OFPFW_DL_VLAN_PCP ) ) {
+    masked->dl_vlan_pcp = match->dl_vlan_pcp;
+  }
+  if ( !( wildcards & OFPFW_DL_SRC ) ) {
+    memcpy( masked->dl_src, match->dl_src, OFP_ETH_ALEN );
+  }
+  if ( !( wildcards & OFPFW_DL_DST ) ) {
+    memcpy( masked->dl_dst, match->dl_dst, OFP_ETH_ALEN );
+  }
+  if ( !( wildcards & OFPFW_DL_TYPE ) ) {
+    masked->dl_type = match->dl_type;
+  }
+  masked->nw_src = match->nw_src & create_nw_src_mask( wildcards );
+  masked->nw_dst = match->nw_dst & create_nw_dst_mask( wildcards );
+  if ( !( wildcards & OFPFW_NW_TOS ) ) {
+    masked->nw_tos = match->nw_tos;
+  }
+  if ( !( wildcards & OFPFW_NW_PROTO ) ) {
+    masked->nw_proto = match->nw_proto;
+  }
+  if ( !( wildcards & OFPFW_TP_SRC ) ) {
+    masked->tp_src = match->tp_src;
+  }
+  if ( !( wildcards & OFPFW_TP_DST ) ) {
+    masked->tp_dst = match->tp_dst;
+  }
+}
+
+
+#define PUBLISHED_SLOTS_INITIAL_SIZE 16
+
+
+static published_slots *
+allocate_published_slots( unsigned int n_slots ) {
+  published_slots *slots = xcalloc( 1, offsetof( published_slots, slots ) + sizeof( published_entry * ) * n_slots );
+  slots->n_slots = n_slots;
 
-  create_list( wildcards_table );
+  return slots;
+}
+
+
+static published_tuple *
+allocate_published_tuple( uint32_t wildcards ) {
+  published_tuple *published = xmalloc( sizeof( published_tuple ) );
+  published->wildcards = wildcards;
+  published->n_entries = 0;
+  published->slots = allocate_published_slots( PUBLISHED_SLOTS_INITIAL_SIZE );
+
+  return published;
 }
 
 
 static void
-finalize_wildcards_match_table( list_element *wildcards_table ) {
-  list_element *element;
-  for ( element = wildcards_table; element != NULL; element = element->next ) {
-    free_match_entry( element->data );
-    element->data = NULL;
+free_published_tuple( published_tuple *published ) {
+  for ( unsigned int i = 0; i < published->slots->n_slots; i++ ) {
+    published_entry *entry = published->slots->slots[ i ];
+    while ( entry != NULL ) {
+      published_entry *next = entry->next;
+      xfree( entry );
+      entry = next;
+    }
   }
-  delete_list( wildcards_table );
+  xfree( published->slots );
+  xfree( published );
 }
 
 
-static bool
-insert_wildcards_match_entry( list_element **wildcards_table, struct ofp_match *match, uint16_t priority, void *data ) {
-  assert( match != NULL );
+static published_entry *
+allocate_published_entry( const struct ofp_match *key, uint16_t priority, uint64_t sequence, void *data, published_entry *next ) {
+  published_entry *new_entry = xmalloc( sizeof( published_entry ) );
+  new_entry->key = *key;
+  new_entry->priority = priority;
+  new_entry->sequence = sequence;
+  new_entry->data = data;
+  new_entry->next = next;
+
+  return new_entry;
+}
+
+
+/*
+ * Keeps memory that readers may still see until they leave. It is
+ * freed by reclaim_retired_memory() once the epoch it was retired in
+ * has drained.
+ */
+static void
+retire_memory( match_table *table, void *garbage ) {
+  insert_in_front( &table->retired[ __atomic_load_n( &table->epoch, __ATOMIC_SEQ_CST ) & 1 ], garbage );
+}
+
+
+static void
+retire_published_chain( match_table *table, published_entry *entry ) {
+  while ( entry != NULL ) {
+    published_entry *next = entry->next;
+    retire_memory( table, entry );
+    entry = next;
+  }
+}
+
+
+static void
+retire_published_tuple( match_table *table, published_tuple *published ) {
+  for ( unsigned int i = 0; i < published->slots->n_slots; i++ ) {
+    retire_published_chain( table, published->slots->slots[ i ] );
+  }
+  retire_memory( table, published->slots );
+  retire_memory( table, published );
+}
+
+
+static void
+free_retired_memory( list_element **retired ) {
+  for ( list_element *element = *retired; element != NULL; element = element->next ) {
+    xfree( element->data );
+  }
+  delete_list( *retired );
+  create_list( retired );
+}
+
+
+/*
+ * Frees what was retired before the last epoch flip if no reader
+ * registered under that epoch is left, then flips the epoch again.
+ * Readers register under the current epoch before loading anything,
+ * so only the ones counted under the previous epoch may still hold
+ * memory retired then. Updates never wait for readers; a busy reader
+ * only delays the reclamation to a later update.
+ */
+static void
+reclaim_retired_memory( match_table *table ) {
+  unsigned int epoch = __atomic_load_n( &table->epoch, __ATOMIC_SEQ_CST );
+  unsigned int previous = ( epoch - 1 ) & 1;
+  if ( __atomic_load_n( &table->readers[ previous ], __ATOMIC_SEQ_CST ) != 0 ) {
+    return;
+  }
+  free_retired_memory( &table->retired[ previous ] );
+  __atomic_store_n( &table->epoch, epoch + 1, __ATOMIC_SEQ_CST );
+}
+
+
+static void
+grow_published_tuple( match_table *table, published_tuple *published ) {
+  published_slots *old = published->slots;
+  published_slots *slots = allocate_published_slots( old->n_slots * 2 );
+  for ( unsigned int i = 0; i < old->n_slots; i++ ) {
+    for ( published_entry *entry = old->slots[ i ]; entry != NULL; entry = entry->next ) {
+      unsigned int slot = hash_exact_match_entry( &entry->key ) & ( slots->n_slots - 1 );
+      slots->slots[ slot ] = allocate_published_entry( &entry->key, entry->priority, entry->sequence, entry->data, slots->slots[ slot ] );
+    }
+    retire_published_chain( table, old->slots[ i ] );
+  }
+  __atomic_store_n( &published->slots, slots, __ATOMIC_SEQ_CST );
+  retire_memory( table, old );
+}
+
+
+/*
+ * Makes winner the entry that lookups find for key, or removes key if
+ * winner is NULL. Only the slot of key is copied, so the cost does not
+ * depend on the number of entries in the tuple.
+ */
+static void
+publish_match_entry( match_table *table, published_tuple *published, const struct ofp_match *key, const match_entry *winner ) {
+  published_slots *slots = published->slots;
+  published_entry **slot = &slots->slots[ hash_exact_match_entry( key ) & ( slots->n_slots - 1 ) ];
+  published_entry *old = *slot;
+  published_entry *head = NULL;
+  bool found = false;
+  for ( published_entry *entry = old; entry != NULL; entry = entry->next ) {
+    if ( compare_masked_match( &entry->key, key ) ) {
+      found = true;
+      continue;
+    }
+    head = allocate_published_entry( &entry->key, entry->priority, entry->sequence, entry->data, head );
+  }
+  if ( winner != NULL ) {
+    head = allocate_published_entry( key, winner->priority, winner->sequence, winner->data, head );
+  }
+  __atomic_store_n( slot, head, __ATOMIC_SEQ_CST );
+  retire_published_chain( table, old );
+
+  if ( found && winner == NULL ) {
+    published->n_entries--;
+  }
+  else if ( !found && winner != NULL ) {
+    published->n_entries++;
+    if ( published->n_entries > slots->n_slots ) {
+      grow_published_tuple( table, published );
+    }
+  }
+}
+
+
+static published_entry *
+lookup_published_tuple( published_tuple *published, const struct ofp_match *key ) {
+  published_slots *slots = __atomic_load_n( &published->slots, __ATOMIC_SEQ_CST );
+  unsigned int slot = hash_exact_match_entry( key ) & ( slots->n_slots - 1 );
+  published_entry *entry = __atomic_load_n( &slots->slots[ slot ], __ATOMIC_SEQ_CST );
+  for ( ; entry != NULL; entry = entry->next ) {
+    if ( compare_masked_match( &entry->key, key ) ) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+static match_tuple *
+lookup_match_tuple( list_element *tuples, uint32_t wildcards ) {
+  for ( list_element *element = tuples; element != NULL; element = element->next ) {
+    match_tuple *tuple = element->data;
+    if ( tuple->wildcards == wildcards ) {
+      return tuple;
+    }
+  }
+  return NULL;
+}
+
+
+static void
+sort_match_tuple( list_element **tuples, match_tuple *tuple ) {
+  delete_element( tuples, tuple );
 
   list_element *element;
-  for ( element = *wildcards_table; element != NULL; element = element->next ) {
-    match_entry *entry = element->data;
-    if ( entry->priority < priority ) {
+  for ( element = *tuples; element != NULL; element = element->next ) {
+    match_tuple *other = element->data;
+    if ( other->max_priority < tuple->max_priority ) {
       break;
     }
-    assert( entry != NULL );
-    if ( entry->priority == priority && compare_match_strict( &entry->match, match ) ) {
-      char match_string[ MATCH_STRING_LENGTH ];
-      match_to_string( match, match_string, sizeof( match_string ) );
-      warn( "wildcards match entry already exists ( match = [%s], priority = %u )",
-            match_string, priority );
-      return false;
-    }
   }
-  match_entry *new_entry = allocate_match_entry( match, priority, data );
   if ( element == NULL ) {
-    // tail
-    append_to_tail( wildcards_table, new_entry );
+    append_to_tail( tuples, tuple );
   }
-  else if ( element == *wildcards_table ) {
-    // head
-    insert_in_front( wildcards_table, new_entry );
+  else if ( element == *tuples ) {
+    insert_in_front( tuples, tuple );
   }
   else {
-    // insert before
-    insert_before( wildcards_table, element->data, new_entry );
+    insert_before( tuples, element->data, tuple );
+  }
+}
+
+
+static void
+free_match_bucket( void *key, void *value, void *user_data ) {
+  UNUSED( key );
+  UNUSED( user_data );
+  match_bucket *bucket = value;
+
+  delete_list( bucket->entries );
+  xfree( bucket );
+}
+
+
+static void
+delete_match_tuple( match_tuple *tuple ) {
+  foreach_flat_hash( tuple->buckets, free_match_bucket, NULL );
+  delete_flat_hash( tuple->buckets );
+  xfree( tuple );
+}
+
+
+static void
+update_max_priority( void *key, void *value, void *user_data ) {
+  UNUSED( key );
+  match_bucket *bucket = value;
+  match_tuple *tuple = user_data;
+
+  match_entry *head = bucket->entries->data;
+  if ( head->priority > tuple->max_priority ) {
+    tuple->max_priority = head->priority;
   }
-  return true;
+}
+
+
+static match_bucket *
+lookup_match_bucket( list_element *tuples, struct ofp_match *match, match_tuple **tuple ) {
+  *tuple = lookup_match_tuple( tuples, match->wildcards & OFPFW_ALL );
+  if ( *tuple == NULL ) {
+    return NULL;
+  }
+  struct ofp_match key;
+  mask_match( &key, match, ( *tuple )->wildcards );
+  return lookup_flat_hash_entry( ( *tuple )->buckets, &key );
+}
+
+
+static void
+init_wildcards_match_table( wildcards_match_table *wildcards_table ) {
+  assert( wildcards_table != NULL );
+
+  create_list( &wildcards_table->entries );
+  create_list( &wildcards_table->tuples );
+  wildcards_table->next_sequence = 0;
+}
+
+
+static void
+finalize_wildcards_match_table( wildcards_match_table *wildcards_table ) {
+  list_element *element;
+  for ( element = wildcards_table->entries; element != NULL; element = element->next ) {
+    free_match_entry( element->data );
+    element->data = NULL;
+  }
+  delete_list( wildcards_table->entries );
+  for ( element = wildcards_table->tuples; element != NULL; element = element->next ) {
+    match_tuple *tuple = element->data;
+    free_published_tuple( tuple->published );
+    delete_match_tuple( tuple );
+  }
+  delete_list( wildcards_table->tuples );
 }
 
 
 static match_entry *
-lookup_wildcards_match_strict_entry( list_element *wildcards_table, struct ofp_match *match, uint16_t priority ) {
+lookup_wildcards_match_strict_entry( wildcards_match_table *wildcards_table, struct ofp_match *match, uint16_t priority ) {
   assert( match != NULL );
 
+  match_tuple *tuple;
+  match_bucket *bucket = lookup_match_bucket( wildcards_table->tuples, match, &tuple );
+  if ( bucket == NULL ) {
+    return NULL;
+  }
+  for ( list_element *element = bucket->entries; element != NULL; element = element->next ) {
+    match_entry *entry = element->data;
+    if ( entry->priority == priority ) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+static void
+insert_match_tuple_entry( match_table *table, match_entry *new_entry ) {
+  list_element **tuples = &table->wildcards_table.tuples;
+  uint32_t wildcards = new_entry->match.wildcards & OFPFW_ALL;
+  match_tuple *tuple = lookup_match_tuple( *tuples, wildcards );
+  if ( tuple == NULL ) {
+    tuple = xmalloc( sizeof( match_tuple ) );
+    tuple->wildcards = wildcards;
+    tuple->max_priority = new_entry->priority;
+    tuple->buckets = create_flat_hash( compare_masked_match, hash_exact_match_entry, FLAT_HASH_NO_LOCK );
+    tuple->published = allocate_published_tuple( wildcards );
+    append_to_tail( tuples, tuple );
+    sort_match_tuple( tuples, tuple );
+    table->snapshot_dirty = true;
+  }
+  else if ( new_entry->priority > tuple->max_priority ) {
+    tuple->max_priority = new_entry->priority;
+    sort_match_tuple( tuples, tuple );
+    table->snapshot_dirty = true;
+  }
+
+  struct ofp_match key;
+  mask_match( &key, &new_entry->match, wildcards );
+  match_bucket *bucket = lookup_flat_hash_entry( tuple->buckets, &key );
+  if ( bucket == NULL ) {
+    bucket = xmalloc( sizeof( match_bucket ) );
+    bucket->key = key;
+    create_list( &bucket->entries );
+    insert_flat_hash_entry( tuple->buckets, &bucket->key, bucket );
+  }
+
+  // Entries of a bucket match the same packets, so they only differ in priority.
   list_element *element;
-  for ( element = wildcards_table; element != NULL; element = element->next ) {
+  for ( element = bucket->entries; element != NULL; element = element->next ) {
     match_entry *entry = element->data;
-    if ( entry->priority < priority ) {
+    if ( entry->priority < new_entry->priority ) {
       break;
     }
-    if ( entry->priority == priority && compare_match_strict( &entry->match, match ) ) {
-      return entry;
+  }
+  if ( element == NULL ) {
+    append_to_tail( &bucket->entries, new_entry );
+  }
+  else if ( element == bucket->entries ) {
+    insert_in_front( &bucket->entries, new_entry );
+  }
+  else {
+    insert_before( &bucket->entries, element->data, new_entry );
+  }
+
+  if ( bucket->entries->data == new_entry ) {
+    publish_match_entry( table, tuple->published, &bucket->key, new_entry );
+  }
+}
+
+
+static void
+delete_match_tuple_entry( match_table *table, match_entry *entry ) {
+  list_element **tuples = &table->wildcards_table.tuples;
+  match_tuple *tuple;
+  match_bucket *bucket = lookup_match_bucket( *tuples, &entry->match, &tuple );
+  assert( bucket != NULL );
+
+  bool winner = ( bucket->entries->data == entry );
+  delete_element( &bucket->entries, entry );
+  if ( bucket->entries == NULL ) {
+    delete_flat_hash_entry( tuple->buckets, &bucket->key );
+    if ( tuple->buckets->length > 0 ) {
+      publish_match_entry( table, tuple->published, &bucket->key, NULL );
     }
+    xfree( bucket );
+  }
+  else if ( winner ) {
+    publish_match_entry( table, tuple->published, &bucket->key, bucket->entries->data );
+  }
+  if ( tuple->buckets->length == 0 ) {
+    delete_element( tuples, tuple );
+    retire_published_tuple( table, tuple->published );
+    delete_match_tuple( tuple );
+    table->snapshot_dirty = true;
+  }
+  else if ( entry->priority == tuple->max_priority ) {
+    tuple->max_priority = 0;
+    foreach_flat_hash( tuple->buckets, update_max_priority, tuple );
+    sort_match_tuple( tuples, tuple );
+    table->snapshot_dirty = true;
   }
-  return NULL;
 }
 
 
-static match_entry *
-lookup_wildcards_match_entry( list_element *wildcards_table, struct ofp_match *match ) {
+static bool
+insert_wildcards_match_entry( match_table *table, struct ofp_match *match, uint16_t priority, void *data ) {
   assert( match != NULL );
 
+  wildcards_match_table *wildcards_table = &table->wildcards_table;
+  if ( lookup_wildcards_match_strict_entry( wildcards_table, match, priority ) != NULL ) {
+    char match_string[ MATCH_STRING_LENGTH ];
+    match_to_string( match, match_string, sizeof( match_string ) );
+    warn( "wildcards match entry already exists ( match = [%s], priority = %u )",
+          match_string, priority );
+    return false;
+  }
+
   list_element *element;
-  for ( element = wildcards_table; element != NULL; element = element->next ) {
+  for ( element = wildcards_table->entries; element != NULL; element = element->next ) {
     match_entry *entry = element->data;
-    if ( compare_match( &entry->match, match ) ) {
-      return entry;
+    if ( entry->priority < priority ) {
+      break;
     }
   }
-  return NULL;
+  match_entry *new_entry = allocate_match_entry( match, priority, data );
+  new_entry->sequence = wildcards_table->next_sequence++;
+  if ( element == NULL ) {
+    // tail
+    append_to_tail( &wildcards_table->entries, new_entry );
+  }
+  else if ( element == wildcards_table->entries ) {
+    // head
+    insert_in_front( &wildcards_table->entries, new_entry );
+  }
+  else {
+    // insert before
+    insert_before( &wildcards_table->entries, element->data, new_entry );
+  }
+  insert_match_tuple_entry( table, new_entry );
+  return true;
 }
 
 
 static bool
-update_wildcards_match_entry( list_element *wildcards_table, struct ofp_match *match, uint16_t priority, void *data ) {
+update_wildcards_match_entry( match_table *table, struct ofp_match *match, uint16_t priority, void *data ) {
   assert( match != NULL );
 
-  match_entry *entry = lookup_wildcards_match_strict_entry( wildcards_table, match, priority );
+  match_entry *entry = lookup_wildcards_match_strict_entry( &table->wildcards_table, match, priority );
   if ( entry == NULL ) {
     char match_string[ MATCH_STRING_LENGTH ];
     match_to_string( match, match_string, sizeof( match_string ) );
@@ -394,15 +857,20 @@ update_wildcards_match_entry( list_element *wildcards_table, struct ofp_match *m
     return false;
   }
   entry->data = data;
+  match_tuple *tuple;
+  match_bucket *bucket = lookup_match_bucket( table->wildcards_table.tuples, match, &tuple );
+  if ( bucket->entries->data == entry ) {
+    publish_match_entry( table, tuple->published, &bucket->key, entry );
+  }
   return true;
 }
 
 
 static void *
-delete_wildcards_match_strict_entry( list_element **wildcards_table, struct ofp_match *match, uint16_t priority ) {
+delete_wildcards_match_strict_entry( match_table *table, struct ofp_match *match, uint16_t priority ) {
   assert( match != NULL );
 
-  match_entry *entry = lookup_wildcards_match_strict_entry( *wildcards_table, match, priority );
+  match_entry *entry = lookup_wildcards_match_strict_entry( &table->wildcards_table, match, priority );
   if ( entry == NULL ) {
     char match_string[ MATCH_STRING_LENGTH ];
     match_to_string( match, match_string, sizeof( match_string ) );
@@ -411,17 +879,18 @@ delete_wildcards_match_strict_entry( list_element **wildcards_table, struct ofp_
     return NULL;
   }
   void *data = entry->data;
-  delete_element( wildcards_table, entry );
+  delete_match_tuple_entry( table, entry );
+  delete_element( &table->wildcards_table.entries, entry );
   free_match_entry( entry );
   return data;
 }
 
 
 static void
-map_wildcards_match_table( list_element *wildcards_table, struct ofp_match *match, void function( struct ofp_match, uint16_t, void *, void * ), void * user_data ) {
+map_wildcards_match_table( wildcards_match_table *wildcards_table, struct ofp_match *match, void function( struct ofp_match, uint16_t, void *, void * ), void * user_data ) {
   assert( function != NULL );
 
-  list_element *element = wildcards_table;
+  list_element *element = wildcards_table->entries;
   while ( element != NULL ) {
     match_entry *entry = element->data;
     element = element->next;
@@ -435,12 +904,128 @@ map_wildcards_match_table( list_element *wildcards_table, struct ofp_match *matc
 }
 
 
-void
-init_match_table( void ) {
-  if ( _match_table_head != NULL ) {
-    die( "match table is already initialized." );
+static match_snapshot *
+create_match_snapshot( list_element *tuples ) {
+  unsigned int n_tuples = list_length_of( tuples );
+  match_snapshot *snapshot = xmalloc( offsetof( match_snapshot, tuples ) + sizeof( published_tuple_ref ) * n_tuples );
+  snapshot->n_tuples = 0;
+  for ( list_element *element = tuples; element != NULL; element = element->next ) {
+    match_tuple *tuple = element->data;
+    published_tuple_ref *ref = &snapshot->tuples[ snapshot->n_tuples++ ];
+    ref->tuple = tuple->published;
+    ref->max_priority = tuple->max_priority;
+  }
+
+  return snapshot;
+}
+
+
+/*
+ * Publishes the new order of the tuples if it changed, and frees what
+ * no reader can see any more. Called at the end of every update.
+ */
+static void
+commit_match_table_update( match_table *table ) {
+  if ( table->snapshot_dirty ) {
+    match_snapshot *old = table->snapshot;
+    __atomic_store_n( &table->snapshot, create_match_snapshot( table->wildcards_table.tuples ), __ATOMIC_SEQ_CST );
+    retire_memory( table, old );
+    table->snapshot_dirty = false;
+  }
+  reclaim_retired_memory( table );
+}
+
+
+static match_snapshot *
+enter_match_snapshot( match_table *table, unsigned int *slot ) {
+  for ( ;; ) {
+    unsigned int epoch = __atomic_load_n( &table->epoch, __ATOMIC_SEQ_CST );
+    __atomic_add_fetch( &table->readers[ epoch & 1 ], 1, __ATOMIC_SEQ_CST );
+    if ( __atomic_load_n( &table->epoch, __ATOMIC_SEQ_CST ) == epoch ) {
+      *slot = epoch & 1;
+      return __atomic_load_n( &table->snapshot, __ATOMIC_SEQ_CST );
+    }
+    __atomic_sub_fetch( &table->readers[ epoch & 1 ], 1, __ATOMIC_SEQ_CST );
   }
+}
+
+
+static void
+exit_match_snapshot( match_table *table, unsigned int slot ) {
+  __atomic_sub_fetch( &table->readers[ slot ], 1, __ATOMIC_RELEASE );
+}
 
+
+static bool
+prefer_published_entry( published_entry *entry, published_entry *found ) {
+  return found == NULL || entry->priority > found->priority ||
+         ( entry->priority == found->priority && entry->sequence < found->sequence );
+}
+
+
+/*
+ * Tuple space search: one hash lookup per distinct set of wildcards,
+ * visiting the tuples in descending order of their highest priority
+ * and stopping once no remaining tuple can beat the best match. Ties
+ * go to the entry inserted first, as in the priority ordered list.
+ */
+static published_entry *
+lookup_published_entry( match_table *table, match_snapshot *snapshot, struct ofp_match *match ) {
+  struct ofp_match key;
+  if ( !exact_match( match ) ) {
+    // Wildcards in the key widen every entry, so masked keys cannot be hashed.
+    published_entry *found = NULL;
+    for ( unsigned int i = 0; i < snapshot->n_tuples; i++ ) {
+      published_slots *slots = __atomic_load_n( &snapshot->tuples[ i ].tuple->slots, __ATOMIC_SEQ_CST );
+      for ( unsigned int j = 0; j < slots->n_slots; j++ ) {
+        published_entry *entry = __atomic_load_n( &slots->slots[ j ], __ATOMIC_SEQ_CST );
+        for ( ; entry != NULL; entry = entry->next ) {
+          if ( compare_match( &entry->key, match ) && prefer_published_entry( entry, found ) ) {
+            found = entry;
+          }
+        }
+      }
+    }
+    return found;
+  }
+
+  mask_match( &key, match, 0 );
+  published_entry *found = lookup_published_tuple( table->exact, &key );
+  if ( found != NULL ) {
+    return found;
+  }
+
+  for ( unsigned int i = 0; i < snapshot->n_tuples; i++ ) {
+    published_tuple_ref *ref = &snapshot->tuples[ i ];
+    if ( found != NULL && ref->max_priority < found->priority ) {
+      break;
+    }
+    mask_match( &key, match, ref->tuple->wildcards );
+    published_entry *entry = lookup_published_tuple( ref->tuple, &key );
+    if ( entry != NULL && prefer_published_entry( entry, found ) ) {
+      found = entry;
+    }
+  }
+  return found;
+}
+
+
+static void
+publish_exact_match_entry( match_table *table, struct ofp_match *match ) {
+  struct ofp_match key;
+  mask_match( &key, match, 0 );
+  publish_match_entry( table, table->exact, &key, lookup_exact_match_strict_entry( table->exact_table, match ) );
+}
+
+
+/**
+ * Creates a new match table. Any number of match tables can be used
+ * at the same time.
+ *
+ * @return a new match_table.
+ */
+match_table *
+create_match_table( void ) {
   match_table *table = xmalloc( sizeof( match_table ) );
   init_exact_match_table( &table->exact_table );
   init_wildcards_match_table( &table->wildcards_table );
@@ -449,24 +1034,41 @@ init_match_table( void ) {
   pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
   table->mutex = xmalloc( sizeof( pthread_mutex_t ) );
   pthread_mutex_init( table->mutex, &attr );
-
-  _match_table_head = table;
+  table->exact = allocate_published_tuple( 0 );
+  table->snapshot = create_match_snapshot( NULL );
+  table->snapshot_dirty = false;
+  table->epoch = 0;
+  table->readers[ 0 ] = 0;
+  table->readers[ 1 ] = 0;
+  create_list( &table->retired[ 0 ] );
+  create_list( &table->retired[ 1 ] );
+
+  return table;
 }
 
 
+/**
+ * Deletes a match table. The data of the entries is not freed, and no
+ * other thread may be using the table.
+ *
+ * @param table a match_table.
+ */
 void
-finalize_match_table( void ) {
-  if ( _match_table_head == NULL ) {
-    die( "match table is not initialized." );
-  }
+delete_match_table( match_table *table ) {
+  assert( table != NULL );
 
-  pthread_mutex_t *mutex = _match_table_head->mutex;
+  pthread_mutex_t *mutex = table->mutex;
 
   pthread_mutex_lock( mutex );
-  finalize_exact_match_table( _match_table_head->exact_table );
-  finalize_wildcards_match_table( _match_table_head->wildcards_table );
-  xfree( _match_table_head );
-  _match_table_head = NULL;
+  finalize_exact_match_table( table->exact_table );
+  finalize_wildcards_match_table( &table->wildcards_table );
+  free_published_tuple( table->exact );
+  xfree( table->snapshot );
+  free_retired_memory( &table->retired[ 0 ] );
+  free_retired_memory( &table->retired[ 1 ] );
+  delete_list( table->retired[ 0 ] );
+  delete_list( table->retired[ 1 ] );
+  xfree( table );
   pthread_mutex_unlock( mutex );
   pthread_mutex_destroy( mutex );
   xfree( mutex );
@@ -474,102 +1076,208 @@ finalize_match_table( void ) {
 
 
 bool
-insert_match_entry( struct ofp_match match, uint16_t priority, void *data ) {
-  if ( _match_table_head == NULL ) {
-    die( "match table is not initialized." );
-  }
+insert_match_table_entry( match_table *table, struct ofp_match match, uint16_t priority, void *data ) {
+  assert( table != NULL );
 
-  pthread_mutex_lock( _match_table_head->mutex );
+  pthread_mutex_lock( table->mutex );
   bool result;
   if ( exact_match( &match ) ) {
-    result = insert_exact_match_entry( _match_table_head->exact_table, &match, data );
+    result = insert_exact_match_entry( table->exact_table, &match, data );
+    if ( result ) {
+      publish_exact_match_entry( table, &match );
+    }
   }
   else {
     // wildcards flags are set
-    result = insert_wildcards_match_entry( &_match_table_head->wildcards_table, &match, priority, data );
+    result = insert_wildcards_match_entry( table, &match, priority, data );
   }
-  pthread_mutex_unlock( _match_table_head->mutex );
+  commit_match_table_update( table );
+  pthread_mutex_unlock( table->mutex );
   return result;
 }
 
 
 void *
-lookup_match_strict_entry( struct ofp_match match, uint16_t priority ) {
-  if ( _match_table_head == NULL ) {
-    die( "match table is not initialized." );
-  }
+lookup_match_table_strict_entry( match_table *table, struct ofp_match match, uint16_t priority ) {
+  assert( table != NULL );
 
-  pthread_mutex_lock( _match_table_head->mutex );
+  pthread_mutex_lock( table->mutex );
   match_entry *entry;
   if ( exact_match( &match ) ) {
-    entry = lookup_exact_match_strict_entry( _match_table_head->exact_table, &match );
+    entry = lookup_exact_match_strict_entry( table->exact_table, &match );
   }
   else {
-    entry = lookup_wildcards_match_strict_entry( _match_table_head->wildcards_table, &match, priority );
+    entry = lookup_wildcards_match_strict_entry( &table->wildcards_table, &match, priority );
   }
   void *data = ( entry != NULL ? entry->data : NULL );
-  pthread_mutex_unlock( _match_table_head->mutex );
+  pthread_mutex_unlock( table->mutex );
   return data;
 }
 
 
+/**
+ * Looks up the entry that matches a packet. Exact match entries take
+ * precedence over wildcards entries, which are chosen by priority.
+ * This does not take the table lock, so it may run concurrently with
+ * updates from other threads.
+ *
+ * @param table a match_table.
+ * @param match the match built from a packet.
+ * @return the data of the matching entry, or NULL if there is none.
+ */
 void *
-lookup_match_entry( struct ofp_match match ) {
-  if ( _match_table_head == NULL ) {
-    die( "match table is not initialized." );
-  }
+lookup_match_table_entry( match_table *table, struct ofp_match match ) {
+  assert( table != NULL );
 
-  pthread_mutex_lock( _match_table_head->mutex );
-  match_entry *entry = lookup_exact_match_entry( _match_table_head->exact_table, &match );
-  if ( entry == NULL ) {
-    entry = lookup_wildcards_match_entry( _match_table_head->wildcards_table, &match );
-  }
+  unsigned int slot;
+  match_snapshot *snapshot = enter_match_snapshot( table, &slot );
+  published_entry *entry = lookup_published_entry( table, snapshot, &match );
   void *data = ( entry != NULL ? entry->data : NULL );
-  pthread_mutex_unlock( _match_table_head->mutex );
+  exit_match_snapshot( table, slot );
   return data;
 }
 
 
 bool
-update_match_entry( struct ofp_match match, uint16_t priority, void *data ) {
-  if ( _match_table_head == NULL ) {
-    die( "match table is not initialized." );
-  }
+update_match_table_entry( match_table *table, struct ofp_match match, uint16_t priority, void *data ) {
+  assert( table != NULL );
 
-  pthread_mutex_lock( _match_table_head->mutex );
+  pthread_mutex_lock( table->mutex );
   bool result;
   if ( exact_match( &match ) ) {
-    result = update_exact_match_entry( _match_table_head->exact_table, &match, data );
+    result = update_exact_match_entry( table->exact_table, &match, data );
+    if ( result ) {
+      publish_exact_match_entry( table, &match );
+    }
   }
   else {
     // wildcards flags are set
-    result = update_wildcards_match_entry( _match_table_head->wildcards_table, &match, priority, data );
+    result = update_wildcards_match_entry( table, &match, priority, data );
   }
-  pthread_mutex_unlock( _match_table_head->mutex );
+  commit_match_table_update( table );
+  pthread_mutex_unlock( table->mutex );
   return result;
 }
 
 
 void *
-delete_match_strict_entry( struct ofp_match match, uint16_t priority ) {
-  if ( _match_table_head == NULL ) {
-    die( "match table is not initialized." );
-  }
+delete_match_table_strict_entry( match_table *table, struct ofp_match match, uint16_t priority ) {
+  assert( table != NULL );
 
-  pthread_mutex_lock( _match_table_head->mutex );
+  pthread_mutex_lock( table->mutex );
   void *data = NULL;
   if ( exact_match( &match ) ) {
-    data = delete_exact_match_strict_entry( _match_table_head->exact_table, &match );
+    bool deleted = lookup_exact_match_strict_entry( table->exact_table, &match ) != NULL;
+    data = delete_exact_match_strict_entry( table->exact_table, &match );
+    if ( deleted ) {
+      publish_exact_match_entry( table, &match );
+    }
   }
   else {
     // wildcards flags are set
-    data = delete_wildcards_match_strict_entry( &_match_table_head->wildcards_table, &match, priority );
+    data = delete_wildcards_match_strict_entry( table, &match, priority );
   }
-  pthread_mutex_unlock( _match_table_head->mutex );
+  commit_match_table_update( table );
+  pthread_mutex_unlock( table->mutex );
   return data;
 }
 
 
+static void
+map_match_table_entries( match_table *table, struct ofp_match *match, void function( struct ofp_match match, uint16_t priority, void *data, void *user_data ), void *user_data ) {
+  assert( table != NULL );
+  assert( function != NULL );
+
+  pthread_mutex_lock( table->mutex );
+  map_exact_match_table( table->exact_table, match, function, user_data );
+  map_wildcards_match_table( &table->wildcards_table, match, function, user_data );
+  pthread_mutex_unlock( table->mutex );
+}
+
+
+void
+foreach_match_table_entry( match_table *table, void function( struct ofp_match match, uint16_t priority, void *data, void *user_data ), void *user_data ) {
+  map_match_table_entries( table, NULL, function, user_data );
+}
+
+
+void
+map_match_table_entry( match_table *table, struct ofp_match match, void function( struct ofp_match match, uint16_t priority, void *data, void *user_data ), void *user_data ) {
+  map_match_table_entries( table, &match, function, user_data );
+}
+
+
+void
+init_match_table( void ) {
+  if ( _match_table_head != NULL ) {
+    die( "match table is already initialized." );
+  }
+
+  _match_table_head = create_match_table();
+}
+
+
+void
+finalize_match_table( void ) {
+  if ( _match_table_head == NULL ) {
+    die( "match table is not initialized." );
+  }
+
+  delete_match_table( _match_table_head );
+  _match_table_head = NULL;
+}
+
+
+bool
+insert_match_entry( struct ofp_match match, uint16_t priority, void *data ) {
+  if ( _match_table_head == NULL ) {
+    die( "match table is not initialized." );
+  }
+
+  return insert_match_table_entry( _match_table_head, match, priority, data );
+}
+
+
+void *
+lookup_match_strict_entry( struct ofp_match match, uint16_t priority ) {
+  if ( _match_table_head == NULL ) {
+    die( "match table is not initialized." );
+  }
+
+  return lookup_match_table_strict_entry( _match_table_head, match, priority );
+}
+
+
+void *
+lookup_match_entry( struct ofp_match match ) {
+  if ( _match_table_head == NULL ) {
+    die( "match table is not initialized." );
+  }
+
+  return lookup_match_table_entry( _match_table_head, match );
+}
+
+
+bool
+update_match_entry( struct ofp_match match, uint16_t priority, void *data ) {
+  if ( _match_table_head == NULL ) {
+    die( "match table is not initialized." );
+  }
+
+  return update_match_table_entry( _match_table_head, match, priority, data );
+}
+
+
+void *
+delete_match_strict_entry( struct ofp_match match, uint16_t priority ) {
+  if ( _match_table_head == NULL ) {
+    die( "match table is not initialized." );
+  }
+
+  return delete_match_table_strict_entry( _match_table_head, match, priority );
+}
+
+
 static void
 _map_match_table( struct ofp_match *match, void function( struct ofp_match match, uint16_t priority, void *data, void *user_data ), void *user_data ) {
   if ( _match_table_head == NULL ) {
@@ -579,10 +1287,7 @@ _map_match_table( struct ofp_match *match, void function( struct ofp_match match
     die( "function must not be NULL" );
   }
 
-  pthread_mutex_lock( _match_table_head->mutex );
-  map_exact_match_table( _match_table_head->exact_table, match, function, user_data );
-  map_wildcards_match_table( _match_table_head->wildcards_table, match, function, user_data );
-  pthread_mutex_unlock( _match_table_head->mutex );
+  map_match_table_entries( _match_table_head, match, function, user_data );
 }
 
 
@@ -27,6 +27,20 @@
 #include "linked_list.h"
 
 
+typedef struct match_table match_table;
+
+
+match_table *create_match_table( void );
+void delete_match_table( match_table *table );
+bool insert_match_table_entry( match_table *table, struct ofp_match match, uint16_t priority, void *data );
+void *lookup_match_table_strict_entry( match_table *table, struct ofp_match match, uint16_t priority );
+void *lookup_match_table_entry( match_table *table, struct ofp_match match );
+bool update_match_table_entry( match_table *table, struct ofp_match match, uint16_t priority, void *data );
+void *delete_match_table_strict_entry( match_table *table, struct ofp_match match, uint16_t priority );
+void foreach_match_table_entry( match_table *table, void function( struct ofp_match match, uint16_t priority, void *data, void *user_data ), void *user_data );
+void map_match_table_entry( match_table *table, struct ofp_match match, void function( struct ofp_match match, uint16_t priority, void *data, void *user_data ), void *user_data );
+
+// The following operate on a process-wide match table.
 void init_match_table( void );
 void finalize_match_table( void );
 bool insert_match_entry( struct ofp_match match, uint16_t priority, void *data );
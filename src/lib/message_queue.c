@@ -21,6 +21,14 @@
 #include "message_queue.h"
 
 
+// Elements consumed by the reader are kept on a per-queue free list by
+// the writer instead of going back to the heap.
+#define MAX_FREE_ELEMENTS 64
+
+static uint64_t n_reused_elements = 0;
+static uint64_t n_allocated_elements = 0;
+
+
 message_queue *
 create_message_queue( void ) {
   message_queue *new_queue = xmalloc( sizeof( message_queue ) );
@@ -29,6 +37,8 @@ create_message_queue( void ) {
   new_queue->head->next = NULL;
   new_queue->divider = new_queue->tail = new_queue->head;
   new_queue->length = 0;
+  new_queue->free_elements = NULL;
+  new_queue->n_free_elements = 0;
 
   return new_queue;
 }
@@ -48,6 +58,11 @@ delete_message_queue( message_queue *queue ) {
     queue->head = queue->head->next;
     xfree( element );
   }
+  while ( queue->free_elements != NULL ) {
+    message_queue_element *element = queue->free_elements;
+    queue->free_elements = element->next;
+    xfree( element );
+  }
   xfree( queue );
 
   return true;
@@ -59,11 +74,35 @@ collect_garbage( message_queue *queue ) {
   while ( queue->head != queue->divider ) {
     message_queue_element *element = queue->head;
     queue->head = queue->head->next;
-    xfree( element );
+    if ( queue->n_free_elements < MAX_FREE_ELEMENTS ) {
+      element->next = queue->free_elements;
+      queue->free_elements = element;
+      queue->n_free_elements++;
+    }
+    else {
+      xfree( element );
+    }
   }
 }
 
 
+static message_queue_element *
+alloc_element( message_queue *queue ) {
+  collect_garbage( queue );
+
+  message_queue_element *element = queue->free_elements;
+  if ( element != NULL ) {
+    queue->free_elements = element->next;
+    queue->n_free_elements--;
+    __atomic_fetch_add( &n_reused_elements, 1, __ATOMIC_RELAXED );
+    return element;
+  }
+  __atomic_fetch_add( &n_allocated_elements, 1, __ATOMIC_RELAXED );
+
+  return xmalloc( sizeof( message_queue_element ) );
+}
+
+
 bool
 enqueue_message( message_queue *queue, buffer *message ) {
   if ( queue == NULL ) {
@@ -73,7 +112,7 @@ enqueue_message( message_queue *queue, buffer *message ) {
     die( "message must not be NULL" );
   }
 
-  message_queue_element *new_tail = xmalloc( sizeof( message_queue_element ) );
+  message_queue_element *new_tail = alloc_element( queue );
   new_tail->data = message;
   new_tail->next = NULL;
 
@@ -81,8 +120,6 @@ enqueue_message( message_queue *queue, buffer *message ) {
   queue->tail = new_tail;
   queue->length++;
 
-  collect_garbage( queue );
-
   return true;
 }
 
@@ -135,6 +172,15 @@ void foreach_message_queue( message_queue *queue, bool function( buffer *message
 }
 
 
+void
+foreach_message_queue_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  assert( function != NULL );
+
+  function( "message_queue.reused_elements", __atomic_load_n( &n_reused_elements, __ATOMIC_RELAXED ), user_data );
+  function( "message_queue.allocated_elements", __atomic_load_n( &n_allocated_elements, __ATOMIC_RELAXED ), user_data );
+}
+
+
 /*
  * Local variables:
  * c-basic-offset: 2
@@ -22,6 +22,7 @@
 #define MESSAGE_QUEUE_H
 
 
+#include <stdint.h>
 #include "bool.h"
 #include "buffer.h"
 
@@ -37,6 +38,8 @@ typedef struct {
   message_queue_element *divider;
   message_queue_element *tail;
   unsigned int length;
+  message_queue_element *free_elements;
+  unsigned int n_free_elements;
 } message_queue;
 
 
@@ -46,6 +49,7 @@ bool enqueue_message( message_queue *queue, buffer *message );
 buffer *dequeue_message( message_queue *queue );
 buffer *peek_message( message_queue *queue );
 void foreach_message_queue( message_queue *queue, bool function( buffer *message, void *user_data ), void *user_data );
+void foreach_message_queue_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
 
 
 #endif // MESSAGE_QUEUE_H
@@ -25,9 +25,11 @@
 #include <linux/sockios.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include "doubly_linked_list.h"
@@ -35,6 +37,7 @@
 #include "hash_table.h"
 #include "log.h"
 #include "messenger.h"
+#include "messenger_ring.h"
 #include "timer.h"
 #include "wrapper.h"
 
@@ -92,12 +95,30 @@ extern int mock_accept( int sockfd, struct sockaddr *addr, socklen_t *addrlen );
 #define recv mock_recv
 extern ssize_t mock_recv( int sockfd, void *buf, size_t len, int flags );
 
+#ifdef recvmsg
+#undef recvmsg
+#endif
+#define recvmsg mock_recvmsg
+extern ssize_t mock_recvmsg( int sockfd, struct msghdr *msg, int flags );
+
+#ifdef recvmmsg
+#undef recvmmsg
+#endif
+#define recvmmsg mock_recvmmsg
+extern int mock_recvmmsg( int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout );
+
 #ifdef send
 #undef send
 #endif
 #define send mock_send
 extern ssize_t mock_send( int sockfd, const void *buf, size_t len, int flags );
 
+#ifdef sendmmsg
+#undef sendmmsg
+#endif
+#define sendmmsg mock_sendmmsg
+extern int mock_sendmmsg( int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags );
+
 #ifdef setsockopt
 #undef setsockopt
 #endif
@@ -141,17 +162,35 @@ enum {
   MESSAGE_TYPE_NOTIFY,
   MESSAGE_TYPE_REQUEST,
   MESSAGE_TYPE_REPLY,
+  MESSAGE_TYPE_RING_SETUP,
+  // Only used to register batch callbacks; never sent.
+  MESSAGE_TYPE_NOTIFY_BATCH,
 };
 
+#define MESSENGER_RING_FDS 3
+#define MESSENGER_SEND_BATCH 16
+#define MESSENGER_RECV_BATCH 8
+
+// The data area is allocated on first use, grows up to max_size and is
+// released again by release_idle_message_buffers() once the queue drains.
 typedef struct message_buffer {
   void *buffer;
   size_t data_length;
   size_t size;
   size_t head_offset;
+  size_t max_size;
+  bool used;
+  size_t high_water;
+  uint64_t overflow_count;
+  uint64_t bytes;
 } message_buffer;
 
 typedef struct messenger_socket {
   int fd;
+  struct receive_queue *queue;
+  messenger_ring *ring;
+  bool dispatching;
+  bool closed;
 } messenger_socket;
 
 typedef struct messenger_context {
@@ -172,6 +211,12 @@ typedef struct receive_queue {
   struct sockaddr_un listen_addr;
   dlist_element *client_sockets;
   message_buffer *buffer;
+  int dispatching;
+  void *records;
+  int batch_callbacks;
+  messenger_message *batch;
+  size_t batch_count;
+  size_t batch_size;
 } receive_queue;
 
 typedef struct send_queue {
@@ -185,15 +230,28 @@ typedef struct send_queue {
   uint32_t overflow;
   uint64_t overflow_total_length;
   int socket_buffer_size;
+  messenger_ring *ring;
 } send_queue;
 
+typedef struct messenger_service {
+  char *service_name;           // NULL if the id is free
+  messenger_service_id id;
+  unsigned int references;
+  messenger_service_id next_free;
+  send_queue *send_queue;
+} messenger_service;
+
 
 #define MESSENGER_RECV_BUFFER 100000
-static const uint32_t messenger_send_queue_length = MESSENGER_RECV_BUFFER * 4;
+#define MESSENGER_QUEUE_INITIAL_SIZE 16384
+#define MESSENGER_QUEUE_IDLE_CHECK_INTERVAL 10
 static const uint32_t messenger_send_length_for_flush = MESSENGER_RECV_BUFFER;
 static const uint32_t messenger_bucket_size = MESSENGER_RECV_BUFFER;
-static const uint32_t messenger_recv_queue_length = MESSENGER_RECV_BUFFER * 2;
-static const uint32_t messenger_recv_queue_reserved = MESSENGER_RECV_BUFFER;
+static const size_t messenger_ring_size = 1048576;
+static size_t requested_send_queue_length = 0;
+static size_t requested_recv_queue_length = 0;
+static size_t messenger_send_queue_length = MESSENGER_DEFAULT_SEND_QUEUE_LENGTH;
+static size_t messenger_recv_queue_length = MESSENGER_DEFAULT_RECV_QUEUE_LENGTH;
 
 char socket_directory[ PATH_MAX ];
 static bool initialized = false;
@@ -204,11 +262,26 @@ static hash_table *context_db = NULL;
 static char *_dump_service_name = NULL;
 static char *_dump_app_name = NULL;
 static uint32_t last_transaction_id = 0;
+static messenger_transport requested_transport = MESSENGER_TRANSPORT_DEFAULT;
+static messenger_transport current_transport = MESSENGER_TRANSPORT_SOCKET;
+static int requested_batch_mode = -1;
+static bool batch_mode = false;
+static int flush_event_fd = -1;
+static const char *receiving_service_name = NULL;
+static hash_table *service_ids = NULL;
+static messenger_service **services = NULL;
+static messenger_service_id n_services = 0;
+static messenger_service_id services_size = 0;
+static messenger_service_id first_free_service = MESSENGER_INVALID_SERVICE_ID;
 
 static void on_accept( int fd, void *data );
 static void on_recv( int fd, void *data );
 static void on_send_write( int fd, void *data );
 static void on_send_read( int fd, void *data );
+static void on_send_ring_space( int fd, void *data );
+static void on_recv_ring( int fd, void *data );
+static void on_flush_send_queues( int fd, void *data );
+static void truncate_message_buffer( message_buffer *buf, size_t len );
 
 static void
 _delete_context( void *key, void *value, void *user_data ) {
@@ -256,6 +329,126 @@ age_context_db( void *user_data ) {
 }
 
 
+static messenger_transport
+resolve_messenger_transport() {
+  if ( requested_transport != MESSENGER_TRANSPORT_DEFAULT ) {
+    return requested_transport;
+  }
+
+  const char *transport = getenv( "TREMA_MESSENGER_TRANSPORT" );
+  if ( transport != NULL ) {
+    if ( strcasecmp( transport, "shm" ) == 0 ) {
+      return MESSENGER_TRANSPORT_SHARED_MEMORY;
+    }
+    if ( strcasecmp( transport, "socket" ) != 0 ) {
+      warn( "Unknown messenger transport ( %s ). Using socket.", transport );
+    }
+  }
+
+  return MESSENGER_TRANSPORT_SOCKET;
+}
+
+
+bool
+set_messenger_transport( messenger_transport transport ) {
+  if ( transport != MESSENGER_TRANSPORT_DEFAULT && transport != MESSENGER_TRANSPORT_SOCKET &&
+       transport != MESSENGER_TRANSPORT_SHARED_MEMORY ) {
+    error( "Invalid messenger transport ( %d ).", transport );
+    return false;
+  }
+  requested_transport = transport;
+  if ( initialized ) {
+    current_transport = resolve_messenger_transport();
+  }
+
+  return true;
+}
+
+
+messenger_transport
+get_messenger_transport() {
+  return current_transport;
+}
+
+
+static bool
+resolve_messenger_batch_mode() {
+  if ( requested_batch_mode >= 0 ) {
+    return requested_batch_mode != 0;
+  }
+
+  const char *batch = getenv( "TREMA_MESSENGER_BATCH" );
+  return batch != NULL && strcmp( batch, "1" ) == 0;
+}
+
+
+void
+set_messenger_batch_mode( bool enable ) {
+  requested_batch_mode = enable ? 1 : 0;
+  if ( initialized ) {
+    batch_mode = resolve_messenger_batch_mode();
+  }
+}
+
+
+bool
+get_messenger_batch_mode() {
+  return batch_mode;
+}
+
+
+static size_t
+resolve_messenger_queue_length( size_t requested, const char *name, size_t default_length ) {
+  if ( requested != 0 ) {
+    return requested;
+  }
+
+  const char *length = getenv( name );
+  if ( length != NULL ) {
+    char *end;
+    unsigned long long value = strtoull( length, &end, 0 );
+    if ( *length != '\0' && *end == '\0' && value >= MESSENGER_MIN_QUEUE_LENGTH ) {
+      return ( size_t ) value;
+    }
+    warn( "Invalid %s ( %s ). Using %zu.", name, length, default_length );
+  }
+
+  return default_length;
+}
+
+
+bool
+set_messenger_queue_length( size_t send_queue_length, size_t recv_queue_length ) {
+  if ( ( send_queue_length != 0 && send_queue_length < MESSENGER_MIN_QUEUE_LENGTH ) ||
+       ( recv_queue_length != 0 && recv_queue_length < MESSENGER_MIN_QUEUE_LENGTH ) ) {
+    error( "Messenger queue length must be at least %d bytes ( send = %zu, recv = %zu ).",
+           MESSENGER_MIN_QUEUE_LENGTH, send_queue_length, recv_queue_length );
+    return false;
+  }
+  requested_send_queue_length = send_queue_length;
+  requested_recv_queue_length = recv_queue_length;
+  if ( initialized ) {
+    messenger_send_queue_length = resolve_messenger_queue_length( requested_send_queue_length, "TREMA_MESSENGER_SEND_QUEUE_LENGTH",
+                                                                  MESSENGER_DEFAULT_SEND_QUEUE_LENGTH );
+    messenger_recv_queue_length = resolve_messenger_queue_length( requested_recv_queue_length, "TREMA_MESSENGER_RECV_QUEUE_LENGTH",
+                                                                  MESSENGER_DEFAULT_RECV_QUEUE_LENGTH );
+  }
+
+  return true;
+}
+
+
+void
+get_messenger_queue_length( size_t *send_queue_length, size_t *recv_queue_length ) {
+  if ( send_queue_length != NULL ) {
+    *send_queue_length = messenger_send_queue_length;
+  }
+  if ( recv_queue_length != NULL ) {
+    *recv_queue_length = messenger_recv_queue_length;
+  }
+}
+
+
 bool
 init_messenger( const char *working_directory ) {
   assert( working_directory != NULL );
@@ -268,9 +461,15 @@ init_messenger( const char *working_directory ) {
   }
 
   strcpy( socket_directory, working_directory );
-
-  receive_queues = create_hash_with_size( compare_string, hash_string, 8 );
-  send_queues = create_hash_with_size( compare_string, hash_string, 8 );
+  current_transport = resolve_messenger_transport();
+  batch_mode = resolve_messenger_batch_mode();
+  messenger_send_queue_length = resolve_messenger_queue_length( requested_send_queue_length, "TREMA_MESSENGER_SEND_QUEUE_LENGTH",
+                                                                MESSENGER_DEFAULT_SEND_QUEUE_LENGTH );
+  messenger_recv_queue_length = resolve_messenger_queue_length( requested_recv_queue_length, "TREMA_MESSENGER_RECV_QUEUE_LENGTH",
+                                                                MESSENGER_DEFAULT_RECV_QUEUE_LENGTH );
+
+  receive_queues = create_small_hash( compare_string, hash_string );
+  send_queues = create_small_hash( compare_string, hash_string );
   context_db = create_hash_with_size( compare_uint32, hash_uint32, 128 );
 
   initialized = true;
@@ -303,10 +502,43 @@ free_message_buffer( message_buffer *buf ) {
 
 static void *
 get_message_buffer_head( message_buffer *buf ) {
+  if ( buf->buffer == NULL ) {
+    return NULL;
+  }
   return ( char * ) buf->buffer + buf->head_offset;
 }
 
 
+static void
+stop_send_ring( send_queue *sq ) {
+  assert( sq != NULL );
+
+  if ( sq->ring == NULL ) {
+    return;
+  }
+
+  debug( "Deleting a messenger ring ( service_name = %s, fd = %d ).", sq->service_name, sq->server_socket );
+
+  set_readable( sq->ring->space_event_fd, false );
+  delete_fd_handler( sq->ring->space_event_fd );
+  delete_messenger_ring( sq->ring );
+  sq->ring = NULL;
+}
+
+
+static void
+free_client_socket( messenger_socket *socket ) {
+  assert( socket != NULL );
+
+  if ( socket->ring != NULL ) {
+    set_readable( socket->ring->data_event_fd, false );
+    delete_fd_handler( socket->ring->data_event_fd );
+    delete_messenger_ring( socket->ring );
+  }
+  xfree( socket );
+}
+
+
 static void
 delete_send_queue( send_queue *sq ) {
   assert( NULL != sq );
@@ -314,6 +546,7 @@ delete_send_queue( send_queue *sq ) {
   debug( "Deleting a send queue ( service_name = %s, fd = %d ).", sq->service_name, sq->server_socket );
 
   free_message_buffer( sq->buffer );
+  stop_send_ring( sq );
   if ( sq->server_socket != -1 ) {
     set_readable( sq->server_socket, false );
     set_writable( sq->server_socket, false );
@@ -327,6 +560,12 @@ delete_send_queue( send_queue *sq ) {
   else {
     error( "All send queues are already deleted or not created yet." );
   }
+  if ( service_ids != NULL ) {
+    messenger_service *service = lookup_hash_entry( service_ids, sq->service_name );
+    if ( service != NULL && service->send_queue == sq ) {
+      service->send_queue = NULL;
+    }
+  }
   xfree( sq );
 }
 
@@ -441,7 +680,7 @@ delete_receive_queue( void *service_name, void *_rq, void *user_data ) {
     delete_fd_handler( client_socket->fd );
 
     close( client_socket->fd );
-    xfree( client_socket );
+    free_client_socket( client_socket );
     send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
   }
   delete_dlist( rq->client_sockets );
@@ -451,6 +690,8 @@ delete_receive_queue( void *service_name, void *_rq, void *user_data ) {
 
   close( rq->listen_socket );
   free_message_buffer( rq->buffer );
+  xfree( rq->records );
+  xfree( rq->batch );
   unlink( rq->listen_addr.sun_path );
 
   if ( receive_queues != NULL ) {
@@ -478,6 +719,145 @@ delete_all_receive_queues() {
 }
 
 
+/**
+ * interns a service name and takes a reference to it. The id stays valid
+ * until the reference is released with release_messenger_service_id().
+ */
+messenger_service_id
+get_messenger_service_id( const char *service_name ) {
+  assert( service_name != NULL );
+
+  if ( service_ids == NULL ) {
+    service_ids = create_small_hash( compare_string, hash_string );
+    n_services = 1; // 0 is MESSENGER_INVALID_SERVICE_ID
+  }
+  messenger_service *service = lookup_hash_entry( service_ids, service_name );
+  if ( service != NULL ) {
+    service->references++;
+    return service->id;
+  }
+
+  if ( first_free_service != MESSENGER_INVALID_SERVICE_ID ) {
+    service = services[ first_free_service ];
+    first_free_service = service->next_free;
+  }
+  else {
+    if ( n_services >= services_size ) {
+      messenger_service **old_services = services;
+      services_size = services_size == 0 ? 16 : services_size * 2;
+      services = xmalloc( sizeof( messenger_service * ) * services_size );
+      if ( old_services != NULL ) {
+        memcpy( services, old_services, sizeof( messenger_service * ) * n_services );
+        xfree( old_services );
+      }
+    }
+    service = xmalloc( sizeof( messenger_service ) );
+    service->id = n_services++;
+    services[ service->id ] = service;
+  }
+  service->service_name = xstrdup( service_name );
+  service->references = 1;
+  service->next_free = MESSENGER_INVALID_SERVICE_ID;
+  service->send_queue = NULL;
+  if ( send_queues != NULL ) {
+    service->send_queue = lookup_hash_entry( send_queues, service_name );
+  }
+  insert_hash_entry( service_ids, service->service_name, service );
+
+  debug( "Service name interned ( service_name = %s, id = %u ).", service_name, service->id );
+
+  return service->id;
+}
+
+
+static messenger_service *
+lookup_messenger_service( messenger_service_id id ) {
+  if ( id == MESSENGER_INVALID_SERVICE_ID || id >= n_services ) {
+    return NULL;
+  }
+  messenger_service *service = services[ id ];
+  if ( service->service_name == NULL ) {
+    return NULL;
+  }
+
+  return service;
+}
+
+
+/**
+ * takes another reference to an interned service name, e.g., for a copy
+ * of the id that outlives the reference it was copied from.
+ */
+void
+retain_messenger_service_id( messenger_service_id id ) {
+  messenger_service *service = lookup_messenger_service( id );
+  if ( service == NULL ) {
+    error( "Invalid messenger service id ( id = %u ).", id );
+    return;
+  }
+  service->references++;
+}
+
+
+/**
+ * releases a reference taken by get_messenger_service_id() or
+ * retain_messenger_service_id(). The id is reused for another service name
+ * once its last reference is released. Releasing MESSENGER_INVALID_SERVICE_ID
+ * or after the messenger is finalized does nothing.
+ */
+void
+release_messenger_service_id( messenger_service_id id ) {
+  if ( id == MESSENGER_INVALID_SERVICE_ID || service_ids == NULL ) {
+    return;
+  }
+  messenger_service *service = lookup_messenger_service( id );
+  if ( service == NULL ) {
+    error( "Invalid messenger service id ( id = %u ).", id );
+    return;
+  }
+  if ( --service->references > 0 ) {
+    return;
+  }
+
+  debug( "Service name released ( service_name = %s, id = %u ).", service->service_name, id );
+
+  delete_hash_entry( service_ids, service->service_name );
+  xfree( service->service_name );
+  service->service_name = NULL;
+  service->send_queue = NULL;
+  service->next_free = first_free_service;
+  first_free_service = id;
+}
+
+
+const char *
+get_messenger_service_name( messenger_service_id id ) {
+  messenger_service *service = lookup_messenger_service( id );
+  if ( service == NULL ) {
+    return NULL;
+  }
+  return service->service_name;
+}
+
+
+static void
+delete_messenger_services() {
+  for ( messenger_service_id id = 1; id < n_services; id++ ) {
+    if ( services[ id ]->service_name != NULL ) {
+      xfree( services[ id ]->service_name );
+    }
+    xfree( services[ id ] );
+  }
+  xfree( services );
+  services = NULL;
+  n_services = 0;
+  services_size = 0;
+  first_free_service = MESSENGER_INVALID_SERVICE_ID;
+  delete_hash( service_ids );
+  service_ids = NULL;
+}
+
+
 bool
 finalize_messenger() {
   debug( "Finalizing messenger." );
@@ -503,6 +883,15 @@ finalize_messenger() {
   if ( context_db != NULL ) {
     delete_context_db();
   }
+  if ( service_ids != NULL ) {
+    delete_messenger_services();
+  }
+  if ( flush_event_fd != -1 ) {
+    set_writable( flush_event_fd, false );
+    delete_fd_handler( flush_event_fd );
+    close( flush_event_fd );
+    flush_event_fd = -1;
+  }
 
   initialized = false;
   finalized = true;
@@ -514,15 +903,69 @@ finalize_messenger() {
 
 
 static message_buffer *
-create_message_buffer( size_t size ) {
+create_message_buffer( size_t max_size ) {
   message_buffer *buf = xmalloc( sizeof( message_buffer ) );
+  memset( buf, 0, sizeof( message_buffer ) );
+
+  buf->buffer = NULL;
+  buf->max_size = max_size;
+
+  return buf;
+}
+
+
+/**
+ * reallocates the data area so that at least length bytes fit, doubling
+ * the size up to max_size. queued data is moved to the front.
+ */
+static bool
+grow_message_buffer( message_buffer *buf, size_t length ) {
+  assert( buf != NULL );
+
+  if ( length > buf->max_size ) {
+    return false;
+  }
+
+  size_t size = buf->size > 0 ? buf->size : MESSENGER_QUEUE_INITIAL_SIZE;
+  while ( size < length ) {
+    size <<= 1;
+  }
+  if ( size > buf->max_size ) {
+    size = buf->max_size;
+  }
 
-  buf->buffer = xmalloc( size );
+  void *new_buffer = xmalloc( size );
+  if ( buf->data_length > 0 ) {
+    memcpy( new_buffer, get_message_buffer_head( buf ), buf->data_length );
+  }
+  xfree( buf->buffer );
+  buf->buffer = new_buffer;
   buf->size = size;
-  buf->data_length = 0;
   buf->head_offset = 0;
 
-  return buf;
+  return true;
+}
+
+
+static void
+release_message_buffer( message_buffer *buf ) {
+  assert( buf != NULL );
+  assert( buf->data_length == 0 );
+
+  xfree( buf->buffer );
+  buf->buffer = NULL;
+  buf->size = 0;
+  buf->head_offset = 0;
+}
+
+
+static void
+update_message_buffer_stats( message_buffer *buf, size_t length ) {
+  buf->used = true;
+  buf->bytes += length;
+  if ( buf->data_length > buf->high_water ) {
+    buf->high_water = buf->data_length;
+  }
 }
 
 
@@ -591,6 +1034,12 @@ create_receive_queue( const char *service_name ) {
   rq->message_callbacks = create_dlist();
   rq->client_sockets = create_dlist();
   rq->buffer = create_message_buffer( messenger_recv_queue_length );
+  rq->dispatching = 0;
+  rq->records = NULL;
+  rq->batch_callbacks = 0;
+  rq->batch = NULL;
+  rq->batch_count = 0;
+  rq->batch_size = 0;
 
   insert_hash_entry( receive_queues, rq->service_name, rq );
 
@@ -632,6 +1081,9 @@ add_message_callback( const char *service_name, uint8_t message_type, void *call
   cb->message_type = message_type;
   cb->function = callback;
   insert_after_dlist( rq->message_callbacks, cb );
+  if ( message_type == MESSAGE_TYPE_NOTIFY_BATCH ) {
+    rq->batch_callbacks++;
+  }
 
   return true;
 }
@@ -650,6 +1102,19 @@ _add_message_received_callback( const char *service_name, const callback_message
 bool ( *add_message_received_callback )( const char *service_name, const callback_message_received function ) = _add_message_received_callback;
 
 
+static bool
+_add_message_batch_received_callback( const char *service_name, const callback_message_batch_received callback ) {
+  assert( service_name != NULL );
+  assert( callback != NULL );
+
+  debug( "Adding a message batch received callback ( service_name = %s, callback = %p ).",
+         service_name, callback );
+
+  return add_message_callback( service_name, MESSAGE_TYPE_NOTIFY_BATCH, callback );
+}
+bool ( *add_message_batch_received_callback )( const char *service_name, const callback_message_batch_received function ) = _add_message_batch_received_callback;
+
+
 static bool
 _add_message_requested_callback( const char *service_name,
                                  void ( *callback )( const messenger_context_handle *handle, uint16_t tag, void *data, size_t len ) ) {
@@ -701,6 +1166,9 @@ delete_message_callback( const char *service_name, uint8_t message_type, void (
         debug( "Deleting a callback ( message_type = %#x, callback = %p ).", message_type, callback );
         xfree( cb );
         delete_dlist_element( e );
+        if ( message_type == MESSAGE_TYPE_NOTIFY_BATCH ) {
+          rq->batch_callbacks--;
+        }
         if ( rq->message_callbacks->next == NULL ) {
           debug( "No more callback for message_type = %#x.", message_type );
           delete_receive_queue( rq->service_name, rq, NULL );
@@ -729,6 +1197,19 @@ _delete_message_received_callback( const char *service_name, void ( *callback )(
 bool ( *delete_message_received_callback )( const char *service_name, void ( *callback )( uint16_t tag, void *data, size_t len ) ) = _delete_message_received_callback;
 
 
+static bool
+_delete_message_batch_received_callback( const char *service_name, const callback_message_batch_received callback ) {
+  assert( service_name != NULL );
+  assert( callback != NULL );
+
+  debug( "Deleting a message batch received callback ( service_name = %s, callback = %p ).",
+         service_name, callback );
+
+  return delete_message_callback( service_name, MESSAGE_TYPE_NOTIFY_BATCH, callback );
+}
+bool ( *delete_message_batch_received_callback )( const char *service_name, const callback_message_batch_received function ) = _delete_message_batch_received_callback;
+
+
 static bool
 _delete_message_requested_callback( const char *service_name,
   void ( *callback )( const messenger_context_handle *handle, uint16_t tag, void *data, size_t len ) ) {
@@ -814,11 +1295,94 @@ _rename_message_requested_callback( const char *old_service_name, const char *ne
 bool ( *rename_message_requested_callback )( const char *old_service_name, const char *new_service_name ) = _rename_message_requested_callback;
 
 
-static size_t
-message_buffer_remain_bytes( message_buffer *buf ) {
-  assert( buf != NULL );
+/**
+ * hands a shared memory ring over to the receiver. messages are written
+ * to the ring from then on, and the socket is only used to detect that
+ * the receiver went away.
+ */
+static bool
+start_send_ring( send_queue *sq ) {
+  assert( sq != NULL );
+  assert( sq->ring == NULL );
+
+  messenger_ring *ring = create_messenger_ring( messenger_ring_size );
+  if ( ring == NULL ) {
+    warn( "Falling back to socket transport ( service_name = %s ).", sq->service_name );
+    return false;
+  }
+
+  message_header header;
+  header.version = 0;
+  header.message_type = MESSAGE_TYPE_RING_SETUP;
+  header.tag = 0;
+  header.message_length = htonl( sizeof( message_header ) );
+
+  int fds[ MESSENGER_RING_FDS ] = { ring->memory_fd, ring->data_event_fd, ring->space_event_fd };
+  union {
+    struct cmsghdr align;
+    char buf[ CMSG_SPACE( sizeof( fds ) ) ];
+  } control;
+  struct iovec iov = { &header, sizeof( header ) };
+  struct msghdr msg;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof( control.buf );
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN( sizeof( fds ) );
+  memcpy( CMSG_DATA( cmsg ), fds, sizeof( fds ) );
+
+  if ( sendmsg( sq->server_socket, &msg, MSG_DONTWAIT ) != ( ssize_t ) sizeof( header ) ) {
+    warn( "Failed to set up a messenger ring. Falling back to socket transport ( service_name = %s, errno = %s [%d] ).",
+          sq->service_name, strerror( errno ), errno );
+    delete_messenger_ring( ring );
+    return false;
+  }
+
+  debug( "Messenger ring is set up ( service_name = %s, fd = %d ).", sq->service_name, sq->server_socket );
+
+  sq->ring = ring;
+  set_fd_handler( ring->space_event_fd, on_send_ring_space, sq, NULL, NULL );
+  set_readable( ring->space_event_fd, true );
+
+  return true;
+}
 
-  return buf->size - buf->data_length;
+
+static void
+flush_send_queue_to_ring( send_queue *sq ) {
+  assert( sq != NULL );
+  assert( sq->ring != NULL );
+
+  size_t sent_total = 0;
+  while ( ( sq->buffer->data_length - sent_total ) >= sizeof( message_header ) ) {
+    message_header *header = ( message_header * ) ( ( char * ) get_message_buffer_head( sq->buffer ) + sent_total );
+    uint32_t length = ntohl( header->message_length );
+    void *p = reserve_messenger_ring( sq->ring, length );
+    if ( p == NULL ) {
+      // on_send_ring_space() is called once the receiver makes room.
+      break;
+    }
+    memcpy( p, header, length );
+    commit_messenger_ring( sq->ring, length );
+    send_dump_message( MESSENGER_DUMP_SENT, sq->service_name, p, length );
+    sent_total += length;
+  }
+  truncate_message_buffer( sq->buffer, sent_total );
+}
+
+
+static void
+on_send_ring_space( int fd, void *data ) {
+  send_queue *sq = ( send_queue * ) data;
+
+  assert( sq != NULL );
+
+  clear_messenger_ring_event( fd );
+  flush_send_queue_to_ring( sq );
 }
 
 
@@ -868,8 +1432,17 @@ send_queue_connect( send_queue *sq ) {
   set_fd_handler( sq->server_socket, on_send_read, sq, &on_send_write, sq );
   set_readable( sq->server_socket, true );
 
+  if ( current_transport == MESSENGER_TRANSPORT_SHARED_MEMORY ) {
+    start_send_ring( sq );
+  }
+
   if ( sq->buffer != NULL && sq->buffer->data_length >= sizeof( message_header ) ) {
-    set_writable( sq->server_socket, true );
+    if ( sq->ring != NULL ) {
+      flush_send_queue_to_ring( sq );
+    }
+    else {
+      set_writable( sq->server_socket, true );
+    }
   }
 
   debug( "Connection established ( service_name = %s, sun_path = %s, fd = %d ).",
@@ -994,6 +1567,7 @@ create_send_queue( const char *service_name ) {
   sq->overflow = 0;
   sq->overflow_total_length = 0;
   sq->socket_buffer_size = 0;
+  sq->ring = NULL;
 
   if ( send_queue_try_connect( sq ) == -1 ) {
     xfree( sq );
@@ -1009,62 +1583,83 @@ create_send_queue( const char *service_name ) {
 }
 
 
+static void *reserve_message_buffer( message_buffer *buf, size_t len, bool movable );
+
+
 static bool
 write_message_buffer( message_buffer *buf, const void *data, size_t len ) {
   assert( buf != NULL );
 
-  if ( message_buffer_remain_bytes( buf ) < len ) {
+  void *p = reserve_message_buffer( buf, len, true );
+  if ( p == NULL ) {
     return false;
   }
-
-  if ( ( buf->head_offset + buf->data_length + len ) <= buf->size ) {
-    memcpy( ( char * ) get_message_buffer_head( buf ) + buf->data_length, data, len );
-  }
-  else {
-    memmove( buf->buffer, ( char * ) get_message_buffer_head( buf ), buf->data_length );
-    buf->head_offset = 0;
-    memcpy( ( char * ) buf->buffer + buf->data_length, data, len );
-  }
+  memcpy( p, data, len );
   buf->data_length += len;
+  update_message_buffer_stats( buf, len );
 
   return true;
 }
 
 
-static bool
-push_message_to_send_queue( const char *service_name, const uint8_t message_type, const uint16_t tag, const void *data, size_t len ) {
-  assert( service_name != NULL );
+/**
+ * writes send queues in a single pass at the end of the event loop
+ * iteration instead of waiting for each socket to become writable.
+ * flush_event_fd is never written, so it is always writable.
+ */
+static bool
+schedule_send_queue_flush() {
+  if ( flush_event_fd == -1 ) {
+    flush_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( flush_event_fd == -1 ) {
+      error( "Failed to create an eventfd ( errno = %s [%d] ).", strerror( errno ), errno );
+      return false;
+    }
+    set_fd_handler( flush_event_fd, NULL, NULL, on_flush_send_queues, NULL );
+  }
+  set_writable( flush_event_fd, true );
 
-  debug( "Pushing a message to send queue ( service_name = %s, message_type = %#x, tag = %#x, data = %p, len = %zu ).",
-         service_name, message_type, tag, data, len );
+  return true;
+}
 
-  message_header header;
 
-  if ( send_queues == NULL ) {
-    error( "All send queues are already deleted or not created yet." );
-    return false;
-  }
-
-  send_queue *sq = lookup_hash_entry( send_queues, service_name );
+static bool
+push_message_iov( send_queue *sq, const uint8_t message_type, const uint16_t tag, const struct iovec *iov, int iovcnt ) {
+  assert( sq != NULL );
+  assert( iov != NULL || iovcnt == 0 );
 
-  if ( NULL == sq ) {
-    sq = create_send_queue( service_name );
-    assert( sq != NULL );
+  size_t len = 0;
+  for ( int i = 0; i < iovcnt; i++ ) {
+    len += iov[ i ].iov_len;
   }
 
+  debug( "Pushing a message to send queue ( service_name = %s, message_type = %#x, tag = %#x, iovcnt = %d, len = %zu ).",
+         sq->service_name, message_type, tag, iovcnt, len );
+
+  message_header header;
   header.version = 0;
   header.message_type = message_type;
   header.tag = htons( tag );
   uint32_t length = ( uint32_t ) ( sizeof( message_header ) + len );
   header.message_length = htonl( length );
 
-  if ( message_buffer_remain_bytes( sq->buffer ) < length ) {
+  if ( length > sq->buffer->max_size ) {
+    error( "Message is longer than send queue ( service_name = %s, length = %u, max_size = %zu ).",
+           sq->service_name, length, sq->buffer->max_size );
+    // Retrying would never succeed.
+    errno = EMSGSIZE;
+    return false;
+  }
+  if ( sq->buffer->data_length + length > sq->buffer->max_size ) {
+    ++sq->buffer->overflow_count;
     if ( sq->overflow == 0 ) {
       warn( "Could not write a message to send queue due to overflow ( service_name = %s, fd = %u, length = %u ).", sq->service_name, sq->server_socket, length );
     }
     ++sq->overflow;
     sq->overflow_total_length += length;
     send_dump_message( MESSENGER_DUMP_SEND_OVERFLOW, sq->service_name, NULL, 0 );
+    // The message is not queued, so the caller may try again later.
+    errno = EAGAIN;
     return false;
   }
   if ( sq->overflow > 1 ) {
@@ -1073,8 +1668,32 @@ push_message_to_send_queue( const char *service_name, const uint8_t message_type
   sq->overflow = 0;
   sq->overflow_total_length = 0;
 
+  if ( sq->ring != NULL && sq->buffer->data_length == 0 ) {
+    char *p = reserve_messenger_ring( sq->ring, length );
+    if ( p != NULL ) {
+      memcpy( p, &header, sizeof( message_header ) );
+      size_t offset = sizeof( message_header );
+      for ( int i = 0; i < iovcnt; i++ ) {
+        memcpy( p + offset, iov[ i ].iov_base, iov[ i ].iov_len );
+        offset += iov[ i ].iov_len;
+      }
+      commit_messenger_ring( sq->ring, length );
+      update_message_buffer_stats( sq->buffer, length );
+      send_dump_message( MESSENGER_DUMP_SENT, sq->service_name, p, length );
+      return true;
+    }
+  }
+
+  // Makes room for the whole message at once so that the pieces below are not copied twice.
+  if ( reserve_message_buffer( sq->buffer, length, true ) == NULL ) {
+    error( "Failed to reserve send queue ( service_name = %s, length = %u ).", sq->service_name, length );
+    errno = ENOBUFS;
+    return false;
+  }
   write_message_buffer( sq->buffer, &header, sizeof( message_header ) );
-  write_message_buffer( sq->buffer, data, len );
+  for ( int i = 0; i < iovcnt; i++ ) {
+    write_message_buffer( sq->buffer, iov[ i ].iov_base, iov[ i ].iov_len );
+  }
 
   if ( sq->server_socket == -1 ) {
     debug( "Tried to send message on closed send queue, connecting..." );
@@ -1083,7 +1702,14 @@ push_message_to_send_queue( const char *service_name, const uint8_t message_type
     return true;
   }
 
-  set_writable( sq->server_socket, true );
+  if ( sq->ring != NULL ) {
+    flush_send_queue_to_ring( sq );
+    return true;
+  }
+
+  if ( !batch_mode || !schedule_send_queue_flush() ) {
+    set_writable( sq->server_socket, true );
+  }
   if ( sq->buffer->data_length > messenger_send_length_for_flush ) {
     on_send_write( sq->server_socket, sq );
   }
@@ -1091,6 +1717,61 @@ push_message_to_send_queue( const char *service_name, const uint8_t message_type
 }
 
 
+static bool
+push_message_iov_to_send_queue( const char *service_name, const uint8_t message_type, const uint16_t tag, const struct iovec *iov, int iovcnt ) {
+  assert( service_name != NULL );
+
+  if ( send_queues == NULL ) {
+    error( "All send queues are already deleted or not created yet." );
+    errno = ENOTCONN;
+    return false;
+  }
+
+  send_queue *sq = lookup_hash_entry( send_queues, service_name );
+
+  if ( NULL == sq ) {
+    sq = create_send_queue( service_name );
+    assert( sq != NULL );
+  }
+
+  return push_message_iov( sq, message_type, tag, iov, iovcnt );
+}
+
+
+static bool
+push_message_iov_to_handle( messenger_service_id id, const uint8_t message_type, const uint16_t tag, const struct iovec *iov, int iovcnt ) {
+  messenger_service *service = lookup_messenger_service( id );
+  if ( service == NULL ) {
+    error( "Invalid messenger service id ( id = %u ).", id );
+    errno = EINVAL;
+    return false;
+  }
+  if ( send_queues == NULL ) {
+    error( "All send queues are already deleted or not created yet." );
+    errno = ENOTCONN;
+    return false;
+  }
+
+  if ( service->send_queue == NULL ) {
+    service->send_queue = lookup_hash_entry( send_queues, service->service_name );
+    if ( service->send_queue == NULL ) {
+      service->send_queue = create_send_queue( service->service_name );
+      assert( service->send_queue != NULL );
+    }
+  }
+
+  return push_message_iov( service->send_queue, message_type, tag, iov, iovcnt );
+}
+
+
+static bool
+push_message_to_send_queue( const char *service_name, const uint8_t message_type, const uint16_t tag, const void *data, size_t len ) {
+  struct iovec iov = { ( void * ) ( uintptr_t ) data, len };
+
+  return push_message_iov_to_send_queue( service_name, message_type, tag, &iov, 1 );
+}
+
+
 static bool
 _send_message( const char *service_name, const uint16_t tag, const void *data, size_t len ) {
   assert( service_name != NULL );
@@ -1103,6 +1784,34 @@ _send_message( const char *service_name, const uint16_t tag, const void *data, s
 bool ( *send_message )( const char *service_name, const uint16_t tag, const void *data, size_t len ) = _send_message;
 
 
+static bool
+_send_message_iov( const char *service_name, const uint16_t tag, const struct iovec *iov, int iovcnt ) {
+  assert( service_name != NULL );
+
+  debug( "Sending a message ( service_name = %s, tag = %#x, iov = %p, iovcnt = %d ).",
+         service_name, tag, iov, iovcnt );
+
+  return push_message_iov_to_send_queue( service_name, MESSAGE_TYPE_NOTIFY, tag, iov, iovcnt );
+}
+bool ( *send_message_iov )( const char *service_name, const uint16_t tag, const struct iovec *iov, int iovcnt ) = _send_message_iov;
+
+
+static bool
+_send_message_to_handle( messenger_service_id id, const uint16_t tag, const void *data, size_t len ) {
+  struct iovec iov = { ( void * ) ( uintptr_t ) data, len };
+
+  return push_message_iov_to_handle( id, MESSAGE_TYPE_NOTIFY, tag, &iov, 1 );
+}
+bool ( *send_message_to_handle )( messenger_service_id id, const uint16_t tag, const void *data, size_t len ) = _send_message_to_handle;
+
+
+static bool
+_send_message_iov_to_handle( messenger_service_id id, const uint16_t tag, const struct iovec *iov, int iovcnt ) {
+  return push_message_iov_to_handle( id, MESSAGE_TYPE_NOTIFY, tag, iov, iovcnt );
+}
+bool ( *send_message_iov_to_handle )( messenger_service_id id, const uint16_t tag, const struct iovec *iov, int iovcnt ) = _send_message_iov_to_handle;
+
+
 static messenger_context *
 insert_context( void *user_data ) {
   messenger_context *context = xmalloc( sizeof( messenger_context ) );
@@ -1278,6 +1987,10 @@ add_recv_queue_client_fd( receive_queue *rq, int fd ) {
 
   socket = xmalloc( sizeof( messenger_socket ) );
   socket->fd = fd;
+  socket->queue = rq;
+  socket->ring = NULL;
+  socket->dispatching = false;
+  socket->closed = false;
   insert_after_dlist( rq->client_sockets, socket );
 
   set_fd_handler( fd, on_recv, rq, NULL, NULL );
@@ -1322,6 +2035,8 @@ on_accept( int fd, void *data ) {
 }
 
 
+static void dispatch_recv_ring( messenger_socket *socket );
+
 static int
 del_recv_queue_client_fd( receive_queue *rq, int fd ) {
   assert( rq != NULL );
@@ -1337,10 +2052,20 @@ del_recv_queue_client_fd( receive_queue *rq, int fd ) {
     if ( socket->fd == fd ) {
       set_readable( fd, false );
       delete_fd_handler( fd );
+      socket->fd = -1;
+
+      if ( socket->ring != NULL ) {
+        // Delivers messages the peer wrote before closing the connection.
+        dispatch_recv_ring( socket );
+        if ( socket->dispatching ) {
+          socket->closed = true;
+          return 1;
+        }
+      }
 
       debug( "Deleting fd ( %d ).", fd );
       delete_dlist_element( element );
-      xfree( socket );
+      free_client_socket( socket );
       return 1;
     }
   }
@@ -1349,6 +2074,76 @@ del_recv_queue_client_fd( receive_queue *rq, int fd ) {
 }
 
 
+static messenger_socket *
+lookup_recv_queue_client_socket( receive_queue *rq, int fd ) {
+  assert( rq != NULL );
+
+  for ( dlist_element *element = rq->client_sockets->next; element; element = element->next ) {
+    messenger_socket *socket = element->data;
+    if ( socket->fd == fd ) {
+      return socket;
+    }
+  }
+
+  return NULL;
+}
+
+
+/**
+ * maps the shared memory ring passed with a MESSAGE_TYPE_RING_SETUP
+ * message. returns false if the connection must be closed.
+ */
+static bool
+attach_recv_queue_ring( receive_queue *rq, int fd, struct msghdr *msg, const void *data, ssize_t len ) {
+  assert( rq != NULL );
+  assert( msg != NULL );
+
+  int fds[ MESSENGER_RING_FDS ];
+  size_t n_fds = 0;
+  for ( struct cmsghdr *cmsg = CMSG_FIRSTHDR( msg ); cmsg != NULL; cmsg = CMSG_NXTHDR( msg, cmsg ) ) {
+    if ( cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ) {
+      continue;
+    }
+    size_t n = ( cmsg->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+    for ( size_t i = 0; i < n; i++ ) {
+      int received_fd;
+      memcpy( &received_fd, CMSG_DATA( cmsg ) + i * sizeof( int ), sizeof( int ) );
+      if ( n_fds < MESSENGER_RING_FDS ) {
+        fds[ n_fds++ ] = received_fd;
+      }
+      else {
+        close( received_fd );
+      }
+    }
+  }
+
+  const message_header *header = data;
+  messenger_socket *socket = lookup_recv_queue_client_socket( rq, fd );
+  messenger_ring *ring = NULL;
+  if ( socket != NULL && socket->ring == NULL && n_fds == MESSENGER_RING_FDS &&
+       ( msg->msg_flags & MSG_CTRUNC ) == 0 && len == ( ssize_t ) sizeof( message_header ) &&
+       header->message_type == MESSAGE_TYPE_RING_SETUP ) {
+    ring = attach_messenger_ring( fds[ 0 ], fds[ 1 ], fds[ 2 ] );
+  }
+  if ( ring == NULL ) {
+    error( "Failed to set up a messenger ring ( fd = %d, service_name = %s ).", fd, rq->service_name );
+    for ( size_t i = 0; i < n_fds; i++ ) {
+      close( fds[ i ] );
+    }
+    return false;
+  }
+
+  debug( "Messenger ring is attached ( fd = %d, service_name = %s ).", fd, rq->service_name );
+
+  socket->ring = ring;
+  set_fd_handler( ring->data_event_fd, on_recv_ring, socket, NULL, NULL );
+  set_readable( ring->data_event_fd, true );
+  dispatch_recv_ring( socket );
+
+  return true;
+}
+
+
 static void
 truncate_message_buffer( message_buffer *buf, size_t len ) {
   assert( buf != NULL );
@@ -1373,16 +2168,41 @@ truncate_message_buffer( message_buffer *buf, size_t len ) {
 
 
 /**
- * pulls message data from recv_queue.
- * returns 1 if succeeded, otherwise 0.
+ * returns a pointer to contiguous free space of len bytes at the tail of
+ * the buffer. queued data is compacted, or the buffer grown, only if
+ * movable is true.
  */
-static int
-pull_from_recv_queue( receive_queue *rq, uint8_t *message_type, uint16_t *tag, void *data, size_t *len, size_t maxlen ) {
+static void *
+reserve_message_buffer( message_buffer *buf, size_t len, bool movable ) {
+  assert( buf != NULL );
+
+  if ( ( buf->head_offset + buf->data_length + len ) > buf->size ) {
+    if ( !movable ) {
+      return NULL;
+    }
+    if ( ( buf->data_length + len ) > buf->size ) {
+      if ( !grow_message_buffer( buf, buf->data_length + len ) ) {
+        return NULL;
+      }
+    }
+    else {
+      memmove( buf->buffer, get_message_buffer_head( buf ), buf->data_length );
+      buf->head_offset = 0;
+    }
+  }
+
+  return ( char * ) get_message_buffer_head( buf ) + buf->data_length;
+}
+
+
+/**
+ * pulls a message from recv_queue without copying it.
+ * returns the message header in the queue, or NULL if no complete message
+ * is queued. the message stays valid until the queue is compacted.
+ */
+static message_header *
+pull_from_recv_queue( receive_queue *rq ) {
   assert( rq != NULL );
-  assert( message_type != NULL );
-  assert( tag != NULL );
-  assert( data != NULL );
-  assert( len != NULL );
 
   debug( "Pulling a message from receive queue ( service_name = %s ).", rq->service_name );
 
@@ -1390,30 +2210,26 @@ pull_from_recv_queue( receive_queue *rq, uint8_t *message_type, uint16_t *tag, v
 
   if ( rq->buffer->data_length < sizeof( message_header ) ) {
     debug( "Queue length is smaller than a message header ( queue length = %zu ).", rq->buffer->data_length );
-    return 0;
+    return NULL;
   }
 
   header = ( message_header * ) get_message_buffer_head( rq->buffer );
 
   uint32_t length = ntohl( header->message_length );
   assert( length != 0 );
-  assert( length < messenger_recv_queue_length );
+  assert( length <= rq->buffer->max_size );
   if ( rq->buffer->data_length < length ) {
     debug( "Queue length is smaller than message length ( queue length = %zu, message length = %u ).",
            rq->buffer->data_length, length );
-    return 0;
+    return NULL;
   }
 
-  *message_type = header->message_type;
-  *tag = ntohs( header->tag );
-  *len = length - sizeof( message_header );
-  memcpy( data, header->value, *len > maxlen ? maxlen : *len );
   truncate_message_buffer( rq->buffer, length );
 
   debug( "A message is retrieved from receive queue ( message_type = %#x, tag = %#x, len = %zu, data = %p ).",
-         *message_type, *tag, *len, data );
+         header->message_type, ntohs( header->tag ), length - sizeof( message_header ), header->value );
 
-  return 1;
+  return header;
 }
 
 
@@ -1435,6 +2251,9 @@ call_message_callbacks( receive_queue *rq, const uint8_t message_type, const uin
   debug( "Calling message callbacks ( service_name = %s, message_type = %#x, tag = %#x, data = %p, len = %zu ).",
          rq->service_name, message_type, tag, data, len );
 
+  const char *previous_service_name = receiving_service_name;
+  receiving_service_name = rq->service_name;
+
   for ( element = rq->message_callbacks->next; element; element = element->next ) {
     cb = element->data;
     if ( cb->message_type != message_type ) {
@@ -1503,6 +2322,213 @@ call_message_callbacks( receive_queue *rq, const uint8_t message_type, const uin
       assert( 0 );
     }
   }
+  receiving_service_name = previous_service_name;
+}
+
+
+const char *
+get_receiving_service_name( void ) {
+  return receiving_service_name;
+}
+
+
+static void
+dispatch_message( receive_queue *rq, message_header *header ) {
+  assert( rq != NULL );
+  assert( header != NULL );
+
+  uint16_t tag = ntohs( header->tag );
+  size_t len = ntohl( header->message_length ) - sizeof( message_header );
+
+  call_message_callbacks( rq, header->message_type, tag, header->value, len );
+
+  if ( header->message_type != MESSAGE_TYPE_NOTIFY || rq->batch_callbacks == 0 ) {
+    return;
+  }
+  if ( rq->batch_count == rq->batch_size ) {
+    size_t size = rq->batch_size == 0 ? 64 : rq->batch_size * 2;
+    messenger_message *batch = xmalloc( sizeof( messenger_message ) * size );
+    if ( rq->batch_count > 0 ) {
+      memcpy( batch, rq->batch, sizeof( messenger_message ) * rq->batch_count );
+    }
+    xfree( rq->batch );
+    rq->batch = batch;
+    rq->batch_size = size;
+  }
+  messenger_message *message = &rq->batch[ rq->batch_count++ ];
+  message->tag = tag;
+  message->data = header->value;
+  message->len = len;
+}
+
+
+/**
+ * calls batch callbacks with the messages collected by dispatch_message().
+ * the caller must keep the messages in place until this returns.
+ */
+static void
+deliver_message_batch( receive_queue *rq ) {
+  assert( rq != NULL );
+
+  if ( rq->batch_count == 0 ) {
+    return;
+  }
+
+  // Messages received from callbacks are collected into a new batch.
+  messenger_message *batch = rq->batch;
+  size_t count = rq->batch_count;
+  size_t size = rq->batch_size;
+  rq->batch = NULL;
+  rq->batch_count = 0;
+  rq->batch_size = 0;
+
+  debug( "Delivering a message batch ( service_name = %s, count = %zu ).", rq->service_name, count );
+
+  const char *previous_service_name = receiving_service_name;
+  receiving_service_name = rq->service_name;
+  for ( dlist_element *element = rq->message_callbacks->next; element; element = element->next ) {
+    receive_queue_callback *cb = element->data;
+    if ( cb->message_type == MESSAGE_TYPE_NOTIFY_BATCH ) {
+      callback_message_batch_received batch_received_callback = cb->function;
+      batch_received_callback( batch, count );
+    }
+  }
+  receiving_service_name = previous_service_name;
+
+  if ( rq->batch == NULL ) {
+    rq->batch = batch;
+    rq->batch_size = size;
+  }
+  else {
+    xfree( batch );
+  }
+}
+
+
+static void
+dispatch_recv_queue( receive_queue *rq ) {
+  assert( rq != NULL );
+
+  message_header *header;
+
+  rq->dispatching++;
+  while ( true ) {
+    while ( ( header = pull_from_recv_queue( rq ) ) != NULL ) {
+      dispatch_message( rq, header );
+    }
+    if ( rq->batch_count == 0 ) {
+      break;
+    }
+    deliver_message_batch( rq );
+  }
+  rq->dispatching--;
+  if ( rq->dispatching == 0 && rq->buffer->data_length == 0 ) {
+    rq->buffer->head_offset = 0;
+  }
+}
+
+
+/**
+ * dispatches the messages in a record received with recvmmsg(2). a record
+ * always holds whole messages.
+ */
+static void
+dispatch_record( receive_queue *rq, void *record, size_t len ) {
+  size_t offset = 0;
+
+  while ( ( len - offset ) >= sizeof( message_header ) ) {
+    message_header *header = ( message_header * ) ( ( char * ) record + offset );
+    uint32_t length = ntohl( header->message_length );
+    if ( length < sizeof( message_header ) || length > len - offset ) {
+      error( "Invalid message length ( service_name = %s, length = %u, remaining = %zu ).",
+             rq->service_name, length, len - offset );
+      return;
+    }
+    dispatch_message( rq, header );
+    offset += length;
+  }
+}
+
+
+/**
+ * receives up to MESSENGER_RECV_BATCH records with a single recvmmsg(2)
+ * and dispatches them in place. a short read means the socket is
+ * drained, so no further call is made just to see EAGAIN.
+ */
+static void
+recv_records( receive_queue *rq, int fd ) {
+  assert( rq != NULL );
+  assert( rq->dispatching == 0 );
+
+  if ( rq->records == NULL ) {
+    rq->records = xmalloc( MESSENGER_RECV_BATCH * MESSENGER_RECV_BUFFER );
+  }
+
+  struct mmsghdr msgs[ MESSENGER_RECV_BATCH ];
+  struct iovec iov[ MESSENGER_RECV_BATCH ];
+  union {
+    struct cmsghdr align;
+    char buf[ CMSG_SPACE( sizeof( int ) * MESSENGER_RING_FDS ) ];
+  } control[ MESSENGER_RECV_BATCH ];
+
+  memset( msgs, 0, sizeof( msgs ) );
+  for ( int i = 0; i < MESSENGER_RECV_BATCH; i++ ) {
+    iov[ i ].iov_base = ( char * ) rq->records + i * MESSENGER_RECV_BUFFER;
+    iov[ i ].iov_len = MESSENGER_RECV_BUFFER;
+    msgs[ i ].msg_hdr.msg_iov = &iov[ i ];
+    msgs[ i ].msg_hdr.msg_iovlen = 1;
+    msgs[ i ].msg_hdr.msg_control = control[ i ].buf;
+    msgs[ i ].msg_hdr.msg_controllen = sizeof( control[ i ].buf );
+  }
+
+  int received = recvmmsg( fd, msgs, MESSENGER_RECV_BATCH, MSG_DONTWAIT | MSG_CMSG_CLOEXEC, NULL );
+  if ( received == -1 ) {
+    if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
+      error( "Failed to recv ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
+      send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
+      del_recv_queue_client_fd( rq, fd );
+      close( fd );
+    }
+    return;
+  }
+
+  // Records must stay intact until batch callbacks are called.
+  rq->dispatching++;
+  size_t received_length = 0;
+  for ( int i = 0; i < received; i++ ) {
+    void *record = iov[ i ].iov_base;
+    size_t len = msgs[ i ].msg_len;
+    if ( len == 0 ) {
+      debug( "Connection closed ( fd = %d, service_name = %s ).", fd, rq->service_name );
+      send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
+      del_recv_queue_client_fd( rq, fd );
+      close( fd );
+      break;
+    }
+    if ( msgs[ i ].msg_hdr.msg_controllen > 0 ) {
+      if ( !attach_recv_queue_ring( rq, fd, &msgs[ i ].msg_hdr, record, ( ssize_t ) len ) ) {
+        send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
+        del_recv_queue_client_fd( rq, fd );
+        close( fd );
+        break;
+      }
+      continue;
+    }
+    debug( "Received a record ( service_name = %s, len = %zu ).", rq->service_name, len );
+    send_dump_message( MESSENGER_DUMP_RECEIVED, rq->service_name, record, ( uint32_t ) len );
+    received_length += len;
+    dispatch_record( rq, record, len );
+  }
+  rq->buffer->used = true;
+  rq->buffer->bytes += received_length;
+  if ( received_length > rq->buffer->high_water ) {
+    rq->buffer->high_water = received_length;
+  }
+  dispatch_recv_queue( rq );
+  rq->dispatching--;
+  if ( rq->buffer->data_length == 0 ) {
+    rq->buffer->head_offset = 0;
+  }
 }
 
 
@@ -1515,17 +2541,39 @@ on_recv( int fd, void *data ) {
 
   debug( "Receiving data from remote ( fd = %d, service_name = %s ).", fd, rq->service_name );
 
-  uint8_t buf[ MESSENGER_RECV_BUFFER ];
+  if ( batch_mode && rq->dispatching == 0 ) {
+    recv_records( rq, fd );
+    return;
+  }
+
+  void *buf;
   ssize_t recv_len;
-  size_t buf_len;
-  uint8_t message_type;
-  uint16_t tag;
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[ CMSG_SPACE( sizeof( int ) * MESSENGER_RING_FDS ) ];
+  } control;
 
-  while ( ( buf_len = message_buffer_remain_bytes( rq->buffer ) ) > messenger_recv_queue_reserved ) {
-    if ( buf_len > sizeof( buf ) ) {
-      buf_len = sizeof( buf );
+  while ( true ) {
+    // Callbacks being dispatched refer to messages in the queue, so it must not be moved.
+    buf = NULL;
+    if ( rq->buffer->data_length + MESSENGER_RECV_BUFFER < rq->buffer->max_size ) {
+      buf = reserve_message_buffer( rq->buffer, MESSENGER_RECV_BUFFER, rq->dispatching == 0 );
     }
-    recv_len = recv( fd, buf, buf_len, 0 );
+    if ( buf == NULL ) {
+      // The rest is read after queued messages are dispatched.
+      rq->buffer->overflow_count++;
+      break;
+    }
+    iov.iov_base = buf;
+    iov.iov_len = MESSENGER_RECV_BUFFER;
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof( control.buf );
+    recv_len = recvmsg( fd, &msg, MSG_CMSG_CLOEXEC );
     if ( recv_len == -1 ) {
       if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
         error( "Failed to recv ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
@@ -1545,25 +2593,99 @@ on_recv( int fd, void *data ) {
       close( fd );
       break;
     }
+    if ( msg.msg_controllen > 0 ) {
+      if ( !attach_recv_queue_ring( rq, fd, &msg, buf, recv_len ) ) {
+        send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
+        del_recv_queue_client_fd( rq, fd );
+        close( fd );
+      }
+      break;
+    }
+
+    rq->buffer->data_length += ( size_t ) recv_len;
+    update_message_buffer_stats( rq->buffer, ( size_t ) recv_len );
+    debug( "Pushing a message to receive queue ( service_name = %s, len = %zd ).", rq->service_name, recv_len );
+    send_dump_message( MESSENGER_DUMP_RECEIVED, rq->service_name, buf, ( uint32_t ) recv_len );
+  }
+
+  if ( rq->dispatching > 0 ) {
+    // Messages received here are dispatched by the outer on_recv() call.
+    return;
+  }
+
+  dispatch_recv_queue( rq );
+}
+
 
-    if ( !write_message_buffer( rq->buffer, buf, ( size_t ) recv_len ) ) {
-      warn( "Could not write a message to receive queue due to overflow ( service_name = %s, len = %zd ).", rq->service_name, recv_len );
-      send_dump_message( MESSENGER_DUMP_RECV_OVERFLOW, rq->service_name, buf, ( uint32_t ) recv_len );
+/**
+ * delivers messages in a shared memory ring. callbacks refer to the ring
+ * directly, so a message is released only after all callbacks return.
+ */
+static void
+dispatch_recv_ring( messenger_socket *socket ) {
+  assert( socket != NULL );
+  assert( socket->ring != NULL );
+
+  if ( socket->dispatching ) {
+    return;
+  }
+
+  receive_queue *rq = socket->queue;
+  messenger_ring *ring = socket->ring;
+  message_header *header;
+  // Other descriptors get a chance to run after this many bytes unless the peer is gone.
+  size_t budget = rq->buffer->max_size;
+
+  socket->dispatching = true;
+  do {
+    while ( budget > 0 && ( header = peek_messenger_ring( ring ) ) != NULL ) {
+      uint32_t length = ntohl( header->message_length );
+      send_dump_message( MESSENGER_DUMP_RECEIVED, rq->service_name, header, length );
+      rq->buffer->used = true;
+      rq->buffer->bytes += length;
+      dispatch_message( rq, header );
+      advance_messenger_ring( ring, header );
+      if ( rq->batch_count == 0 ) {
+        release_messenger_ring( ring );
+      }
+      if ( socket->fd >= 0 ) {
+        budget = budget > length ? budget - length : 0;
+      }
     }
-    else {
-      debug( "Pushing a message to receive queue ( service_name = %s, len = %zd ).", rq->service_name, recv_len );
-      send_dump_message( MESSENGER_DUMP_RECEIVED, rq->service_name, buf, ( uint32_t ) recv_len );
+    // Batched messages are handed back to the producer once delivered.
+    if ( rq->batch_count > 0 ) {
+      deliver_message_batch( rq );
+      release_messenger_ring( ring );
     }
+  } while ( budget > 0 && !wait_messenger_ring( ring ) );
+  socket->dispatching = false;
+
+  if ( budget == 0 ) {
+    wake_messenger_ring_consumer( ring );
   }
 
-  while ( pull_from_recv_queue( rq, &message_type, &tag, buf, &buf_len, sizeof( buf ) ) == 1 ) {
-    call_message_callbacks( rq, message_type, tag, buf, buf_len );
+  if ( socket->closed ) {
+    delete_dlist_element( find_element( rq->client_sockets, socket ) );
+    free_client_socket( socket );
   }
 }
 
 
+static void
+on_recv_ring( int fd, void *data ) {
+  messenger_socket *socket = ( messenger_socket * ) data;
+
+  assert( socket != NULL );
+
+  debug( "Receiving data from messenger ring ( fd = %d, service_name = %s ).", fd, socket->queue->service_name );
+
+  clear_messenger_ring_event( fd );
+  dispatch_recv_ring( socket );
+}
+
+
 static uint32_t
-get_send_data( send_queue *sq, size_t offset ) {
+get_send_bucket_size( send_queue *sq ) {
   assert( sq != NULL );
 
   uint32_t bucket_size = messenger_bucket_size;
@@ -1582,13 +2704,21 @@ get_send_data( send_queue *sq, size_t offset ) {
     }
   }
 
+  return bucket_size;
+}
+
+
+static uint32_t
+get_send_data( send_queue *sq, size_t offset, uint32_t bucket_size ) {
+  assert( sq != NULL );
+
   uint32_t length = 0;
   message_header *header;
   while ( ( sq->buffer->data_length - offset ) >= sizeof( message_header ) ) {
     header = ( message_header * ) ( ( char * ) get_message_buffer_head( sq->buffer ) + offset );
     uint32_t message_length = ntohl( header->message_length );
     assert( message_length != 0 );
-    assert( message_length < messenger_recv_queue_length );
+    assert( message_length <= sq->buffer->max_size );
     if ( length + message_length > bucket_size ) {
       if ( length == 0 ) {
         length = message_length;
@@ -1616,6 +2746,7 @@ on_send_read( int fd, void *data ) {
     set_writable( sq->server_socket, false );
     delete_fd_handler( sq->server_socket );
 
+    stop_send_ring( sq );
     close( sq->server_socket );
     sq->server_socket = -1;
 
@@ -1630,6 +2761,92 @@ on_send_read( int fd, void *data ) {
 }
 
 
+static void
+handle_send_error( send_queue *sq, int fd, int err, size_t sent_total ) {
+  assert( sq != NULL );
+
+  if ( err != EAGAIN && err != EWOULDBLOCK ) {
+    error( "Failed to send ( service_name = %s, fd = %d, errno = %s [%d] ).",
+           sq->service_name, fd, strerror( err ), err );
+    send_dump_message( MESSENGER_DUMP_SEND_CLOSED, sq->service_name, NULL, 0 );
+
+    set_readable( sq->server_socket, false );
+    set_writable( sq->server_socket, false );
+    delete_fd_handler( sq->server_socket );
+
+    stop_send_ring( sq );
+    close( sq->server_socket );
+    sq->server_socket = -1;
+    sq->refused_count = 0;
+
+    // Tries to reconnecting immediately, else adds a reconnect timer.
+    send_queue_try_connect( sq );
+  }
+  else {
+    set_writable( fd, true );
+  }
+  truncate_message_buffer( sq->buffer, sent_total );
+  if ( err == EMSGSIZE || err == ENOBUFS || err == ENOMEM ) {
+    warn( "Dropping %zu bytes data in send queue ( service_name = %s ).", sq->buffer->data_length, sq->service_name );
+    truncate_message_buffer( sq->buffer, sq->buffer->data_length );
+  }
+}
+
+
+/**
+ * sends up to MESSENGER_SEND_BATCH records with a single sendmmsg(2).
+ * records are bounded by half of the socket buffer rather than by its
+ * free space, so that no ioctl is needed; sendmmsg(2) simply stops at the
+ * first record that does not fit.
+ */
+static void
+send_records( int fd, send_queue *sq ) {
+  uint32_t bucket_size = messenger_bucket_size;
+  if ( sq->socket_buffer_size > 0 && ( uint32_t ) sq->socket_buffer_size / 2 < bucket_size ) {
+    bucket_size = ( uint32_t ) sq->socket_buffer_size / 2;
+  }
+
+  struct mmsghdr msgs[ MESSENGER_SEND_BATCH ];
+  struct iovec iov[ MESSENGER_SEND_BATCH ];
+  size_t sent_total = 0;
+  unsigned int count;
+  int sent = 0;
+
+  do {
+    size_t offset = sent_total;
+    uint32_t send_len;
+    count = 0;
+    memset( msgs, 0, sizeof( msgs ) );
+    while ( count < MESSENGER_SEND_BATCH && ( send_len = get_send_data( sq, offset, bucket_size ) ) > 0 ) {
+      iov[ count ].iov_base = ( char * ) get_message_buffer_head( sq->buffer ) + offset;
+      iov[ count ].iov_len = send_len;
+      msgs[ count ].msg_hdr.msg_iov = &iov[ count ];
+      msgs[ count ].msg_hdr.msg_iovlen = 1;
+      offset += send_len;
+      count++;
+    }
+    if ( count == 0 ) {
+      break;
+    }
+
+    sent = sendmmsg( fd, msgs, count, MSG_DONTWAIT );
+    if ( sent == -1 ) {
+      handle_send_error( sq, fd, errno, sent_total );
+      return;
+    }
+    for ( int i = 0; i < sent; i++ ) {
+      assert( msgs[ i ].msg_len == iov[ i ].iov_len );
+      send_dump_message( MESSENGER_DUMP_SENT, sq->service_name, iov[ i ].iov_base, msgs[ i ].msg_len );
+      sent_total += msgs[ i ].msg_len;
+    }
+  } while ( ( unsigned int ) sent == count );
+
+  truncate_message_buffer( sq->buffer, sent_total );
+  // Waits for the socket only if it is full.
+  set_writable( fd, sq->buffer->data_length > 0 );
+}
+
+
 static void
 on_send_write( int fd, void *data ) {
   send_queue *sq = ( send_queue * ) data;
@@ -1645,37 +2862,21 @@ on_send_write( int fd, void *data ) {
     return;
   }
 
+  if ( batch_mode ) {
+    send_records( fd, sq );
+    return;
+  }
+
   void *send_data;
   size_t send_len;
   ssize_t sent_len;
   size_t sent_total = 0;
 
-  while ( ( send_len = get_send_data( sq, sent_total ) ) > 0 ) {
+  while ( ( send_len = get_send_data( sq, sent_total, get_send_bucket_size( sq ) ) ) > 0 ) {
     send_data = ( ( char * ) get_message_buffer_head( sq->buffer ) + sent_total );
     sent_len = send( fd, send_data, send_len, MSG_DONTWAIT );
     if ( sent_len == -1 ) {
-      int err = errno;
-      if ( err != EAGAIN && err != EWOULDBLOCK ) {
-        error( "Failed to send ( service_name = %s, fd = %d, errno = %s [%d] ).",
-               sq->service_name, fd, strerror( err ), err );
-        send_dump_message( MESSENGER_DUMP_SEND_CLOSED, sq->service_name, NULL, 0 );
-
-        set_readable( sq->server_socket, false );
-        set_writable( sq->server_socket, false );
-        delete_fd_handler( sq->server_socket );
-
-        close( sq->server_socket );
-        sq->server_socket = -1;
-        sq->refused_count = 0;
-
-        // Tries to reconnecting immediately, else adds a reconnect timer.
-        send_queue_try_connect( sq );
-      }
-      truncate_message_buffer( sq->buffer, sent_total );
-      if ( err == EMSGSIZE || err == ENOBUFS || err == ENOMEM ) {
-        warn( "Dropping %zu bytes data in send queue ( service_name = %s ).", sq->buffer->data_length, sq->service_name );
-        truncate_message_buffer( sq->buffer, sq->buffer->data_length );
-      }
+      handle_send_error( sq, fd, errno, sent_total );
       return;
     }
     assert( sent_len != 0 );
@@ -1691,6 +2892,28 @@ on_send_write( int fd, void *data ) {
 }
 
 
+static void
+on_flush_send_queues( int fd, void *data ) {
+  UNUSED( data );
+
+  set_writable( fd, false );
+  if ( send_queues == NULL ) {
+    return;
+  }
+
+  hash_iterator iter;
+  hash_entry *e;
+  init_hash_iterator( send_queues, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    send_queue *sq = e->value;
+    // Queues waiting for their socket to drain are left to on_send_write().
+    if ( sq->server_socket != -1 && sq->ring == NULL && sq->buffer->data_length > 0 && !writable( sq->server_socket ) ) {
+      on_send_write( sq->server_socket, sq );
+    }
+  }
+}
+
+
 int
 flush_messenger() {
   int connected_count, sending_count, reconnecting_count, closed_count;
@@ -1707,11 +2930,95 @@ flush_messenger() {
 }
 
 
+/**
+ * releases the data area of a queue that stayed empty since the last
+ * check, or that was grown for a burst and has drained since.
+ */
+static void
+shrink_message_buffer( message_buffer *buf ) {
+  assert( buf != NULL );
+
+  if ( buf->buffer != NULL && buf->data_length == 0 && ( !buf->used || buf->size > MESSENGER_QUEUE_INITIAL_SIZE ) ) {
+    release_message_buffer( buf );
+  }
+  buf->used = false;
+}
+
+
+static void
+release_idle_message_buffers( void *user_data ) {
+  UNUSED( user_data );
+
+  hash_iterator iter;
+  hash_entry *e;
+  if ( send_queues != NULL ) {
+    init_hash_iterator( send_queues, &iter );
+    while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+      send_queue *sq = e->value;
+      shrink_message_buffer( sq->buffer );
+    }
+  }
+  if ( receive_queues != NULL ) {
+    init_hash_iterator( receive_queues, &iter );
+    while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+      receive_queue *rq = e->value;
+      // Messages being dispatched may refer to the queue.
+      if ( rq->dispatching > 0 ) {
+        continue;
+      }
+      if ( !rq->buffer->used && rq->records != NULL ) {
+        xfree( rq->records );
+        rq->records = NULL;
+      }
+      shrink_message_buffer( rq->buffer );
+    }
+  }
+}
+
+
+static void
+report_message_buffer_stat( const char *queue_type, const char *service_name, message_buffer *buf,
+                            void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  char key[ MESSENGER_SERVICE_NAME_LENGTH + 64 ];
+
+  snprintf( key, sizeof( key ), "messenger.%s.%s.high_water", queue_type, service_name );
+  function( key, buf->high_water, user_data );
+  snprintf( key, sizeof( key ), "messenger.%s.%s.overflow", queue_type, service_name );
+  function( key, buf->overflow_count, user_data );
+  snprintf( key, sizeof( key ), "messenger.%s.%s.bytes", queue_type, service_name );
+  function( key, buf->bytes, user_data );
+}
+
+
+void
+foreach_messenger_queue_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  assert( function != NULL );
+
+  hash_iterator iter;
+  hash_entry *e;
+  if ( send_queues != NULL ) {
+    init_hash_iterator( send_queues, &iter );
+    while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+      send_queue *sq = e->value;
+      report_message_buffer_stat( "send_queue", sq->service_name, sq->buffer, function, user_data );
+    }
+  }
+  if ( receive_queues != NULL ) {
+    init_hash_iterator( receive_queues, &iter );
+    while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+      receive_queue *rq = e->value;
+      report_message_buffer_stat( "recv_queue", rq->service_name, rq->buffer, function, user_data );
+    }
+  }
+}
+
+
 bool
 start_messenger() {
   debug( "Starting messenger." );
 
   add_periodic_event_callback( 10, age_context_db, NULL );
+  add_periodic_event_callback( MESSENGER_QUEUE_IDLE_CHECK_INTERVAL, release_idle_message_buffers, NULL );
 
   return true;
 }
@@ -25,12 +25,18 @@
 #include <net/if.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 #include <time.h>
 #include "checks.h"
 #include "bool.h"
 
 
 #define MESSENGER_SERVICE_NAME_LENGTH 32
+#define MESSENGER_INVALID_SERVICE_ID 0
+
+
+// Interned service name. See get_messenger_service_id().
+typedef uint32_t messenger_service_id;
 
 
 typedef struct message_header {
@@ -108,20 +114,94 @@ typedef struct text_dump_header {
 
 typedef void ( *callback_message_received )( uint16_t tag, void *data, size_t len );
 
+typedef struct {
+  uint16_t tag;
+  void *data;
+  size_t len;
+} messenger_message;
+
+// Called with every message received by a service since the last call.
+// Messages are valid only until the callback returns.
+typedef void ( *callback_message_batch_received )( const messenger_message *messages, size_t count );
+
+#define MESSENGER_DEFAULT_SEND_QUEUE_LENGTH 400000
+#define MESSENGER_DEFAULT_RECV_QUEUE_LENGTH 200000
+#define MESSENGER_MIN_QUEUE_LENGTH 200000
+
+typedef enum {
+  MESSENGER_TRANSPORT_DEFAULT = 0,
+  MESSENGER_TRANSPORT_SOCKET,
+  MESSENGER_TRANSPORT_SHARED_MEMORY,
+} messenger_transport;
+
 
 extern bool ( *add_message_received_callback )( const char *service_name, const callback_message_received function );
 extern bool ( *rename_message_received_callback )( const char *old_service_name, const char *new_service_name );
 extern bool ( *delete_message_received_callback )( const char *service_name, void ( *callback )( uint16_t tag, void *data, size_t len ) );
+extern bool ( *add_message_batch_received_callback )( const char *service_name, const callback_message_batch_received function );
+extern bool ( *delete_message_batch_received_callback )( const char *service_name, const callback_message_batch_received function );
 extern bool ( *add_message_requested_callback )( const char *service_name, void ( *callback )( const messenger_context_handle *handle, uint16_t tag, void *data, size_t len ) );
 extern bool ( *rename_message_requested_callback )( const char *old_service_name, const char *new_service_name );
 extern bool ( *delete_message_requested_callback )( const char *service_name, void ( *callback )( const messenger_context_handle *handle, uint16_t tag, void *data, size_t len ) );
 extern bool ( *add_message_replied_callback )( const char *service_name, void ( *callback )( uint16_t tag, void *data, size_t len, void *user_data ) );
 extern bool ( *delete_message_replied_callback )( const char *service_name, void ( *callback )( uint16_t tag, void *data, size_t len, void *user_data ) );
+// The send functions set errno whenever they return false:
+//   EAGAIN   the send queue is full; the message may be sent again later.
+//   EMSGSIZE the message is longer than the send queue.
+//   EINVAL   the service id is not valid.
+//   ENOTCONN the messenger is not initialized or already finalized.
+//   ENOBUFS  the send queue could not be allocated.
+// A message to a service that is not connected yet is queued and sent
+// once the connection is established.
 extern bool ( *send_message )( const char *service_name, const uint16_t tag, const void *data, size_t len );
+extern bool ( *send_message_iov )( const char *service_name, const uint16_t tag, const struct iovec *iov, int iovcnt );
+extern bool ( *send_message_to_handle )( messenger_service_id id, const uint16_t tag, const void *data, size_t len );
+extern bool ( *send_message_iov_to_handle )( messenger_service_id id, const uint16_t tag, const struct iovec *iov, int iovcnt );
 extern bool ( *send_request_message )( const char *to_service_name, const char *from_service_name, const uint16_t tag, const void *data, size_t len, void *user_data );
 extern bool ( *send_reply_message )( const messenger_context_handle *handle, const uint16_t tag, const void *data, size_t len );
 extern bool ( *clear_send_queue )( const char *service_name );
 
+// Selects how messages are carried to services connected from then on.
+// With MESSENGER_TRANSPORT_DEFAULT, the TREMA_MESSENGER_TRANSPORT
+// environment variable ("socket" or "shm") is consulted and socket is used
+// if unset. Receivers accept either transport.
+bool set_messenger_transport( messenger_transport transport );
+messenger_transport get_messenger_transport( void );
+
+// In batch mode, messages queued for any service are written together once
+// per event loop iteration with sendmmsg(2), and sockets are drained with
+// recvmmsg(2). Unless set explicitly, it is enabled by setting the
+// TREMA_MESSENGER_BATCH environment variable to 1.
+void set_messenger_batch_mode( bool enable );
+bool get_messenger_batch_mode( void );
+
+// Send and receive queues start empty, grow on demand up to these lengths
+// in bytes and are released when idle. Zero selects the default; unless set
+// explicitly, the TREMA_MESSENGER_SEND_QUEUE_LENGTH and
+// TREMA_MESSENGER_RECV_QUEUE_LENGTH environment variables are consulted.
+// Queues created from then on use the new lengths.
+bool set_messenger_queue_length( size_t send_queue_length, size_t recv_queue_length );
+void get_messenger_queue_length( size_t *send_queue_length, size_t *recv_queue_length );
+
+// Reports the high-water mark, the number of overflows and the number of
+// bytes moved of each queue as messenger.<send|recv>_queue.<service>.*.
+void foreach_messenger_queue_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
+
+// Resolves a service name to an id once, so that messages can be sent with
+// send_message_to_handle() without hashing the name each time. Each
+// get_messenger_service_id() or retain_messenger_service_id() call takes a
+// reference that is given back with release_messenger_service_id(). The id
+// and the name returned by get_messenger_service_name() stay valid while
+// referenced; once unreferenced, the id may be reused for another name.
+messenger_service_id get_messenger_service_id( const char *service_name );
+void retain_messenger_service_id( messenger_service_id id );
+void release_messenger_service_id( messenger_service_id id );
+const char *get_messenger_service_name( messenger_service_id id );
+
+// Returns the service name of the message being delivered, or NULL
+// outside of message callbacks.
+const char *get_receiving_service_name( void );
+
 bool init_messenger( const char *working_directory );
 bool finalize_messenger( void );
 
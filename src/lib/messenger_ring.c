@@ -0,0 +1,336 @@
+/*
+ * Single-producer/single-consumer message ring in shared memory.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "log.h"
+#include "messenger_ring.h"
+#include "wrapper.h"
+
+
+#define MESSENGER_RING_MAGIC 0x54524d52
+#define MESSENGER_RING_ALIGN 8
+#define MESSENGER_RING_CACHE_LINE 64
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+
+// Each side writes only to its own cache line.
+struct messenger_ring_header {
+  uint32_t magic;
+  uint32_t size;
+  struct {
+    uint64_t tail;
+    uint32_t producer_waiting;
+  } producer __attribute__( ( aligned( MESSENGER_RING_CACHE_LINE ) ) );
+  struct {
+    uint64_t head;
+    uint32_t consumer_waiting;
+  } consumer __attribute__( ( aligned( MESSENGER_RING_CACHE_LINE ) ) );
+} __attribute__( ( aligned( MESSENGER_RING_CACHE_LINE ) ) );
+
+
+static size_t
+aligned_length( size_t length ) {
+  return ( length + MESSENGER_RING_ALIGN - 1 ) & ~( ( size_t ) MESSENGER_RING_ALIGN - 1 );
+}
+
+
+static int
+create_memory_fd( void ) {
+#ifdef SYS_memfd_create
+  return ( int ) syscall( SYS_memfd_create, "trema.messenger", MFD_CLOEXEC );
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+
+static void
+notify( int event_fd ) {
+  uint64_t one = 1;
+  ssize_t ret = write( event_fd, &one, sizeof( one ) );
+  if ( ret < 0 && errno != EAGAIN ) {
+    error( "Failed to notify an event ( fd = %d, errno = %s [%d] ).", event_fd, strerror( errno ), errno );
+  }
+}
+
+
+void
+clear_messenger_ring_event( int event_fd ) {
+  uint64_t count;
+  ssize_t ret = read( event_fd, &count, sizeof( count ) );
+  if ( ret < 0 && errno != EAGAIN ) {
+    error( "Failed to read an event ( fd = %d, errno = %s [%d] ).", event_fd, strerror( errno ), errno );
+  }
+}
+
+
+static messenger_ring *
+map_messenger_ring( int memory_fd, size_t size ) {
+  size_t map_size = sizeof( messenger_ring_header ) + size;
+  void *p = mmap( NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0 );
+  if ( p == MAP_FAILED ) {
+    error( "Failed to map a messenger ring ( fd = %d, size = %zu, errno = %s [%d] ).", memory_fd, map_size, strerror( errno ), errno );
+    return NULL;
+  }
+
+  messenger_ring *ring = xmalloc( sizeof( messenger_ring ) );
+  memset( ring, 0, sizeof( messenger_ring ) );
+  ring->header = p;
+  ring->data = ( uint8_t * ) p + sizeof( messenger_ring_header );
+  ring->size = size;
+  ring->memory_fd = memory_fd;
+  ring->data_event_fd = -1;
+  ring->space_event_fd = -1;
+
+  return ring;
+}
+
+
+messenger_ring *
+create_messenger_ring( size_t size ) {
+  assert( size != 0 );
+  assert( ( size & ( size - 1 ) ) == 0 );
+
+  int memory_fd = create_memory_fd();
+  if ( memory_fd < 0 ) {
+    error( "Failed to create a messenger ring ( errno = %s [%d] ).", strerror( errno ), errno );
+    return NULL;
+  }
+  if ( ftruncate( memory_fd, ( off_t ) ( sizeof( messenger_ring_header ) + size ) ) < 0 ) {
+    error( "Failed to resize a messenger ring ( fd = %d, errno = %s [%d] ).", memory_fd, strerror( errno ), errno );
+    close( memory_fd );
+    return NULL;
+  }
+  messenger_ring *ring = map_messenger_ring( memory_fd, size );
+  if ( ring == NULL ) {
+    close( memory_fd );
+    return NULL;
+  }
+  ring->header->size = ( uint32_t ) size;
+  ring->header->magic = MESSENGER_RING_MAGIC;
+  // The consumer has not looked at the ring yet, so the first message wakes it up.
+  ring->header->consumer.consumer_waiting = 1;
+
+  ring->data_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  ring->space_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  if ( ring->data_event_fd < 0 || ring->space_event_fd < 0 ) {
+    error( "Failed to create an eventfd ( errno = %s [%d] ).", strerror( errno ), errno );
+    delete_messenger_ring( ring );
+    return NULL;
+  }
+
+  return ring;
+}
+
+
+messenger_ring *
+attach_messenger_ring( int memory_fd, int data_event_fd, int space_event_fd ) {
+  struct stat st;
+  if ( fstat( memory_fd, &st ) < 0 || ( size_t ) st.st_size <= sizeof( messenger_ring_header ) ) {
+    error( "Invalid messenger ring ( fd = %d ).", memory_fd );
+    return NULL;
+  }
+  size_t size = ( size_t ) st.st_size - sizeof( messenger_ring_header );
+  messenger_ring *ring = map_messenger_ring( memory_fd, size );
+  if ( ring == NULL ) {
+    return NULL;
+  }
+  if ( ring->header->magic != MESSENGER_RING_MAGIC || ring->header->size != size || ( size & ( size - 1 ) ) != 0 ) {
+    error( "Invalid messenger ring ( fd = %d, magic = %#x, size = %u ).", memory_fd, ring->header->magic, ring->header->size );
+    ring->memory_fd = -1;
+    delete_messenger_ring( ring );
+    return NULL;
+  }
+  ring->head = __atomic_load_n( &ring->header->consumer.head, __ATOMIC_ACQUIRE );
+  ring->tail = __atomic_load_n( &ring->header->producer.tail, __ATOMIC_ACQUIRE );
+  ring->data_event_fd = data_event_fd;
+  ring->space_event_fd = space_event_fd;
+
+  return ring;
+}
+
+
+void
+delete_messenger_ring( messenger_ring *ring ) {
+  assert( ring != NULL );
+
+  munmap( ring->header, sizeof( messenger_ring_header ) + ring->size );
+  if ( ring->memory_fd >= 0 ) {
+    close( ring->memory_fd );
+  }
+  if ( ring->data_event_fd >= 0 ) {
+    close( ring->data_event_fd );
+  }
+  if ( ring->space_event_fd >= 0 ) {
+    close( ring->space_event_fd );
+  }
+  xfree( ring );
+}
+
+
+static bool
+has_space( messenger_ring *ring, size_t length ) {
+  uint64_t head = __atomic_load_n( &ring->header->consumer.head, __ATOMIC_ACQUIRE );
+  return ( ring->tail + length - head ) <= ring->size;
+}
+
+
+/*
+ * Returns a pointer to length contiguous bytes, or NULL if the ring is
+ * full. In the latter case the consumer notifies space_event_fd once it
+ * has made room.
+ */
+void *
+reserve_messenger_ring( messenger_ring *ring, size_t length ) {
+  assert( ring != NULL );
+  assert( length >= sizeof( message_header ) );
+
+  length = aligned_length( length );
+  size_t offset = ( size_t ) ( ring->tail & ( ring->size - 1 ) );
+  size_t contiguous = ring->size - offset;
+  size_t required = contiguous < length ? contiguous + length : length;
+  if ( required > ring->size ) {
+    return NULL;
+  }
+
+  if ( !has_space( ring, required ) ) {
+    __atomic_store_n( &ring->header->producer.producer_waiting, 1, __ATOMIC_SEQ_CST );
+    if ( !has_space( ring, required ) ) {
+      return NULL;
+    }
+    __atomic_store_n( &ring->header->producer.producer_waiting, 0, __ATOMIC_RELAXED );
+  }
+
+  if ( contiguous < length ) {
+    message_header *wrap = ( message_header * ) ( ring->data + offset );
+    wrap->message_length = 0;
+    ring->tail += contiguous;
+    offset = 0;
+  }
+
+  return ring->data + offset;
+}
+
+
+void
+commit_messenger_ring( messenger_ring *ring, size_t length ) {
+  assert( ring != NULL );
+
+  ring->tail += aligned_length( length );
+  __atomic_store_n( &ring->header->producer.tail, ring->tail, __ATOMIC_RELEASE );
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  if ( __atomic_load_n( &ring->header->consumer.consumer_waiting, __ATOMIC_RELAXED ) != 0 &&
+       __atomic_exchange_n( &ring->header->consumer.consumer_waiting, 0, __ATOMIC_ACQ_REL ) != 0 ) {
+    notify( ring->data_event_fd );
+  }
+}
+
+
+message_header *
+peek_messenger_ring( messenger_ring *ring ) {
+  assert( ring != NULL );
+
+  uint64_t tail = __atomic_load_n( &ring->header->producer.tail, __ATOMIC_ACQUIRE );
+  while ( ring->head != tail ) {
+    size_t offset = ( size_t ) ( ring->head & ( ring->size - 1 ) );
+    message_header *header = ( message_header * ) ( ring->data + offset );
+    if ( header->message_length != 0 ) {
+      return header;
+    }
+    ring->head += ring->size - offset;
+  }
+
+  return NULL;
+}
+
+
+void
+advance_messenger_ring( messenger_ring *ring, const message_header *header ) {
+  assert( ring != NULL );
+  assert( header != NULL );
+
+  ring->head += aligned_length( ntohl( header->message_length ) );
+}
+
+
+void
+release_messenger_ring( messenger_ring *ring ) {
+  assert( ring != NULL );
+
+  __atomic_store_n( &ring->header->consumer.head, ring->head, __ATOMIC_RELEASE );
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  if ( __atomic_load_n( &ring->header->producer.producer_waiting, __ATOMIC_RELAXED ) != 0 &&
+       __atomic_exchange_n( &ring->header->producer.producer_waiting, 0, __ATOMIC_ACQ_REL ) != 0 ) {
+    notify( ring->space_event_fd );
+  }
+}
+
+
+void
+consume_messenger_ring( messenger_ring *ring, const message_header *header ) {
+  advance_messenger_ring( ring, header );
+  release_messenger_ring( ring );
+}
+
+
+/*
+ * Asks the producer for a wakeup on data_event_fd. Returns false if data
+ * arrived in the meantime, in which case the ring must be drained again.
+ */
+bool
+wait_messenger_ring( messenger_ring *ring ) {
+  assert( ring != NULL );
+
+  __atomic_store_n( &ring->header->consumer.consumer_waiting, 1, __ATOMIC_SEQ_CST );
+  if ( peek_messenger_ring( ring ) != NULL ) {
+    __atomic_store_n( &ring->header->consumer.consumer_waiting, 0, __ATOMIC_RELAXED );
+    return false;
+  }
+
+  return true;
+}
+
+
+void
+wake_messenger_ring_consumer( messenger_ring *ring ) {
+  assert( ring != NULL );
+
+  notify( ring->data_event_fd );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
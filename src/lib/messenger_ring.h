@@ -0,0 +1,80 @@
+/*
+ * Single-producer/single-consumer message ring in shared memory.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef MESSENGER_RING_H
+#define MESSENGER_RING_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bool.h"
+#include "messenger.h"
+
+
+/*
+ * Records are laid out in the ring exactly as on the messenger socket
+ * (message_header followed by the value) and are 8-byte aligned. A record
+ * never wraps around; a header with zero message_length tells the
+ * consumer to continue at the beginning of the ring.
+ */
+
+typedef struct messenger_ring_header messenger_ring_header;
+
+typedef struct {
+  messenger_ring_header *header;
+  uint8_t *data;
+  size_t size;
+  uint64_t head;
+  uint64_t tail;
+  int memory_fd;
+  int data_event_fd;
+  int space_event_fd;
+} messenger_ring;
+
+
+messenger_ring *create_messenger_ring( size_t size );
+messenger_ring *attach_messenger_ring( int memory_fd, int data_event_fd, int space_event_fd );
+void delete_messenger_ring( messenger_ring *ring );
+
+// Producer side.
+void *reserve_messenger_ring( messenger_ring *ring, size_t length );
+void commit_messenger_ring( messenger_ring *ring, size_t length );
+
+// Consumer side.
+message_header *peek_messenger_ring( messenger_ring *ring );
+void consume_messenger_ring( messenger_ring *ring, const message_header *header );
+// consume_messenger_ring() split in two, so that several messages can be
+// looked at before any of them is handed back to the producer.
+void advance_messenger_ring( messenger_ring *ring, const message_header *header );
+void release_messenger_ring( messenger_ring *ring );
+bool wait_messenger_ring( messenger_ring *ring );
+void wake_messenger_ring_consumer( messenger_ring *ring );
+void clear_messenger_ring_event( int event_fd );
+
+
+#endif // MESSENGER_RING_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
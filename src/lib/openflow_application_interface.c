@@ -17,6 +17,7 @@
 
 
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
@@ -46,6 +47,30 @@ const char *mock_get_trema_name( void );
 #define send_message mock_send_message
 bool mock_send_message( char *service_name, uint16_t tag, void *data, size_t len );
 
+#ifdef send_message_to_handle
+#undef send_message_to_handle
+#endif
+#define send_message_to_handle mock_send_message_to_handle
+bool mock_send_message_to_handle( messenger_service_id id, uint16_t tag, void *data, size_t len );
+
+#ifdef get_messenger_service_id
+#undef get_messenger_service_id
+#endif
+#define get_messenger_service_id mock_get_messenger_service_id
+messenger_service_id mock_get_messenger_service_id( const char *service_name );
+
+#ifdef release_messenger_service_id
+#undef release_messenger_service_id
+#endif
+#define release_messenger_service_id mock_release_messenger_service_id
+void mock_release_messenger_service_id( messenger_service_id id );
+
+#ifdef get_messenger_service_name
+#undef get_messenger_service_name
+#endif
+#define get_messenger_service_name mock_get_messenger_service_name
+const char *mock_get_messenger_service_name( messenger_service_id id );
+
 #ifdef send_request_message
 #undef send_request_message
 #endif
@@ -147,9 +172,38 @@ static bool openflow_application_interface_initialized = false;
 static openflow_event_handlers_t event_handlers;
 static char service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
 
+// Messenger ids of the "switch.<datapath id>" services, so that messages to
+// a switch are sent without formatting and hashing its service name.
+#define SWITCH_SERVICE_CACHE_SIZE 256
+static struct {
+  uint64_t datapath_id;
+  messenger_service_id service;
+} switch_services[ SWITCH_SERVICE_CACHE_SIZE ];
+
+
+// Flow batches are sent in messenger messages of up to this length.
+#define FLOW_BATCH_MAX_LENGTH 65536
+
+struct flow_batch {
+  uint64_t datapath_id;
+  buffer *messages;
+  size_t header_length;
+};
+
+// Batches committed with a barrier request waiting for its reply.
+typedef struct {
+  uint64_t datapath_id;
+  uint32_t transaction_id;
+  flow_batch_completed_handler callback;
+  void *user_data;
+} pending_flow_batch;
+
+static list_element *pending_flow_batches = NULL;
+
 
 static void handle_message( uint16_t message_type, void *data, size_t length );
 static void handle_list_switches_reply( uint16_t message_type, void *dpid, size_t length, void *user_data );
+static void clear_stat_counters( void );
 
 
 enum {
@@ -187,6 +241,7 @@ init_openflow_application_interface( const char *custom_service_name ) {
 
   memset( &event_handlers, 0, sizeof( openflow_event_handlers_t ) );
   memset( service_name, '\0', sizeof( service_name ) );
+  clear_stat_counters();
 
   size_t length = strlen( custom_service_name ) + 1;
   if ( length > MESSENGER_SERVICE_NAME_LENGTH ) {
@@ -218,6 +273,17 @@ finalize_openflow_application_interface() {
 
   memset( &event_handlers, 0, sizeof( openflow_event_handlers_t ) );
   memset( service_name, '\0', sizeof( service_name ) );
+  for ( int i = 0; i < SWITCH_SERVICE_CACHE_SIZE; i++ ) {
+    release_messenger_service_id( switch_services[ i ].service );
+  }
+  memset( switch_services, 0, sizeof( switch_services ) );
+  clear_stat_counters();
+
+  for ( list_element *e = pending_flow_batches; e != NULL; e = e->next ) {
+    xfree( e->data );
+  }
+  delete_list( pending_flow_batches );
+  pending_flow_batches = NULL;
 
   openflow_application_interface_initialized = false;
 
@@ -277,6 +343,31 @@ set_switch_disconnected_handler( switch_disconnected_handler callback, void *use
 }
 
 
+/*
+ * The callback is called with congested = true when the send queue of
+ * the switch daemon to the switch grows over its high watermark, and
+ * with congested = false when it drains below the low watermark.
+ */
+bool
+set_switch_congestion_handler( switch_congestion_handler callback, void *user_data ) {
+  if ( callback == NULL ) {
+    die( "Callback function ( switch_congestion_handler ) must not be NULL." );
+  }
+  assert( callback != NULL );
+
+  maybe_init_openflow_application_interface();
+  assert( openflow_application_interface_initialized );
+
+  debug( "Setting a switch congestion handler ( callback = %p, user_data = %p ).",
+         callback, user_data );
+
+  event_handlers.switch_congestion_callback = callback;
+  event_handlers.switch_congestion_user_data = user_data;
+
+  return true;
+}
+
+
 bool
 set_error_handler( error_handler callback, void *user_data ) {
   if ( callback == NULL ) {
@@ -826,8 +917,7 @@ handle_packet_in( const uint64_t datapath_id, buffer *data ) {
 
   buffer *body = NULL;
   if ( body_length > 0 ) {
-    body = duplicate_buffer( data );
-    remove_front_buffer( body, offsetof( struct ofp_packet_in, data ) );
+    body = slice_buffer( data, offsetof( struct ofp_packet_in, data ), data->length - offsetof( struct ofp_packet_in, data ) );
     bool parse_ok = parse_packet( body );
     if ( !parse_ok ) {
       error( "Failed to parse a packet." );
@@ -1185,6 +1275,33 @@ handle_stats_reply( const uint64_t datapath_id, buffer *data ) {
 }
 
 
+static pending_flow_batch *
+lookup_pending_flow_batch( uint64_t datapath_id, uint32_t transaction_id ) {
+  for ( list_element *e = pending_flow_batches; e != NULL; e = e->next ) {
+    pending_flow_batch *pending = e->data;
+    if ( pending->datapath_id == datapath_id && pending->transaction_id == transaction_id ) {
+      return pending;
+    }
+  }
+
+  return NULL;
+}
+
+
+static void
+delete_pending_flow_batches( uint64_t datapath_id ) {
+  list_element *e = pending_flow_batches;
+  while ( e != NULL ) {
+    pending_flow_batch *pending = e->data;
+    e = e->next;
+    if ( pending->datapath_id == datapath_id ) {
+      delete_element( &pending_flow_batches, pending );
+      xfree( pending );
+    }
+  }
+}
+
+
 static void
 handle_barrier_reply( const uint64_t datapath_id, buffer *data ) {
   uint32_t transaction_id;
@@ -1202,6 +1319,16 @@ handle_barrier_reply( const uint64_t datapath_id, buffer *data ) {
   debug( "A barrier reply message is received from %#" PRIx64 " ( transaction_id = %#x ).",
          datapath_id, transaction_id );
 
+  pending_flow_batch *pending = lookup_pending_flow_batch( datapath_id, transaction_id );
+  if ( pending != NULL ) {
+    delete_element( &pending_flow_batches, pending );
+    debug( "Calling flow batch completed handler ( callback = %p, user_data = %p ).",
+           pending->callback, pending->user_data );
+    pending->callback( datapath_id, transaction_id, pending->user_data );
+    xfree( pending );
+    return;
+  }
+
   if ( event_handlers.barrier_reply_callback == NULL ) {
     debug( "Callback function for barrier reply events is not set." );
     return;
@@ -1288,54 +1415,86 @@ handle_queue_get_config_reply( const uint64_t datapath_id, buffer *data ) {
 }
 
 
+static const char *switch_event_stat_names[] = {
+  [ MESSENGER_OPENFLOW_CONNECTED ] = "switch_connected",
+  [ MESSENGER_OPENFLOW_READY ] = "switch_ready",
+  [ MESSENGER_OPENFLOW_DISCONNECTED ] = "switch_disconnected",
+  [ MESSENGER_OPENFLOW_FAILD_TO_CONNECT ] = "switch_failed_to_connect",
+  [ MESSENGER_OPENFLOW_CONGESTED ] = "switch_congested",
+  [ MESSENGER_OPENFLOW_UNCONGESTED ] = "switch_uncongested",
+};
+#define N_SWITCH_EVENT_STATS ( sizeof( switch_event_stat_names ) / sizeof( switch_event_stat_names[ 0 ] ) )
+
+static const char *openflow_message_stat_names[] = {
+  [ OFPT_HELLO ] = "hello",
+  [ OFPT_ERROR ] = "error",
+  [ OFPT_ECHO_REQUEST ] = "echo_request",
+  [ OFPT_ECHO_REPLY ] = "echo_reply",
+  [ OFPT_VENDOR ] = "vendor",
+  [ OFPT_FEATURES_REQUEST ] = "features_request",
+  [ OFPT_FEATURES_REPLY ] = "features_reply",
+  [ OFPT_GET_CONFIG_REQUEST ] = "get_config_request",
+  [ OFPT_GET_CONFIG_REPLY ] = "get_config_reply",
+  [ OFPT_SET_CONFIG ] = "set_config",
+  [ OFPT_PACKET_IN ] = "packet_in",
+  [ OFPT_FLOW_REMOVED ] = "flow_removed",
+  [ OFPT_PORT_STATUS ] = "port_status",
+  [ OFPT_PACKET_OUT ] = "packet_out",
+  [ OFPT_FLOW_MOD ] = "flow_mod",
+  [ OFPT_PORT_MOD ] = "port_mod",
+  [ OFPT_STATS_REQUEST ] = "stats_request",
+  [ OFPT_STATS_REPLY ] = "stats_reply",
+  [ OFPT_BARRIER_REQUEST ] = "barrier_request",
+  [ OFPT_BARRIER_REPLY ] = "barrier_reply",
+  [ OFPT_QUEUE_GET_CONFIG_REQUEST ] = "queue_get_config_request",
+  [ OFPT_QUEUE_GET_CONFIG_REPLY ] = "queue_get_config_reply",
+};
+#define N_OPENFLOW_MESSAGE_STATS ( sizeof( openflow_message_stat_names ) / sizeof( openflow_message_stat_names[ 0 ] ) )
+
+// Counters are registered on first use and indexed by type, direction
+// and result. The last row is for undefined types.
+static stat_counter *switch_event_stats[ N_SWITCH_EVENT_STATS + 1 ][ 2 ][ 2 ];
+static stat_counter *openflow_message_stats[ N_OPENFLOW_MESSAGE_STATS + 1 ][ 2 ][ 2 ];
+
+
 static void
-update_switch_event_stats( uint16_t type, int send_receive, bool result ) {
-  char key[ STAT_KEY_LENGTH ];
-  char suffix[ 16 ];
-  char direction[ 16 ];
-  const char *prefix = "openflow_application_interface.";
+clear_stat_counters() {
+  memset( switch_event_stats, 0, sizeof( switch_event_stats ) );
+  memset( openflow_message_stats, 0, sizeof( openflow_message_stats ) );
+}
 
-  memset( suffix, '\0', sizeof( suffix ) );
 
-  if ( result ) {
-    sprintf( suffix, "_succeeded" );
-  }
-  else {
-    sprintf( suffix, "_failed" );
+static void
+increment_openflow_stat( stat_counter **counter, const char *name, int send_receive, bool result ) {
+  if ( *counter == NULL ) {
+    char key[ STAT_KEY_LENGTH ];
+    snprintf( key, STAT_KEY_LENGTH, "openflow_application_interface.%s%s%s", name,
+              send_receive == OPENFLOW_MESSAGE_SEND ? "_send" : "_receive",
+              result ? "_succeeded" : "_failed" );
+    *counter = register_stat_counter( key );
+    if ( *counter == NULL ) {
+      return;
+    }
   }
 
-  memset( direction, '\0', sizeof( direction ) );
+  increment_stat_counter( *counter );
+}
 
-  switch ( send_receive ) {
-  case OPENFLOW_MESSAGE_SEND:
-    sprintf( direction, "_send" );
-    break;
-  case OPENFLOW_MESSAGE_RECEIVE:
-    sprintf( direction, "_receive" );
-    break;
-  default:
+
+static void
+update_switch_event_stats( uint16_t type, int send_receive, bool result ) {
+  if ( send_receive != OPENFLOW_MESSAGE_SEND && send_receive != OPENFLOW_MESSAGE_RECEIVE ) {
     return;
   }
 
-  switch ( type ) {
-  case MESSENGER_OPENFLOW_CONNECTED:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "switch_connected", direction, suffix );
-    break;
-  case MESSENGER_OPENFLOW_READY:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "switch_ready", direction, suffix );
-    break;
-  case MESSENGER_OPENFLOW_DISCONNECTED:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "switch_disconnected", direction, suffix );
-    break;
-  case MESSENGER_OPENFLOW_FAILD_TO_CONNECT:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "switch_failed_to_connect", direction, suffix );
-    break;
-  default:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "undefined_switch_event", direction, suffix );
-    break;
+  size_t index = N_SWITCH_EVENT_STATS;
+  const char *name = "undefined_switch_event";
+  if ( type < N_SWITCH_EVENT_STATS && switch_event_stat_names[ type ] != NULL ) {
+    index = type;
+    name = switch_event_stat_names[ type ];
   }
 
-  increment_stat( key );
+  increment_openflow_stat( &switch_event_stats[ index ][ send_receive ][ result ], name, send_receive, result );
 }
 
 
@@ -1373,10 +1532,38 @@ handle_messenger_openflow_disconnected( uint64_t datapath_id ) {
   else {
     debug( "Callback function for switch disconnected events is not set." );
   }
+  delete_pending_flow_batches( datapath_id );
   delete_openflow_messages( datapath_id );
 }
 
 
+static void
+handle_switch_congestion( uint16_t type, void *data, size_t length ) {
+  assert( data != NULL );
+  assert( length == sizeof( openflow_service_header_t ) + sizeof( openflow_send_queue_status_t ) );
+
+  openflow_service_header_t *message = data;
+  uint64_t datapath_id = ntohll( message->datapath_id );
+  openflow_send_queue_status_t *status = ( openflow_send_queue_status_t * ) ( message + 1 );
+  uint32_t queue_length = ntohl( status->queue_length );
+  uint64_t queue_bytes = ntohll( status->queue_bytes );
+  bool congested = ( type == MESSENGER_OPENFLOW_CONGESTED );
+
+  debug( "Send queue to a switch %#" PRIx64 " is %s ( queue_length = %u, queue_bytes = %" PRIu64 " ).",
+         datapath_id, congested ? "congested" : "drained", queue_length, queue_bytes );
+
+  if ( event_handlers.switch_congestion_callback != NULL ) {
+    event_handlers.switch_congestion_callback( datapath_id, congested, queue_length, queue_bytes,
+                                               event_handlers.switch_congestion_user_data );
+  }
+  else {
+    debug( "Callback function for switch congestion events is not set." );
+  }
+
+  update_switch_event_stats( type, OPENFLOW_MESSAGE_RECEIVE, true );
+}
+
+
 static void
 handle_switch_events( uint16_t type, void *data, size_t length ) {
   assert( data != NULL );
@@ -1409,112 +1596,23 @@ handle_switch_events( uint16_t type, void *data, size_t length ) {
 
 static void
 update_openflow_stats( uint8_t type, int send_receive, bool result ) {
-  char key[ STAT_KEY_LENGTH ];
-  char suffix[ 16 ];
-  char direction[ 16 ];
-  const char *prefix = "openflow_application_interface.";
-
-  memset( suffix, '\0', sizeof( suffix ) );
-
-  if ( result ) {
-    sprintf( suffix, "_succeeded" );
-  }
-  else {
-    sprintf( suffix, "_failed" );
-  }
-
-  memset( direction, '\0', sizeof( direction ) );
-
-  switch ( send_receive ) {
-  case OPENFLOW_MESSAGE_SEND:
-    sprintf( direction, "_send" );
-    break;
-  case OPENFLOW_MESSAGE_RECEIVE:
-    sprintf( direction, "_receive" );
-    break;
-  default:
+  if ( send_receive != OPENFLOW_MESSAGE_SEND && send_receive != OPENFLOW_MESSAGE_RECEIVE ) {
     return;
   }
 
-  switch ( type ) {
-  case OFPT_HELLO:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "hello", direction, suffix );
-    break;
-  case OFPT_ERROR:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "error", direction, suffix );
-    break;
-  case OFPT_ECHO_REQUEST:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "echo_request", direction, suffix );
-    break;
-  case OFPT_ECHO_REPLY:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "echo_reply", direction, suffix );
-    break;
-  case OFPT_VENDOR:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "vendor", direction, suffix );
-    break;
-  case OFPT_FEATURES_REQUEST:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "features_request", direction, suffix );
-    break;
-  case OFPT_FEATURES_REPLY:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "features_reply", direction, suffix );
-    break;
-  case OFPT_GET_CONFIG_REQUEST:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "get_config_request", direction, suffix );
-    break;
-  case OFPT_GET_CONFIG_REPLY:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "get_config_reply", direction, suffix );
-    break;
-  case OFPT_SET_CONFIG:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "set_config", direction, suffix );
-    break;
-  case OFPT_PACKET_IN:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "packet_in", direction, suffix );
-    break;
-  case OFPT_FLOW_REMOVED:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "flow_removed", direction, suffix );
-    break;
-  case OFPT_PORT_STATUS:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "port_status", direction, suffix );
-    break;
-  case OFPT_PACKET_OUT:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "packet_out", direction, suffix );
-    break;
-  case OFPT_FLOW_MOD:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "flow_mod", direction, suffix );
-    break;
-  case OFPT_PORT_MOD:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "port_mod", direction, suffix );
-    break;
-  case OFPT_STATS_REQUEST:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "stats_request", direction, suffix );
-    break;
-  case OFPT_STATS_REPLY:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "stats_reply", direction, suffix );
-    break;
-  case OFPT_BARRIER_REQUEST:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "barrier_request", direction, suffix );
-    break;
-  case OFPT_BARRIER_REPLY:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "barrier_reply", direction, suffix );
-    break;
-  case OFPT_QUEUE_GET_CONFIG_REQUEST:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "queue_get_config_request", direction, suffix );
-    break;
-  case OFPT_QUEUE_GET_CONFIG_REPLY:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "queue_get_config_reply", direction, suffix );
-    break;
-  default:
-    snprintf( key, STAT_KEY_LENGTH, "%s%s%s%s", prefix, "undefined_message_type", direction, suffix );
-    break;
+  size_t index = N_OPENFLOW_MESSAGE_STATS;
+  const char *name = "undefined_message_type";
+  if ( type < N_OPENFLOW_MESSAGE_STATS ) {
+    index = type;
+    name = openflow_message_stat_names[ type ];
   }
 
-  increment_stat( key );
+  increment_openflow_stat( &openflow_message_stats[ index ][ send_receive ][ result ], name, send_receive, result );
 }
 
 
 static void
 handle_openflow_message( void *data, size_t length ) {
-  void *p;
   int ret;
   uint64_t datapath_id;
   buffer *buffer;
@@ -1530,12 +1628,11 @@ handle_openflow_message( void *data, size_t length ) {
 
   datapath_id = ntohll( message->datapath_id );
 
-  buffer = alloc_buffer_with_length( length );
+  // The message is handled in place; handlers must copy what they keep.
+  buffer = alloc_buffer_view( data, length );
 
   assert( buffer != NULL );
 
-  p = append_back_buffer( buffer, length );
-  memcpy( p, data, length );
   remove_front_buffer( buffer, sizeof( openflow_service_header_t ) );
 
   ret = validate_openflow_message( buffer );
@@ -1609,6 +1706,9 @@ handle_message( uint16_t type, void *data, size_t length ) {
   case MESSENGER_OPENFLOW_READY:
   case MESSENGER_OPENFLOW_DISCONNECTED:
     return handle_switch_events( type, data, length );
+  case MESSENGER_OPENFLOW_CONGESTED:
+  case MESSENGER_OPENFLOW_UNCONGESTED:
+    return handle_switch_congestion( type, data, length );
   default:
     error( "Unhandled message ( type = %#x ).", type );
     update_switch_event_stats( type, OPENFLOW_MESSAGE_RECEIVE, true );
@@ -1679,11 +1779,30 @@ handle_list_switches_reply( uint16_t message_type, void *data, size_t length, vo
 }
 
 
+static messenger_service_id
+switch_service_id( uint64_t datapath_id ) {
+  unsigned int index = hash_datapath_id( &datapath_id ) % SWITCH_SERVICE_CACHE_SIZE;
+  if ( switch_services[ index ].service == MESSENGER_INVALID_SERVICE_ID ||
+       switch_services[ index ].datapath_id != datapath_id ) {
+    char remote_service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
+    snprintf( remote_service_name, sizeof( remote_service_name ),
+              "switch.%#" PRIx64, datapath_id );
+    // The id of a switch that is evicted from the cache is released, so
+    // that switches coming and going do not pile up service names.
+    release_messenger_service_id( switch_services[ index ].service );
+    switch_services[ index ].datapath_id = datapath_id;
+    switch_services[ index ].service = get_messenger_service_id( remote_service_name );
+  }
+
+  return switch_services[ index ].service;
+}
+
+
 bool
 send_openflow_message( const uint64_t datapath_id, buffer *message ) {
   bool ret;
   void *data;
-  char remote_service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
+  messenger_service_id remote_service;
   uint16_t header_length;
   buffer *buffer;
   struct ofp_header *ofp;
@@ -1698,13 +1817,19 @@ send_openflow_message( const uint64_t datapath_id, buffer *message ) {
   }
 
   ofp = ( struct ofp_header * ) message->data;
-  buffer = duplicate_buffer( message );
-
-  assert( buffer != NULL );
-
   header_length = ( uint16_t ) ( sizeof( openflow_service_header_t )
                   + strlen( service_name ) + 1 );
 
+  // Messages from create_*() have enough headroom for the header, which
+  // is then prepended in place and removed again after sending.
+  if ( headroom_of_buffer( message ) >= header_length ) {
+    buffer = message;
+  }
+  else {
+    buffer = duplicate_buffer( message );
+  }
+  assert( buffer != NULL );
+
   header.datapath_id = htonll( datapath_id );
   header.service_name_length = htons( ( uint16_t ) ( strlen( service_name ) + 1 ) );
 
@@ -1714,27 +1839,188 @@ send_openflow_message( const uint64_t datapath_id, buffer *message ) {
   memcpy( ( char * ) data + sizeof( openflow_service_header_t ),
           service_name, strlen( service_name ) );
 
-  memset( remote_service_name, '\0', sizeof( remote_service_name ) );
-  snprintf( remote_service_name, sizeof( remote_service_name ),
-            "switch.%#" PRIx64, datapath_id );
+  remote_service = switch_service_id( datapath_id );
 
   debug( "Sending an OpenFlow message to %#" PRIx64
          " ( service_name = %s, remote_service_name = %s, "
          "ofp_header = [version = %#x, type = %#x, length = %u, transaction_id = %#x] ).",
-         datapath_id, service_name, remote_service_name,
+         datapath_id, service_name, get_messenger_service_name( remote_service ),
          ofp->version, ofp->type, ntohs( ofp->length ), ntohl( ofp->xid ) );
 
-  ret =  send_message( remote_service_name, MESSENGER_OPENFLOW_MESSAGE,
-                       buffer->data, buffer->length );
+  ret =  send_message_to_handle( remote_service, MESSENGER_OPENFLOW_MESSAGE,
+                                 buffer->data, buffer->length );
+  int send_errno = errno;
 
-  free_buffer( buffer );
+  if ( buffer == message ) {
+    remove_front_buffer( message, header_length );
+  }
+  else {
+    free_buffer( buffer );
+  }
 
   update_openflow_stats( ofp->type, OPENFLOW_MESSAGE_SEND, ret );
+  errno = send_errno;
 
   return ret;
 }
 
 
+flow_batch *
+begin_flow_batch( const uint64_t datapath_id ) {
+  maybe_init_openflow_application_interface();
+  assert( openflow_application_interface_initialized );
+
+  flow_batch *batch = xmalloc( sizeof( flow_batch ) );
+  batch->datapath_id = datapath_id;
+  batch->messages = NULL;
+  batch->header_length = sizeof( openflow_service_header_t ) + strlen( service_name ) + 1;
+
+  return batch;
+}
+
+
+// Counts each message queued in a batch as sent or as failed.
+static void
+update_flow_batch_stats( const flow_batch *batch, bool result ) {
+  size_t offset = batch->header_length;
+  while ( offset < batch->messages->length ) {
+    struct ofp_header *ofp = ( struct ofp_header * ) ( ( char * ) batch->messages->data + offset );
+    update_openflow_stats( ofp->type, OPENFLOW_MESSAGE_SEND, result );
+    offset += ntohs( ofp->length );
+  }
+}
+
+
+/*
+ * Messages are counted in the stats once, as sent when the batch goes out
+ * or as failed when it is discarded, however many attempts it takes.
+ */
+static bool
+flush_flow_batch( flow_batch *batch ) {
+  assert( batch != NULL );
+
+  if ( batch->messages == NULL ) {
+    return true;
+  }
+
+  debug( "Sending a batch of OpenFlow messages to %#" PRIx64 " ( length = %zu ).",
+         batch->datapath_id, batch->messages->length - batch->header_length );
+
+  bool ret = send_message_to_handle( switch_service_id( batch->datapath_id ), MESSENGER_OPENFLOW_MESSAGES,
+                                     batch->messages->data, batch->messages->length );
+
+  // Unsent messages stay in the batch so that they can be sent later.
+  if ( !ret ) {
+    return false;
+  }
+
+  update_flow_batch_stats( batch, true );
+  free_buffer( batch->messages );
+  batch->messages = NULL;
+
+  return true;
+}
+
+
+/*
+ * Copies an OpenFlow message into the batch. A full batch is sent before
+ * the message is added. If that fails, false is returned, the message is
+ * not added and the queued messages are kept in the batch.
+ */
+bool
+add_flow_to_batch( flow_batch *batch, const buffer *flow_mod ) {
+  assert( batch != NULL );
+  assert( flow_mod != NULL );
+  assert( flow_mod->length >= sizeof( struct ofp_header ) );
+
+  if ( batch->messages != NULL && batch->messages->length + flow_mod->length > FLOW_BATCH_MAX_LENGTH ) {
+    if ( !flush_flow_batch( batch ) ) {
+      return false;
+    }
+  }
+
+  if ( batch->messages == NULL ) {
+    batch->messages = alloc_buffer_with_length( FLOW_BATCH_MAX_LENGTH );
+    openflow_service_header_t *header = append_back_buffer( batch->messages, batch->header_length );
+    header->datapath_id = htonll( batch->datapath_id );
+    header->service_name_length = htons( ( uint16_t ) ( batch->header_length - sizeof( openflow_service_header_t ) ) );
+    memcpy( ( char * ) header + sizeof( openflow_service_header_t ), service_name,
+            batch->header_length - sizeof( openflow_service_header_t ) );
+  }
+  memcpy( append_back_buffer( batch->messages, flow_mod->length ), flow_mod->data, flow_mod->length );
+
+  return true;
+}
+
+
+/*
+ * Sends the rest of the batch and frees it. If callback is given, a
+ * barrier request is appended and callback is called on its reply
+ * instead of the barrier reply handler.
+ *
+ * On failure the batch is not freed and still holds the unsent messages.
+ * It may be committed again or freed with discard_flow_batch().
+ */
+bool
+commit_flow_batch( flow_batch *batch, flow_batch_completed_handler callback, void *user_data ) {
+  assert( batch != NULL );
+
+  pending_flow_batch *pending = NULL;
+  size_t barrier_length = 0;
+  if ( callback != NULL ) {
+    uint32_t transaction_id = get_transaction_id();
+    buffer *barrier = create_barrier_request( transaction_id );
+    barrier_length = barrier->length;
+    bool ret = add_flow_to_batch( batch, barrier );
+    free_buffer( barrier );
+    if ( !ret ) {
+      return false;
+    }
+
+    pending = xmalloc( sizeof( pending_flow_batch ) );
+    pending->datapath_id = batch->datapath_id;
+    pending->transaction_id = transaction_id;
+    pending->callback = callback;
+    pending->user_data = user_data;
+    append_to_tail( &pending_flow_batches, pending );
+  }
+
+  if ( !flush_flow_batch( batch ) ) {
+    if ( pending != NULL ) {
+      delete_element( &pending_flow_batches, pending );
+      xfree( pending );
+      // Drops the barrier request so that a retry appends a new one. It
+      // is the last message even if the batch was sent to make room for it.
+      batch->messages->length -= barrier_length;
+      if ( batch->messages->length <= batch->header_length ) {
+        free_buffer( batch->messages );
+        batch->messages = NULL;
+      }
+    }
+    return false;
+  }
+  xfree( batch );
+
+  return true;
+}
+
+
+/*
+ * Frees a batch without sending the messages queued in it. They are
+ * counted as failed.
+ */
+void
+discard_flow_batch( flow_batch *batch ) {
+  assert( batch != NULL );
+
+  if ( batch->messages != NULL ) {
+    update_flow_batch_stats( batch, false );
+    free_buffer( batch->messages );
+  }
+  xfree( batch );
+}
+
+
 bool
 send_list_switches_request( void *user_data ) {
   uint16_t message_type = 0;
@@ -1755,11 +2041,7 @@ bool
 delete_openflow_messages( uint64_t datapath_id ) {
   debug( "Deleting OpenFlow messages in a send queue ( datapath_id = %#" PRIx64 " ).", datapath_id );
 
-  char remote_service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
-  memset( remote_service_name, '\0', sizeof( remote_service_name ) );
-  snprintf( remote_service_name, sizeof( remote_service_name ),
-            "switch.%#" PRIx64, datapath_id );
-  return clear_send_queue( remote_service_name );
+  return clear_send_queue( get_messenger_service_name( switch_service_id( datapath_id ) ) );
 }
 
 
@@ -1779,12 +2061,8 @@ disconnect_switch( uint64_t datapath_id ) {
   char *name = append_back_buffer( buf, service_name_length );
   memcpy( name, service_name, service_name_length );
 
-  char remote_service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
-  snprintf( remote_service_name, sizeof( remote_service_name ),
-            "switch.%#" PRIx64, datapath_id );
-
-  bool ret =  send_message( remote_service_name, MESSENGER_OPENFLOW_DISCONNECT_REQUEST,
-                            buf->data, buf->length );
+  bool ret =  send_message_to_handle( switch_service_id( datapath_id ), MESSENGER_OPENFLOW_DISCONNECT_REQUEST,
+                                      buf->data, buf->length );
 
   free_buffer( buf );
 
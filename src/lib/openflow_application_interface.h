@@ -61,6 +61,15 @@ typedef void ( *switch_disconnected_handler )(
 );
 
 
+typedef void ( *switch_congestion_handler )(
+  uint64_t datapath_id,
+  bool congested,
+  uint32_t queue_length,
+  uint64_t queue_bytes,
+  void *user_data
+);
+
+
 typedef void ( *error_handler )(
   uint64_t datapath_id,
   uint32_t transaction_id,
@@ -191,6 +200,13 @@ typedef void ( *barrier_reply_handler )(
 );
 
 
+typedef void ( *flow_batch_completed_handler )(
+  uint64_t datapath_id,
+  uint32_t transaction_id,
+  void *user_data
+);
+
+
 typedef void ( *queue_get_config_reply_handler )(
   uint64_t datapath_id,
   uint32_t transaction_id,
@@ -250,6 +266,9 @@ typedef struct openflow_event_handlers {
   void *queue_get_config_reply_user_data;
 
   list_switches_reply_handler list_switches_reply_callback;
+
+  switch_congestion_handler switch_congestion_callback;
+  void *switch_congestion_user_data;
 } openflow_event_handlers_t;
 
 
@@ -275,6 +294,7 @@ bool _set_switch_ready_handler( bool simple_callback, void *callback, void *user
 
 
 bool set_switch_disconnected_handler( switch_disconnected_handler callback, void *user_data );
+bool set_switch_congestion_handler( switch_congestion_handler callback, void *user_data );
 bool set_error_handler( error_handler callback, void *user_data );
 bool set_echo_reply_handler( echo_reply_handler callback, void *user_data );
 bool set_vendor_handler( vendor_handler callback, void *user_data );
@@ -322,11 +342,28 @@ bool set_list_switches_reply_handler( list_switches_reply_handler callback );
 
 /********************************************************************************
  * Function for sending an OpenFlow message to an OpenFlow switch.
+ *
+ * Returns false with errno set if the message could not be queued. EAGAIN
+ * means the send queue to the switch daemon is full and the message may be
+ * sent again later. Any other errno ( see send_message() in messenger.h )
+ * is permanent.
  ********************************************************************************/
 
 bool send_openflow_message( const uint64_t datapath_id, buffer *message );
 
 
+/********************************************************************************
+ * Functions for sending a batch of flow_mods to an OpenFlow switch.
+ ********************************************************************************/
+
+typedef struct flow_batch flow_batch;
+
+flow_batch *begin_flow_batch( const uint64_t datapath_id );
+bool add_flow_to_batch( flow_batch *batch, const buffer *flow_mod );
+bool commit_flow_batch( flow_batch *batch, flow_batch_completed_handler callback, void *user_data );
+void discard_flow_batch( flow_batch *batch );
+
+
 /********************************************************************************
  * Function for retrieving the list of switches from Switch Manager.
  ********************************************************************************/
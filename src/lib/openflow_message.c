@@ -26,6 +26,7 @@
 #include <syslog.h>
 #include <unistd.h>
 #include "openflow_message.h"
+#include "openflow_service_interface.h"
 #include "packet_info.h"
 #include "wrapper.h"
 #include "log.h"
@@ -72,6 +73,7 @@ extern void mock_debug( const char *format, ... );
                         | OFPPF_10GB_FD | OFPPF_COPPER | OFPPF_FIBER      \
                         | OFPPF_AUTONEG | OFPPF_PAUSE | OFPPF_PAUSE_ASYM )
 #define FLOW_MOD_FLAGS ( OFPFF_SEND_FLOW_REM | OFPFF_CHECK_OVERLAP | OFPFF_EMERG )
+#define PACKED_ACTIONS_INITIAL_LENGTH 64
 
 
 static uint32_t transaction_id = 0;
@@ -109,7 +111,7 @@ create_header( const uint32_t transaction_id, const uint8_t type, const uint16_t
 
   assert( length >= sizeof( struct ofp_header ) );
 
-  buffer *buffer = alloc_buffer();
+  buffer *buffer = alloc_buffer_with_headroom( OPENFLOW_SERVICE_HEADROOM, length );
   assert( buffer != NULL );
 
   struct ofp_header *header = append_back_buffer( buffer, length );
@@ -492,18 +494,13 @@ get_actions_length( const openflow_actions *actions ) {
 }
 
 
-buffer *
-create_packet_out( const uint32_t transaction_id, const uint32_t buffer_id, const uint16_t in_port,
-                   const openflow_actions *actions, const buffer *data ) {
-  void *a, *d;
+static buffer *
+build_packet_out( const uint32_t transaction_id, const uint32_t buffer_id, const uint16_t in_port,
+                  const uint16_t actions_length, const buffer *data ) {
   uint16_t length;
   uint16_t data_length = 0;
-  uint16_t action_length = 0;
-  uint16_t actions_length = 0;
   buffer *buffer;
   struct ofp_packet_out *packet_out;
-  struct ofp_action_header *action_header;
-  list_element *action;
 
   if ( ( data != NULL ) && ( data->length > 0 ) ) {
     data_length = ( uint16_t ) data->length;
@@ -521,11 +518,6 @@ create_packet_out( const uint32_t transaction_id, const uint32_t buffer_id, cons
     }
   }
 
-  if ( actions != NULL ) {
-    debug( "# of actions = %d.", actions->n_actions );
-    actions_length = get_actions_length( actions );
-  }
-
   length = ( uint16_t ) ( offsetof( struct ofp_packet_out, actions ) + actions_length + data_length );
   buffer = create_header( transaction_id, OFPT_PACKET_OUT, length );
   assert( buffer != NULL );
@@ -535,22 +527,9 @@ create_packet_out( const uint32_t transaction_id, const uint32_t buffer_id, cons
   packet_out->in_port = htons( in_port );
   packet_out->actions_len = htons( actions_length );
 
-  if ( actions_length > 0 ) {
-    a = ( void * ) ( ( char * ) buffer->data + offsetof( struct ofp_packet_out, actions ) );
-
-    action = actions->list;
-    while ( action != NULL ) {
-      action_header = ( struct ofp_action_header * ) action->data;
-      action_length = action_header->len;
-      hton_action( ( struct ofp_action_header * ) a, action_header );
-      a = ( void * ) ( ( char * ) a + action_length );
-      action = action->next;
-    }
-  }
-
   if ( data_length > 0 ) {
-    d = ( void * ) ( ( char * ) buffer->data
-                     + offsetof( struct ofp_packet_out, actions ) + actions_length );
+    void *d = ( void * ) ( ( char * ) buffer->data
+                           + offsetof( struct ofp_packet_out, actions ) + actions_length );
     memcpy( d, data->data, data_length );
   }
 
@@ -558,23 +537,72 @@ create_packet_out( const uint32_t transaction_id, const uint32_t buffer_id, cons
 }
 
 
+// Converts actions into network byte order and writes them back to back.
+static void
+hton_actions( void *dst, const openflow_actions *actions ) {
+  void *a = dst;
+  for ( list_element *action = actions->list; action != NULL; action = action->next ) {
+    struct ofp_action_header *action_header = ( struct ofp_action_header * ) action->data;
+    uint16_t action_length = action_header->len;
+    hton_action( ( struct ofp_action_header * ) a, action_header );
+    a = ( void * ) ( ( char * ) a + action_length );
+  }
+}
+
+
 buffer *
-create_flow_mod( const uint32_t transaction_id, const struct ofp_match match,
-                 const uint64_t cookie, const uint16_t command,
-                 const uint16_t idle_timeout, const uint16_t hard_timeout,
-                 const uint16_t priority, const uint32_t buffer_id,
-                 const uint16_t out_port, const uint16_t flags,
-                 const openflow_actions *actions ) {
-  void *a;
+create_packet_out( const uint32_t transaction_id, const uint32_t buffer_id, const uint16_t in_port,
+                   const openflow_actions *actions, const buffer *data ) {
+  uint16_t actions_length = 0;
+
+  if ( actions != NULL ) {
+    debug( "# of actions = %d.", actions->n_actions );
+    actions_length = get_actions_length( actions );
+  }
+
+  buffer *buffer = build_packet_out( transaction_id, buffer_id, in_port, actions_length, data );
+  if ( actions_length > 0 ) {
+    hton_actions( ( ( struct ofp_packet_out * ) buffer->data )->actions, actions );
+  }
+
+  return buffer;
+}
+
+
+/*
+ * Same as create_packet_out() but takes actions built with
+ * append_packed_action_*(), which are copied as they are.
+ */
+buffer *
+create_packet_out_with_packed_actions( const uint32_t transaction_id, const uint32_t buffer_id, const uint16_t in_port,
+                                       const buffer *actions, const buffer *data ) {
+  uint16_t actions_length = 0;
+
+  if ( actions != NULL ) {
+    actions_length = ( uint16_t ) actions->length;
+  }
+
+  buffer *buffer = build_packet_out( transaction_id, buffer_id, in_port, actions_length, data );
+  if ( actions_length > 0 ) {
+    memcpy( ( ( struct ofp_packet_out * ) buffer->data )->actions, actions->data, actions_length );
+  }
+
+  return buffer;
+}
+
+
+static buffer *
+build_flow_mod( const uint32_t transaction_id, const struct ofp_match match,
+                const uint64_t cookie, const uint16_t command,
+                const uint16_t idle_timeout, const uint16_t hard_timeout,
+                const uint16_t priority, const uint32_t buffer_id,
+                const uint16_t out_port, const uint16_t flags,
+                const uint16_t actions_length ) {
   char match_str[ 1024 ];
   uint16_t length;
-  uint16_t action_length = 0;
-  uint16_t actions_length = 0;
   buffer *buffer;
   struct ofp_match m = match;
   struct ofp_flow_mod *flow_mod;
-  struct ofp_action_header *action_header;
-  list_element *action;
 
   // Because match_to_string() is costly, we check logging_level first.
   if ( get_logging_level() >= LOG_DEBUG ) {
@@ -588,11 +616,6 @@ create_flow_mod( const uint32_t transaction_id, const struct ofp_match match,
            buffer_id, out_port, flags );
   }
 
-  if ( actions != NULL ) {
-    debug( "# of actions = %d.", actions->n_actions );
-    actions_length = get_actions_length( actions );
-  }
-
   length = ( uint16_t ) ( offsetof( struct ofp_flow_mod, actions ) + actions_length );
   buffer = create_header( transaction_id, OFPT_FLOW_MOD, length );
   assert( buffer != NULL );
@@ -608,17 +631,55 @@ create_flow_mod( const uint32_t transaction_id, const struct ofp_match match,
   flow_mod->out_port = htons( out_port );
   flow_mod->flags = htons( flags );
 
+  return buffer;
+}
+
+
+buffer *
+create_flow_mod( const uint32_t transaction_id, const struct ofp_match match,
+                 const uint64_t cookie, const uint16_t command,
+                 const uint16_t idle_timeout, const uint16_t hard_timeout,
+                 const uint16_t priority, const uint32_t buffer_id,
+                 const uint16_t out_port, const uint16_t flags,
+                 const openflow_actions *actions ) {
+  uint16_t actions_length = 0;
+
+  if ( actions != NULL ) {
+    debug( "# of actions = %d.", actions->n_actions );
+    actions_length = get_actions_length( actions );
+  }
+
+  buffer *buffer = build_flow_mod( transaction_id, match, cookie, command, idle_timeout, hard_timeout,
+                                   priority, buffer_id, out_port, flags, actions_length );
   if ( actions_length > 0 ) {
-    a = ( void * ) ( ( char * ) buffer->data + offsetof( struct ofp_flow_mod, actions ) );
-
-    action = actions->list;
-    while ( action != NULL ) {
-      action_header = ( struct ofp_action_header * ) action->data;
-      action_length = action_header->len;
-      hton_action( ( struct ofp_action_header * ) a, action_header );
-      a = ( void * ) ( ( char * ) a + action_length );
-      action = action->next;
-    }
+    hton_actions( ( ( struct ofp_flow_mod * ) buffer->data )->actions, actions );
+  }
+
+  return buffer;
+}
+
+
+/*
+ * Same as create_flow_mod() but takes actions built with
+ * append_packed_action_*(), which are copied as they are.
+ */
+buffer *
+create_flow_mod_with_packed_actions( const uint32_t transaction_id, const struct ofp_match match,
+                                     const uint64_t cookie, const uint16_t command,
+                                     const uint16_t idle_timeout, const uint16_t hard_timeout,
+                                     const uint16_t priority, const uint32_t buffer_id,
+                                     const uint16_t out_port, const uint16_t flags,
+                                     const buffer *actions ) {
+  uint16_t actions_length = 0;
+
+  if ( actions != NULL ) {
+    actions_length = ( uint16_t ) actions->length;
+  }
+
+  buffer *buffer = build_flow_mod( transaction_id, match, cookie, command, idle_timeout, hard_timeout,
+                                   priority, buffer_id, out_port, flags, actions_length );
+  if ( actions_length > 0 ) {
+    memcpy( ( ( struct ofp_flow_mod * ) buffer->data )->actions, actions->data, actions_length );
   }
 
   return buffer;
@@ -1658,6 +1719,171 @@ append_action_vendor( openflow_actions *actions, const uint32_t vendor, const bu
   return ret;
 }
 
+
+/*
+ * Creates an empty buffer to append actions to with
+ * append_packed_action_*(). Actions are written in network byte order
+ * back to back, so that the buffer can be copied into a flow_mod or a
+ * packet_out as it is, and reused for any number of messages.
+ */
+buffer *
+create_packed_actions( void ) {
+  return alloc_buffer_with_length( PACKED_ACTIONS_INITIAL_LENGTH );
+}
+
+
+static void *
+append_packed_action( buffer *actions, const uint16_t type, const uint16_t length ) {
+  assert( actions != NULL );
+  assert( actions->length + length <= UINT16_MAX );
+
+  struct ofp_action_header *action_header = append_back_buffer( actions, length );
+  memset( action_header, 0, length );
+  action_header->type = htons( type );
+  action_header->len = htons( length );
+
+  return action_header;
+}
+
+
+bool
+append_packed_action_output( buffer *actions, const uint16_t port, const uint16_t max_len ) {
+  struct ofp_action_output *action_output = append_packed_action( actions, OFPAT_OUTPUT, sizeof( struct ofp_action_output ) );
+  action_output->port = htons( port );
+  action_output->max_len = htons( max_len );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_vlan_vid( buffer *actions, const uint16_t vlan_vid ) {
+  assert( ( vlan_vid & ~VLAN_VID_MASK ) == 0 );
+
+  struct ofp_action_vlan_vid *action_vlan_vid = append_packed_action( actions, OFPAT_SET_VLAN_VID, sizeof( struct ofp_action_vlan_vid ) );
+  action_vlan_vid->vlan_vid = htons( vlan_vid );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_vlan_pcp( buffer *actions, const uint8_t vlan_pcp ) {
+  assert( ( vlan_pcp & ~VLAN_PCP_MASK ) == 0 );
+
+  struct ofp_action_vlan_pcp *action_vlan_pcp = append_packed_action( actions, OFPAT_SET_VLAN_PCP, sizeof( struct ofp_action_vlan_pcp ) );
+  action_vlan_pcp->vlan_pcp = vlan_pcp;
+
+  return true;
+}
+
+
+bool
+append_packed_action_strip_vlan( buffer *actions ) {
+  append_packed_action( actions, OFPAT_STRIP_VLAN, sizeof( struct ofp_action_header ) );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_dl_src( buffer *actions, const uint8_t hw_addr[ OFP_ETH_ALEN ] ) {
+  assert( hw_addr != NULL );
+
+  struct ofp_action_dl_addr *action_dl_addr = append_packed_action( actions, OFPAT_SET_DL_SRC, sizeof( struct ofp_action_dl_addr ) );
+  memcpy( action_dl_addr->dl_addr, hw_addr, OFP_ETH_ALEN );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_dl_dst( buffer *actions, const uint8_t hw_addr[ OFP_ETH_ALEN ] ) {
+  assert( hw_addr != NULL );
+
+  struct ofp_action_dl_addr *action_dl_addr = append_packed_action( actions, OFPAT_SET_DL_DST, sizeof( struct ofp_action_dl_addr ) );
+  memcpy( action_dl_addr->dl_addr, hw_addr, OFP_ETH_ALEN );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_nw_src( buffer *actions, const uint32_t nw_addr ) {
+  struct ofp_action_nw_addr *action_nw_addr = append_packed_action( actions, OFPAT_SET_NW_SRC, sizeof( struct ofp_action_nw_addr ) );
+  action_nw_addr->nw_addr = htonl( nw_addr );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_nw_dst( buffer *actions, const uint32_t nw_addr ) {
+  struct ofp_action_nw_addr *action_nw_addr = append_packed_action( actions, OFPAT_SET_NW_DST, sizeof( struct ofp_action_nw_addr ) );
+  action_nw_addr->nw_addr = htonl( nw_addr );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_nw_tos( buffer *actions, const uint8_t nw_tos ) {
+  assert( ( nw_tos & ~NW_TOS_MASK ) == 0 );
+
+  struct ofp_action_nw_tos *action_nw_tos = append_packed_action( actions, OFPAT_SET_NW_TOS, sizeof( struct ofp_action_nw_tos ) );
+  action_nw_tos->nw_tos = nw_tos;
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_tp_src( buffer *actions, const uint16_t tp_port ) {
+  struct ofp_action_tp_port *action_tp_port = append_packed_action( actions, OFPAT_SET_TP_SRC, sizeof( struct ofp_action_tp_port ) );
+  action_tp_port->tp_port = htons( tp_port );
+
+  return true;
+}
+
+
+bool
+append_packed_action_set_tp_dst( buffer *actions, const uint16_t tp_port ) {
+  struct ofp_action_tp_port *action_tp_port = append_packed_action( actions, OFPAT_SET_TP_DST, sizeof( struct ofp_action_tp_port ) );
+  action_tp_port->tp_port = htons( tp_port );
+
+  return true;
+}
+
+
+bool
+append_packed_action_enqueue( buffer *actions, const uint16_t port, const uint32_t queue_id ) {
+  struct ofp_action_enqueue *action_enqueue = append_packed_action( actions, OFPAT_ENQUEUE, sizeof( struct ofp_action_enqueue ) );
+  action_enqueue->port = htons( port );
+  action_enqueue->queue_id = htonl( queue_id );
+
+  return true;
+}
+
+
+bool
+append_packed_action_vendor( buffer *actions, const uint32_t vendor, const buffer *body ) {
+  uint16_t body_length = 0;
+
+  if ( ( body != NULL ) && ( body->length > 0 ) ) {
+    body_length = ( uint16_t ) body->length;
+  }
+  assert( ( body_length % 8 ) == 0 );
+
+  struct ofp_action_vendor_header *action_vendor = append_packed_action( actions, OFPAT_VENDOR, ( uint16_t ) ( sizeof( struct ofp_action_vendor_header ) + body_length ) );
+  action_vendor->vendor = htonl( vendor );
+  if ( body_length > 0 ) {
+    memcpy( ( char * ) action_vendor + sizeof( struct ofp_action_vendor_header ), body->data, body_length );
+  }
+
+  return true;
+}
+
+
 // A valid remote version is one of the defined wire protocol numbers for a
 // HELLO message and strictly OpenFlow 1.0 for any other message.
 bool
@@ -84,6 +84,22 @@ buffer *create_flow_mod(
   const uint16_t flags,
   const openflow_actions *actions
 );
+buffer *create_packet_out_with_packed_actions( const uint32_t transaction_id, const uint32_t buffer_id,
+                                               const uint16_t in_port, const buffer *actions,
+                                               const buffer *data );
+buffer *create_flow_mod_with_packed_actions(
+  const uint32_t transaction_id,
+  const struct ofp_match match,
+  const uint64_t cookie,
+  const uint16_t command,
+  const uint16_t idle_timeout,
+  const uint16_t hard_timeout,
+  const uint16_t priority,
+  const uint32_t buffer_id,
+  const uint16_t out_port,
+  const uint16_t flags,
+  const buffer *actions
+);
 buffer *create_port_mod( const uint32_t transaction_id, const uint16_t port_no,
                          const uint8_t hw_addr[ OFP_ETH_ALEN ], const uint32_t config,
                          const uint32_t mask, const uint32_t advertise );
@@ -146,6 +162,24 @@ bool append_action_enqueue( openflow_actions *actions, const uint16_t port,
 bool append_action_vendor( openflow_actions *actions, const uint32_t vendor,
                            const buffer *data );
 
+// Actions in network byte order, packed back to back in a buffer
+buffer *create_packed_actions( void );
+bool append_packed_action_output( buffer *actions, const uint16_t port, const uint16_t max_len );
+bool append_packed_action_set_vlan_vid( buffer *actions, const uint16_t vlan_vid );
+bool append_packed_action_set_vlan_pcp( buffer *actions, const uint8_t vlan_pcp );
+bool append_packed_action_strip_vlan( buffer *actions );
+bool append_packed_action_set_dl_src( buffer *actions, const uint8_t hw_addr[ OFP_ETH_ALEN ] );
+bool append_packed_action_set_dl_dst( buffer *actions, const uint8_t hw_addr[ OFP_ETH_ALEN ] );
+bool append_packed_action_set_nw_src( buffer *actions, const uint32_t nw_addr );
+bool append_packed_action_set_nw_dst( buffer *actions, const uint32_t nw_addr );
+bool append_packed_action_set_nw_tos( buffer *actions, const uint8_t nw_tos );
+bool append_packed_action_set_tp_src( buffer *actions, const uint16_t tp_port );
+bool append_packed_action_set_tp_dst( buffer *actions, const uint16_t tp_port );
+bool append_packed_action_enqueue( buffer *actions, const uint16_t port,
+                                   const uint32_t queue_id );
+bool append_packed_action_vendor( buffer *actions, const uint32_t vendor,
+                                  const buffer *data );
+
 
 // Return code definitions indicating the result of OpenFlow message validation.
 enum {
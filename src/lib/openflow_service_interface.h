@@ -32,13 +32,17 @@
 #define MESSENGER_OPENFLOW_DISCONNECTED 4
 #define MESSENGER_OPENFLOW_DISCONNECT_REQUEST 5
 #define MESSENGER_OPENFLOW_FAILD_TO_CONNECT 6
+#define MESSENGER_OPENFLOW_MESSAGES 7
+#define MESSENGER_OPENFLOW_CONGESTED 8
+#define MESSENGER_OPENFLOW_UNCONGESTED 9
 
 
 /**
  * Header for sending/receiving OpenFlow messages or events via messenger.
  * A null-terminated service name can be provided after service_name_len
  * and an OpenFlow message must be included in the rest of part in case of
- * MESSENGER_OPENFLOW_MESSAGE. service_name_length can be zero if service
+ * MESSENGER_OPENFLOW_MESSAGE, or a sequence of OpenFlow messages in case
+ * of MESSENGER_OPENFLOW_MESSAGES. service_name_length can be zero if service
  * name notification is not necessary.
  */
 typedef struct openflow_service_header {
@@ -47,6 +51,25 @@ typedef struct openflow_service_header {
 } __attribute__( ( packed ) ) openflow_service_header_t;
 
 
+/**
+ * Space reserved in front of OpenFlow messages created by
+ * openflow_message so that the header above and a service name can be
+ * prepended without copying the message.
+ */
+#define OPENFLOW_SERVICE_HEADROOM 64
+
+
+/**
+ * Follows openflow_service_header_t in MESSENGER_OPENFLOW_CONGESTED and
+ * MESSENGER_OPENFLOW_UNCONGESTED events. It tells how much is waiting in
+ * the send queue of the switch daemon to be written to the switch.
+ */
+typedef struct openflow_send_queue_status {
+  uint32_t queue_length; // number of OpenFlow messages
+  uint64_t queue_bytes;
+} __attribute__( ( packed ) ) openflow_send_queue_status_t;
+
+
 #endif // OPENFLOW_SERVICE_INTERFACE_H
 
 
@@ -33,6 +33,7 @@
 typedef struct {
   void *callback;
   void *user_data;
+  bool with_stats;
 } handler_data;
 
 
@@ -92,10 +93,17 @@ ntoh_packetin_filter_entry( packetin_filter_entry *dst, packetin_filter_entry *s
 
 
 static void
-dump_completed( int status, int n_entries, packetin_filter_entry *entries, handler_data *data ) {
+dump_completed( int status, int n_entries, packetin_filter_entry *entries, packetin_filter_stats *stats,
+                handler_data *data ) {
   if ( data->callback != NULL ) {
-    dump_packetin_filter_handler callback = data->callback;
-    callback( status, n_entries, entries, data->user_data );
+    if ( data->with_stats ) {
+      dump_packetin_filter_stats_handler callback = data->callback;
+      callback( status, n_entries, entries, stats, data->user_data );
+    }
+    else {
+      dump_packetin_filter_handler callback = data->callback;
+      callback( status, n_entries, entries, data->user_data );
+    }
   }
   xfree( data );
 }
@@ -163,14 +171,15 @@ delete_packetin_filter( struct ofp_match match, uint16_t priority, char *service
 }
 
 
-bool
-dump_packetin_filter( struct ofp_match match, uint16_t priority, char *service_name, bool strict,
-                      dump_packetin_filter_handler callback, void *user_data ) {
+static bool
+send_dump_packetin_filter_request( struct ofp_match match, uint16_t priority, char *service_name, bool strict,
+                                   void *callback, bool with_stats, void *user_data ) {
   maybe_init_packetin_filter_interface();
 
   handler_data *data = xmalloc( sizeof( handler_data ) );
   data->callback = callback;
   data->user_data = user_data;
+  data->with_stats = with_stats;
 
   dump_packetin_filter_request request;
   memset( &request, 0, sizeof( dump_packetin_filter_request ) );
@@ -196,6 +205,20 @@ dump_packetin_filter( struct ofp_match match, uint16_t priority, char *service_n
 }
 
 
+bool
+dump_packetin_filter( struct ofp_match match, uint16_t priority, char *service_name, bool strict,
+                      dump_packetin_filter_handler callback, void *user_data ) {
+  return send_dump_packetin_filter_request( match, priority, service_name, strict, callback, false, user_data );
+}
+
+
+bool
+dump_packetin_filter_stats( struct ofp_match match, uint16_t priority, char *service_name, bool strict,
+                            dump_packetin_filter_stats_handler callback, void *user_data ) {
+  return send_dump_packetin_filter_request( match, priority, service_name, strict, callback, true, user_data );
+}
+
+
 static void
 handle_reply( uint16_t tag, void *data, size_t length, void *user_data ) {
   switch ( tag ) {
@@ -226,23 +249,36 @@ handle_reply( uint16_t tag, void *data, size_t length, void *user_data ) {
         return;
       }
       dump_packetin_filter_reply *reply = data;
-      size_t expected_length = offsetof( dump_packetin_filter_reply, entries ) + sizeof( packetin_filter_entry ) * ntohl( reply->n_entries );
-      if ( length != expected_length ) {
+      size_t entries_length = offsetof( dump_packetin_filter_reply, entries ) + sizeof( packetin_filter_entry ) * ntohl( reply->n_entries );
+      size_t stats_length = sizeof( packetin_filter_stats ) * ntohl( reply->n_entries );
+      // Hit counts are optional so that replies without them are still accepted.
+      if ( length != entries_length && length != entries_length + stats_length ) {
         error( "Invalid dump packetin filter reply ( length = %zu ).", length );
         return;
       }
       packetin_filter_entry *entries = NULL;
+      packetin_filter_stats *stats = NULL;
       int n_entries = ( int ) ntohl( reply->n_entries );
       if ( n_entries > 0 && reply->entries != NULL ) {
         entries = xmalloc( sizeof( packetin_filter_entry ) * ( size_t ) n_entries );
         for ( int i = 0; i < n_entries; i++ ) {
           ntoh_packetin_filter_entry( &entries[ i ], &reply->entries[ i ] );
         }
+        if ( length > entries_length ) {
+          packetin_filter_stats *src = ( packetin_filter_stats * ) ( ( char * ) data + entries_length );
+          stats = xmalloc( stats_length );
+          for ( int i = 0; i < n_entries; i++ ) {
+            stats[ i ].n_hits = ntohll( src[ i ].n_hits );
+          }
+        }
       }
-      dump_completed( reply->status, n_entries, entries, user_data );
+      dump_completed( reply->status, n_entries, entries, stats, user_data );
       if ( entries != NULL ) {
         xfree( entries );
       }
+      if ( stats != NULL ) {
+        xfree( stats );
+      }
     }
     break;
     default:
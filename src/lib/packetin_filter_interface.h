@@ -55,6 +55,10 @@ typedef struct {
   char service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
 } __attribute__( ( packed ) ) packetin_filter_entry;
 
+typedef struct {
+  uint64_t n_hits; // packets matched so far
+} __attribute__( ( packed ) ) packetin_filter_stats;
+
 typedef struct {
   packetin_filter_entry entry;
 } __attribute__( ( packed ) ) add_packetin_filter_request;
@@ -82,6 +86,7 @@ typedef struct {
   uint8_t status;
   uint32_t n_entries;
   packetin_filter_entry entries[ 0 ];
+  // Followed by packetin_filter_stats[ n_entries ] in the same order as entries.
 } __attribute__( ( packed ) ) dump_packetin_filter_reply;
 
 
@@ -103,6 +108,14 @@ typedef void ( *dump_packetin_filter_handler )(
   void *user_data
 );
 
+typedef void ( *dump_packetin_filter_stats_handler )(
+  int status,
+  int n_entries,
+  packetin_filter_entry *entries,
+  packetin_filter_stats *stats,
+  void *user_data
+);
+
 
 bool add_packetin_filter( struct ofp_match match, uint16_t priority, char *service_name,
                           add_packetin_filter_handler callback, void *user_data );
@@ -110,6 +123,8 @@ bool delete_packetin_filter( struct ofp_match match, uint16_t priority, char *se
                              delete_packetin_filter_handler callback, void *user_data );
 bool dump_packetin_filter( struct ofp_match match, uint16_t priority, char *service_name, bool strict,
                            dump_packetin_filter_handler callback, void *user_data );
+bool dump_packetin_filter_stats( struct ofp_match match, uint16_t priority, char *service_name, bool strict,
+                                 dump_packetin_filter_stats_handler callback, void *user_data );
 bool init_packetin_filter_interface( void );
 bool finalize_packetin_filter_interface( void );
 
@@ -21,23 +21,180 @@
 #include <errno.h>
 #include <limits.h>
 #include <sqlite3.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "checks.h"
+#include "hash_table.h"
 #include "log.h"
 #include "persistent_storage.h"
 #include "trema_private.h"
 #include "trema_wrapper.h"
+#include "utility.h"
 #include "wrapper.h"
 
 
 static const size_t MAX_KEY_LENGTH = 256;
 static const size_t MAX_VALUE_LENGTH = 256;
+static const unsigned int MAX_CACHE_ENTRIES = 65536;
+static const int BUSY_TIMEOUT_MSEC = 1000;
 static const char DEFAULT_DB_FILE[] = ".trema.db";
 static char *db_file = NULL;
 static sqlite3 *db_handle = NULL;
 static bool backend_initialized = false;
+static bool in_batch = false;
+
+enum {
+  SELECT_STATEMENT,
+  INSERT_STATEMENT,
+  UPDATE_STATEMENT,
+  DELETE_STATEMENT,
+  DATA_VERSION_STATEMENT,
+  N_STATEMENTS,
+};
+
+static const char *statement_sqls[ N_STATEMENTS ] = {
+  [ SELECT_STATEMENT ] = "SELECT value FROM trema WHERE key = ?",
+  [ INSERT_STATEMENT ] = "INSERT INTO trema (key,value) VALUES (?,?)",
+  [ UPDATE_STATEMENT ] = "UPDATE trema SET value = ? WHERE key = ?",
+  [ DELETE_STATEMENT ] = "DELETE FROM trema WHERE key = ?",
+  [ DATA_VERSION_STATEMENT ] = "PRAGMA data_version",
+};
+static sqlite3_stmt *statements[ N_STATEMENTS ];
+
+// Write-through cache of the table ( key => cache_entry ).
+typedef struct {
+  char *value;
+  char key[];
+} cache_entry;
+
+static hash_table *cache = NULL;
+static int64_t cache_data_version = -1;
+
+
+static void
+clear_cache() {
+  if ( cache == NULL ) {
+    return;
+  }
+
+  hash_iterator iter;
+  hash_entry *e;
+  init_hash_iterator( cache, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    cache_entry *entry = delete_hash_entry( cache, e->key );
+    xfree( entry->value );
+    xfree( entry );
+  }
+}
+
+
+static void
+delete_cache() {
+  if ( cache == NULL ) {
+    return;
+  }
+
+  clear_cache();
+  delete_hash( cache );
+  cache = NULL;
+  cache_data_version = -1;
+}
+
+
+static const char *
+lookup_cache( const char *key ) {
+  cache_entry *entry = lookup_hash_entry( cache, key );
+  if ( entry == NULL ) {
+    return NULL;
+  }
+
+  return entry->value;
+}
+
+
+static void
+update_cache( const char *key, const char *value ) {
+  cache_entry *entry = lookup_hash_entry( cache, key );
+  if ( entry != NULL ) {
+    xfree( entry->value );
+    entry->value = xstrdup( value );
+    return;
+  }
+
+  if ( cache->length >= MAX_CACHE_ENTRIES ) {
+    clear_cache();
+  }
+  size_t length = strlen( key ) + 1;
+  entry = xmalloc( sizeof( cache_entry ) + length );
+  memcpy( entry->key, key, length );
+  entry->value = xstrdup( value );
+  insert_hash_entry( cache, entry->key, entry );
+}
+
+
+static void
+invalidate_cache( const char *key ) {
+  cache_entry *entry = delete_hash_entry( cache, key );
+  if ( entry != NULL ) {
+    xfree( entry->value );
+    xfree( entry );
+  }
+}
+
+
+static void
+finalize_statements() {
+  for ( int i = 0; i < N_STATEMENTS; i++ ) {
+    if ( statements[ i ] != NULL ) {
+      sqlite3_finalize( statements[ i ] );
+      statements[ i ] = NULL;
+    }
+  }
+}
+
+
+static bool
+prepare_statements() {
+  for ( int i = 0; i < N_STATEMENTS; i++ ) {
+    int ret = trema_sqlite3_prepare_v2( db_handle, statement_sqls[ i ], -1, &statements[ i ], NULL );
+    if ( ret != SQLITE_OK ) {
+      error( "Failed to prepare a SQL statement ( statement = %s, error = %s ).",
+             statement_sqls[ i ], trema_sqlite3_errmsg( db_handle ) );
+      finalize_statements();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static void
+reset_statement( sqlite3_stmt *statement ) {
+  sqlite3_reset( statement );
+  sqlite3_clear_bindings( statement );
+}
+
+
+/*
+ * Steps a statement whose parameters are bound. Returns SQLITE_ROW or
+ * SQLITE_DONE, or -1 on failure. The caller resets the statement.
+ */
+static int
+step_statement( sqlite3_stmt *statement ) {
+  int ret = trema_sqlite3_step( statement );
+  if ( ret != SQLITE_ROW && ret != SQLITE_DONE ) {
+    char *sql = sqlite3_expanded_sql( statement );
+    error( "Failed to execute a SQL statement ( statement = %s, error = %s ).",
+           sql != NULL ? sql : sqlite3_sql( statement ), trema_sqlite3_errmsg( db_handle ) );
+    trema_sqlite3_free( sql );
+    return -1;
+  }
+
+  return ret;
+}
 
 
 static bool
@@ -45,6 +202,13 @@ finalize_backend( bool delete_file ) {
   assert( db_handle != NULL );
   assert( db_file != NULL );
 
+  if ( in_batch ) {
+    warn( "Discarding an uncommitted batch." );
+    in_batch = false;
+  }
+  delete_cache();
+  finalize_statements();
+
   int ret = trema_sqlite3_close( db_handle );
   if ( ret != SQLITE_OK ) {
     error( "Failed to destroy a sqlite3 object ( %s ).", trema_sqlite3_errmsg( db_handle ) );
@@ -60,6 +224,12 @@ finalize_backend( bool delete_file ) {
              db_file, strerror_r( errno, buf, sizeof( buf ) ), errno );
       goto error;
     }
+    // Left behind only if another process still has the database open.
+    char path[ PATH_MAX ];
+    snprintf( path, sizeof( path ), "%s-wal", db_file );
+    unlink( path );
+    snprintf( path, sizeof( path ), "%s-shm", db_file );
+    unlink( path );
   }
 
   xfree( db_file );
@@ -92,6 +262,7 @@ init_backend() {
     finalize_backend( false );
     return false;
   }
+  sqlite3_busy_timeout( db_handle, BUSY_TIMEOUT_MSEC );
 
   char *err = NULL;
   char *statement = sqlite3_mprintf( "CREATE TABLE IF NOT EXISTS trema ( key TEXT, value TEXT, CONSTRAINT key_unique UNIQUE (key) ON CONFLICT FAIL )" );
@@ -108,24 +279,42 @@ init_backend() {
   }
   trema_sqlite3_free( statement );
 
-  return true;
-}
+  // A write-ahead log lets a commit append to the log without an fsync
+  // while readers in other processes keep going.
+  ret = trema_sqlite3_exec( db_handle, "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL", NULL, NULL, &err );
+  if ( ret != SQLITE_OK ) {
+    warn( "Failed to enable write-ahead logging ( error = %s ).", err );
+    trema_sqlite3_free( err );
+  }
 
+  if ( !prepare_statements() ) {
+    finalize_backend( false );
+    return false;
+  }
+  cache = create_hash( compare_string, hash_string );
+  cache_data_version = -1;
 
-static int
-save_value( void *value, int n_columns, char **columns, char **column_names ) {
-  UNUSED( column_names );
+  return true;
+}
 
-  assert( n_columns == 1 );
-  assert( columns != NULL );
-  assert( columns[ 0 ] != NULL );
-  assert( value != NULL );
 
-  size_t length = strlen( columns[ 0 ] ) + 1;
-  *( char ** ) value = xmalloc( length );
-  strncpy( *( char ** ) value, columns[ 0 ], length );
+/*
+ * Drops the cache if another connection has committed since the last
+ * check. PRAGMA data_version does not change on our own commits.
+ */
+static void
+validate_cache() {
+  sqlite3_stmt *statement = statements[ DATA_VERSION_STATEMENT ];
+  int64_t data_version = -1;
+  if ( sqlite3_step( statement ) == SQLITE_ROW ) {
+    data_version = sqlite3_column_int64( statement, 0 );
+  }
+  sqlite3_reset( statement );
 
-  return 0;
+  if ( data_version < 0 || data_version != cache_data_version ) {
+    clear_cache();
+  }
+  cache_data_version = data_version;
 }
 
 
@@ -134,42 +323,31 @@ get_value_from_backend( const char *key ) {
   assert( db_handle != NULL );
   assert( key != NULL );
 
+  sqlite3_stmt *statement = statements[ SELECT_STATEMENT ];
+  sqlite3_bind_text( statement, 1, key, -1, SQLITE_STATIC );
   char *value = NULL;
-  char *err = NULL;
-  char *statement = sqlite3_mprintf( "SELECT value FROM trema WHERE key = '%q'", key );
-  int ret = trema_sqlite3_exec( db_handle, statement, save_value, &value, &err );
-  if ( ret != SQLITE_OK ) {
-    error( "Failed to execute a SQL statement ( statement = %s, error = %s ).", statement, err );
-    trema_sqlite3_free( statement );
-    trema_sqlite3_free( err );
-    return NULL;
+  if ( step_statement( statement ) == SQLITE_ROW ) {
+    const char *column = ( const char * ) sqlite3_column_text( statement, 0 );
+    value = xstrdup( column != NULL ? column : "" );
   }
-  trema_sqlite3_free( statement );
+  reset_statement( statement );
 
   return value;
 }
 
 
 static bool
-save_value_to_backend( const char *key, const char *value ) {
-  assert( db_handle != NULL );
-  assert( key != NULL );
-
-  char *err = NULL;
-  char *statement = sqlite3_mprintf( "INSERT INTO trema (key,value) VALUES ('%q','%q')", key, value );
-  int ret = trema_sqlite3_exec( db_handle, statement, NULL, NULL, &err );
-  if ( ret != SQLITE_OK ) {
-    error( "Failed to execute a SQL statement ( statement = %s, error = %s ).", statement, err );
-    trema_sqlite3_free( statement );
-    trema_sqlite3_free( err );
+execute_update( sqlite3_stmt *statement, const char *changed ) {
+  int ret = step_statement( statement );
+  reset_statement( statement );
+  if ( ret < 0 ) {
     return false;
   }
-  trema_sqlite3_free( statement );
 
   int n_changes = trema_sqlite3_changes( db_handle );
   if ( n_changes != 1 ) {
     if ( n_changes > 1 ) {
-      error( "Multiple entries are created ( n_changes = %d ).", n_changes );
+      error( "Multiple entries are %s ( n_changes = %d ).", changed, n_changes );
     }
     return false;
   }
@@ -179,30 +357,28 @@ save_value_to_backend( const char *key, const char *value ) {
 
 
 static bool
-update_value_on_backend( const char *key, const char *value ) {
+save_value_to_backend( const char *key, const char *value ) {
   assert( db_handle != NULL );
   assert( key != NULL );
 
-  char *err = NULL;
-  char *statement = sqlite3_mprintf( "UPDATE trema SET value = '%q' WHERE key = '%q'", value, key );
-  int ret = trema_sqlite3_exec( db_handle, statement, NULL, NULL, &err );
-  if ( ret != SQLITE_OK ) {
-    error( "Failed to execute a SQL statement ( statement = %s, error = %s ).", statement, err );
-    trema_sqlite3_free( statement );
-    trema_sqlite3_free( err );
-    return false;
-  }
-  trema_sqlite3_free( statement );
+  sqlite3_stmt *statement = statements[ INSERT_STATEMENT ];
+  sqlite3_bind_text( statement, 1, key, -1, SQLITE_STATIC );
+  sqlite3_bind_text( statement, 2, value, -1, SQLITE_STATIC );
 
-  int n_changes = trema_sqlite3_changes( db_handle );
-  if ( n_changes != 1 ) {
-    if ( n_changes > 1 ) {
-      error( "Multiple entries are updated ( n_changes = %d ).", n_changes );
-    }
-    return false;
-  }
+  return execute_update( statement, "created" );
+}
 
-  return true;
+
+static bool
+update_value_on_backend( const char *key, const char *value ) {
+  assert( db_handle != NULL );
+  assert( key != NULL );
+
+  sqlite3_stmt *statement = statements[ UPDATE_STATEMENT ];
+  sqlite3_bind_text( statement, 1, value, -1, SQLITE_STATIC );
+  sqlite3_bind_text( statement, 2, key, -1, SQLITE_STATIC );
+
+  return execute_update( statement, "updated" );
 }
 
 
@@ -211,26 +387,10 @@ delete_key_value_from_backend( const char *key ) {
   assert( db_handle != NULL );
   assert( key != NULL );
 
-  char *err = NULL;
-  char *statement = sqlite3_mprintf( "DELETE FROM trema WHERE key = '%q'", key );
-  int ret = trema_sqlite3_exec( db_handle, statement, NULL, NULL, &err );
-  if ( ret != SQLITE_OK ) {
-    error( "Failed to execute a SQL statement ( statement = %s, error = %s ).", statement, err );
-    trema_sqlite3_free( statement );
-    trema_sqlite3_free( err );
-    return false;
-  }
-  trema_sqlite3_free( statement );
-
-  int n_changes = trema_sqlite3_changes( db_handle );
-  if ( n_changes != 1 ) {
-    if ( n_changes > 1 ) {
-      error( "Multiple entries are deleted ( n_changes = %d ).", n_changes );
-    }
-    return false;
-  }
+  sqlite3_stmt *statement = statements[ DELETE_STATEMENT ];
+  sqlite3_bind_text( statement, 1, key, -1, SQLITE_STATIC );
 
-  return true;
+  return execute_update( statement, "deleted" );
 }
 
 
@@ -283,11 +443,19 @@ static bool
 key_exists( const char *key ) {
   assert( key != NULL );
 
+  // set_value() and delete_key_value() choose their statement from this
+  // answer, so it must not come from a cache another process has outdated.
+  validate_cache();
+  if ( lookup_cache( key ) != NULL ) {
+    return true;
+  }
+
   char *retrieved = get_value_from_backend( key );
   if ( retrieved == NULL ) {
     return false;
   }
 
+  update_cache( key, retrieved );
   xfree( retrieved );
 
   return true;
@@ -377,11 +545,21 @@ set_value( const char *key, const char *value ) {
     return false;
   }
 
+  bool ret;
   if ( key_exists( key ) ) {
-    return update_value_on_backend( key, value );
+    ret = update_value_on_backend( key, value );
+  }
+  else {
+    ret = save_value_to_backend( key, value );
+  }
+  if ( ret ) {
+    update_cache( key, value );
+  }
+  else {
+    invalidate_cache( key );
   }
 
-  return save_value_to_backend( key, value );
+  return ret;
 }
 
 
@@ -402,10 +580,17 @@ get_value( const char *key, char *value, const size_t length ) {
     return false;
   }
 
-  char *retrieved = get_value_from_backend( key );
+  validate_cache();
+  const char *retrieved = lookup_cache( key );
   if ( retrieved == NULL ) {
-    error( "Failed to retrieve a value for '%s'.", key );
-    return false;
+    char *fetched = get_value_from_backend( key );
+    if ( fetched == NULL ) {
+      error( "Failed to retrieve a value for '%s'.", key );
+      return false;
+    }
+    update_cache( key, fetched );
+    xfree( fetched );
+    retrieved = lookup_cache( key );
   }
 
   size_t required_length = strlen( retrieved ) + 1;
@@ -415,8 +600,7 @@ get_value( const char *key, char *value, const size_t length ) {
     return false;
   }
 
-  strncpy( value, retrieved, required_length );
-  xfree( retrieved );
+  memcpy( value, retrieved, required_length );
 
   return true;
 }
@@ -436,7 +620,70 @@ delete_key_value( const char *key ) {
     return false;
   }
 
-  return delete_key_value_from_backend( key );
+  bool ret = delete_key_value_from_backend( key );
+  invalidate_cache( key );
+
+  return ret;
+}
+
+
+static bool
+execute_transaction_statement( const char *statement ) {
+  char *err = NULL;
+  int ret = trema_sqlite3_exec( db_handle, statement, NULL, NULL, &err );
+  if ( ret != SQLITE_OK ) {
+    error( "Failed to execute a SQL statement ( statement = %s, error = %s ).", statement, err );
+    trema_sqlite3_free( err );
+    return false;
+  }
+
+  return true;
+}
+
+
+/*
+ * Groups subsequent set_value() and delete_key_value() calls into a
+ * single transaction, which is written out by
+ * commit_persistent_storage_batch().
+ */
+bool
+begin_persistent_storage_batch() {
+  if ( !backend_ready() ) {
+    return false;
+  }
+  if ( in_batch ) {
+    error( "A batch is already in progress." );
+    return false;
+  }
+
+  if ( !execute_transaction_statement( "BEGIN IMMEDIATE" ) ) {
+    return false;
+  }
+  in_batch = true;
+
+  return true;
+}
+
+
+bool
+commit_persistent_storage_batch() {
+  if ( !backend_ready() ) {
+    return false;
+  }
+  if ( !in_batch ) {
+    error( "No batch is in progress." );
+    return false;
+  }
+
+  in_batch = false;
+  if ( !execute_transaction_statement( "COMMIT" ) ) {
+    // Nothing in the batch is stored, so neither is the cache valid.
+    execute_transaction_statement( "ROLLBACK" );
+    clear_cache();
+    return false;
+  }
+
+  return true;
 }
 
 
@@ -31,6 +31,8 @@ bool clear_persistent_storage();
 bool set_value( const char *key, const char *value );
 bool get_value( const char *key, char *value, const size_t length );
 bool delete_key_value( const char *key );
+bool begin_persistent_storage_batch();
+bool commit_persistent_storage_batch();
 
 
 #endif // PERSISTENT_STORAGE_H
@@ -20,7 +20,7 @@
 #include <inttypes.h>
 #include <pthread.h>
 #include "bool.h"
-#include "hash_table.h"
+#include "flat_hash_table.h"
 #include "log.h"
 #include "stat.h"
 #include "utility.h"
@@ -58,33 +58,38 @@ void mock_error( const char *format, ... );
 
 #endif // UNIT_TESTING
 
-static hash_table *stats = NULL;
+#define MAX_STAT_REPORTERS 8
+
+static flat_hash_table *stats = NULL;
 static pthread_mutex_t stats_table_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static stat_reporter reporters[ MAX_STAT_REPORTERS ];
+static unsigned int n_reporters = 0;
 
 
 static void
 create_stats_table() {
   assert( stats == NULL );
-  stats = create_hash( compare_string, hash_string );
+  // Accesses are serialized by stats_table_mutex.
+  stats = create_flat_hash( compare_string, hash_string, FLAT_HASH_NO_LOCK );
   assert( stats != NULL );
 }
 
 
 static void
 delete_stats_table() {
-  hash_iterator iter;
+  flat_hash_iterator iter;
   hash_entry *e;
 
   assert( stats != NULL );
 
-  init_hash_iterator( stats, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
-    void *value = delete_hash_entry( stats, e->key );
+  init_flat_hash_iterator( stats, &iter );
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
+    void *value = delete_flat_hash_entry( stats, e->key );
     if ( value != NULL ) {
       xfree( value );
     }
   }
-  delete_hash( stats );
+  delete_flat_hash( stats );
   stats = NULL;
 }
 
@@ -114,19 +119,65 @@ finalize_stat() {
 
   pthread_mutex_lock( &stats_table_mutex );
   delete_stats_table();
+  n_reporters = 0;
+  pthread_mutex_unlock( &stats_table_mutex );
+
+  return true;
+}
+
+
+bool
+add_stat_reporter( stat_reporter reporter ) {
+  assert( reporter != NULL );
+
+  pthread_mutex_lock( &stats_table_mutex );
+
+  for ( unsigned int i = 0; i < n_reporters; i++ ) {
+    if ( reporters[ i ] == reporter ) {
+      pthread_mutex_unlock( &stats_table_mutex );
+      return true;
+    }
+  }
+  if ( n_reporters >= MAX_STAT_REPORTERS ) {
+    error( "Too many statistics reporters ( max = %d ).", MAX_STAT_REPORTERS );
+    pthread_mutex_unlock( &stats_table_mutex );
+    return false;
+  }
+  reporters[ n_reporters++ ] = reporter;
+
   pthread_mutex_unlock( &stats_table_mutex );
 
   return true;
 }
 
 
+bool
+delete_stat_reporter( stat_reporter reporter ) {
+  assert( reporter != NULL );
+
+  pthread_mutex_lock( &stats_table_mutex );
+
+  for ( unsigned int i = 0; i < n_reporters; i++ ) {
+    if ( reporters[ i ] == reporter ) {
+      reporters[ i ] = reporters[ --n_reporters ];
+      pthread_mutex_unlock( &stats_table_mutex );
+      return true;
+    }
+  }
+
+  pthread_mutex_unlock( &stats_table_mutex );
+
+  return false;
+}
+
+
 bool
 add_stat_entry( const char *key ) {
   assert( key != NULL );
 
   pthread_mutex_lock( &stats_table_mutex );
 
-  stat_entry *entry = lookup_hash_entry( stats, key );
+  stat_entry *entry = lookup_flat_hash_entry( stats, key );
 
   if ( entry != NULL ) {
     error( "Statistic entry for %s already exists.", key );
@@ -136,10 +187,11 @@ add_stat_entry( const char *key ) {
 
   entry = xmalloc( sizeof( stat_entry ) );
   entry->value = 0;
+  entry->counter = false;
   strncpy( entry->key, key, STAT_KEY_LENGTH );
   entry->key[ STAT_KEY_LENGTH - 1 ] = '\0';
 
-  insert_hash_entry( stats, entry->key, entry );
+  insert_flat_hash_entry( stats, entry->key, entry );
 
   pthread_mutex_unlock( &stats_table_mutex );
 
@@ -154,23 +206,55 @@ increment_stat( const char *key ) {
 
   pthread_mutex_lock( &stats_table_mutex );
 
-  stat_entry *entry = lookup_hash_entry( stats, key );
+  stat_entry *entry = lookup_flat_hash_entry( stats, key );
   if ( entry == NULL ) {
     if ( add_stat_entry( key ) == false ) {
       pthread_mutex_unlock( &stats_table_mutex );
       return;
     }
-    entry = lookup_hash_entry( stats, key );
+    entry = lookup_flat_hash_entry( stats, key );
   }
 
   assert( entry != NULL );
 
-  ( entry->value )++;
+  // Counters may be incremented at the same time without the lock.
+  __atomic_add_fetch( &entry->value, 1, __ATOMIC_RELAXED );
 
   pthread_mutex_unlock( &stats_table_mutex );
 }
 
 
+/*
+ * Returns a handle to the entry for key, adding one if there is none, to
+ * be passed to increment_stat_counter(). A counter that has not counted
+ * anything is not reported, so keys show up as with increment_stat().
+ */
+stat_counter *
+register_stat_counter( const char *key ) {
+  assert( key != NULL );
+  assert( stats != NULL );
+
+  pthread_mutex_lock( &stats_table_mutex );
+
+  stat_entry *entry = lookup_flat_hash_entry( stats, key );
+  if ( entry == NULL ) {
+    if ( add_stat_entry( key ) == false ) {
+      pthread_mutex_unlock( &stats_table_mutex );
+      return NULL;
+    }
+    entry = lookup_flat_hash_entry( stats, key );
+  }
+
+  assert( entry != NULL );
+
+  entry->counter = true;
+
+  pthread_mutex_unlock( &stats_table_mutex );
+
+  return entry;
+}
+
+
 void
 reset_stats() {
   assert( stats != NULL );
@@ -178,12 +262,16 @@ reset_stats() {
   pthread_mutex_lock( &stats_table_mutex );
 
   hash_entry *e = NULL;
-  hash_iterator iter;
-  init_hash_iterator( stats, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+  flat_hash_iterator iter;
+  init_flat_hash_iterator( stats, &iter );
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
     stat_entry *st = e->value;
-    if ( st != NULL ) {
-      void *deleted = delete_hash_entry( stats, st->key );
+    if ( st != NULL && st->counter ) {
+      // Keeps the entry since someone holds a handle to it.
+      __atomic_store_n( &st->value, 0, __ATOMIC_RELAXED );
+    }
+    else if ( st != NULL ) {
+      void *deleted = delete_flat_hash_entry( stats, st->key );
       if ( deleted != NULL ) {
         xfree( deleted );
       }
@@ -202,14 +290,21 @@ foreach_stat( void function( const char *key, const uint64_t value, void *user_d
   pthread_mutex_lock( &stats_table_mutex );
 
   hash_entry *e = NULL;
-  hash_iterator iter;
-  init_hash_iterator( stats, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+  flat_hash_iterator iter;
+  init_flat_hash_iterator( stats, &iter );
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
     stat_entry *st = e->value;
-    if ( st != NULL ) {
-      function( st->key, st->value, user_data );
+    if ( st == NULL ) {
+      continue;
+    }
+    uint64_t value = __atomic_load_n( &st->value, __ATOMIC_RELAXED );
+    if ( !st->counter || value != 0 ) {
+      function( st->key, value, user_data );
     }
   }
+  for ( unsigned int i = 0; i < n_reporters; i++ ) {
+    reporters[ i ]( function, user_data );
+  }
 
   pthread_mutex_unlock( &stats_table_mutex );
 }
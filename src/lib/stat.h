@@ -22,24 +22,52 @@
 #define STAT_H
 
 
+#include <stdint.h>
+#include "bool.h"
+
+
 #define STAT_KEY_LENGTH 256
 
 
 typedef struct {
   char key[ STAT_KEY_LENGTH ];
   uint64_t value;
+  bool counter;
 } stat_entry;
 
 
+/*
+ * A handle to a statistic entry that is incremented without a lookup or
+ * a lock. Handles stay valid until finalize_stat().
+ */
+typedef stat_entry stat_counter;
+
+
+/*
+ * Reports statistics that are kept outside of the table, such as the
+ * counters of allocation pools. Reporters are called from foreach_stat().
+ */
+typedef void ( *stat_reporter )( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
+
+
 bool init_stat( void );
 bool finalize_stat( void );
 bool add_stat_entry( const char *key );
 void increment_stat( const char *key );
+stat_counter *register_stat_counter( const char *key );
 void reset_stats( void );
+bool add_stat_reporter( stat_reporter reporter );
+bool delete_stat_reporter( stat_reporter reporter );
 void foreach_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
 void dump_stats();
 
 
+static inline void
+increment_stat_counter( stat_counter *counter ) {
+  __atomic_add_fetch( &counter->value, 1, __ATOMIC_RELAXED );
+}
+
+
 #endif // STAT_H
 
 
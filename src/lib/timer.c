@@ -20,7 +20,9 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
-#include "doubly_linked_list.h"
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include "log.h"
 #include "timer.h"
 #include "wrapper.h"
@@ -51,51 +53,65 @@ void mock_debug( const char *format, ... );
 #endif // UNIT_TESTING
 
 
+/*
+ * Timers are kept in a hierarchical timing wheel with a resolution of
+ * TIMER_TICK_NSEC. Level 0 has one slot per tick, and each slot of level
+ * N covers TIMER_WHEEL_SIZE slots of level N - 1. Timers are cascaded
+ * down to lower levels when the wheel reaches their block, so adding and
+ * deleting a timer are O(1). Timers never fire before their expiration;
+ * an expiration is rounded up to the next tick.
+ */
+
+#define TIMER_TICK_NSEC 1000000
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE ( 1 << TIMER_WHEEL_BITS )
+#define TIMER_WHEEL_MASK ( TIMER_WHEEL_SIZE - 1 )
+#define TIMER_WHEEL_LEVELS 6
+#define TIMER_WHEEL_MAX_DELTA ( ( ( uint64_t ) 1 << ( TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS ) ) - 1 )
+
+#define TIMER_TABLE_INITIAL_SIZE 64
+#define TIMER_HASH_INITIAL_SIZE 64
+
+
 typedef struct timer_callback_info {
   timer_callback function;
   struct timespec expires_at;
   struct timespec interval;
   void *user_data;
+  timer_id id;
+  uint64_t expires_tick;
+  int wheel_level;
+  int wheel_slot;
+  struct timer_callback_info *prev;
+  struct timer_callback_info *next;
+  struct timer_callback_info *hash_next;
 } timer_callback_info;
 
 
-static dlist_element *timer_callbacks = NULL;
+static bool timer_initialized = false;
 
+// Wheel slots are circular lists whose head is a sentinel entry.
+static timer_callback_info timer_wheel[ TIMER_WHEEL_LEVELS ][ TIMER_WHEEL_SIZE ];
+static uint64_t timer_wheel_bitmap[ TIMER_WHEEL_LEVELS ];
+static uint64_t timer_wheel_tick = 0;
+static bool timer_wheel_started = false;
 
-bool
-_init_timer() {
-  if ( timer_callbacks != NULL ) {
-    error( "Called init_timer twice." );
-    return false;
-  }
-
-  timer_callbacks = create_dlist();
-
-  debug( "Initializing timer callbacks ( timer_callbacks = %p ).", timer_callbacks );
-  return true;
-}
-bool ( *init_timer )( void ) = _init_timer;
-
+// Timer ids encode an index to this table and a generation number.
+static timer_callback_info **timer_table = NULL;
+static uint32_t *timer_generations = NULL;
+static uint32_t *timer_free_indexes = NULL;
+static uint32_t timer_free_count = 0;
+static uint32_t timer_table_size = 0;
 
-bool
-_finalize_timer() {
-  dlist_element *e;
+// ( function, user_data ) -> timers, for delete_timer_event().
+static timer_callback_info **timer_hash = NULL;
+static uint32_t timer_hash_size = 0;
+static uint32_t timer_count = 0;
 
-  debug( "Deleting timer callbacks ( timer_callbacks = %p ).", timer_callbacks );
+static timer_callback_info *running_timer = NULL;
 
-  if ( timer_callbacks != NULL ) {
-    for ( e = timer_callbacks->next; e; e = e->next ) {
-      xfree( e->data );
-    }
-    delete_dlist( timer_callbacks );
-    timer_callbacks = NULL;
-  }
-  else {
-    error( "All timer callbacks are already deleted or not created yet." );
-  }
-  return true;
-}
-bool ( *finalize_timer )( void ) = _finalize_timer;
+static int timer_fd = -1;
+static uint64_t timer_fd_armed_tick = 0;
 
 
 #define VALID_TIMESPEC( _a )                                  \
@@ -112,29 +128,317 @@ bool ( *finalize_timer )( void ) = _finalize_timer;
   }                                                           \
   while ( 0 )
 
-#define SUB_TIMESPEC( _a, _b, _return )                       \
-  do {                                                        \
-    ( _return )->tv_sec = ( _a )->tv_sec - ( _b )->tv_sec;    \
-    ( _return )->tv_nsec = ( _a )->tv_nsec - ( _b )->tv_nsec; \
-    if ( ( _return )->tv_nsec < 0 ) {                         \
-      ( _return )->tv_sec--;                                  \
-      ( _return )->tv_nsec += 1000000000;                     \
-    }                                                         \
-  }                                                           \
-  while ( 0 )
-
 #define TIMESPEC_LESS_THEN( _a, _b )                          \
   ( ( ( _a )->tv_sec == ( _b )->tv_sec ) ?                    \
     ( ( _a )->tv_nsec < ( _b )->tv_nsec ) :                   \
     ( ( _a )->tv_sec < ( _b )->tv_sec ) )
 
-#define TIMESPEC_TO_MICROSECONDS( _a, _b )                    \
-  do {                                                        \
-    struct timespec round = { 0, 999 };                       \
-    ADD_TIMESPEC( _a, &round, &round );                       \
-    ( *( _b ) = ( int ) ( round.tv_sec * 1000000 + round.tv_nsec / 1000 ) ); \
-  }                                                           \
-  while ( 0 )
+
+static uint64_t
+timespec_to_tick( const struct timespec *ts, bool round_up ) {
+  if ( ts->tv_sec < 0 ) {
+    return 0;
+  }
+  uint64_t nsec = ( uint64_t ) ts->tv_sec * 1000000000ULL + ( uint64_t ) ts->tv_nsec;
+  if ( round_up ) {
+    nsec += TIMER_TICK_NSEC - 1;
+  }
+  return nsec / TIMER_TICK_NSEC;
+}
+
+
+static void
+tick_to_timespec( uint64_t tick, struct timespec *ts ) {
+  uint64_t nsec = tick * TIMER_TICK_NSEC;
+  ts->tv_sec = ( time_t ) ( nsec / 1000000000ULL );
+  ts->tv_nsec = ( long ) ( nsec % 1000000000ULL );
+}
+
+
+static void
+unlink_timer_entry( timer_callback_info *cb ) {
+  if ( cb->next != NULL ) {
+    cb->prev->next = cb->next;
+    cb->next->prev = cb->prev;
+    cb->prev = cb->next = NULL;
+  }
+}
+
+
+static void
+link_timer_entry( timer_callback_info *head, timer_callback_info *cb ) {
+  cb->prev = head->prev;
+  cb->next = head;
+  head->prev->next = cb;
+  head->prev = cb;
+}
+
+
+static void
+init_timer_list( timer_callback_info *head ) {
+  head->prev = head->next = head;
+}
+
+
+static bool
+timer_list_empty( const timer_callback_info *head ) {
+  return head->next == head;
+}
+
+
+static void
+insert_timer_callback( timer_callback_info *cb ) {
+  uint64_t expires = cb->expires_tick;
+  if ( expires < timer_wheel_tick ) {
+    // Already expired. Run it on the next tick to be processed.
+    expires = timer_wheel_tick;
+  }
+  uint64_t delta = expires - timer_wheel_tick;
+  if ( delta > TIMER_WHEEL_MAX_DELTA ) {
+    // Beyond the range of the wheel. Park it in the top level; it is
+    // placed again with its own expiration whenever the slot is reached.
+    delta = TIMER_WHEEL_MAX_DELTA;
+    expires = timer_wheel_tick + delta;
+  }
+
+  int level = 0;
+  while ( level < TIMER_WHEEL_LEVELS - 1 && ( delta >> ( TIMER_WHEEL_BITS * ( level + 1 ) ) ) != 0 ) {
+    level++;
+  }
+  int slot = ( int ) ( ( expires >> ( TIMER_WHEEL_BITS * level ) ) & TIMER_WHEEL_MASK );
+
+  link_timer_entry( &timer_wheel[ level ][ slot ], cb );
+  timer_wheel_bitmap[ level ] |= ( uint64_t ) 1 << slot;
+  cb->wheel_level = level;
+  cb->wheel_slot = slot;
+}
+
+
+static void
+remove_timer_callback( timer_callback_info *cb ) {
+  if ( cb->next == NULL ) {
+    return;
+  }
+  unlink_timer_entry( cb );
+  // cb may have been in a list of expired timers rather than in the
+  // wheel. Either way the slot bit is only cleared if the slot is empty.
+  if ( timer_list_empty( &timer_wheel[ cb->wheel_level ][ cb->wheel_slot ] ) ) {
+    timer_wheel_bitmap[ cb->wheel_level ] &= ~( ( uint64_t ) 1 << cb->wheel_slot );
+  }
+}
+
+
+static uint32_t
+hash_timer( timer_callback function, void *user_data ) {
+  uint64_t key = ( uint64_t ) ( uintptr_t ) function ^ ( ( uint64_t ) ( uintptr_t ) user_data * 0x9e3779b97f4a7c15ULL );
+  return ( uint32_t ) ( ( key ^ ( key >> 29 ) ) & ( timer_hash_size - 1 ) );
+}
+
+
+static void
+resize_timer_hash( uint32_t new_size ) {
+  timer_callback_info **old_hash = timer_hash;
+  uint32_t old_size = timer_hash_size;
+
+  timer_hash = xcalloc( new_size, sizeof( timer_callback_info * ) );
+  timer_hash_size = new_size;
+
+  for ( uint32_t i = 0; i < old_size; i++ ) {
+    timer_callback_info *cb = old_hash[ i ];
+    while ( cb != NULL ) {
+      timer_callback_info *next = cb->hash_next;
+      uint32_t bucket = hash_timer( cb->function, cb->user_data );
+      cb->hash_next = timer_hash[ bucket ];
+      timer_hash[ bucket ] = cb;
+      cb = next;
+    }
+  }
+  if ( old_hash != NULL ) {
+    xfree( old_hash );
+  }
+}
+
+
+static void
+resize_timer_table( uint32_t new_size ) {
+  timer_callback_info **new_table = xcalloc( new_size, sizeof( timer_callback_info * ) );
+  uint32_t *new_generations = xcalloc( new_size, sizeof( uint32_t ) );
+  uint32_t *new_free_indexes = xcalloc( new_size, sizeof( uint32_t ) );
+
+  if ( timer_table != NULL ) {
+    memcpy( new_table, timer_table, sizeof( timer_callback_info * ) * timer_table_size );
+    memcpy( new_generations, timer_generations, sizeof( uint32_t ) * timer_table_size );
+    memcpy( new_free_indexes, timer_free_indexes, sizeof( uint32_t ) * timer_free_count );
+    xfree( timer_table );
+    xfree( timer_generations );
+    xfree( timer_free_indexes );
+  }
+  for ( uint32_t i = new_size; i > timer_table_size; i-- ) {
+    new_free_indexes[ timer_free_count++ ] = i - 1;
+  }
+
+  timer_table = new_table;
+  timer_generations = new_generations;
+  timer_free_indexes = new_free_indexes;
+  timer_table_size = new_size;
+}
+
+
+static void
+register_timer( timer_callback_info *cb ) {
+  if ( timer_free_count == 0 ) {
+    resize_timer_table( timer_table_size * 2 );
+  }
+  uint32_t index = timer_free_indexes[ --timer_free_count ];
+  if ( ++timer_generations[ index ] == 0 ) {
+    timer_generations[ index ] = 1;
+  }
+  timer_table[ index ] = cb;
+  cb->id = ( ( timer_id ) timer_generations[ index ] << 32 ) | index;
+
+  if ( timer_count >= timer_hash_size ) {
+    resize_timer_hash( timer_hash_size * 2 );
+  }
+  uint32_t bucket = hash_timer( cb->function, cb->user_data );
+  cb->hash_next = timer_hash[ bucket ];
+  timer_hash[ bucket ] = cb;
+  timer_count++;
+}
+
+
+static void
+unregister_timer( timer_callback_info *cb ) {
+  uint32_t index = ( uint32_t ) ( cb->id & 0xffffffff );
+  timer_table[ index ] = NULL;
+  timer_free_indexes[ timer_free_count++ ] = index;
+
+  timer_callback_info **p = &timer_hash[ hash_timer( cb->function, cb->user_data ) ];
+  while ( *p != NULL ) {
+    if ( *p == cb ) {
+      *p = cb->hash_next;
+      break;
+    }
+    p = &( *p )->hash_next;
+  }
+  cb->hash_next = NULL;
+  timer_count--;
+}
+
+
+static timer_callback_info *
+lookup_timer_by_id( timer_id id ) {
+  uint32_t index = ( uint32_t ) ( id & 0xffffffff );
+  uint32_t generation = ( uint32_t ) ( id >> 32 );
+  if ( timer_table == NULL || index >= timer_table_size || generation == 0 ) {
+    return NULL;
+  }
+  if ( timer_generations[ index ] != generation ) {
+    return NULL;
+  }
+  return timer_table[ index ];
+}
+
+
+static timer_callback_info *
+lookup_timer_by_callback( timer_callback function, void *user_data ) {
+  if ( timer_hash == NULL ) {
+    return NULL;
+  }
+  for ( timer_callback_info *cb = timer_hash[ hash_timer( function, user_data ) ]; cb != NULL; cb = cb->hash_next ) {
+    if ( cb->function == function && cb->user_data == user_data ) {
+      return cb;
+    }
+  }
+  return NULL;
+}
+
+
+static void
+cancel_timer( timer_callback_info *cb ) {
+  debug( "Deleting a callback ( callback = %p, user_data = %p, id = %#" PRIx64 " ).", cb->function, cb->user_data, cb->id );
+
+  unregister_timer( cb );
+  if ( cb == running_timer ) {
+    // Freed by the executor once the callback returns.
+    cb->function = NULL;
+    return;
+  }
+  remove_timer_callback( cb );
+  xfree( cb );
+}
+
+
+bool
+_init_timer() {
+  if ( timer_initialized ) {
+    error( "Called init_timer twice." );
+    return false;
+  }
+
+  for ( int level = 0; level < TIMER_WHEEL_LEVELS; level++ ) {
+    for ( int slot = 0; slot < TIMER_WHEEL_SIZE; slot++ ) {
+      init_timer_list( &timer_wheel[ level ][ slot ] );
+    }
+    timer_wheel_bitmap[ level ] = 0;
+  }
+  timer_wheel_started = false;
+  timer_count = 0;
+  running_timer = NULL;
+  resize_timer_table( TIMER_TABLE_INITIAL_SIZE );
+  resize_timer_hash( TIMER_HASH_INITIAL_SIZE );
+
+  if ( timer_fd < 0 ) {
+    // Kept open for the lifetime of the process so that event handlers
+    // can keep it registered across init_timer()/finalize_timer().
+    timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+    if ( timer_fd < 0 ) {
+      debug( "timerfd is not available ( %s [%d] ).", strerror( errno ), errno );
+    }
+  }
+  timer_fd_armed_tick = 0;
+
+  timer_initialized = true;
+
+  debug( "Initializing timer callbacks." );
+  return true;
+}
+bool ( *init_timer )( void ) = _init_timer;
+
+
+bool
+_finalize_timer() {
+  debug( "Deleting timer callbacks." );
+
+  if ( timer_initialized ) {
+    for ( uint32_t i = 0; i < timer_table_size; i++ ) {
+      if ( timer_table[ i ] != NULL && timer_table[ i ] != running_timer ) {
+        xfree( timer_table[ i ] );
+      }
+    }
+    xfree( timer_table );
+    xfree( timer_generations );
+    xfree( timer_free_indexes );
+    xfree( timer_hash );
+    timer_table = NULL;
+    timer_generations = NULL;
+    timer_free_indexes = NULL;
+    timer_hash = NULL;
+    timer_table_size = timer_free_count = timer_hash_size = timer_count = 0;
+
+    if ( timer_fd >= 0 && timer_fd_armed_tick != 0 ) {
+      struct itimerspec disarm;
+      memset( &disarm, 0, sizeof( disarm ) );
+      timerfd_settime( timer_fd, TFD_TIMER_ABSTIME, &disarm, NULL );
+      timer_fd_armed_tick = 0;
+    }
+    timer_initialized = false;
+  }
+  else {
+    error( "All timer callbacks are already deleted or not created yet." );
+  }
+  return true;
+}
+bool ( *finalize_timer )( void ) = _finalize_timer;
 
 
 static void
@@ -146,100 +450,209 @@ on_timer( timer_callback_info *callback, struct timespec *now ) {
          callback->function, ( int64_t ) callback->expires_at.tv_sec, callback->expires_at.tv_nsec,
          ( int64_t ) callback->interval.tv_sec, callback->interval.tv_nsec, callback->user_data );
 
-  if ( VALID_TIMESPEC( &callback->expires_at ) ) {
-    callback->function( callback->user_data );
-    if ( VALID_TIMESPEC( &callback->interval ) ) {
-      ADD_TIMESPEC( &callback->expires_at, &callback->interval, &callback->expires_at );
-      if ( TIMESPEC_LESS_THEN( &callback->expires_at, now ) ) {
-        callback->expires_at.tv_sec = now->tv_sec;
-        callback->expires_at.tv_nsec = now->tv_nsec;
-      }
-    }
-    else {
-      callback->expires_at.tv_sec = 0;
-      callback->expires_at.tv_nsec = 0;
-      callback->function = NULL;
+  running_timer = callback;
+  callback->function( callback->user_data );
+  running_timer = NULL;
+
+  if ( callback->function == NULL ) {
+    // Deleted in the callback.
+    xfree( callback );
+    return;
+  }
+
+  if ( VALID_TIMESPEC( &callback->interval ) ) {
+    ADD_TIMESPEC( &callback->expires_at, &callback->interval, &callback->expires_at );
+    if ( TIMESPEC_LESS_THEN( &callback->expires_at, now ) ) {
+      callback->expires_at.tv_sec = now->tv_sec;
+      callback->expires_at.tv_nsec = now->tv_nsec;
     }
+    callback->expires_tick = timespec_to_tick( &callback->expires_at, true );
+    insert_timer_callback( callback );
     debug( "Set expires_at value to %" PRIu64 ".%09lu.", ( int64_t ) callback->expires_at.tv_sec, callback->expires_at.tv_nsec );
   }
   else {
-    error( "Invalid expires_at value." );
+    unregister_timer( callback );
+    xfree( callback );
   }
 }
 
 
 static void
-insert_timer_callback( timer_callback_info *new_cb ) {
-  assert( timer_callbacks != NULL );
-  dlist_element *element, *last = timer_callbacks;
-  for ( element = timer_callbacks->next; element != NULL; element = element->next ) {
-    timer_callback_info *cb = element->data;
-    if ( TIMESPEC_LESS_THEN( &new_cb->expires_at, &cb->expires_at ) ) {
-      insert_before_dlist( element, new_cb );
-      return;
-    }
-    last = element;
+cascade_timers( int level ) {
+  int slot = ( int ) ( ( timer_wheel_tick >> ( TIMER_WHEEL_BITS * level ) ) & TIMER_WHEEL_MASK );
+  timer_callback_info *head = &timer_wheel[ level ][ slot ];
+  if ( timer_list_empty( head ) ) {
+    return;
   }
-  insert_after_dlist( last, new_cb );
-}
-
 
-void
-_execute_timer_events( int *next_timeout_usec ) {
-  assert( next_timeout_usec != NULL );
-  struct timespec now;
-  timer_callback_info *callback;
-  dlist_element *element, *element_next;
+  timer_callback_info list;
+  list.prev = head->prev;
+  list.next = head->next;
+  list.prev->next = &list;
+  list.next->prev = &list;
+  init_timer_list( head );
+  timer_wheel_bitmap[ level ] &= ~( ( uint64_t ) 1 << slot );
+
+  while ( !timer_list_empty( &list ) ) {
+    timer_callback_info *cb = list.next;
+    unlink_timer_entry( cb );
+    insert_timer_callback( cb );
+  }
+}
 
-  debug( "Executing timer events ( timer_callbacks = %p ).", timer_callbacks );
 
-  assert( clock_gettime( CLOCK_MONOTONIC, &now ) == 0 );
-  assert( timer_callbacks != NULL );
+static void
+run_timer_wheel( uint64_t now_tick, struct timespec *now ) {
+  while ( timer_wheel_tick <= now_tick ) {
+    // Skip ticks while the lower levels of the wheel are empty, up to
+    // the next boundary where the lowest non-empty level cascades.
+    int empty_levels = 0;
+    while ( empty_levels < TIMER_WHEEL_LEVELS && timer_wheel_bitmap[ empty_levels ] == 0 ) {
+      empty_levels++;
+    }
+    if ( empty_levels == TIMER_WHEEL_LEVELS ) {
+      timer_wheel_tick = now_tick + 1;
+      break;
+    }
+    if ( empty_levels > 0 ) {
+      uint64_t span_mask = ( ( uint64_t ) 1 << ( TIMER_WHEEL_BITS * empty_levels ) ) - 1;
+      if ( ( timer_wheel_tick & span_mask ) != 0 ) {
+        uint64_t boundary = ( timer_wheel_tick | span_mask ) + 1;
+        timer_wheel_tick = boundary < now_tick + 1 ? boundary : now_tick + 1;
+        continue;
+      }
+    }
 
-  for ( element = timer_callbacks->next; element; element = element_next ) {
-    element_next = element->next;
-    callback = element->data;
-    if ( callback->function != NULL ) {
-      if ( TIMESPEC_LESS_THEN( &now, &callback->expires_at ) ) {
+    for ( int level = 1; level < TIMER_WHEEL_LEVELS; level++ ) {
+      if ( ( timer_wheel_tick & ( ( ( uint64_t ) 1 << ( TIMER_WHEEL_BITS * level ) ) - 1 ) ) != 0 ) {
         break;
       }
-      on_timer( callback, &now );
+      cascade_timers( level );
     }
-    delete_dlist_element( element );
-    if ( callback->function == NULL ) {
-      xfree( callback );
+
+    uint64_t tick = timer_wheel_tick;
+    int slot = ( int ) ( tick & TIMER_WHEEL_MASK );
+    timer_callback_info *head = &timer_wheel[ 0 ][ slot ];
+    timer_wheel_tick++;
+    if ( timer_list_empty( head ) ) {
+      continue;
     }
-    else {
-      insert_timer_callback( callback );
+
+    timer_callback_info expired;
+    expired.prev = head->prev;
+    expired.next = head->next;
+    expired.prev->next = &expired;
+    expired.next->prev = &expired;
+    init_timer_list( head );
+    timer_wheel_bitmap[ 0 ] &= ~( ( uint64_t ) 1 << slot );
+
+    // Callbacks may delete any timer in the expired list, so take one
+    // entry at a time.
+    while ( !timer_list_empty( &expired ) ) {
+      timer_callback_info *cb = expired.next;
+      unlink_timer_entry( cb );
+      if ( cb->expires_tick > tick ) {
+        // Not due yet. Cascade it again rather than firing early.
+        insert_timer_callback( cb );
+        continue;
+      }
+      on_timer( cb, now );
     }
   }
+}
 
-  struct timespec max_timeout = { ( INT_MAX / 1000000 ), 0 };
-  struct timespec min_timeout = { 0, 0 };
-  if ( timer_callbacks->next == NULL ) {
-    TIMESPEC_TO_MICROSECONDS( &max_timeout, next_timeout_usec );
+
+static bool
+next_timer_tick( uint64_t *tick ) {
+  if ( timer_wheel_bitmap[ 0 ] != 0 ) {
+    int base = ( int ) ( timer_wheel_tick & TIMER_WHEEL_MASK );
+    uint64_t rotated = ( timer_wheel_bitmap[ 0 ] >> base ) | ( base > 0 ? timer_wheel_bitmap[ 0 ] << ( TIMER_WHEEL_SIZE - base ) : 0 );
+    *tick = timer_wheel_tick + ( uint64_t ) __builtin_ctzll( rotated );
+    return true;
   }
-  else {
-    callback = timer_callbacks->next->data;
-    if ( TIMESPEC_LESS_THEN( &callback->expires_at, &now ) ) {
-      TIMESPEC_TO_MICROSECONDS( &min_timeout, next_timeout_usec );
+
+  // Entries of upper levels expire no earlier than their slot is
+  // cascaded, so waking up at the earliest cascade is sufficient.
+  for ( int level = 1; level < TIMER_WHEEL_LEVELS; level++ ) {
+    if ( timer_wheel_bitmap[ level ] == 0 ) {
+      continue;
     }
-    else {
-      struct timespec timeout;
-      SUB_TIMESPEC( &callback->expires_at, &now, &timeout );
-      if ( TIMESPEC_LESS_THEN( &timeout, &max_timeout ) ) {
-        TIMESPEC_TO_MICROSECONDS( &timeout, next_timeout_usec );
-      }
-      else {
-        TIMESPEC_TO_MICROSECONDS( &max_timeout, next_timeout_usec );
-      }
+    int shift = TIMER_WHEEL_BITS * level;
+    uint64_t block = timer_wheel_tick >> shift;
+    int base = ( int ) ( block & TIMER_WHEEL_MASK );
+    uint64_t rotated = ( timer_wheel_bitmap[ level ] >> base ) | ( base > 0 ? timer_wheel_bitmap[ level ] << ( TIMER_WHEEL_SIZE - base ) : 0 );
+    uint64_t ahead = ( uint64_t ) __builtin_ctzll( rotated );
+    if ( ahead == 0 && ( timer_wheel_tick & ( ( ( uint64_t ) 1 << shift ) - 1 ) ) != 0 ) {
+      ahead = TIMER_WHEEL_SIZE;
     }
+    *tick = ( block + ahead ) << shift;
+    return true;
+  }
+
+  return false;
+}
+
+
+static void
+arm_timer_fd( uint64_t tick ) {
+  if ( timer_fd < 0 || tick == timer_fd_armed_tick ) {
+    return;
+  }
+
+  struct itimerspec spec;
+  memset( &spec, 0, sizeof( spec ) );
+  if ( tick != 0 ) {
+    tick_to_timespec( tick, &spec.it_value );
+  }
+  if ( timerfd_settime( timer_fd, TFD_TIMER_ABSTIME, &spec, NULL ) < 0 ) {
+    error( "Failed to arm timerfd ( %s [%d] ).", strerror( errno ), errno );
+    return;
+  }
+  timer_fd_armed_tick = tick;
+}
+
+
+void
+_execute_timer_events( int *next_timeout_usec ) {
+  assert( next_timeout_usec != NULL );
+  struct timespec now;
+
+  debug( "Executing timer events ( timer_count = %u ).", timer_count );
+
+  assert( clock_gettime( CLOCK_MONOTONIC, &now ) == 0 );
+  assert( timer_initialized );
+
+  uint64_t now_tick = timespec_to_tick( &now, false );
+  if ( !timer_wheel_started ) {
+    timer_wheel_tick = now_tick;
+    timer_wheel_started = true;
   }
+  run_timer_wheel( now_tick, &now );
+
+  const int64_t max_timeout_usec = ( INT_MAX / 1000000 ) * ( int64_t ) 1000000;
+  uint64_t tick;
+  if ( !next_timer_tick( &tick ) ) {
+    arm_timer_fd( 0 );
+    *next_timeout_usec = ( int ) max_timeout_usec;
+    return;
+  }
+
+  struct timespec expires_at;
+  tick_to_timespec( tick, &expires_at );
+  int64_t timeout_nsec = ( int64_t ) ( expires_at.tv_sec - now.tv_sec ) * 1000000000 + ( expires_at.tv_nsec - now.tv_nsec );
+  if ( timeout_nsec <= 0 ) {
+    *next_timeout_usec = 0;
+    return;
+  }
+  arm_timer_fd( tick );
+
+  int64_t timeout_usec = ( timeout_nsec + 999 ) / 1000;
+  *next_timeout_usec = ( int ) ( timeout_usec < max_timeout_usec ? timeout_usec : max_timeout_usec );
 }
 void ( *execute_timer_events )( int * ) = _execute_timer_events;
 
 
-bool
+timer_id
 _add_timer_event_callback( struct itimerspec *interval, timer_callback callback, void *user_data ) {
   assert( interval != NULL );
   assert( callback != NULL );
@@ -259,7 +672,7 @@ _add_timer_event_callback( struct itimerspec *interval, timer_callback callback,
   if ( clock_gettime( CLOCK_MONOTONIC, &now ) != 0 ) {
     error( "Failed to retrieve monotonic time ( %s [%d] ).", strerror( errno ), errno );
     xfree( cb );
-    return false;
+    return INVALID_TIMER_ID;
   }
 
   cb->interval = interval->it_interval;
@@ -273,20 +686,26 @@ _add_timer_event_callback( struct itimerspec *interval, timer_callback callback,
   else {
     error( "Timer must not be zero when a timer event is added." );
     xfree( cb );
-    return false;
+    return INVALID_TIMER_ID;
   }
+  cb->expires_tick = timespec_to_tick( &cb->expires_at, true );
 
   debug( "Set an initial expiration time to %" PRIu64 ".%09lu.", ( int64_t ) now.tv_sec, now.tv_nsec );
 
-  assert( timer_callbacks != NULL );
+  assert( timer_initialized );
+  if ( !timer_wheel_started ) {
+    timer_wheel_tick = timespec_to_tick( &now, false );
+    timer_wheel_started = true;
+  }
+  register_timer( cb );
   insert_timer_callback( cb );
 
-  return true;
+  return cb->id;
 }
-bool ( *add_timer_event_callback )( struct itimerspec *interval, timer_callback callback, void *user_data ) = _add_timer_event_callback;
+timer_id ( *add_timer_event_callback )( struct itimerspec *interval, timer_callback callback, void *user_data ) = _add_timer_event_callback;
 
 
-bool
+timer_id
 _add_periodic_event_callback( const time_t seconds, timer_callback callback, void *user_data ) {
   assert( callback != NULL );
 
@@ -302,7 +721,7 @@ _add_periodic_event_callback( const time_t seconds, timer_callback callback, voi
 
   return add_timer_event_callback( &interval, callback, user_data );
 }
-bool ( *add_periodic_event_callback )( const time_t seconds, timer_callback callback, void *user_data ) = _add_periodic_event_callback;
+timer_id ( *add_periodic_event_callback )( const time_t seconds, timer_callback callback, void *user_data ) = _add_periodic_event_callback;
 
 
 bool
@@ -311,27 +730,15 @@ _delete_timer_event( timer_callback callback, void *user_data ) {
 
   debug( "Deleting a timer event ( callback = %p, user_data = %p ).", callback, user_data );
 
-  dlist_element *e;
-
-  if ( timer_callbacks == NULL ) {
+  if ( !timer_initialized ) {
     debug( "All timer callbacks are already deleted or not created yet." );
     return false;
   }
 
-  for ( e = timer_callbacks->next; e; e = e->next ) {
-    timer_callback_info *cb = e->data;
-    if ( cb->function == callback && cb->user_data == user_data ) {
-      debug( "Deleting a callback ( callback = %p, user_data = %p ).", callback, user_data );
-      //xfree( cb );
-      //delete_dlist_element( e );
-      cb->function = NULL;
-      cb->user_data = NULL;
-      cb->expires_at.tv_sec = 0;
-      cb->expires_at.tv_nsec = 0;
-      cb->interval.tv_sec = 0;
-      cb->interval.tv_nsec = 0;
-      return true;
-    }
+  timer_callback_info *cb = lookup_timer_by_callback( callback, user_data );
+  if ( cb != NULL ) {
+    cancel_timer( cb );
+    return true;
   }
 
   error( "No registered timer event callback found." );
@@ -341,6 +748,34 @@ _delete_timer_event( timer_callback callback, void *user_data ) {
 bool ( *delete_timer_event )( timer_callback callback, void *user_data ) = _delete_timer_event;
 
 
+bool
+_delete_timer_event_by_id( timer_id id ) {
+  debug( "Deleting a timer event ( id = %#" PRIx64 " ).", id );
+
+  if ( !timer_initialized ) {
+    debug( "All timer callbacks are already deleted or not created yet." );
+    return false;
+  }
+
+  timer_callback_info *cb = lookup_timer_by_id( id );
+  if ( cb == NULL ) {
+    debug( "No registered timer event found ( id = %#" PRIx64 " ).", id );
+    return false;
+  }
+
+  cancel_timer( cb );
+  return true;
+}
+bool ( *delete_timer_event_by_id )( timer_id id ) = _delete_timer_event_by_id;
+
+
+int
+_get_timer_fd() {
+  return timer_fd;
+}
+int ( *get_timer_fd )( void ) = _get_timer_fd;
+
+
 /*
  * Local variables:
  * c-basic-offset: 2
@@ -23,22 +23,34 @@
 
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 
 typedef void ( *timer_callback )( void *user_data );
 
+// Identifies a timer event. Never reused while the timer is alive.
+typedef uint64_t timer_id;
+
+#define INVALID_TIMER_ID ( ( timer_id ) 0 )
+
 
 extern bool ( *init_timer )( void );
 extern bool ( *finalize_timer )( void );
 
-extern bool ( *add_timer_event_callback )( struct itimerspec *interval, timer_callback callback, void *user_data );
-extern bool ( *add_periodic_event_callback )( const time_t seconds, timer_callback callback, void *user_data );
+// Return the id of the added timer event, or INVALID_TIMER_ID on failure.
+extern timer_id ( *add_timer_event_callback )( struct itimerspec *interval, timer_callback callback, void *user_data );
+extern timer_id ( *add_periodic_event_callback )( const time_t seconds, timer_callback callback, void *user_data );
 
 extern bool ( *delete_timer_event )( timer_callback callback, void *user_data );
+extern bool ( *delete_timer_event_by_id )( timer_id id );
 
 extern void ( *execute_timer_events )( int *next_timeout_usec );
 
+// A timerfd armed at the next expiration, or -1 if not available.
+// Event handlers may poll it to wake up precisely on time.
+extern int ( *get_timer_fd )( void );
+
 
 #endif // TIMER_H
 
@@ -226,6 +226,42 @@ bool mock_init_stat();
 #define finalize_stat mock_finalize_stat
 bool mock_finalize_stat();
 
+#ifdef add_stat_reporter
+#undef add_stat_reporter
+#endif
+#define add_stat_reporter mock_add_stat_reporter
+bool mock_add_stat_reporter( stat_reporter reporter );
+
+#ifdef init_buffer_pool
+#undef init_buffer_pool
+#endif
+#define init_buffer_pool mock_init_buffer_pool
+void mock_init_buffer_pool();
+
+#ifdef finalize_buffer_pool
+#undef finalize_buffer_pool
+#endif
+#define finalize_buffer_pool mock_finalize_buffer_pool
+void mock_finalize_buffer_pool();
+
+#ifdef foreach_buffer_pool_stat
+#undef foreach_buffer_pool_stat
+#endif
+#define foreach_buffer_pool_stat mock_foreach_buffer_pool_stat
+void mock_foreach_buffer_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
+
+#ifdef foreach_message_queue_pool_stat
+#undef foreach_message_queue_pool_stat
+#endif
+#define foreach_message_queue_pool_stat mock_foreach_message_queue_pool_stat
+void mock_foreach_message_queue_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
+
+#ifdef foreach_messenger_queue_stat
+#undef foreach_messenger_queue_stat
+#endif
+#define foreach_messenger_queue_stat mock_foreach_messenger_queue_stat
+void mock_foreach_messenger_queue_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
+
 #ifdef init_timer
 #undef init_timer
 #endif
@@ -385,6 +421,7 @@ finalize_trema() {
   finalize_messenger();
   finalize_stat();
   finalize_timer();
+  finalize_buffer_pool();
   trema_started = false;
   unlink_pid( get_trema_pid(), get_trema_name() );
   xfree( trema_name );
@@ -621,8 +658,12 @@ init_trema( int *argc, char ***argv ) {
   set_hup_handler();
   set_usr1_handler();
   set_usr2_handler();
+  init_buffer_pool();
   init_messenger( get_trema_sock() );
   init_stat();
+  add_stat_reporter( foreach_buffer_pool_stat );
+  add_stat_reporter( foreach_message_queue_pool_stat );
+  add_stat_reporter( foreach_messenger_queue_stat );
   init_timer();
   init_management_interface();
 
@@ -30,7 +30,9 @@
 #include "etherip.h"
 #include "event_forward_interface.h"
 #include "event_handler.h"
+#include "flat_hash_table.h"
 #include "hash_table.h"
+#include "histogram.h"
 #include "linked_list.h"
 #include "log.h"
 #include "management_service_interface.h"
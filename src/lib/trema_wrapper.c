@@ -47,6 +47,8 @@ int ( *trema_sqlite3_open )( const char *filename, sqlite3 **ppDb ) = sqlite3_op
 int ( *trema_sqlite3_close )( sqlite3 * ) = sqlite3_close;
 int ( *trema_sqlite3_exec )( sqlite3 *, const char *sql, int ( *callback )( void *, int, char **, char ** ), void *, char **errmsg ) = sqlite3_exec;
 int ( *trema_sqlite3_changes )( sqlite3 * ) = sqlite3_changes;
+int ( *trema_sqlite3_prepare_v2 )( sqlite3 *, const char *sql, int nByte, sqlite3_stmt **ppStmt, const char **pzTail ) = sqlite3_prepare_v2;
+int ( *trema_sqlite3_step )( sqlite3_stmt * ) = sqlite3_step;
 void ( *trema_sqlite3_free )( void * ) = sqlite3_free;
 const char * ( *trema_sqlite3_errmsg )( sqlite3 * ) = sqlite3_errmsg;
 
@@ -51,6 +51,8 @@ extern int ( *trema_sqlite3_open )( const char *filename, sqlite3 **ppDb );
 extern int ( *trema_sqlite3_close )( sqlite3 * );
 extern int ( *trema_sqlite3_exec )( sqlite3 *, const char *sql, int ( *callback )( void *, int, char **, char ** ), void *, char **errmsg );
 extern int ( *trema_sqlite3_changes )( sqlite3 * );
+extern int ( *trema_sqlite3_prepare_v2 )( sqlite3 *, const char *sql, int nByte, sqlite3_stmt **ppStmt, const char **pzTail );
+extern int ( *trema_sqlite3_step )( sqlite3_stmt * );
 extern void ( *trema_sqlite3_free )( void * );
 extern const char * ( *trema_sqlite3_errmsg )( sqlite3 * );
 
@@ -19,6 +19,7 @@
 
 
 #include <assert.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,11 +30,13 @@ static char service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
 static uint32_t application_id = 0;
 static uint8_t *data = NULL;
 static size_t data_length = 0;
+static bool text_reply = false;
 
 
 void
 usage( void ) {
-  printf( "Usage: application SERVICE_NAME APPLICATION_ID [DATA_IN_HEX]\n" );
+  printf( "Usage: application [-t|--text] SERVICE_NAME APPLICATION_ID [DATA_IN_HEX]\n" );
+  printf( "  -t, --text                  print the reply data as text\n" );
 }
 
 
@@ -88,10 +91,30 @@ hex_string_to_data( char *string ) {
 }
 
 
+static struct option long_options[] = {
+  { "text", 0, NULL, 't' },
+  { NULL, 0, NULL, 0 },
+};
+static char short_options[] = "t";
+
+
 static void
 parse_arguments( int argc, char **argv ) {
   assert( argv != NULL );
 
+  int c;
+  while ( ( c = getopt_long( argc, argv, short_options, long_options, NULL ) ) != -1 ) {
+    switch ( c ) {
+      case 't':
+        text_reply = true;
+        break;
+      default:
+        print_usage_and_exit();
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if ( argc < 3 || argc > 4 ) {
     print_usage_and_exit();
   }
@@ -155,7 +178,10 @@ handle_reply( uint16_t tag, void *data, size_t length, void *user_data ) {
   }
 
   size_t data_length = length - offsetof( management_application_reply, data );
-  if ( data_length > 0 ) {
+  if ( data_length > 0 && text_reply ) {
+    printf( "%.*s", ( int ) data_length, ( const char * ) reply->data );
+  }
+  else if ( data_length > 0 ) {
     printf( "Data: " );
     for ( size_t i = 0; i < data_length; i++ ) {
       printf( "%02x", reply->data[ i ] );
@@ -73,12 +73,12 @@ void mock_insert_match_entry( struct ofp_match *ofp_match, uint16_t priority,
 #define lookup_match_entry mock_lookup_match_entry
 match_entry *mock_lookup_match_entry( struct ofp_match *match );
 
-#ifdef send_message
-#undef send_message
+#ifdef send_message_to_handle
+#undef send_message_to_handle
 #endif
-#define send_message mock_send_message
-bool mock_send_message( const char *service_name, const uint16_t tag, const void *data,
-                        size_t len );
+#define send_message_to_handle mock_send_message_to_handle
+bool mock_send_message_to_handle( messenger_service_id id, const uint16_t tag, const void *data,
+                                  size_t len );
 
 #ifdef init_trema
 #undef init_trema
@@ -165,6 +165,26 @@ parse_etherip( const buffer *data ) {
 }
 
 
+// Data of a match table entry. The services are messenger ids stored
+// in the list data pointers.
+typedef struct {
+  list_element *services;
+  uint64_t n_hits;
+} packetin_filter_rule;
+
+
+static messenger_service_id
+service_id_of( const list_element *element ) {
+  return ( messenger_service_id ) ( uintptr_t ) element->data;
+}
+
+
+static const char *
+service_name_of( const list_element *element ) {
+  return get_messenger_service_name( service_id_of( element ) );
+}
+
+
 static void
 handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
                   uint32_t buffer_id, uint16_t total_len,
@@ -172,7 +192,6 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
                   void *user_data ) {
   UNUSED( user_data );
 
-  char match_str[ 1024 ];
   struct ofp_match ofp_match;   // host order
 
   buffer *copy = NULL;
@@ -186,14 +205,23 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
     free_buffer( copy );
     copy = NULL;
   }
-  match_to_string( &ofp_match, match_str, sizeof( match_str ) );
 
-  list_element *services = lookup_match_entry( ofp_match );
-  if ( services == NULL ) {
+  packetin_filter_rule *rule = lookup_match_entry( ofp_match );
+  if ( rule == NULL ) {
     debug( "match entry not found" );
     return;
   }
+  rule->n_hits++;
 
+  // The match is formatted only if it is going to be logged.
+  char match_str[ 1024 ];
+  match_str[ 0 ] = '\0';
+  if ( get_logging_level() >= LOG_DEBUG ) {
+    match_to_string( &ofp_match, match_str, sizeof( match_str ) );
+  }
+
+  // The same message goes to every service since the header carries no
+  // service name.
   buffer *buf = create_packet_in( transaction_id, buffer_id, total_len, in_port,
                                   reason, data );
 
@@ -202,16 +230,17 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
   message->datapath_id = htonll( datapath_id );
   message->service_name_length = htons( 0 );
   list_element *element;
-  for ( element = services; element != NULL; element = element->next ) {
-    const char *service_name = element->data;
-    if ( !send_message( service_name, MESSENGER_OPENFLOW_MESSAGE,
-                        buf->data, buf->length ) ) {
-      error( "Failed to send a message to %s ( match = %s ).", service_name, match_str );
-      free_buffer( buf );
-      return;
+  for ( element = rule->services; element != NULL; element = element->next ) {
+    if ( !send_message_to_handle( service_id_of( element ), MESSENGER_OPENFLOW_MESSAGE,
+                                  buf->data, buf->length ) ) {
+      if ( match_str[ 0 ] == '\0' ) {
+        match_to_string( &ofp_match, match_str, sizeof( match_str ) );
+      }
+      error( "Failed to send a message to %s ( match = %s ).", service_name_of( element ), match_str );
+      continue;
     }
 
-    debug( "Sending a message to %s ( match = %s ).", service_name, match_str );
+    debug( "Sending a message to %s ( match = %s ).", service_name_of( element ), match_str );
   }
 
   free_buffer( buf );
@@ -225,17 +254,22 @@ init_packetin_match_table( void ) {
 
 
 static void
-free_user_data_entry( struct ofp_match match, uint16_t priority, void *services, void *user_data ) {
+free_services( list_element *services ) {
+  for ( list_element *e = services; e != NULL; e = e->next ) {
+    release_messenger_service_id( service_id_of( e ) );
+  }
+  delete_list( services );
+}
+
+
+static void
+free_user_data_entry( struct ofp_match match, uint16_t priority, void *rule, void *user_data ) {
   UNUSED( match );
   UNUSED( priority );
   UNUSED( user_data );
 
-  list_element *element;
-  for ( element = services; element != NULL; element = element->next ) {
-    xfree( element->data );
-    element->data = NULL;
-  }
-  delete_list( services );
+  free_services( ( ( packetin_filter_rule * ) rule )->services );
+  xfree( rule );
 }
 
 
@@ -248,25 +282,29 @@ finalize_packetin_match_table( void ) {
 
 static bool
 add_packetin_match_entry( struct ofp_match match, uint16_t priority, const char *service_name ) {
-  bool ( *insert_or_update_match_entry )( struct ofp_match, uint16_t, void * ) = update_match_entry;
-  list_element *services = lookup_match_strict_entry( match, priority );
-  if ( services == NULL ) {
-    insert_or_update_match_entry = insert_match_entry;
-    create_list( &services );
+  void *service = ( void * ) ( uintptr_t ) get_messenger_service_id( service_name );
+  packetin_filter_rule *rule = lookup_match_strict_entry( match, priority );
+  if ( rule == NULL ) {
+    rule = xmalloc( sizeof( packetin_filter_rule ) );
+    create_list( &rule->services );
+    rule->n_hits = 0;
+    append_to_tail( &rule->services, service );
+    insert_match_entry( match, priority, rule );
+    return true;
   }
-  else {
-    list_element *element;
-    for ( element = services; element != NULL; element = element->next ) {
-      if ( strcmp( element->data, service_name ) == 0 ) {
-        char match_string[ 256 ];
-        match_to_string( &match, match_string, sizeof( match_string ) );
-        warn( "match entry already exists ( match = [%s], service_name = [%s] )", match_string, service_name );
-        return false;
-      }
+
+  list_element *element;
+  for ( element = rule->services; element != NULL; element = element->next ) {
+    if ( element->data == service ) {
+      char match_string[ 256 ];
+      match_to_string( &match, match_string, sizeof( match_string ) );
+      warn( "match entry already exists ( match = [%s], service_name = [%s] )", match_string, service_name );
+      release_messenger_service_id( ( messenger_service_id ) ( uintptr_t ) service );
+      return false;
     }
   }
-  append_to_tail( &services, xstrdup( service_name ) );
-  insert_or_update_match_entry( match, priority, services );
+  // The rule is shared with the match table, so appending is enough.
+  append_to_tail( &rule->services, service );
 
   return true;
 }
@@ -274,20 +312,21 @@ add_packetin_match_entry( struct ofp_match match, uint16_t priority, const char
 
 static int
 delete_packetin_match_entry( struct ofp_match match, uint16_t priority, const char *service_name ) {
-  list_element *head = delete_match_strict_entry( match, priority );
-  if ( head == NULL ) {
+  packetin_filter_rule *rule = delete_match_strict_entry( match, priority );
+  if ( rule == NULL ) {
     return 0;
   }
 
   int n_deleted = 0;
   int n_remaining_services = 0;
-  list_element *services = head;
+  list_element *services = rule->services;
   while ( services != NULL ) {
-    char *service = services->data;
+    void *service = services->data;
+    const char *name = service_name_of( services );
     services = services->next;
-    if ( strcmp( service, service_name ) == 0 ) {
-      delete_element( &head, service );
-      xfree( service );
+    if ( strcmp( name, service_name ) == 0 ) {
+      delete_element( &rule->services, service );
+      release_messenger_service_id( ( messenger_service_id ) ( uintptr_t ) service );
       n_deleted++;
     }
     else {
@@ -296,12 +335,13 @@ delete_packetin_match_entry( struct ofp_match match, uint16_t priority, const ch
   }
 
   if ( n_remaining_services == 0 ) {
-    if ( head != NULL ) {
-      delete_list( head );
+    if ( rule->services != NULL ) {
+      delete_list( rule->services );
     }
+    xfree( rule );
   }
   else {
-    insert_match_entry( match, priority, head );
+    insert_match_entry( match, priority, rule );
   }
 
   return n_deleted;
@@ -396,14 +436,15 @@ delete_filter_walker( struct ofp_match match, uint16_t priority, void *data, voi
   assert( reply_buffer != NULL );
 
   delete_packetin_filter_reply *reply = reply_buffer->data;
-  list_element *head = delete_match_strict_entry( match, priority );
-  for ( list_element *services = head; services != NULL; services = services->next ) {
-    xfree( services->data );
-    reply->n_deleted++;
+  packetin_filter_rule *rule = delete_match_strict_entry( match, priority );
+  if ( rule == NULL ) {
+    return;
   }
-  if ( head != NULL ) {
-    delete_list( head );
+  for ( list_element *services = rule->services; services != NULL; services = services->next ) {
+    reply->n_deleted++;
   }
+  free_services( rule->services );
+  xfree( rule );
 }
 
 
@@ -437,21 +478,31 @@ handle_delete_filter_request( const messenger_context_handle *handle, delete_pac
 }
 
 
+static void
+append_filter_entry( buffer *entries, buffer *stats, struct ofp_match *match, uint16_t priority,
+                     const char *service_name, uint64_t n_hits ) {
+  packetin_filter_entry *entry = append_back_buffer( entries, sizeof( packetin_filter_entry ) );
+  hton_match( &entry->match, match );
+  entry->priority = htons( priority );
+  strncpy( entry->service_name, service_name, sizeof( entry->service_name ) );
+  entry->service_name[ sizeof( entry->service_name ) - 1 ] = '\0';
+
+  packetin_filter_stats *entry_stats = append_back_buffer( stats, sizeof( packetin_filter_stats ) );
+  entry_stats->n_hits = htonll( n_hits );
+
+  dump_packetin_filter_reply *reply = entries->data;
+  reply->n_entries++;
+}
+
+
 static void
 dump_filter_walker( struct ofp_match match, uint16_t priority, void *data, void *user_data ) {
-  buffer *reply_buffer = user_data;
-  assert( reply_buffer != NULL );
+  buffer **buffers = user_data;
+  assert( buffers != NULL );
 
-  dump_packetin_filter_reply *reply = reply_buffer->data;
-  list_element *services = data;
-  while ( services != NULL ) {
-    reply->n_entries++;
-    packetin_filter_entry *entry = append_back_buffer( reply_buffer, sizeof( packetin_filter_entry ) );
-    hton_match( &entry->match, &match );
-    entry->priority = htons( priority );
-    strncpy( entry->service_name, services->data, sizeof( entry->service_name ) );
-    entry->service_name[ sizeof( entry->service_name ) - 1 ] = '\0';
-    services = services->next;
+  packetin_filter_rule *rule = data;
+  for ( list_element *services = rule->services; services != NULL; services = services->next ) {
+    append_filter_entry( buffers[ 0 ], buffers[ 1 ], &match, priority, service_name_of( services ), rule->n_hits );
   }
 }
 
@@ -465,27 +516,31 @@ handle_dump_filter_request( const messenger_context_handle *handle, dump_packeti
   dump_packetin_filter_reply *reply = append_back_buffer( buf, offsetof( dump_packetin_filter_reply, entries ) );
   reply->status = PACKETIN_FILTER_OPERATION_SUCCEEDED;
   reply->n_entries = 0;
+  // Hit counts follow all entries, so they are collected separately.
+  buffer *stats = alloc_buffer_with_length( 256 );
 
   struct ofp_match match;
   ntoh_match( &match, &request->criteria.match );
   uint16_t priority = ntohs( request->criteria.priority );
   if ( request->flags & PACKETIN_FILTER_FLAG_MATCH_STRICT ) {
-    list_element *services = lookup_match_strict_entry( match, priority );
+    packetin_filter_rule *rule = lookup_match_strict_entry( match, priority );
+    list_element *services = rule != NULL ? rule->services : NULL;
     while ( services != NULL ) {
-      if ( strcmp( services->data, request->criteria.service_name ) == 0 ) {
-        packetin_filter_entry *entry = append_back_buffer( buf, sizeof( packetin_filter_entry ) );
-        reply->n_entries++;
-        entry->match = request->criteria.match;
-        entry->priority = request->criteria.priority;
-        strncpy( entry->service_name, services->data, sizeof( entry->service_name ) );
-        entry->service_name[ sizeof( entry->service_name ) - 1 ] = '\0';
+      if ( strcmp( service_name_of( services ), request->criteria.service_name ) == 0 ) {
+        append_filter_entry( buf, stats, &match, priority, service_name_of( services ), rule->n_hits );
       }
       services = services->next;
     }
   }
   else {
-    map_match_table( match, dump_filter_walker, buf );
+    buffer *buffers[] = { buf, stats };
+    map_match_table( match, dump_filter_walker, buffers );
+  }
+  if ( stats->length > 0 ) {
+    memcpy( append_back_buffer( buf, stats->length ), stats->data, stats->length );
   }
+  free_buffer( stats );
+  reply = buf->data;
   reply->n_entries = htonl( reply->n_entries );
 
   bool ret = send_reply_message( handle, MESSENGER_DUMP_PACKETIN_FILTER_REPLY, buf->data, buf->length );
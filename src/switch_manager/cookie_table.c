@@ -16,26 +16,26 @@
  */
 
 
+#include <assert.h>
 #include <inttypes.h>
 #include <openflow.h>
+#include <stddef.h>
 #include <string.h>
 #include "cookie_table.h"
 #include "trema.h"
 
 
-static cookie_table_t cookie_table;
 static uint64_t cookie_dough = 0;
 static uint64_t INVALID_COOKIE = UINT64_MAX;
 static const time_t COOKIE_ENTRY_LIFETIME = 86400 * 30;
-static const unsigned int BUCKETS_SIZE = 131063;
 
 
 static uint64_t
-generate_cookie( void ) {
+generate_cookie( cookie_table_t *table ) {
   uint64_t initial_value = ( cookie_dough != ( INVALID_COOKIE - 1 ) ) ? ++cookie_dough : 1;
 
   cookie_dough = initial_value;
-  while ( lookup_cookie_entry_by_cookie( &cookie_dough ) != NULL ) {
+  while ( lookup_cookie_entry_by_cookie( table, &cookie_dough ) != NULL ) {
     if ( cookie_dough != ( INVALID_COOKIE - 1 ) ) {
       cookie_dough++;
     }
@@ -73,7 +73,7 @@ compare_application( const void *x, const void *y ) {
   if ( ex->cookie != ey->cookie ) {
     return false;
   }
-  if ( strcmp( ex->service_name, ey->service_name ) != 0 ) {
+  if ( ex->service != ey->service ) {
     return false;
   }
   return true;
@@ -82,25 +82,21 @@ compare_application( const void *x, const void *y ) {
 
 static unsigned int
 hash_application( const void *key ) {
-  return hash_core( key, ( int ) sizeof( uint64_t ) );
+  return hash_core( key, ( int ) offsetof( application_entry_t, flags ) );
 }
 
 
 static cookie_entry_t *
-allocate_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t flags ) {
+allocate_cookie_entry( cookie_table_t *table, uint64_t *original_cookie, messenger_service_id service, uint16_t flags ) {
   cookie_entry_t *new_entry;
 
   new_entry = xmalloc( sizeof( cookie_entry_t ) );
   memset( new_entry, 0, sizeof( cookie_entry_t ) );
 
-  new_entry->cookie = generate_cookie();
+  new_entry->cookie = generate_cookie( table );
   new_entry->application.cookie = *original_cookie;
-
-  if ( strlen( service_name ) + 1 > MESSENGER_SERVICE_NAME_LENGTH ) {
-    warn( "Too long service name ( service_name = %s ).", service_name );
-  }
-  strncpy( new_entry->application.service_name, service_name, MESSENGER_SERVICE_NAME_LENGTH );
-  new_entry->application.service_name[ MESSENGER_SERVICE_NAME_LENGTH - 1 ] = '\0';
+  retain_messenger_service_id( service );
+  new_entry->application.service = service;
 
   new_entry->application.flags = flags;
   new_entry->reference_count = 1;
@@ -112,6 +108,7 @@ allocate_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t f
 
 static void
 free_cookie_entry( cookie_entry_t *free_entry ) {
+  release_messenger_service_id( free_entry->application.service );
   xfree( free_entry );
 }
 
@@ -128,30 +125,34 @@ free_cookie_table_walker( void *key, void *value, void *user_data ) {
 
 
 void
-init_cookie_table( void ) {
-  cookie_table.global = create_hash_with_size( compare_cookie, hash_cookie_entry, BUCKETS_SIZE );
-  cookie_table.application = create_hash_with_size( compare_application, hash_application, BUCKETS_SIZE );
+init_cookie_table( cookie_table_t *table ) {
+  assert( table != NULL );
+
+  table->global = create_flat_hash( compare_cookie, hash_cookie_entry, FLAT_HASH_NO_LOCK );
+  table->application = create_flat_hash( compare_application, hash_application, FLAT_HASH_NO_LOCK );
 }
 
 
 void
-finalize_cookie_table( void ) {
-  foreach_hash( cookie_table.global, free_cookie_table_walker, NULL );
-  delete_hash( cookie_table.global );
-  delete_hash( cookie_table.application );
-  cookie_table.global = NULL;
-  cookie_table.application = NULL;
+finalize_cookie_table( cookie_table_t *table ) {
+  assert( table != NULL );
+
+  foreach_flat_hash( table->global, free_cookie_table_walker, NULL );
+  delete_flat_hash( table->global );
+  delete_flat_hash( table->application );
+  table->global = NULL;
+  table->application = NULL;
 }
 
 
 uint64_t *
-insert_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t flags ) {
+insert_cookie_entry( cookie_table_t *table, uint64_t *original_cookie, messenger_service_id service, uint16_t flags ) {
   cookie_entry_t *new_entry, *conflict_entry;
 
   debug( "Inserting cookie entry ( original_cookie = %#" PRIx64 ", service_name = %s, flags = %#x ).",
-         *original_cookie, service_name, flags );
+         *original_cookie, get_messenger_service_name( service ), flags );
 
-  new_entry = lookup_cookie_entry_by_application( original_cookie, service_name );
+  new_entry = lookup_cookie_entry_by_application( table, original_cookie, service );
   if ( new_entry != NULL ) {
     new_entry->reference_count++;
     new_entry->expire_at = time( NULL ) + COOKIE_ENTRY_LIFETIME;
@@ -160,24 +161,24 @@ insert_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t fla
     return &new_entry->cookie;
   }
 
-  new_entry = allocate_cookie_entry( original_cookie, service_name, flags );
-  conflict_entry = lookup_cookie_entry_by_cookie( &new_entry->cookie );
+  new_entry = allocate_cookie_entry( table, original_cookie, service, flags );
+  conflict_entry = lookup_cookie_entry_by_cookie( table, &new_entry->cookie );
   if ( conflict_entry != NULL ) {
     warn( "Conflicted cookie ( cookie = %#" PRIx64 " ).", new_entry->cookie );
-    delete_cookie_entry( conflict_entry );
+    delete_cookie_entry( table, conflict_entry );
   }
-  insert_hash_entry( cookie_table.global, &new_entry->cookie, new_entry );
-  insert_hash_entry( cookie_table.application, &new_entry->application, new_entry );
+  insert_flat_hash_entry( table->global, &new_entry->cookie, new_entry );
+  insert_flat_hash_entry( table->application, &new_entry->application, new_entry );
 
   return &new_entry->cookie;
 }
 
 
 void
-delete_cookie_entry( cookie_entry_t *entry ) {
+delete_cookie_entry( cookie_table_t *table, cookie_entry_t *entry ) {
   debug( "Deleting cookie entry ( cookie = %#" PRIx64 ", application = [ cookie = %#" PRIx64 ", service_name = %s, "
          "flags = %#x ], reference_count = %d, expire_at = %" PRIu64 " ).",
-         entry->cookie, entry->application.cookie, entry->application.service_name,
+         entry->cookie, entry->application.cookie, get_messenger_service_name( entry->application.service ),
          entry->application.flags, entry->reference_count, ( int64_t ) entry->expire_at );
 
   if ( entry->reference_count > 1 ) {
@@ -186,14 +187,14 @@ delete_cookie_entry( cookie_entry_t *entry ) {
     return;
   }
 
-  cookie_entry_t *delete_entry_global = delete_hash_entry( cookie_table.global, &entry->cookie );
+  cookie_entry_t *delete_entry_global = delete_flat_hash_entry( table->global, &entry->cookie );
   if ( delete_entry_global == NULL ) {
     error( "No cookie entry found ( cookie = %#" PRIx64 " ).", entry->cookie );
   }
-  cookie_entry_t *delete_entry_application = delete_hash_entry( cookie_table.application, &entry->application );
+  cookie_entry_t *delete_entry_application = delete_flat_hash_entry( table->application, &entry->application );
   if ( delete_entry_application == NULL ) {
     error( "No cookie entry found ( cookie = %#" PRIx64 ", service_name = %s ).",
-           entry->application.cookie, entry->application.service_name );
+           entry->application.cookie, get_messenger_service_name( entry->application.service ) );
   }
 
   free_cookie_entry( entry );
@@ -201,53 +202,52 @@ delete_cookie_entry( cookie_entry_t *entry ) {
 
 
 cookie_entry_t *
-lookup_cookie_entry_by_cookie( uint64_t *cookie ) {
-  return lookup_hash_entry( cookie_table.global, cookie );
+lookup_cookie_entry_by_cookie( cookie_table_t *table, uint64_t *cookie ) {
+  return lookup_flat_hash_entry( table->global, cookie );
 }
 
 
 cookie_entry_t *
-lookup_cookie_entry_by_application( uint64_t *cookie, char *service_name ) {
+lookup_cookie_entry_by_application( cookie_table_t *table, uint64_t *cookie, messenger_service_id service ) {
   application_entry_t key;
   cookie_entry_t *entry;
 
   memset( &key, 0, sizeof( application_entry_t ) );
   key.cookie = *cookie;
-  strncpy( key.service_name, service_name, MESSENGER_SERVICE_NAME_LENGTH );
-  key.service_name[ MESSENGER_SERVICE_NAME_LENGTH - 1 ] = '\0';
+  key.service = service;
 
-  entry = lookup_hash_entry( cookie_table.application, &key );
+  entry = lookup_flat_hash_entry( table->application, &key );
 
   return entry;
 }
 
 
 static void
-age_cookie_entry( cookie_entry_t *entry ) {
+age_cookie_entry( cookie_table_t *table, cookie_entry_t *entry ) {
   if ( entry->expire_at < time( NULL ) ) {
     // TODO: check if the target flow is still alive or not
     warn( "Aging out cookie entry ( cookie = %#" PRIx64 ", application = [ cookie = %#" PRIx64 ", service_name = %s, "
           "flags = %#x ], reference_count = %d, expire_at = %" PRIu64 " ).",
-          entry->cookie, entry->application.cookie, entry->application.service_name,
+          entry->cookie, entry->application.cookie, get_messenger_service_name( entry->application.service ),
           entry->application.flags, entry->reference_count, ( int64_t ) entry->expire_at );
 
-    delete_hash_entry( cookie_table.global, &entry->cookie );
-    delete_hash_entry( cookie_table.application, &entry->application );
+    delete_flat_hash_entry( table->global, &entry->cookie );
+    delete_flat_hash_entry( table->application, &entry->application );
     free_cookie_entry( entry );
   }
 }
 
 
 void
-age_cookie_table( void *user_data ) {
-  UNUSED( user_data );
+age_cookie_table( void *table ) {
+  assert( table != NULL );
 
-  hash_iterator iter;
+  flat_hash_iterator iter;
   hash_entry *e;
 
-  init_hash_iterator( cookie_table.global, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
-    age_cookie_entry( e->value );
+  init_flat_hash_iterator( ( ( cookie_table_t * ) table )->global, &iter );
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
+    age_cookie_entry( table, e->value );
   }
 }
 
@@ -256,26 +256,26 @@ static void
 dump_cookie_entry( cookie_entry_t *entry ) {
   info( "cookie = %#" PRIx64 ", application = [ cookie = %#" PRIx64 ", service_name = %s, "
         "flags = %#x ], reference_count = %d, expire_at = %" PRIu64 "",
-        entry->cookie, entry->application.cookie, entry->application.service_name,
+        entry->cookie, entry->application.cookie, get_messenger_service_name( entry->application.service ),
         entry->application.flags, entry->reference_count, ( int64_t ) entry->expire_at );
 }
 
 
 void
-dump_cookie_table( void ) {
-  hash_iterator iter;
+dump_cookie_table( cookie_table_t *table ) {
+  flat_hash_iterator iter;
   hash_entry *e;
 
   info( "#### COOKIE TABLE ####" );
   info( "[global]" );
-  init_hash_iterator( cookie_table.global, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+  init_flat_hash_iterator( table->global, &iter );
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
     dump_cookie_entry( e->value );
   }
 
   info( "[application]" );
-  init_hash_iterator( cookie_table.application, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+  init_flat_hash_iterator( table->application, &iter );
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
     dump_cookie_entry( e->value );
   }
   info( "#### END ####" );
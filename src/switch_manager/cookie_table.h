@@ -32,7 +32,7 @@
 
 typedef struct application_entry {
   uint64_t cookie;
-  char service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
+  messenger_service_id service;
   uint16_t flags;
 } application_entry_t;
 
@@ -43,20 +43,21 @@ typedef struct cookie_entry {
   time_t expire_at;
 } cookie_entry_t;
 
+// Cookie translations of a switch.
 typedef struct cookie_table {
-  hash_table *global;
-  hash_table *application;
+  flat_hash_table *global;
+  flat_hash_table *application;
 } cookie_table_t;
 
 
-void init_cookie_table( void );
-void finalize_cookie_table( void );
-uint64_t *insert_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t flags );
-void delete_cookie_entry( cookie_entry_t *entry );
-cookie_entry_t *lookup_cookie_entry_by_cookie( uint64_t *cookie );
-cookie_entry_t *lookup_cookie_entry_by_application( uint64_t *cookie, char *service_name );
-void age_cookie_table( void *user_data );
-void dump_cookie_table( void );
+void init_cookie_table( cookie_table_t *table );
+void finalize_cookie_table( cookie_table_t *table );
+uint64_t *insert_cookie_entry( cookie_table_t *table, uint64_t *original_cookie, messenger_service_id service, uint16_t flags );
+void delete_cookie_entry( cookie_table_t *table, cookie_entry_t *entry );
+cookie_entry_t *lookup_cookie_entry_by_cookie( cookie_table_t *table, uint64_t *cookie );
+cookie_entry_t *lookup_cookie_entry_by_application( cookie_table_t *table, uint64_t *cookie, messenger_service_id service );
+void age_cookie_table( void *table );
+void dump_cookie_table( cookie_table_t *table );
 
 
 #endif // COOKIE_TABLE_H
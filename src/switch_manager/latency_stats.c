@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "latency_stats.h"
+
+
+#define NO_BUFFER UINT32_MAX
+
+static const char *latency_type_names[ LATENCY_TYPES ] = {
+  [ LATENCY_ECHO ] = "echo",
+  [ LATENCY_BARRIER ] = "barrier",
+  [ LATENCY_STATS ] = "stats",
+  [ LATENCY_PACKET_OUT ] = "packet_out",
+};
+
+
+uint64_t
+get_latency_clock( void ) {
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+
+  // Never returns zero, which tells an unused timestamp.
+  return ( uint64_t ) now.tv_sec * 1000000 + ( uint64_t ) now.tv_nsec / 1000 + 1;
+}
+
+
+void
+record_latency( latency_stats *stats, latency_type type, uint64_t since ) {
+  assert( stats != NULL );
+  assert( type < LATENCY_TYPES );
+
+  if ( since == 0 ) {
+    return;
+  }
+  uint64_t now = get_latency_clock();
+  record_histogram_value( &stats->histograms[ type ], now > since ? now - since : 0 );
+}
+
+
+void
+latency_flow_mod_sent( latency_stats *stats ) {
+  assert( stats != NULL );
+
+  if ( stats->first_flow_mod_at == 0 ) {
+    stats->first_flow_mod_at = get_latency_clock();
+  }
+}
+
+
+/*
+ * Returns the time to measure the reply to a barrier_request from, i.e.,
+ * when the first flow_mod that the barrier covers was sent.
+ */
+uint64_t
+latency_barrier_request_sent( latency_stats *stats ) {
+  assert( stats != NULL );
+
+  uint64_t since = stats->first_flow_mod_at;
+  stats->first_flow_mod_at = 0;
+  if ( since == 0 ) {
+    since = get_latency_clock();
+  }
+
+  return since;
+}
+
+
+void
+latency_packet_in_received( latency_stats *stats, uint32_t buffer_id ) {
+  assert( stats != NULL );
+
+  if ( buffer_id == NO_BUFFER ) {
+    return;
+  }
+  // Older packet_ins are overwritten since the switch has likely dropped them.
+  unsigned int slot = buffer_id % LATENCY_PACKET_IN_SLOTS;
+  stats->packet_ins[ slot ].buffer_id = buffer_id;
+  stats->packet_ins[ slot ].received_at = get_latency_clock();
+}
+
+
+void
+latency_packet_out_sent( latency_stats *stats, uint32_t buffer_id ) {
+  assert( stats != NULL );
+
+  if ( buffer_id == NO_BUFFER ) {
+    return;
+  }
+  unsigned int slot = buffer_id % LATENCY_PACKET_IN_SLOTS;
+  if ( stats->packet_ins[ slot ].received_at == 0 || stats->packet_ins[ slot ].buffer_id != buffer_id ) {
+    return;
+  }
+  record_latency( stats, LATENCY_PACKET_OUT, stats->packet_ins[ slot ].received_at );
+  stats->packet_ins[ slot ].received_at = 0;
+}
+
+
+static void
+report_latency( const char *prefix, const char *name, uint64_t value,
+                void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  char key[ STAT_KEY_LENGTH ];
+  snprintf( key, sizeof( key ), "%s.%s", prefix, name );
+  function( key, value, user_data );
+}
+
+
+/*
+ * Reports the number of round trips and their percentiles in
+ * microseconds as "switch.<datapath id>.latency.<type>.*" keys.
+ */
+void
+foreach_latency_stat( const latency_stats *stats, uint64_t datapath_id, void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  assert( stats != NULL );
+  assert( function != NULL );
+
+  for ( int i = 0; i < LATENCY_TYPES; i++ ) {
+    const histogram *h = &stats->histograms[ i ];
+    if ( h->n_values == 0 ) {
+      continue;
+    }
+    char prefix[ STAT_KEY_LENGTH ];
+    snprintf( prefix, sizeof( prefix ), "switch.%#" PRIx64 ".latency.%s", datapath_id, latency_type_names[ i ] );
+    report_latency( prefix, "count", h->n_values, function, user_data );
+    report_latency( prefix, "p50_usec", histogram_percentile( h, 50.0 ), function, user_data );
+    report_latency( prefix, "p99_usec", histogram_percentile( h, 99.0 ), function, user_data );
+    report_latency( prefix, "p999_usec", histogram_percentile( h, 99.9 ), function, user_data );
+    report_latency( prefix, "max_usec", h->max, function, user_data );
+  }
+}
+
+
+typedef struct {
+  buffer *buf;
+  const char *name;
+} dump_context;
+
+
+static void
+append_line( buffer *buf, const char *line ) {
+  size_t length = strlen( line );
+  memcpy( append_back_buffer( buf, length ), line, length );
+}
+
+
+static void
+dump_bucket( uint64_t lower, uint64_t upper, uint64_t count, void *user_data ) {
+  dump_context *context = user_data;
+
+  char line[ 128 ];
+  snprintf( line, sizeof( line ), "%s %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", context->name, lower, upper, count );
+  append_line( context->buf, line );
+}
+
+
+/*
+ * Dumps the non-empty buckets of all histograms as text, one
+ * "<type> <lower usec> <upper usec> <count>" line for each.
+ */
+buffer *
+dump_latency_histograms( const latency_stats *stats ) {
+  assert( stats != NULL );
+
+  dump_context context;
+  context.buf = alloc_buffer_with_length( 1024 );
+  append_line( context.buf, "# type lower_usec upper_usec count\n" );
+  for ( int i = 0; i < LATENCY_TYPES; i++ ) {
+    context.name = latency_type_names[ i ];
+    foreach_histogram_bucket( &stats->histograms[ i ], dump_bucket, &context );
+  }
+
+  return context.buf;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
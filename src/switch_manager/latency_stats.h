@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+
+#include "trema.h"
+
+
+typedef enum {
+  LATENCY_ECHO = 0,   // echo_request to echo_reply
+  LATENCY_BARRIER,    // first flow_mod before a barrier_request to barrier_reply
+  LATENCY_STATS,      // stats_request to the last stats_reply
+  LATENCY_PACKET_OUT, // packet_in to packet_out with the same buffer_id
+  LATENCY_TYPES,
+} latency_type;
+
+#define LATENCY_PACKET_IN_SLOTS 256
+
+
+// Round trip times of a switch in microseconds. Zero-filled is empty.
+typedef struct {
+  histogram histograms[ LATENCY_TYPES ];
+  uint64_t first_flow_mod_at; // 0 if no flow_mod since the last barrier_request
+  struct {
+    uint32_t buffer_id;
+    uint64_t received_at;     // 0 if the slot is not in use
+  } packet_ins[ LATENCY_PACKET_IN_SLOTS ];
+} latency_stats;
+
+
+uint64_t get_latency_clock( void );
+void record_latency( latency_stats *stats, latency_type type, uint64_t since );
+void latency_flow_mod_sent( latency_stats *stats );
+uint64_t latency_barrier_request_sent( latency_stats *stats );
+void latency_packet_in_received( latency_stats *stats, uint32_t buffer_id );
+void latency_packet_out_sent( latency_stats *stats, uint32_t buffer_id );
+void foreach_latency_stat( const latency_stats *stats, uint64_t datapath_id, void function( const char *key, const uint64_t value, void *user_data ), void *user_data );
+buffer *dump_latency_histograms( const latency_stats *stats );
+
+
+#endif // LATENCY_STATS_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
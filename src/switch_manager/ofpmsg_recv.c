@@ -61,15 +61,15 @@ send_transaction_reply( struct switch_info *sw_info, buffer *buf ) {
   header = buf->data;
   xid = ntohl( header->xid );
 
-  xid_entry = lookup_xid_entry( xid );
+  xid_entry = lookup_xid_entry( &sw_info->xid_table, xid );
   if ( xid_entry == NULL ) {
     free_buffer( buf );
     return -1;
   }
   header->xid = htonl( xid_entry->original_xid );
-  service_send_to_reply( xid_entry->service_name, MESSENGER_OPENFLOW_MESSAGE,
+  service_send_to_reply( xid_entry->service, MESSENGER_OPENFLOW_MESSAGE,
                          &sw_info->datapath_id, buf );
-  delete_xid_entry( xid_entry );
+  delete_xid_entry( &sw_info->xid_table, xid_entry );
   free_buffer( buf );
 
   return 0;
@@ -119,7 +119,7 @@ ofpmsg_recv_error( struct switch_info *sw_info, buffer *buf ) {
     if ( length >= offsetof( struct ofp_flow_mod, command ) ) {
       struct ofp_flow_mod *flow_mod = ( struct ofp_flow_mod * ) error_msg->data;
       uint32_t xid = ntohl( flow_mod->header.xid );
-      xid_entry_t *xid_entry = lookup_xid_entry( xid );
+      xid_entry_t *xid_entry = lookup_xid_entry( &sw_info->xid_table, xid );
       if ( xid_entry != NULL ) {
         flow_mod->header.xid = htonl( xid_entry->original_xid );
       }
@@ -129,7 +129,7 @@ ofpmsg_recv_error( struct switch_info *sw_info, buffer *buf ) {
         return 0;
       }
       if ( sw_info->cookie_translation ) {
-        cookie_entry_t *entry = lookup_cookie_entry_by_cookie( &cookie );
+        cookie_entry_t *entry = lookup_cookie_entry_by_cookie( &sw_info->cookie_table, &cookie );
         if ( entry != NULL ) {
           flow_mod->cookie = htonll( entry->application.cookie );
           if ( length >= offsetof( struct ofp_flow_mod, actions ) ) {
@@ -143,7 +143,7 @@ ofpmsg_recv_error( struct switch_info *sw_info, buffer *buf ) {
           case OFPFC_ADD:
           {
             if ( entry != NULL ) {
-              delete_cookie_entry( entry );
+              delete_cookie_entry( &sw_info->cookie_table, entry );
             }
             else {
               error( "No cookie entry found ( cookie = %#" PRIx64 " ).", cookie );
@@ -206,7 +206,7 @@ int
 ofpmsg_recv_vendor( struct switch_info *sw_info, buffer *buf ) {
   ofpmsg_debug( "Receive 'vendor' from a switch." );
 
-  service_send_to_application( sw_info->vendor_service_name_list,
+  service_send_to_application( &sw_info->vendor_services,
                                MESSENGER_OPENFLOW_MESSAGE,
                                &sw_info->datapath_id, buf );
   free_buffer( buf );
@@ -253,7 +253,10 @@ int
 ofpmsg_recv_packetin( struct switch_info *sw_info, buffer *buf ) {
   ofpmsg_debug( "Receive 'packet in' from a switch." );
 
-  service_send_to_application( sw_info->packetin_service_name_list,
+  struct ofp_packet_in *packet_in = buf->data;
+  latency_packet_in_received( &sw_info->latency, ntohl( packet_in->buffer_id ) );
+
+  service_send_to_application( &sw_info->packetin_services,
                                MESSENGER_OPENFLOW_MESSAGE,
                                &sw_info->datapath_id, buf );
   free_buffer( buf );
@@ -279,13 +282,13 @@ ofpmsg_recv_flowremoved( struct switch_info *sw_info, buffer *buf ) {
   }
 
   if ( !sw_info->cookie_translation ) {
-    service_send_to_application( sw_info->state_service_name_list, MESSENGER_OPENFLOW_MESSAGE,
+    service_send_to_application( &sw_info->state_services, MESSENGER_OPENFLOW_MESSAGE,
                                  &sw_info->datapath_id, buf );
     free_buffer( buf );
     return 0;
   }
 
-  entry = lookup_cookie_entry_by_cookie( &cookie );
+  entry = lookup_cookie_entry_by_cookie( &sw_info->cookie_table, &cookie );
   if ( entry == NULL ) {
     error( "No cookie entry found ( cookie = %#" PRIx64 " ).", cookie );
     free_buffer( buf );
@@ -294,17 +297,17 @@ ofpmsg_recv_flowremoved( struct switch_info *sw_info, buffer *buf ) {
 
   debug( "Cookie found ( cookie = %#" PRIx64 ", application = [ cookie = %#" PRIx64
          ", service name = %s, flags = %#x ], reference_count = %d, expire_at = %" PRIu64 " ).",
-         cookie, entry->application.cookie, entry->application.service_name, entry->application.flags,
+         cookie, entry->application.cookie, get_messenger_service_name( entry->application.service ), entry->application.flags,
          entry->reference_count, ( int64_t ) entry->expire_at );
 
   if ( entry->application.flags & OFPFF_SEND_FLOW_REM ) {
     flow_removed->cookie = htonll( entry->application.cookie );
 
-    service_send_to_reply( entry->application.service_name, MESSENGER_OPENFLOW_MESSAGE,
+    service_send_to_reply( entry->application.service, MESSENGER_OPENFLOW_MESSAGE,
                            &sw_info->datapath_id, buf );
   }
 
-  delete_cookie_entry( entry );
+  delete_cookie_entry( &sw_info->cookie_table, entry );
   free_buffer( buf );
 
   return 0;
@@ -315,7 +318,7 @@ int
 ofpmsg_recv_portstatus( struct switch_info *sw_info, buffer *buf ) {
   ofpmsg_debug( "Receive 'port status' from a switch." );
 
-  service_send_to_application( sw_info->portstatus_service_name_list,
+  service_send_to_application( &sw_info->portstatus_services,
                                MESSENGER_OPENFLOW_MESSAGE,
                                &sw_info->datapath_id, buf );
   free_buffer( buf );
@@ -337,10 +340,10 @@ ofpmsg_recv_statsreply( struct switch_info *sw_info, buffer *buf ) {
     struct ofp_flow_stats *flow_stats = ( void * ) ( ( char * ) stats_reply + body_offset );
     while ( body_length > 0 ) {
       uint64_t cookie = ntohll( flow_stats->cookie );
-      cookie_entry_t *entry = lookup_cookie_entry_by_cookie( &cookie );
+      cookie_entry_t *entry = lookup_cookie_entry_by_cookie( &sw_info->cookie_table, &cookie );
       if ( entry != NULL ) {
         debug( "Cookie entry found ( cookie = %#" PRIx64 ", application = [ cookie = %#" PRIx64 ", service name = %s ] ).",
-               cookie, entry->application.cookie, entry->application.service_name );
+               cookie, entry->application.cookie, get_messenger_service_name( entry->application.service ) );
         flow_stats->cookie = htonll( entry->application.cookie );
       }
       else {
@@ -354,18 +357,19 @@ ofpmsg_recv_statsreply( struct switch_info *sw_info, buffer *buf ) {
 
   // since we may receive multiple replies, we cannot call send_transaction_reply().
   uint32_t xid = ntohl( stats_reply->header.xid );
-  xid_entry_t *xid_entry = lookup_xid_entry( xid );
+  xid_entry_t *xid_entry = lookup_xid_entry( &sw_info->xid_table, xid );
   if ( xid_entry == NULL ) {
     error( "No transaction id entry found ( transaction_id = %#" PRIx32 " ).", xid );
     free_buffer( buf );
     return -1;
   }
   stats_reply->header.xid = htonl( xid_entry->original_xid );
-  service_send_to_reply( xid_entry->service_name, MESSENGER_OPENFLOW_MESSAGE,
+  service_send_to_reply( xid_entry->service, MESSENGER_OPENFLOW_MESSAGE,
                          &sw_info->datapath_id, buf );
 
   if ( ( ntohs( stats_reply->flags ) & OFPSF_REPLY_MORE ) == 0 ) {
-    delete_xid_entry( xid_entry );
+    record_latency( &sw_info->latency, LATENCY_STATS, xid_entry->sent_at );
+    delete_xid_entry( &sw_info->xid_table, xid_entry );
   }
   free_buffer( buf );
 
@@ -377,6 +381,12 @@ int
 ofpmsg_recv_barrierreply( struct switch_info *sw_info, buffer *buf ) {
   ofpmsg_debug( "Receive 'barrier reply' from a switch." );
 
+  struct ofp_header *header = buf->data;
+  xid_entry_t *xid_entry = lookup_xid_entry( &sw_info->xid_table, ntohl( header->xid ) );
+  if ( xid_entry != NULL ) {
+    record_latency( &sw_info->latency, LATENCY_BARRIER, xid_entry->sent_at );
+  }
+
   send_transaction_reply( sw_info, buf );
 
   return 0;
@@ -135,7 +135,7 @@ ofpmsg_send_error_msg( struct switch_info *sw_info, uint16_t type, uint16_t code
 
 
 static int
-update_flowmod_cookie( buffer *buf, char *service_name ) {
+update_flowmod_cookie( struct switch_info *sw_info, buffer *buf, messenger_service_id service ) {
   struct ofp_flow_mod *flow_mod = buf->data;
   uint16_t command = ntohs( flow_mod->command );
   uint16_t flags = ntohs( flow_mod->flags );
@@ -144,7 +144,7 @@ update_flowmod_cookie( buffer *buf, char *service_name ) {
   switch ( command ) {
   case OFPFC_ADD:
   {
-    uint64_t *new_cookie = insert_cookie_entry( &cookie, service_name, flags );
+    uint64_t *new_cookie = insert_cookie_entry( &sw_info->cookie_table, &cookie, service, flags );
     if ( new_cookie == NULL ) {
       return -1;
     }
@@ -156,12 +156,12 @@ update_flowmod_cookie( buffer *buf, char *service_name ) {
   case OFPFC_MODIFY:
   case OFPFC_MODIFY_STRICT:
   {
-    cookie_entry_t *entry = lookup_cookie_entry_by_application( &cookie, service_name );
+    cookie_entry_t *entry = lookup_cookie_entry_by_application( &sw_info->cookie_table, &cookie, service );
     if ( entry != NULL ) {
       flow_mod->cookie = htonll( entry->cookie );
     }
     else {
-      uint64_t *new_cookie = insert_cookie_entry( &cookie, service_name, flags );
+      uint64_t *new_cookie = insert_cookie_entry( &sw_info->cookie_table, &cookie, service, flags );
       if ( new_cookie == NULL ) {
         return -1;
       }
@@ -174,7 +174,7 @@ update_flowmod_cookie( buffer *buf, char *service_name ) {
   case OFPFC_DELETE:
   case OFPFC_DELETE_STRICT:
   {
-    cookie_entry_t *entry = lookup_cookie_entry_by_application( &cookie, service_name );
+    cookie_entry_t *entry = lookup_cookie_entry_by_application( &sw_info->cookie_table, &cookie, service );
     if ( entry != NULL ) {
       flow_mod->cookie = htonll( entry->cookie );
     }
@@ -193,6 +193,36 @@ update_flowmod_cookie( buffer *buf, char *service_name ) {
 }
 
 
+static void
+track_request_latency( struct switch_info *sw_info, buffer *buf, uint32_t xid ) {
+  struct ofp_header *ofp_header = buf->data;
+
+  switch ( ofp_header->type ) {
+  case OFPT_FLOW_MOD:
+    latency_flow_mod_sent( &sw_info->latency );
+    break;
+
+  case OFPT_BARRIER_REQUEST:
+    lookup_xid_entry( &sw_info->xid_table, xid )->sent_at = latency_barrier_request_sent( &sw_info->latency );
+    break;
+
+  case OFPT_STATS_REQUEST:
+    lookup_xid_entry( &sw_info->xid_table, xid )->sent_at = get_latency_clock();
+    break;
+
+  case OFPT_PACKET_OUT:
+  {
+    struct ofp_packet_out *packet_out = buf->data;
+    latency_packet_out_sent( &sw_info->latency, ntohl( packet_out->buffer_id ) );
+  }
+  break;
+
+  default:
+    break;
+  }
+}
+
+
 int
 ofpmsg_send( struct switch_info *sw_info, buffer *buf, char *service_name ) {
   int ret;
@@ -200,18 +230,23 @@ ofpmsg_send( struct switch_info *sw_info, buffer *buf, char *service_name ) {
   uint32_t new_xid;
 
   ofp_header = buf->data;
+  messenger_service_id service = get_messenger_service_id( service_name );
 
-  new_xid = insert_xid_entry( ntohl( ofp_header->xid ), service_name );
+  new_xid = insert_xid_entry( &sw_info->xid_table, ntohl( ofp_header->xid ), service );
   ofp_header->xid = htonl( new_xid );
+  track_request_latency( sw_info, buf, new_xid );
 
   if ( ofp_header->type == OFPT_FLOW_MOD && sw_info->cookie_translation ) {
-    ret = update_flowmod_cookie( buf, service_name );
+    ret = update_flowmod_cookie( sw_info, buf, service );
     if ( ret < 0 ) {
       error( "Failed to update cookie value ( ret = %d ).", ret );
+      release_messenger_service_id( service );
       free_buffer( buf );
       return ret;
     }
   }
+  // The xid and cookie entries hold their own references.
+  release_messenger_service_id( service );
 
   ret = send_to_secure_channel( sw_info, buf );
   if ( ret == 0 ) {
@@ -19,13 +19,17 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <openflow.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include "trema.h"
 #include "secure_channel_listener.h"
@@ -35,6 +39,10 @@
 
 const int LISTEN_SOCK_MAX = 128;
 
+#define SECURE_CHANNEL_HANDSHAKE_BUFFER_SIZE 65536
+static const time_t SECURE_CHANNEL_HANDSHAKE_TIMEOUT = 10; // sec.
+static const time_t SWITCH_WORKER_MIN_LIFETIME = 1; // sec.
+
 #ifdef UNIT_TESTING
 #define static
 
@@ -225,6 +233,376 @@ free_switch_daemon_args( char **argv ) {
 static const int ACCEPT_FD = 3;
 
 
+static void
+redirect_stdio_to_dev_null( void ) {
+  int in_fd = open( "/dev/null", O_RDONLY );
+  if ( in_fd != 0 ) {
+    dup2( in_fd, 0 );
+    close( in_fd );
+  }
+  int out_fd = open( "/dev/null", O_WRONLY );
+  if ( out_fd != 1 ) {
+    dup2( out_fd, 1 );
+    close( out_fd );
+  }
+  int err_fd = open( "/dev/null", O_WRONLY );
+  if ( err_fd != 2 ) {
+    dup2( err_fd, 2 );
+    close( err_fd );
+  }
+}
+
+
+static char **
+make_switch_worker_args( struct listener_info *listener_info, int index ) {
+  const int SWITCH_WORKER_DEFAULT_ARGC = 4;
+  const int argc = SWITCH_WORKER_DEFAULT_ARGC + listener_info->switch_daemon_argc + 1;
+  char **argv = xcalloc( ( size_t ) argc, sizeof( char * ) );
+
+  int i = 0;
+  argv[ i++ ] = xasprintf( "%s%d", SWITCH_WORKER_PREFIX, index );
+  argv[ i++ ] = xasprintf( "%s%s%d", SWITCH_MANAGER_NAME_OPTION, SWITCH_WORKER_PREFIX, index );
+  argv[ i++ ] = xasprintf( "%s%d", SWITCH_MANAGER_SOCKET_OPTION, ACCEPT_FD );
+  argv[ i++ ] = xstrdup( SWITCH_MANAGER_WORKER_OPTION );
+  for ( int j = 0; j < listener_info->switch_daemon_argc; i++, j++ ) {
+    argv[ i ] = xstrdup( listener_info->switch_daemon_argv[ j ] );
+  }
+
+  return argv;
+}
+
+
+static bool
+start_switch_worker( struct listener_info *listener_info, int index ) {
+  struct switch_worker *worker = &listener_info->workers[ index ];
+  int sockets[ 2 ];
+
+  if ( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets ) < 0 ) {
+    error( "Failed to create a socket pair for switch worker %d. %s.", index, strerror( errno ) );
+    return false;
+  }
+  pid_t pid = fork();
+  if ( pid < 0 ) {
+    error( "Failed to fork. %s.", strerror( errno ) );
+    close( sockets[ 0 ] );
+    close( sockets[ 1 ] );
+    return false;
+  }
+  if ( pid == 0 ) {
+    close( listener_info->listen_fd );
+    if ( sockets[ 1 ] != ACCEPT_FD ) {
+      dup2( sockets[ 1 ], ACCEPT_FD );
+      close( sockets[ 1 ] );
+    }
+    else {
+      fcntl( ACCEPT_FD, F_SETFD, 0 );
+    }
+
+    char **argv = make_switch_worker_args( listener_info, index );
+    redirect_stdio_to_dev_null();
+
+    execvp( listener_info->switch_daemon, argv );
+    error( "Failed to execvp: %s(%s) %s %s. %s.",
+      argv[ 0 ], listener_info->switch_daemon,
+      argv[ 1 ], argv[ 2 ], strerror( errno ) );
+
+    free_switch_daemon_args( argv );
+    exit( EXIT_FAILURE );
+  }
+
+  close( sockets[ 1 ] );
+  // Handing over must not block the accept loop of switch_manager.
+  int flags = fcntl( sockets[ 0 ], F_GETFL, 0 );
+  if ( flags < 0 || fcntl( sockets[ 0 ], F_SETFL, flags | O_NONBLOCK ) < 0 ) {
+    warn( "Failed to set O_NONBLOCK to switch worker %d socket. %s.", index, strerror( errno ) );
+  }
+  worker->pid = pid;
+  worker->socket = sockets[ 0 ];
+  worker->started_at = time( NULL );
+  init_switch_worker_handoffs( worker );
+  debug( "Switch worker %d is started ( pid = %d ).", index, pid );
+
+  return true;
+}
+
+
+bool
+start_switch_workers( struct listener_info *listener_info ) {
+  listener_info->workers = xcalloc( ( size_t ) listener_info->n_workers, sizeof( struct switch_worker ) );
+  for ( int i = 0; i < listener_info->n_workers; i++ ) {
+    listener_info->workers[ i ].socket = -1;
+  }
+  for ( int i = 0; i < listener_info->n_workers; i++ ) {
+    if ( !start_switch_worker( listener_info, i ) ) {
+      stop_switch_workers( listener_info );
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/*
+ * Starts a new worker in place of the exited one. Switches served by
+ * the old worker reconnect to switch_manager by themselves. Returns false
+ * if pid is not a switch worker.
+ */
+bool
+restart_switch_worker( struct listener_info *listener_info, pid_t pid ) {
+  for ( int i = 0; i < listener_info->n_workers; i++ ) {
+    struct switch_worker *worker = &listener_info->workers[ i ];
+    if ( worker->pid != pid || worker->socket < 0 ) {
+      continue;
+    }
+    finalize_switch_worker_handoffs( worker );
+    close( worker->socket );
+    worker->socket = -1;
+    if ( time( NULL ) - worker->started_at < SWITCH_WORKER_MIN_LIFETIME ) {
+      error( "Switch worker %d ( pid = %d ) exited right after startup. Not restarting.", i, pid );
+      return true;
+    }
+    warn( "Switch worker %d ( pid = %d ) exited. Restarting.", i, pid );
+    start_switch_worker( listener_info, i );
+    return true;
+  }
+
+  return false;
+}
+
+
+void
+stop_switch_workers( struct listener_info *listener_info ) {
+  if ( listener_info->workers == NULL ) {
+    return;
+  }
+  // Workers exit when their socket is closed.
+  for ( int i = 0; i < listener_info->n_workers; i++ ) {
+    if ( listener_info->workers[ i ].socket >= 0 ) {
+      finalize_switch_worker_handoffs( &listener_info->workers[ i ] );
+      close( listener_info->workers[ i ].socket );
+      listener_info->workers[ i ].socket = -1;
+    }
+  }
+  xfree( listener_info->workers );
+  listener_info->workers = NULL;
+}
+
+
+/*
+ * With switch workers, switch_manager exchanges hello messages and reads
+ * the features reply by itself to learn the datapath id, and then hands
+ * the secure channel over to the worker in charge of the datapath.
+ */
+typedef struct {
+  int fd;
+  struct listener_info *listener_info;
+  bool hello_received;
+  size_t hello_length;
+  size_t length;
+  uint8_t data[ SECURE_CHANNEL_HANDSHAKE_BUFFER_SIZE ];
+} pending_secure_channel;
+
+
+static void
+handshake_timeout( void *user_data );
+
+
+static void
+close_pending_secure_channel( pending_secure_channel *channel, bool close_fd ) {
+  delete_timer_event( handshake_timeout, channel );
+  set_readable( channel->fd, false );
+  delete_fd_handler( channel->fd );
+  if ( close_fd ) {
+    close( channel->fd );
+  }
+  xfree( channel );
+}
+
+
+static void
+handshake_timeout( void *user_data ) {
+  pending_secure_channel *channel = user_data;
+
+  error( "Handshake timeout ( fd = %d ).", channel->fd );
+  set_readable( channel->fd, false );
+  delete_fd_handler( channel->fd );
+  close( channel->fd );
+  xfree( channel );
+}
+
+
+static bool
+send_to_pending_secure_channel( pending_secure_channel *channel, buffer *buf ) {
+  ssize_t ret = write( channel->fd, buf->data, buf->length );
+  size_t length = buf->length;
+  free_buffer( buf );
+  if ( ret < 0 || ( size_t ) ret != length ) {
+    error( "Failed to send a message to switch ( fd = %d, errno = %s [%d] ).", channel->fd, strerror( errno ), errno );
+    return false;
+  }
+
+  return true;
+}
+
+
+static size_t
+service_name_rules_length( list_element *list, const char *prefix ) {
+  size_t length = 0;
+  for ( list_element *e = list; e != NULL; e = e->next ) {
+    length += strlen( prefix ) + strlen( e->data ) + 1;
+  }
+  return length;
+}
+
+
+static char *
+append_service_name_rules( char *p, list_element *list, const char *prefix ) {
+  for ( list_element *e = list; e != NULL; e = e->next ) {
+    p += sprintf( p, "%s%s", prefix, ( const char * ) e->data ) + 1;
+  }
+  return p;
+}
+
+
+static void
+hand_over_secure_channel( pending_secure_channel *channel, uint64_t datapath_id ) {
+  struct listener_info *listener_info = channel->listener_info;
+  struct switch_worker *worker = &listener_info->workers[ select_switch_worker( datapath_id, listener_info->n_workers ) ];
+  if ( worker->socket < 0 ) {
+    error( "No switch worker for datapath %#" PRIx64 ".", datapath_id );
+    close_pending_secure_channel( channel, true );
+    return;
+  }
+
+  size_t service_names_length = service_name_rules_length( listener_info->vendor_service_name_list, VENDOR_PREFIX )
+    + service_name_rules_length( listener_info->packetin_service_name_list, PACKET_IN_PREFIX )
+    + service_name_rules_length( listener_info->portstatus_service_name_list, PORTSTATUS_PREFIX )
+    + service_name_rules_length( listener_info->state_service_name_list, STATE_PREFIX );
+  size_t data_length = channel->length - channel->hello_length;
+  size_t length = offsetof( switch_connection, data ) + service_names_length + data_length;
+  if ( length > SWITCH_CONNECTION_MAX_LENGTH ) {
+    error( "Too many destination rules to hand over datapath %#" PRIx64 ".", datapath_id );
+    close_pending_secure_channel( channel, true );
+    return;
+  }
+
+  switch_connection *connection = xmalloc( length );
+  connection->datapath_id = datapath_id;
+  connection->service_names_length = ( uint32_t ) service_names_length;
+  connection->data_length = ( uint32_t ) data_length;
+  char *p = connection->data;
+  p = append_service_name_rules( p, listener_info->vendor_service_name_list, VENDOR_PREFIX );
+  p = append_service_name_rules( p, listener_info->packetin_service_name_list, PACKET_IN_PREFIX );
+  p = append_service_name_rules( p, listener_info->portstatus_service_name_list, PORTSTATUS_PREFIX );
+  p = append_service_name_rules( p, listener_info->state_service_name_list, STATE_PREFIX );
+  memcpy( p, channel->data + channel->hello_length, data_length );
+
+  debug( "Handing over datapath %#" PRIx64 " to switch worker %d ( pid = %d ).",
+         datapath_id, ( int ) ( worker - listener_info->workers ), worker->pid );
+  int fd = channel->fd;
+  close_pending_secure_channel( channel, false );
+  hand_over_switch_connection( worker, fd, connection );
+}
+
+
+static void
+read_pending_secure_channel( int fd, void *data ) {
+  pending_secure_channel *channel = data;
+
+  ssize_t ret = read( fd, channel->data + channel->length, sizeof( channel->data ) - channel->length );
+  if ( ret < 0 ) {
+    if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) {
+      return;
+    }
+    error( "Failed to read from switch ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
+    close_pending_secure_channel( channel, true );
+    return;
+  }
+  if ( ret == 0 ) {
+    debug( "Connection closed by switch ( fd = %d ).", fd );
+    close_pending_secure_channel( channel, true );
+    return;
+  }
+  channel->length += ( size_t ) ret;
+
+  if ( !channel->hello_received ) {
+    if ( channel->length < sizeof( struct ofp_header ) ) {
+      return;
+    }
+    struct ofp_header *header = ( struct ofp_header * ) channel->data;
+    uint16_t length = ntohs( header->length );
+    if ( header->type != OFPT_HELLO || length < sizeof( struct ofp_header ) ) {
+      error( "Invalid message from switch while waiting for hello ( type = %#x, length = %u ).", header->type, length );
+      close_pending_secure_channel( channel, true );
+      return;
+    }
+    if ( channel->length < length ) {
+      return;
+    }
+    channel->hello_received = true;
+    channel->hello_length = length;
+    if ( !send_to_pending_secure_channel( channel, create_features_request( get_transaction_id() ) ) ) {
+      close_pending_secure_channel( channel, true );
+      return;
+    }
+  }
+
+  size_t offset = channel->hello_length;
+  while ( channel->length - offset >= sizeof( struct ofp_header ) ) {
+    struct ofp_header *header = ( struct ofp_header * ) ( channel->data + offset );
+    uint16_t length = ntohs( header->length );
+    if ( length < sizeof( struct ofp_header ) ) {
+      error( "Invalid message from switch ( type = %#x, length = %u ).", header->type, length );
+      close_pending_secure_channel( channel, true );
+      return;
+    }
+    if ( channel->length - offset < length ) {
+      break;
+    }
+    if ( header->type == OFPT_FEATURES_REPLY && length >= sizeof( struct ofp_switch_features ) ) {
+      const struct ofp_switch_features *features = ( const struct ofp_switch_features * ) header;
+      hand_over_secure_channel( channel, ntohll( features->datapath_id ) );
+      return;
+    }
+    offset += length;
+  }
+
+  if ( channel->length == sizeof( channel->data ) ) {
+    error( "No features reply from switch ( fd = %d ).", fd );
+    close_pending_secure_channel( channel, true );
+  }
+}
+
+
+static void
+start_handshake( struct listener_info *listener_info, int accept_fd ) {
+  fcntl( accept_fd, F_SETFD, FD_CLOEXEC );
+  fcntl( accept_fd, F_SETFL, O_NONBLOCK );
+
+  pending_secure_channel *channel = xmalloc( sizeof( pending_secure_channel ) );
+  memset( channel, 0, offsetof( pending_secure_channel, data ) );
+  channel->fd = accept_fd;
+  channel->listener_info = listener_info;
+
+  if ( !send_to_pending_secure_channel( channel, create_hello( get_transaction_id() ) ) ) {
+    close( accept_fd );
+    xfree( channel );
+    return;
+  }
+
+  set_fd_handler( accept_fd, read_pending_secure_channel, channel, NULL, NULL );
+  set_readable( accept_fd, true );
+
+  struct itimerspec interval;
+  interval.it_value.tv_sec = SECURE_CHANNEL_HANDSHAKE_TIMEOUT;
+  interval.it_value.tv_nsec = 0;
+  interval.it_interval.tv_sec = 0;
+  interval.it_interval.tv_nsec = 0;
+  add_timer_event_callback( &interval, handshake_timeout, channel );
+}
+
+
 void
 secure_channel_accept( int fd, void *data ) {
   struct listener_info *listener_info = data;
@@ -240,6 +618,10 @@ secure_channel_accept( int fd, void *data ) {
     error( "Failed to accept from switch. :%s.", strerror( errno ) );
     return;
   }
+  if ( listener_info->n_workers > 0 ) {
+    start_handshake( listener_info, accept_fd );
+    return;
+  }
   pid = fork();
   if ( pid < 0 ) {
     error( "Failed to fork. %s.", strerror( errno ) );
@@ -255,22 +637,7 @@ secure_channel_accept( int fd, void *data ) {
     }
 
     char **argv = make_switch_daemon_args( listener_info, &addr, accept_fd );
-
-    int in_fd = open( "/dev/null", O_RDONLY );
-    if ( in_fd != 0 ) {
-      dup2( in_fd, 0 );
-      close( in_fd );
-    }
-    int out_fd = open( "/dev/null", O_WRONLY );
-    if ( out_fd != 1 ) {
-      dup2( out_fd, 1 );
-      close( out_fd );
-    }
-    int err_fd = open( "/dev/null", O_WRONLY );
-    if ( err_fd != 2 ) {
-      dup2( err_fd, 2 );
-      close( err_fd );
-    }
+    redirect_stdio_to_dev_null();
 
     execvp( listener_info->switch_daemon, argv );
     error( "Failed to execvp: %s(%s) %s %s. %s.",
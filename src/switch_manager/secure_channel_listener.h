@@ -27,6 +27,9 @@
 
 bool secure_channel_listen_start( struct listener_info *listener_info );
 void secure_channel_accept( int fd, void *data );
+bool start_switch_workers( struct listener_info *listener_info );
+bool restart_switch_worker( struct listener_info *listener_info, pid_t pid );
+void stop_switch_workers( struct listener_info *listener_info );
 
 
 #endif // SECURE_CANNEL_LISTENER_H
@@ -29,7 +29,62 @@
 #include "secure_channel_receiver.h"
 
 
-static const size_t RECEIVE_BUFFFER_SIZE = UINT16_MAX + sizeof( struct ofp_packet_in ) - 2;
+// holds the longest OpenFlow message and fits in the largest buffer pool class
+static const size_t RECEIVE_BUFFFER_SIZE = UINT16_MAX + 1;
+
+
+/*
+ * Queued messages refer to the receive buffer without copying. Once they
+ * are all released, the remaining fragment is moved to the front of the
+ * buffer. Otherwise it is moved to a new buffer.
+ */
+static void
+prepare_fragment_buffer( struct switch_info *sw_info ) {
+  buffer *fragment_buf = sw_info->fragment_buf;
+  if ( fragment_buf == NULL ) {
+    sw_info->fragment_buf = alloc_buffer_with_length( RECEIVE_BUFFFER_SIZE );
+    return;
+  }
+
+  if ( is_shared_buffer( fragment_buf ) ) {
+    sw_info->fragment_buf = alloc_buffer_with_length( RECEIVE_BUFFFER_SIZE );
+    if ( fragment_buf->length > 0 ) {
+      char *p = append_back_buffer( sw_info->fragment_buf, fragment_buf->length );
+      memcpy( p, fragment_buf->data, fragment_buf->length );
+    }
+    free_buffer( fragment_buf );
+    return;
+  }
+
+  size_t headroom = headroom_of_buffer( fragment_buf );
+  if ( headroom > 0 ) {
+    memmove( ( char * ) fragment_buf->data - headroom, fragment_buf->data, fragment_buf->length );
+    fragment_buf->data = ( char * ) fragment_buf->data - headroom;
+  }
+}
+
+
+static int
+split_received_messages( struct switch_info *sw_info ) {
+  while ( sw_info->fragment_buf->length >= sizeof( struct ofp_header ) ) {
+    struct ofp_header *header = sw_info->fragment_buf->data;
+    if ( ! valid_message_version( header->type, header->version ) ) {
+      error( "Receive error: invalid version (version %d)", header->version );
+      ofpmsg_send_error_msg( sw_info,
+                             OFPET_BAD_REQUEST, OFPBRC_BAD_VERSION, sw_info->fragment_buf );
+      return -1;
+    }
+    uint16_t message_length = ntohs( header->length );
+    if ( message_length > sw_info->fragment_buf->length ) {
+      break;
+    }
+    buffer *message = slice_buffer( sw_info->fragment_buf, 0, message_length );
+    remove_front_buffer( sw_info->fragment_buf, message_length );
+    enqueue_message( sw_info->recv_queue, message );
+  }
+
+  return 0;
+}
 
 
 int
@@ -42,9 +97,7 @@ recv_from_secure_channel( struct switch_info *sw_info ) {
     return 0;
   }
 
-  if ( sw_info->fragment_buf == NULL ) {
-    sw_info->fragment_buf = alloc_buffer_with_length( RECEIVE_BUFFFER_SIZE );
-  }
+  prepare_fragment_buffer( sw_info );
 
   size_t remaining_length = RECEIVE_BUFFFER_SIZE - sw_info->fragment_buf->length;
   char *recv_buf = ( char * ) sw_info->fragment_buf->data + sw_info->fragment_buf->length;
@@ -62,36 +115,33 @@ recv_from_secure_channel( struct switch_info *sw_info ) {
   }
   sw_info->fragment_buf->length += ( size_t ) recv_length;
 
-  size_t read_total = 0;
-  while ( sw_info->fragment_buf->length >= sizeof( struct ofp_header ) ) {
-    struct ofp_header *header = sw_info->fragment_buf->data;
-    if ( ! valid_message_version( header->type, header->version ) ) {
-      error( "Receive error: invalid version (version %d)", header->version );
-      ofpmsg_send_error_msg( sw_info,
-                             OFPET_BAD_REQUEST, OFPBRC_BAD_VERSION, sw_info->fragment_buf );
-      return -1;
-    }
-    uint16_t message_length = ntohs( header->length );
-    if ( message_length > sw_info->fragment_buf->length ) {
-      break;
-    }
-    buffer *message = alloc_buffer_with_length( message_length );
-    char *p = append_back_buffer( message, message_length );
-    memcpy( p, sw_info->fragment_buf->data, message_length );
-    remove_front_buffer( sw_info->fragment_buf, message_length );
-    enqueue_message( sw_info->recv_queue, message );
-    read_total += message_length;
-  }
+  return split_received_messages( sw_info );
+}
+
 
-  // remove headroom manually for next call
-  if ( read_total > 0 ) {
-    memmove( ( char * ) sw_info->fragment_buf->data - read_total,
-             sw_info->fragment_buf->data,
-             sw_info->fragment_buf->length );
-    sw_info->fragment_buf->data = ( char * ) sw_info->fragment_buf->data - read_total;
+/*
+ * Queues messages read from the secure channel by someone else ( i.e.
+ * switch_manager before handing the channel over to a worker ).
+ */
+int
+feed_secure_channel( struct switch_info *sw_info, const void *data, size_t length ) {
+  assert( sw_info != NULL );
+  assert( sw_info->recv_queue != NULL );
+
+  if ( length > RECEIVE_BUFFFER_SIZE ) {
+    error( "Too long data is fed to a secure channel ( length = %zu ).", length );
+    return -1;
+  }
+  prepare_fragment_buffer( sw_info );
+  if ( sw_info->fragment_buf->length + length > RECEIVE_BUFFFER_SIZE ) {
+    error( "No room to feed a secure channel ( length = %zu ).", length );
+    return -1;
+  }
+  if ( length > 0 ) {
+    memcpy( append_back_buffer( sw_info->fragment_buf, length ), data, length );
   }
 
-  return 0;
+  return split_received_messages( sw_info );
 }
 
 
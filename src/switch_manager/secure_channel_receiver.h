@@ -26,6 +26,7 @@
 
 
 int recv_from_secure_channel( struct switch_info *sw_info );
+int feed_secure_channel( struct switch_info *sw_info, const void *data, size_t length );
 int handle_messages_from_secure_channel( struct switch_info *sw_info );
 
 
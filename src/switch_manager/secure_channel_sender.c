@@ -18,6 +18,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <openflow.h>
 #include <string.h>
@@ -26,9 +27,30 @@
 #include "message_queue.h"
 #include "ofpmsg_send.h"
 #include "secure_channel_sender.h"
+#include "service_interface.h"
 #include "trema.h"
 
 
+static void
+update_congestion( struct switch_info *sw_info ) {
+  if ( sw_info->state != SWITCH_STATE_COMPLETED ) {
+    return;
+  }
+  if ( !sw_info->congested && sw_info->send_queue_bytes >= SWITCH_SEND_QUEUE_HIGH_WATERMARK ) {
+    sw_info->congested = true;
+    info( "Send queue to a switch %#" PRIx64 " is congested ( length = %u, bytes = %" PRIu64 " ).",
+          sw_info->datapath_id, sw_info->send_queue->length, sw_info->send_queue_bytes );
+    service_send_congestion( sw_info, MESSENGER_OPENFLOW_CONGESTED );
+  }
+  else if ( sw_info->congested && sw_info->send_queue_bytes <= SWITCH_SEND_QUEUE_LOW_WATERMARK ) {
+    sw_info->congested = false;
+    info( "Send queue to a switch %#" PRIx64 " is drained ( length = %u, bytes = %" PRIu64 " ).",
+          sw_info->datapath_id, sw_info->send_queue->length, sw_info->send_queue_bytes );
+    service_send_congestion( sw_info, MESSENGER_OPENFLOW_UNCONGESTED );
+  }
+}
+
+
 int
 send_to_secure_channel( struct switch_info *sw_info, buffer *buf ) {
   assert( sw_info != NULL );
@@ -39,9 +61,12 @@ send_to_secure_channel( struct switch_info *sw_info, buffer *buf ) {
     return -1;
   }
 
+  size_t length = buf->length;
   bool res = enqueue_message( sw_info->send_queue, buf );
   if ( res ) {
+    sw_info->send_queue_bytes += length;
     set_writable( sw_info->secure_channel_fd, true );
+    update_congestion( sw_info );
   }
   return res ? 0 : -1;
 }
@@ -104,20 +129,22 @@ flush_secure_channel( struct switch_info *sw_info ) {
   if ( write_length == 0 ) {
     return 0;
   }
+  sw_info->send_queue_bytes -= ( uint64_t ) write_length;
   while ( ( buf = peek_message( sw_info->send_queue ) ) != NULL ) {
     if ( write_length == 0 ) {
       set_writable( sw_info->secure_channel_fd, true );
-      return 0;
+      break;
     }
     if ( ( size_t ) write_length < buf->length ) {
       remove_front_buffer( buf, ( size_t ) write_length );
       set_writable( sw_info->secure_channel_fd, true );
-      return 0;
+      break;
     }
     write_length -= ( ssize_t ) buf->length;
     buf = dequeue_message( sw_info->send_queue );
     free_buffer( buf );
   }
+  update_congestion( sw_info );
 
   return 0;
 }
@@ -24,18 +24,8 @@
 #include "trema.h"
 
 
-static buffer *
-create_openflow_application_message( uint64_t *datapath_id, buffer *data ) {
-  openflow_service_header_t *message;
-  buffer *buf;
-  void *append;
-  size_t append_len = 0;
-
-  if ( data != NULL ) {
-     append_len = data->length;
-  }
-  buf = alloc_buffer_with_length( sizeof( openflow_service_header_t ) + append_len );
-  message = append_back_buffer( buf, sizeof( openflow_service_header_t ) );
+static int
+create_openflow_application_message( struct iovec *iov, openflow_service_header_t *message, uint64_t *datapath_id, buffer *data ) {
   if ( datapath_id == NULL ) {
     message->datapath_id = ~0U; // FIXME: defined invalid datapath_id
   }
@@ -44,58 +34,89 @@ create_openflow_application_message( uint64_t *datapath_id, buffer *data ) {
   }
   message->service_name_length = htons( 0 );
   // TODO: append ipaddress and port
-  if ( append_len > 0 ) {
-    append = append_back_buffer( buf, append_len );
-    memcpy( append, data->data, append_len );
+  iov[ 0 ].iov_base = message;
+  iov[ 0 ].iov_len = sizeof( openflow_service_header_t );
+  if ( data == NULL || data->length == 0 ) {
+    return 1;
   }
+  // the message body is sent from the original buffer without copying
+  iov[ 1 ].iov_base = data->data;
+  iov[ 1 ].iov_len = data->length;
 
-  return buf;
+  return 2;
 }
 
 
 void
-service_send_to_reply( char *service_name, uint16_t message_type, uint64_t *datapath_id, buffer *data ) {
-  buffer *buf;
+update_service_id_list( service_id_list *services, list_element *service_name_list ) {
+  free_service_id_list( services );
 
-  if ( service_name == NULL ) {
+  unsigned int length = list_length_of( service_name_list );
+  if ( length == 0 ) {
     return;
   }
+  services->ids = xmalloc( sizeof( messenger_service_id ) * length );
+  for ( list_element *e = service_name_list; e != NULL; e = e->next ) {
+    services->ids[ services->length++ ] = get_messenger_service_id( e->data );
+  }
+}
 
-  buf = create_openflow_application_message( datapath_id, data );
-  if ( !send_message( service_name, message_type, buf->data, buf->length ) ) {
-    error( "Failed to send to reply ( service_name = %s ).", service_name );
+
+void
+free_service_id_list( service_id_list *services ) {
+  for ( unsigned int i = 0; i < services->length; i++ ) {
+    release_messenger_service_id( services->ids[ i ] );
+  }
+  if ( services->ids != NULL ) {
+    xfree( services->ids );
+  }
+  services->ids = NULL;
+  services->length = 0;
+}
+
+
+void
+service_send_to_reply( messenger_service_id service, uint16_t message_type, uint64_t *datapath_id, buffer *data ) {
+  openflow_service_header_t message;
+  struct iovec iov[ 2 ];
+  int iovcnt;
+
+  if ( service == MESSENGER_INVALID_SERVICE_ID ) {
+    return;
+  }
+
+  iovcnt = create_openflow_application_message( iov, &message, datapath_id, data );
+  if ( !send_message_iov_to_handle( service, message_type, iov, iovcnt ) ) {
+    error( "Failed to send to reply ( service_name = %s ).", get_messenger_service_name( service ) );
   }
-  free_buffer( buf );
 }
 
 
 void
-service_send_to_application( list_element *service_name_list, uint16_t message_type, uint64_t *datapath_id, buffer *data ) {
-  buffer *buf;
-  list_element *list;
-  char *service_name;
+service_send_to_application( const service_id_list *services, uint16_t message_type, uint64_t *datapath_id, buffer *data ) {
+  openflow_service_header_t message;
+  struct iovec iov[ 2 ];
+  int iovcnt;
 
-  if ( service_name_list == NULL ) {
+  if ( services->length == 0 ) {
     return;
   }
 
-  buf = create_openflow_application_message( datapath_id, data );
+  iovcnt = create_openflow_application_message( iov, &message, datapath_id, data );
 
-  static const char *error_service_name = NULL;
-  for ( list = service_name_list; list != NULL; list = list->next ) {
-    service_name = list->data;
-    if ( !send_message( service_name, message_type,
-                        buf->data, buf->length ) ) {
-      if ( error_service_name != service_name ) {
-        warn( "Failed to send message ( service_name = %s ).", service_name );
+  static messenger_service_id error_service = MESSENGER_INVALID_SERVICE_ID;
+  for ( unsigned int i = 0; i < services->length; i++ ) {
+    messenger_service_id service = services->ids[ i ];
+    if ( !send_message_iov_to_handle( service, message_type, iov, iovcnt ) ) {
+      if ( error_service != service ) {
+        warn( "Failed to send message ( service_name = %s ).", get_messenger_service_name( service ) );
       }
-      error_service_name = service_name;
+      error_service = service;
     }
     else {
-      error_service_name = NULL;
+      error_service = MESSENGER_INVALID_SERVICE_ID;
     }
   }
-  free_buffer( buf );
 }
 
 
@@ -118,12 +139,45 @@ handle_openflow_message( uint64_t *datapath_id, char *service_name, buffer *buf
 }
 
 
+static void
+handle_openflow_messages( uint64_t *datapath_id, char *service_name, buffer *buf ) {
+  size_t offset = 0;
+
+  // Each message refers to its part of buf, so a batch is not copied.
+  while ( offset + sizeof( struct ofp_header ) <= buf->length ) {
+    struct ofp_header *header = ( struct ofp_header * ) ( ( char * ) buf->data + offset );
+    size_t length = ntohs( header->length );
+    if ( length < sizeof( struct ofp_header ) || offset + length > buf->length ) {
+      notice( "Invalid OpenFlow message in a batch. dpid = %#" PRIx64 ", offset = %zu, length = %zu, service_name = %s",
+              *datapath_id, offset, length, service_name );
+      break;
+    }
+    handle_openflow_message( datapath_id, service_name, slice_buffer( buf, offset, length ) );
+    offset += length;
+  }
+  free_buffer( buf );
+}
+
+
 static void
 handle_openflow_disconnect_request( uint64_t *datapath_id ) {
   switch_event_disconnect_request( datapath_id );
 }
 
 
+void
+service_send_congestion( struct switch_info *sw_info, uint16_t message_type ) {
+  buffer *body = alloc_buffer_with_length( sizeof( openflow_send_queue_status_t ) );
+  openflow_send_queue_status_t *status = append_back_buffer( body, sizeof( openflow_send_queue_status_t ) );
+  status->queue_length = htonl( sw_info->send_queue != NULL ? sw_info->send_queue->length : 0 );
+  status->queue_bytes = htonll( sw_info->send_queue_bytes );
+
+  service_send_to_application( &sw_info->state_services, message_type, &sw_info->datapath_id, body );
+
+  free_buffer( body );
+}
+
+
 void
 service_recv_from_application( uint16_t message_type, buffer *buf ) {
    openflow_service_header_t *message;
@@ -160,6 +214,9 @@ service_recv_from_application( uint16_t message_type, buffer *buf ) {
   case MESSENGER_OPENFLOW_MESSAGE:
     handle_openflow_message( &datapath_id, service_name, buf );
     break;
+  case MESSENGER_OPENFLOW_MESSAGES:
+    handle_openflow_messages( &datapath_id, service_name, buf );
+    break;
   case MESSENGER_OPENFLOW_DISCONNECT_REQUEST:
     free_buffer( buf );
     handle_openflow_disconnect_request( &datapath_id );
@@ -27,9 +27,12 @@
 #include "switchinfo.h"
 
 
-void service_send_to_reply( char *service_name, uint16_t message_type, uint64_t *datapath_id, buffer *buf );
-void service_send_to_application( list_element *service_name_list, uint16_t message_type, uint64_t *datapath_id, buffer *buf );
+void update_service_id_list( service_id_list *services, list_element *service_name_list );
+void free_service_id_list( service_id_list *services );
+void service_send_to_reply( messenger_service_id service, uint16_t message_type, uint64_t *datapath_id, buffer *buf );
+void service_send_to_application( const service_id_list *services, uint16_t message_type, uint64_t *datapath_id, buffer *buf );
 void service_recv_from_application( uint16_t message_type, buffer *buf );
+void service_send_congestion( struct switch_info *sw_info, uint16_t message_type );
 
 
 #endif // SERVICE_INTERFACE_H
@@ -29,6 +29,7 @@
 #include <assert.h>
 #include "trema.h"
 #include "cookie_table.h"
+#include "management_interface.h"
 #include "message_queue.h"
 #include "messenger.h"
 #include "ofpmsg_send.h"
@@ -39,6 +40,7 @@
 #include "switch.h"
 #include "xid_table.h"
 #include "switch_option.h"
+#include "switch_worker.h"
 #include "event_forward_entry_manipulation.h"
 
 #define SUB_TIMESPEC( _a, _b, _return )                       \
@@ -55,14 +57,18 @@
 
 struct switch_info switch_info;
 
+// In worker mode, switch_info only holds the options and the socket
+// connected to switch_manager. Each secure channel has its own switch_info.
+static bool worker_mode = false;
+static hash_table *switches = NULL;     // datapath id -> switch_info owning switch.<dpid>
+static list_element *connections = NULL;
+
 static const time_t COOKIE_TABLE_AGING_INTERVAL = 3600; // sec.
 static const time_t ECHO_REQUEST_INTERVAL = 60; // sec.
 static const time_t ECHO_REPLY_TIMEOUT = 2; // ses.
 static const time_t WARNING_ECHO_RTT = 500; // msec. The value must is less than 1000.
 
 
-static bool age_cookie_table_enabled = false;
-
 #define SWITCH_MANAGER "switch_manager"
 
 
@@ -86,6 +92,7 @@ usage() {
     "      --no-flow-cleanup           do not cleanup flows on startup\n"
     "      --no-cookie-translation     do not translate cookie values\n"
     "      --no-packet_in              do not allow packet-ins on startup\n"
+    "      --worker                    serve secure channels handed over by switch manager\n"
     "  -h, --help                      display this help and exit\n"
     "\n"
     "DESTINATION-RULE:\n"
@@ -143,6 +150,10 @@ option_parser( int argc, char *argv[] ) {
         switch_info.deny_packet_in_on_startup = true;
         break;
 
+      case WORKER_LONG_OPTION_VALUE:
+        worker_mode = true;
+        break;
+
       default:
         usage();
         exit( EXIT_SUCCESS );
@@ -168,23 +179,27 @@ service_recv( uint16_t message_type, void *data, size_t data_len ) {
 
 static void
 service_send_state( struct switch_info *sw_info, uint64_t *dpid, uint16_t tag ) {
-  service_send_to_application( sw_info->state_service_name_list, tag, dpid, NULL );
+  service_send_to_application( &sw_info->state_services, tag, dpid, NULL );
 }
 
 
 static void
 secure_channel_read( int fd, void *data ) {
   UNUSED( fd );
-  UNUSED( data );
+  struct switch_info *sw_info = data;
 
-  if ( recv_from_secure_channel( &switch_info ) < 0 ) {
-    switch_event_disconnected( &switch_info );
+  if ( recv_from_secure_channel( sw_info ) < 0 ) {
+    switch_event_disconnected( sw_info );
     return;
   }
 
-  if ( switch_info.recv_queue->length > 0 ) {
-    int ret = handle_messages_from_secure_channel( &switch_info );
+  if ( sw_info->recv_queue->length > 0 ) {
+    int ret = handle_messages_from_secure_channel( sw_info );
     if ( ret < 0 ) {
+      if ( worker_mode ) {
+        switch_event_disconnected( sw_info );
+        return;
+      }
       stop_event_handler();
       stop_messenger();
     }
@@ -195,64 +210,64 @@ secure_channel_read( int fd, void *data ) {
 static void
 secure_channel_write( int fd, void *data ) {
   UNUSED( fd );
-  UNUSED( data );
+  struct switch_info *sw_info = data;
 
-  if ( flush_secure_channel( &switch_info ) < 0 ) {
-    switch_event_disconnected( &switch_info );
+  if ( flush_secure_channel( sw_info ) < 0 ) {
+    switch_event_disconnected( sw_info );
     return;
   }
 }
 
 
 static void
-switch_set_timeout( long sec, timer_callback callback, void *user_data ) {
+switch_set_timeout( struct switch_info *sw_info, long sec, timer_callback callback ) {
   struct itimerspec interval;
 
   interval.it_value.tv_sec = sec;
   interval.it_value.tv_nsec = 0;
   interval.it_interval.tv_sec = 0;
   interval.it_interval.tv_nsec = 0;
-  add_timer_event_callback( &interval, callback, user_data );
-  switch_info.running_timer = true;
+  add_timer_event_callback( &interval, callback, sw_info );
+  sw_info->running_timer = true;
 }
 
 
 static void
-switch_unset_timeout( timer_callback callback, void *user_data ) {
-  if ( switch_info.running_timer ) {
-    switch_info.running_timer = false;
-    delete_timer_event( callback, user_data );
+switch_unset_timeout( struct switch_info *sw_info, timer_callback callback ) {
+  if ( sw_info->running_timer ) {
+    sw_info->running_timer = false;
+    delete_timer_event( callback, sw_info );
   }
 }
 
 
 static void
 switch_event_timeout_hello( void *user_data ) {
-  UNUSED( user_data );
+  struct switch_info *sw_info = user_data;
 
-  if ( switch_info.state != SWITCH_STATE_WAIT_HELLO ) {
+  if ( sw_info->state != SWITCH_STATE_WAIT_HELLO ) {
     return;
   }
-  switch_info.running_timer = false;
+  sw_info->running_timer = false;
 
   error( "Hello timeout. state:%d, dpid:%#" PRIx64 ", fd:%d.",
-         switch_info.state, switch_info.datapath_id, switch_info.secure_channel_fd );
-  switch_event_disconnected( &switch_info );
+         sw_info->state, sw_info->datapath_id, sw_info->secure_channel_fd );
+  switch_event_disconnected( sw_info );
 }
 
 
 static void
 switch_event_timeout_features_reply( void *user_data ) {
-  UNUSED( user_data );
+  struct switch_info *sw_info = user_data;
 
-  if ( switch_info.state != SWITCH_STATE_WAIT_FEATURES_REPLY ) {
+  if ( sw_info->state != SWITCH_STATE_WAIT_FEATURES_REPLY ) {
     return;
   }
-  switch_info.running_timer = false;
+  sw_info->running_timer = false;
 
   error( "Features Reply timeout. state:%d, dpid:%#" PRIx64 ", fd:%d.",
-         switch_info.state, switch_info.datapath_id, switch_info.secure_channel_fd );
-  switch_event_disconnected( &switch_info );
+         sw_info->state, sw_info->datapath_id, sw_info->secure_channel_fd );
+  switch_event_disconnected( sw_info );
 }
 
 
@@ -269,7 +284,7 @@ switch_event_connected( struct switch_info *sw_info ) {
   }
   sw_info->state = SWITCH_STATE_WAIT_HELLO;
 
-  switch_set_timeout( SWITCH_STATE_TIMEOUT_HELLO, switch_event_timeout_hello, NULL );
+  switch_set_timeout( sw_info, SWITCH_STATE_TIMEOUT_HELLO, switch_event_timeout_hello );
 
   return 0;
 }
@@ -281,7 +296,7 @@ switch_event_recv_hello( struct switch_info *sw_info ) {
 
   if ( sw_info->state == SWITCH_STATE_WAIT_HELLO ) {
     // cancel to hello_wait-timeout timer
-    switch_unset_timeout( switch_event_timeout_hello, NULL );
+    switch_unset_timeout( sw_info, switch_event_timeout_hello );
 
     if ( sw_info->deny_packet_in_on_startup ) {
       ret = ofpmsg_send_deny_all( sw_info );
@@ -296,8 +311,8 @@ switch_event_recv_hello( struct switch_info *sw_info ) {
     }
     sw_info->state = SWITCH_STATE_WAIT_FEATURES_REPLY;
 
-    switch_set_timeout( SWITCH_STATE_TIMEOUT_FEATURES_REPLY,
-                        switch_event_timeout_features_reply, NULL );
+    switch_set_timeout( sw_info, SWITCH_STATE_TIMEOUT_FEATURES_REPLY,
+                        switch_event_timeout_features_reply );
   }
 
   return 0;
@@ -306,10 +321,11 @@ switch_event_recv_hello( struct switch_info *sw_info ) {
 
 static void
 echo_reply_timeout( void *user_data ) {
-  UNUSED( user_data );
+  struct switch_info *sw_info = user_data;
+  sw_info->running_timer = false;
 
-  error( "Echo request timeout ( datapath id %#" PRIx64 ").", switch_info.datapath_id );
-  switch_event_disconnected( &switch_info );
+  error( "Echo request timeout ( datapath id %#" PRIx64 ").", sw_info->datapath_id );
+  switch_event_disconnected( sw_info );
 }
 
 
@@ -327,13 +343,15 @@ switch_event_recv_echoreply( struct switch_info *sw_info, buffer *buf ) {
   if ( ntohll( body->datapath_id ) != sw_info->datapath_id ) {
     return 0;
   }
-  switch_unset_timeout( echo_reply_timeout, NULL );
+  switch_unset_timeout( sw_info, echo_reply_timeout );
   struct timespec now, tim;
   clock_gettime( CLOCK_MONOTONIC, &now );
   tim.tv_sec = ( time_t ) ntohl( body->sec );
   tim.tv_nsec = ( long ) ntohl( body->nsec );
 
   SUB_TIMESPEC( &now, &tim, &tim );
+  uint64_t rtt = ( uint64_t ) tim.tv_sec * 1000000 + ( uint64_t ) tim.tv_nsec / 1000;
+  record_histogram_value( &sw_info->latency.histograms[ LATENCY_ECHO ], rtt );
 
   if ( tim.tv_sec > 0 || tim.tv_nsec > ( ( long ) WARNING_ECHO_RTT * 1000000 ) ) {
     warn( "echo round-trip time is greater then %ld ms ( round-trip time = %" PRId64 ".%09ld ).",
@@ -350,7 +368,7 @@ echo_request_interval( void *user_data ) {
 
   buffer *buf = alloc_buffer();
   echo_body *body = append_back_buffer( buf, sizeof( echo_body ) );
-  body->datapath_id = htonll( switch_info.datapath_id );
+  body->datapath_id = htonll( sw_info->datapath_id );
   struct timespec now;
   clock_gettime( CLOCK_MONOTONIC, &now );
   body->sec = htonl( ( uint32_t ) now.tv_sec );
@@ -359,11 +377,11 @@ echo_request_interval( void *user_data ) {
 
   int err = ofpmsg_send_echorequest( sw_info, sw_info->echo_request_xid, buf );
   if ( err < 0 ) {
-    switch_event_disconnected( &switch_info );
+    switch_event_disconnected( sw_info );
     return;
   }
 
-  switch_set_timeout( ECHO_REPLY_TIMEOUT, echo_reply_timeout, NULL );
+  switch_set_timeout( sw_info, ECHO_REPLY_TIMEOUT, echo_reply_timeout );
 }
 
 
@@ -371,6 +389,50 @@ static void
 confirm_self_dpid_is_registerd( uint64_t* dpids, size_t n_dpids, void *user_data );
 
 
+static struct switch_info *
+lookup_switch_info( uint64_t datapath_id ) {
+  if ( !worker_mode ) {
+    return switch_info.datapath_id == datapath_id ? &switch_info : NULL;
+  }
+
+  struct switch_info *sw_info = lookup_hash_entry( switches, &datapath_id );
+  if ( sw_info == NULL || sw_info->state == SWITCH_STATE_DISCONNECTED ) {
+    return NULL;
+  }
+  return sw_info;
+}
+
+
+static void
+register_switch_service( struct switch_info *sw_info, const char *service_name ) {
+  struct switch_info *old_sw_info = lookup_hash_entry( switches, &sw_info->datapath_id );
+  if ( old_sw_info == NULL ) {
+    add_message_received_callback( service_name, service_recv );
+    add_management_service( service_name );
+  }
+  else if ( old_sw_info->state != SWITCH_STATE_DISCONNECTED ) {
+    notice( "Datapath %#" PRIx64 " has reconnected. Closing the old secure channel ( fd = %d ).",
+            sw_info->datapath_id, old_sw_info->secure_channel_fd );
+    switch_event_disconnected( old_sw_info );
+  }
+  insert_hash_entry( switches, &sw_info->datapath_id, sw_info );
+}
+
+
+static void
+unregister_switch_service( struct switch_info *sw_info ) {
+  if ( lookup_hash_entry( switches, &sw_info->datapath_id ) != sw_info ) {
+    return;
+  }
+
+  char service_name[ SWITCH_MANAGER_PREFIX_STR_LEN + SWITCH_MANAGER_DPID_STR_LEN + 1 ];
+  snprintf( service_name, sizeof( service_name ), "%s%#" PRIx64, SWITCH_MANAGER_PREFIX, sw_info->datapath_id );
+  delete_message_received_callback( service_name, service_recv );
+  delete_management_service( service_name );
+  delete_hash_entry( switches, &sw_info->datapath_id );
+}
+
+
 int
 switch_event_recv_featuresreply( struct switch_info *sw_info, uint64_t *dpid ) {
   int ret;
@@ -384,7 +446,7 @@ switch_event_recv_featuresreply( struct switch_info *sw_info, uint64_t *dpid ) {
     sw_info->state = SWITCH_STATE_COMPLETED;
 
     // cancel to features_reply_wait-timeout timer
-    switch_unset_timeout( switch_event_timeout_features_reply, NULL );
+    switch_unset_timeout( sw_info, switch_event_timeout_features_reply );
 
     // TODO: set keepalive-timeout
     snprintf( new_service_name, new_service_name_len, "%s%#" PRIx64, SWITCH_MANAGER_PREFIX, sw_info->datapath_id );
@@ -397,22 +459,28 @@ switch_event_recv_featuresreply( struct switch_info *sw_info, uint64_t *dpid ) {
         return -1;
       }
     }
-    // rename service_name of messenger
-    rename_message_received_callback( get_trema_name(), new_service_name );
-
-    // rename management service name
-    char *management_service_name = xstrdup( get_management_service_name( get_trema_name() ) );
-    char *new_management_service_name = xstrdup( get_management_service_name( new_service_name ) );
-    rename_message_requested_callback( management_service_name, new_management_service_name );
-    xfree( management_service_name );
-    xfree( new_management_service_name );
-
-    debug( "Rename service name from %s to %s.", get_trema_name(), new_service_name );
-    if ( messenger_dump_enabled() ) {
-      stop_messenger_dump();
-      start_messenger_dump( new_service_name, DEFAULT_DUMP_SERVICE_NAME );
+    if ( worker_mode ) {
+      // A worker serves switch.<dpid> next to its own service name.
+      register_switch_service( sw_info, new_service_name );
+    }
+    else {
+      // rename service_name of messenger
+      rename_message_received_callback( get_trema_name(), new_service_name );
+
+      // rename management service name
+      char *management_service_name = xstrdup( get_management_service_name( get_trema_name() ) );
+      char *new_management_service_name = xstrdup( get_management_service_name( new_service_name ) );
+      rename_message_requested_callback( management_service_name, new_management_service_name );
+      xfree( management_service_name );
+      xfree( new_management_service_name );
+
+      debug( "Rename service name from %s to %s.", get_trema_name(), new_service_name );
+      if ( messenger_dump_enabled() ) {
+        stop_messenger_dump();
+        start_messenger_dump( new_service_name, DEFAULT_DUMP_SERVICE_NAME );
+      }
+      set_trema_name( new_service_name );
     }
-    set_trema_name( new_service_name );
 
     // reset to default config
     ret = ofpmsg_send_setconfig( sw_info );
@@ -431,17 +499,23 @@ switch_event_recv_featuresreply( struct switch_info *sw_info, uint64_t *dpid ) {
 
     // switch_ready to switch_manager
     debug( "Notify switch_ready to switch manager." );
-    char switch_manager[] =  SWITCH_MANAGER;
-    list_element switch_manager_only_list;
-    switch_manager_only_list.next = NULL;
-    switch_manager_only_list.data = switch_manager;
+    static messenger_service_id switch_manager = MESSENGER_INVALID_SERVICE_ID;
+    if ( switch_manager == MESSENGER_INVALID_SERVICE_ID ) {
+      switch_manager = get_messenger_service_id( SWITCH_MANAGER );
+    }
+    service_id_list switch_manager_only_list = { &switch_manager, 1 };
     service_send_to_application( &switch_manager_only_list, MESSENGER_OPENFLOW_READY, &sw_info->datapath_id, NULL );
 
-    init_event_forward_interface();
+    if ( !worker_mode ) {
+      init_event_forward_interface();
+    }
     // Check switch_manager registration
     debug( "Checking switch manager's switch list." );
-    if ( !send_efi_switch_list_request( confirm_self_dpid_is_registerd, sw_info ) ) {
+    uint64_t *datapath_id = xmalloc( sizeof( uint64_t ) );
+    *datapath_id = sw_info->datapath_id;
+    if ( !send_efi_switch_list_request( confirm_self_dpid_is_registerd, datapath_id ) ) {
       error( "Failed to send switch list request to switch manager." );
+      xfree( datapath_id );
       return -1;
     }
     break;
@@ -467,20 +541,28 @@ notify_state_to_controllers( struct switch_info *sw_info );
 
 static void
 confirm_self_dpid_is_registerd( uint64_t* dpids, size_t n_dpids, void *user_data ) {
-  struct switch_info *sw_info = user_data;
+  uint64_t *datapath_id = user_data;
 
   debug( "Received switch manager's switch list." );
+  // The secure channel may have been closed while waiting for the reply.
+  struct switch_info *sw_info = lookup_switch_info( *datapath_id );
+  if ( sw_info == NULL || sw_info->state != SWITCH_STATE_COMPLETED ) {
+    xfree( datapath_id );
+    return;
+  }
   for ( size_t i = 0 ; i < n_dpids ; ++i ) {
     if ( sw_info->datapath_id == dpids[ i ] ) {
       // self dpid registered
       debug( "Self dpid found" );
+      xfree( datapath_id );
       return notify_state_to_controllers( sw_info );
     }
   }
 
   debug( "Self dpid not found. Retrying..." );
-  if ( !send_efi_switch_list_request( confirm_self_dpid_is_registerd, sw_info ) ){
+  if ( !send_efi_switch_list_request( confirm_self_dpid_is_registerd, datapath_id ) ){
     error( "Failed to send switch list request to switch manager on retry." );
+    xfree( datapath_id );
   }
 }
 
@@ -495,15 +577,56 @@ notify_state_to_controllers( struct switch_info *sw_info ) {
  }
 
 
+static void
+init_transaction_tables( struct switch_info *sw_info ) {
+  init_xid_table( &sw_info->xid_table );
+  if ( sw_info->cookie_translation ) {
+    init_cookie_table( &sw_info->cookie_table );
+  }
+}
+
+
+static void
+finalize_transaction_tables( struct switch_info *sw_info ) {
+  finalize_xid_table( &sw_info->xid_table );
+  if ( sw_info->cookie_translation ) {
+    if ( sw_info->cookie_aging ) {
+      delete_timer_event( age_cookie_table, &sw_info->cookie_table );
+      sw_info->cookie_aging = false;
+    }
+    finalize_cookie_table( &sw_info->cookie_table );
+  }
+}
+
+
+static void
+free_switch_info( void *user_data ) {
+  struct switch_info *sw_info = user_data;
+
+  finalize_transaction_tables( sw_info );
+  unregister_switch_service( sw_info );
+  delete_element( &connections, sw_info );
+  xfree( sw_info );
+}
+
+
 int
 switch_event_disconnected( struct switch_info *sw_info ) {
   int old_state = sw_info->state;
 
+  if ( worker_mode && old_state == SWITCH_STATE_DISCONNECTED ) {
+    return 0;
+  }
   sw_info->state = SWITCH_STATE_DISCONNECTED;
 
   if ( old_state == SWITCH_STATE_COMPLETED ) {
     delete_timer_event( echo_request_interval, sw_info );
   }
+  if ( worker_mode && sw_info->running_timer ) {
+    switch_unset_timeout( sw_info, old_state == SWITCH_STATE_WAIT_HELLO ? switch_event_timeout_hello :
+                          old_state == SWITCH_STATE_WAIT_FEATURES_REPLY ? switch_event_timeout_features_reply :
+                          echo_reply_timeout );
+  }
 
   if ( sw_info->fragment_buf != NULL ) {
     free_buffer( sw_info->fragment_buf );
@@ -514,6 +637,8 @@ switch_event_disconnected( struct switch_info *sw_info ) {
     delete_message_queue( sw_info->send_queue );
     sw_info->send_queue = NULL;
   }
+  sw_info->send_queue_bytes = 0;
+  sw_info->congested = false;
 
   if ( sw_info->recv_queue != NULL ) {
     delete_message_queue( sw_info->recv_queue );
@@ -521,9 +646,9 @@ switch_event_disconnected( struct switch_info *sw_info ) {
   }
 
   if ( sw_info->secure_channel_fd >= 0 ) {
-    set_readable( switch_info.secure_channel_fd, false );
-    set_writable( switch_info.secure_channel_fd, false );
-    delete_fd_handler( switch_info.secure_channel_fd );
+    set_readable( sw_info->secure_channel_fd, false );
+    set_writable( sw_info->secure_channel_fd, false );
+    delete_fd_handler( sw_info->secure_channel_fd );
 
     close( sw_info->secure_channel_fd );
     sw_info->secure_channel_fd = -1;
@@ -551,6 +676,17 @@ switch_event_disconnected( struct switch_info *sw_info ) {
   iterate_list( sw_info->state_service_name_list, xfree_data, NULL );
   delete_list( sw_info->state_service_name_list );
   sw_info->state_service_name_list = NULL;
+  free_service_id_list( &sw_info->vendor_services );
+  free_service_id_list( &sw_info->packetin_services );
+  free_service_id_list( &sw_info->portstatus_services );
+  free_service_id_list( &sw_info->state_services );
+
+  if ( worker_mode ) {
+    // Freed on the next loop since the caller may still refer to it.
+    struct itimerspec interval = { { 0, 0 }, { 0, 1 } };
+    add_timer_event_callback( &interval, free_switch_info, sw_info );
+    return 0;
+  }
 
   stop_trema();
 
@@ -560,26 +696,28 @@ switch_event_disconnected( struct switch_info *sw_info ) {
 
 int
 switch_event_recv_from_application( uint64_t *datapath_id, char *application_service_name, buffer *buf ) {
+  struct switch_info *sw_info = lookup_switch_info( *datapath_id );
 
-  if ( *datapath_id != switch_info.datapath_id ) {
+  if ( sw_info == NULL ) {
     error( "Invalid datapath id %#" PRIx64 ".", *datapath_id );
     free_buffer( buf );
 
     return -1;
   }
 
-  return ofpmsg_send( &switch_info, buf, application_service_name );
+  return ofpmsg_send( sw_info, buf, application_service_name );
 }
 
 
 int
 switch_event_disconnect_request( uint64_t *datapath_id ) {
+  struct switch_info *sw_info = lookup_switch_info( *datapath_id );
 
-  if ( *datapath_id != switch_info.datapath_id ) {
+  if ( sw_info == NULL ) {
     error( "Invalid datapath id %#" PRIx64 ".", *datapath_id );
     return -1;
   }
-  return switch_event_disconnected( &switch_info );
+  return switch_event_disconnected( sw_info );
 }
 
 
@@ -593,42 +731,80 @@ switch_event_recv_error( struct switch_info *sw_info ) {
 }
 
 
+static struct switch_info *
+management_target( void ) {
+  if ( !worker_mode ) {
+    return &switch_info;
+  }
+
+  // Requests for a switch arrive on "switch.<dpid>.m".
+  const char *service_name = get_receiving_service_name();
+  if ( service_name == NULL || strncmp( service_name, SWITCH_MANAGER_PREFIX, strlen( SWITCH_MANAGER_PREFIX ) ) != 0 ) {
+    return NULL;
+  }
+  char *end;
+  uint64_t datapath_id = strtoull( service_name + strlen( SWITCH_MANAGER_PREFIX ), &end, 0 );
+  if ( strcmp( end, ".m" ) != 0 ) {
+    return NULL;
+  }
+  return lookup_switch_info( datapath_id );
+}
+
+
+static void
+reply_event_forward_operation_failure( const messenger_context_handle *handle, uint32_t command, uint8_t type ) {
+  event_forward_operation_reply res;
+  memset( &res, 0, sizeof( event_forward_operation_reply ) );
+  res.type = type;
+  res.result = EFI_OPERATION_FAILED;
+  management_application_reply *reply = create_management_application_reply( MANAGEMENT_REQUEST_FAILED, command, &res, sizeof( event_forward_operation_reply ) );
+  send_management_application_reply( handle, reply );
+  xfree( reply );
+}
+
+
 static void
 management_event_forward_entry_operation( const messenger_context_handle *handle, uint32_t command, event_forward_operation_request *req, size_t data_len ) {
 
   debug( "management efi command:%#x, type:%#x, n_services:%d", command, req->type, req->n_services );
 
+  struct switch_info *sw_info = management_target();
+  if ( sw_info == NULL ) {
+    error( "No switch to manage ( service name = %s ).", get_receiving_service_name() );
+    reply_event_forward_operation_failure( handle, command, req->type );
+    return;
+  }
+
   list_element **subject = NULL;
+  service_id_list *services = NULL;
   switch ( req->type ) {
     case EVENT_FORWARD_TYPE_VENDOR:
       info( "Managing vendor event." );
-      subject = &switch_info.vendor_service_name_list;
+      subject = &sw_info->vendor_service_name_list;
+      services = &sw_info->vendor_services;
       break;
 
     case EVENT_FORWARD_TYPE_PACKET_IN:
       info( "Managing packet_in event." );
-      subject = &switch_info.packetin_service_name_list;
+      subject = &sw_info->packetin_service_name_list;
+      services = &sw_info->packetin_services;
       break;
 
     case EVENT_FORWARD_TYPE_PORT_STATUS:
       info( "Managing port_status event." );
-      subject = &switch_info.portstatus_service_name_list;
+      subject = &sw_info->portstatus_service_name_list;
+      services = &sw_info->portstatus_services;
       break;
 
     case EVENT_FORWARD_TYPE_STATE_NOTIFY:
       info( "Managing state_notify event." );
-      subject = &switch_info.state_service_name_list;
+      subject = &sw_info->state_service_name_list;
+      services = &sw_info->state_services;
       break;
 
     default:
       error( "Invalid EVENT_FWD_TYPE ( %#x )", req->type );
-      event_forward_operation_reply res;
-      memset( &res, 0, sizeof( event_forward_operation_reply ) );
-      res.type = req->type;
-      res.result = EFI_OPERATION_FAILED;
-      management_application_reply *reply = create_management_application_reply( MANAGEMENT_REQUEST_FAILED, command, &res, sizeof( event_forward_operation_reply ) );
-      send_management_application_reply( handle, reply );
-      xfree( reply );
+      reply_event_forward_operation_failure( handle, command, req->type );
       return;
   }
   assert( subject != NULL );
@@ -651,6 +827,7 @@ management_event_forward_entry_operation( const messenger_context_handle *handle
       management_event_forward_entries_set( subject, req, data_len );
       break;
   }
+  update_service_id_list( services, *subject );
 
   buffer *buf = create_event_forward_operation_reply( req->type, EFI_OPERATION_SUCCEEDED, *subject );
   management_application_reply *reply = create_management_application_reply( MANAGEMENT_REQUEST_SUCCEEDED, command, buf->data, buf->length );
@@ -660,42 +837,103 @@ management_event_forward_entry_operation( const messenger_context_handle *handle
 }
 
 
+static void
+report_latency_stats( void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  if ( !worker_mode ) {
+    foreach_latency_stat( &switch_info.latency, switch_info.datapath_id, function, user_data );
+    return;
+  }
+
+  for ( list_element *e = connections; e != NULL; e = e->next ) {
+    struct switch_info *sw_info = e->data;
+    foreach_latency_stat( &sw_info->latency, sw_info->datapath_id, function, user_data );
+  }
+}
+
+
+static void
+management_dump_latency_histograms( const messenger_context_handle *handle, uint32_t command ) {
+  struct switch_info *sw_info = management_target();
+  if ( sw_info == NULL ) {
+    error( "No switch to manage ( service name = %s ).", get_receiving_service_name() );
+    management_application_reply *reply = create_management_application_reply( MANAGEMENT_REQUEST_FAILED, command, NULL, 0 );
+    send_management_application_reply( handle, reply );
+    xfree( reply );
+    return;
+  }
+
+  buffer *buf = dump_latency_histograms( &sw_info->latency );
+  management_application_reply *reply = create_management_application_reply( MANAGEMENT_REQUEST_SUCCEEDED, command, buf->data, buf->length );
+  free_buffer( buf );
+  send_management_application_reply( handle, reply );
+  xfree( reply );
+}
+
+
 static void
 management_recv( const messenger_context_handle *handle, uint32_t command, void *data, size_t data_len, void *user_data ) {
   UNUSED( user_data );
 
+  struct switch_info *sw_info = NULL;
   switch ( command ) {
     case DUMP_XID_TABLE:
+    case DUMP_COOKIE_TABLE:
+    case TOGGLE_COOKIE_AGING:
     {
-      dump_xid_table();
+      sw_info = management_target();
+      if ( sw_info == NULL ) {
+        error( "No switch to manage ( service name = %s ).", get_receiving_service_name() );
+        management_application_reply *reply = create_management_application_reply( MANAGEMENT_REQUEST_FAILED, command, NULL, 0 );
+        send_management_application_reply( handle, reply );
+        xfree( reply );
+        return;
+      }
+    }
+    break;
+
+    default:
+      break;
+  }
+
+  switch ( command ) {
+    case DUMP_XID_TABLE:
+    {
+      dump_xid_table( &sw_info->xid_table );
     }
     break;
 
     case DUMP_COOKIE_TABLE:
     {
-      if ( !switch_info.cookie_translation ) {
+      if ( !sw_info->cookie_translation ) {
         break;
       }
-      dump_cookie_table();
+      dump_cookie_table( &sw_info->cookie_table );
     }
     break;
 
     case TOGGLE_COOKIE_AGING:
     {
-      if ( !switch_info.cookie_translation ) {
+      if ( !sw_info->cookie_translation ) {
         break;
       }
-      if ( age_cookie_table_enabled ) {
-        delete_timer_event( age_cookie_table, NULL );
-        age_cookie_table_enabled = false;
+      if ( sw_info->cookie_aging ) {
+        delete_timer_event( age_cookie_table, &sw_info->cookie_table );
+        sw_info->cookie_aging = false;
       }
       else {
-        add_periodic_event_callback( COOKIE_TABLE_AGING_INTERVAL, age_cookie_table, NULL );
-        age_cookie_table_enabled = true;
+        add_periodic_event_callback( COOKIE_TABLE_AGING_INTERVAL, age_cookie_table, &sw_info->cookie_table );
+        sw_info->cookie_aging = true;
       }
     }
     break;
 
+    case DUMP_LATENCY_HISTOGRAMS:
+    {
+      management_dump_latency_histograms( handle, command );
+      return;
+    }
+    break;
+
     case EVENT_FORWARD_ENTRY_ADD:
     case EVENT_FORWARD_ENTRY_DELETE:
     case EVENT_FORWARD_ENTRY_DUMP:
@@ -726,7 +964,15 @@ management_recv( const messenger_context_handle *handle, uint32_t command, void
 
 static void
 stop_switch_daemon( void ) {
-  switch_event_disconnected( &switch_info );
+  if ( !worker_mode ) {
+    switch_event_disconnected( &switch_info );
+    return;
+  }
+
+  for ( list_element *e = connections; e != NULL; e = e->next ) {
+    switch_event_disconnected( e->data );
+  }
+  stop_trema();
 }
 
 
@@ -740,14 +986,145 @@ handle_sigterm( int signum ) {
 }
 
 
+static void
+add_destination_rule( struct switch_info *sw_info, const char *rule ) {
+  char *service_name;
+
+  if ( strncmp( rule, VENDOR_PREFIX, strlen( VENDOR_PREFIX ) ) == 0 ) {
+    service_name = xstrdup( rule + strlen( VENDOR_PREFIX ) );
+    append_to_tail( &sw_info->vendor_service_name_list, service_name );
+  }
+  else if ( strncmp( rule, PACKET_IN_PREFIX, strlen( PACKET_IN_PREFIX ) ) == 0 ) {
+    service_name = xstrdup( rule + strlen( PACKET_IN_PREFIX ) );
+    append_to_tail( &sw_info->packetin_service_name_list, service_name );
+  }
+  else if ( strncmp( rule, PORTSTATUS_PREFIX, strlen( PORTSTATUS_PREFIX ) ) == 0 ) {
+    service_name = xstrdup( rule + strlen( PORTSTATUS_PREFIX ) );
+    append_to_tail( &sw_info->portstatus_service_name_list, service_name );
+  }
+  else if ( strncmp( rule, STATE_PREFIX, strlen( STATE_PREFIX ) ) == 0 ) {
+    service_name = xstrdup( rule + strlen( STATE_PREFIX ) );
+    append_to_tail( &sw_info->state_service_name_list, service_name );
+  }
+}
+
+
+static void
+update_service_ids( struct switch_info *sw_info ) {
+  update_service_id_list( &sw_info->vendor_services, sw_info->vendor_service_name_list );
+  update_service_id_list( &sw_info->packetin_services, sw_info->packetin_service_name_list );
+  update_service_id_list( &sw_info->portstatus_services, sw_info->portstatus_service_name_list );
+  update_service_id_list( &sw_info->state_services, sw_info->state_service_name_list );
+}
+
+
+static void
+start_secure_channel( int fd, const switch_connection *connection ) {
+  struct switch_info *sw_info = xmalloc( sizeof( struct switch_info ) );
+  memset( sw_info, 0, sizeof( struct switch_info ) );
+  sw_info->secure_channel_fd = fd;
+  sw_info->flow_cleanup = switch_info.flow_cleanup;
+  sw_info->cookie_translation = switch_info.cookie_translation;
+  sw_info->deny_packet_in_on_startup = switch_info.deny_packet_in_on_startup;
+
+  create_list( &sw_info->vendor_service_name_list );
+  create_list( &sw_info->packetin_service_name_list );
+  create_list( &sw_info->portstatus_service_name_list );
+  create_list( &sw_info->state_service_name_list );
+  const char *rules = connection->data;
+  const char *rules_end = connection->data + connection->service_names_length;
+  for ( const char *rule = rules; rule < rules_end; rule += strlen( rule ) + 1 ) {
+    add_destination_rule( sw_info, rule );
+  }
+  update_service_ids( sw_info );
+
+  sw_info->config_flags = OFPC_FRAG_NORMAL;
+  sw_info->miss_send_len = UINT16_MAX;
+  sw_info->send_queue = create_message_queue();
+  sw_info->recv_queue = create_message_queue();
+  init_transaction_tables( sw_info );
+  insert_in_front( &connections, sw_info );
+
+  fcntl( fd, F_SETFL, O_NONBLOCK );
+  set_fd_handler( fd, secure_channel_read, sw_info, secure_channel_write, sw_info );
+  set_readable( fd, true );
+  set_writable( fd, false );
+
+  // switch_manager has exchanged hello messages and sent a features request.
+  service_send_state( sw_info, &sw_info->datapath_id, MESSENGER_OPENFLOW_CONNECTED );
+  if ( sw_info->deny_packet_in_on_startup && ofpmsg_send_deny_all( sw_info ) < 0 ) {
+    switch_event_disconnected( sw_info );
+    return;
+  }
+  sw_info->state = SWITCH_STATE_WAIT_FEATURES_REPLY;
+  switch_set_timeout( sw_info, SWITCH_STATE_TIMEOUT_FEATURES_REPLY, switch_event_timeout_features_reply );
+
+  if ( connection->data_length > 0 ) {
+    if ( feed_secure_channel( sw_info, rules_end, connection->data_length ) < 0 ||
+         handle_messages_from_secure_channel( sw_info ) < 0 ) {
+      switch_event_disconnected( sw_info );
+      return;
+    }
+  }
+  if ( sw_info->state != SWITCH_STATE_DISCONNECTED && flush_secure_channel( sw_info ) < 0 ) {
+    switch_event_disconnected( sw_info );
+  }
+}
+
+
+static void
+switch_manager_read( int fd, void *data ) {
+  UNUSED( data );
+
+  static uint64_t storage[ SWITCH_CONNECTION_MAX_LENGTH / sizeof( uint64_t ) ];
+  switch_connection *connection = ( switch_connection * ) storage;
+  int secure_channel_fd;
+  if ( !recv_switch_connection( fd, connection, sizeof( storage ), &secure_channel_fd ) ) {
+    error( "Lost connection to switch manager." );
+    set_readable( fd, false );
+    delete_fd_handler( fd );
+    stop_switch_daemon();
+    return;
+  }
+  if ( secure_channel_fd < 0 ) {
+    return;
+  }
+
+  debug( "Secure channel handed over ( datapath id = %#" PRIx64 ", fd = %d ).", connection->datapath_id, secure_channel_fd );
+  start_secure_channel( secure_channel_fd, connection );
+}
+
+
+static int
+start_switch_worker( void ) {
+  switches = create_hash( compare_datapath_id, hash_datapath_id );
+  create_list( &connections );
+  init_event_forward_interface();
+
+  set_fd_handler( switch_info.secure_channel_fd, switch_manager_read, NULL, NULL, NULL );
+  set_readable( switch_info.secure_channel_fd, true );
+
+  start_trema();
+
+  finalize_event_forward_interface();
+  while ( connections != NULL ) {
+    free_switch_info( connections->data );
+  }
+  delete_hash( switches );
+  switches = NULL;
+
+  return 0;
+}
+
+
 int
 main( int argc, char *argv[] ) {
   int ret;
   int i;
-  char *service_name;
 
   init_trema( &argc, &argv );
   option_parser( argc, argv );
+  add_stat_reporter( report_latency_stats );
 
   create_list( &switch_info.vendor_service_name_list );
   create_list( &switch_info.packetin_service_name_list );
@@ -755,23 +1132,9 @@ main( int argc, char *argv[] ) {
   create_list( &switch_info.state_service_name_list );
 
   for ( i = optind; i < argc; i++ ) {
-    if ( strncmp( argv[ i ], VENDOR_PREFIX, strlen( VENDOR_PREFIX ) ) == 0 ) {
-      service_name = xstrdup( argv[ i ] + strlen( VENDOR_PREFIX ) );
-      append_to_tail( &switch_info.vendor_service_name_list, service_name );
-    }
-    else if ( strncmp( argv[ i ], PACKET_IN_PREFIX, strlen( PACKET_IN_PREFIX ) ) == 0 ) {
-      service_name = xstrdup( argv[ i ] + strlen( PACKET_IN_PREFIX ) );
-      append_to_tail( &switch_info.packetin_service_name_list, service_name );
-    }
-    else if ( strncmp( argv[ i ], PORTSTATUS_PREFIX, strlen( PORTSTATUS_PREFIX ) ) == 0 ) {
-      service_name = xstrdup( argv[ i ] + strlen( PORTSTATUS_PREFIX ) );
-      append_to_tail( &switch_info.portstatus_service_name_list, service_name );
-    }
-    else if ( strncmp( argv[ i ], STATE_PREFIX, strlen( STATE_PREFIX ) ) == 0 ) {
-      service_name = xstrdup( argv[ i ] + strlen( STATE_PREFIX ) );
-      append_to_tail( &switch_info.state_service_name_list, service_name );
-    }
+    add_destination_rule( &switch_info, argv[ i ] );
   }
+  update_service_ids( &switch_info );
 
   struct sigaction signal_exit;
   memset( &signal_exit, 0, sizeof( struct sigaction ) );
@@ -779,9 +1142,15 @@ main( int argc, char *argv[] ) {
   sigaction( SIGINT, &signal_exit, NULL );
   sigaction( SIGTERM, &signal_exit, NULL );
 
+  if ( worker_mode ) {
+    set_management_application_request_handler( management_recv, NULL );
+
+    return start_switch_worker();
+  }
+
   fcntl( switch_info.secure_channel_fd, F_SETFL, O_NONBLOCK );
 
-  set_fd_handler( switch_info.secure_channel_fd, secure_channel_read, NULL, secure_channel_write, NULL );
+  set_fd_handler( switch_info.secure_channel_fd, secure_channel_read, &switch_info, secure_channel_write, &switch_info );
   set_readable( switch_info.secure_channel_fd, true );
   set_writable( switch_info.secure_channel_fd, false );
 
@@ -795,10 +1164,7 @@ main( int argc, char *argv[] ) {
   switch_info.running_timer = false;
   switch_info.echo_request_xid = 0;
 
-  init_xid_table();
-  if ( switch_info.cookie_translation ) {
-    init_cookie_table();
-  }
+  init_transaction_tables( &switch_info );
 
   add_message_received_callback( get_trema_name(), service_recv );
   set_management_application_request_handler( management_recv, NULL );
@@ -819,10 +1185,7 @@ main( int argc, char *argv[] ) {
   // Note: init_event_forward_interface will be called on feature_reply.
   finalize_event_forward_interface();
 
-  finalize_xid_table();
-  if ( switch_info.cookie_translation ) {
-    finalize_cookie_table();
-  }
+  finalize_transaction_tables( &switch_info );
 
   if ( switch_info.secure_channel_fd >= 0 ) {
     delete_fd_handler( switch_info.secure_channel_fd );
@@ -33,10 +33,22 @@
 #define SWITCH_STATE_TIMEOUT_HELLO 5          // in seconds
 #define SWITCH_STATE_TIMEOUT_FEATURES_REPLY 5 // in seconds
 
+// Applications are notified when the send queue to a switch grows over
+// the high watermark, and again when it drains below the low watermark.
+#define SWITCH_SEND_QUEUE_HIGH_WATERMARK ( 1024 * 1024 ) // in bytes
+#define SWITCH_SEND_QUEUE_LOW_WATERMARK ( 256 * 1024 )   // in bytes
+
 #define SWITCH_MANAGER_PREFIX "switch."
 #define SWITCH_MANAGER_PREFIX_STR_LEN sizeof( SWITCH_MANAGER_PREFIX )
 #define SWITCH_MANAGER_DPID_STR_LEN sizeof( "1234567812345678" )
 
+// Management application_ids handled by switch daemons only, in addition
+// to enum switch_management_command. Numbered apart so that the shared
+// set can grow without clashing.
+enum switch_daemon_management_command {
+  DUMP_LATENCY_HISTOGRAMS = 0x100, // replies with text, see dump_latency_histograms()
+};
+
 int switch_event_connected( struct switch_info *switch_info );
 int switch_event_disconnected( struct switch_info *switch_info );
 int switch_event_recv_hello( struct switch_info *switch_info );
@@ -148,10 +148,11 @@ struct listener_info listener_info;
 static struct option long_options[] = {
   { "port", 1, NULL, 'p' },
   { "switch", 1, NULL, 's' },
+  { "workers", 1, NULL, 'w' },
   { NULL, 0, NULL, 0  },
 };
 
-static char short_options[] = "p:s:";
+static char short_options[] = "p:s:w:";
 
 
 void
@@ -163,6 +164,7 @@ usage() {
     "  -s, --switch=PATH               the command path of switch\n"
     "  -n, --name=SERVICE_NAME         service name\n"
     "  -p, --port=PORT                 server listen port (default %u)\n"
+    "  -w, --workers=NUMBER            serve switches by NUMBER switch processes\n"
     "  -d, --daemonize                 run in the background\n"
     "  -l, --logging_level=LEVEL       set logging level\n"
     "  -g, --syslog                    output log messages to syslog\n"
@@ -194,6 +196,7 @@ wait_child( void ) {
         debug( "Child process is terminated. pid:%d, signal:%d", pid, WTERMSIG( status ) );
       }
     }
+    restart_switch_worker( &listener_info, pid );
   }
 }
 
@@ -265,6 +268,7 @@ init_listener_info( struct listener_info *listener_info ) {
 
 static void
 finalize_listener_info( struct listener_info *listener_info ) {
+  stop_switch_workers( listener_info );
   if ( listener_info->switch_daemon != NULL ) {
     xfree( ( void * ) ( uintptr_t ) listener_info->switch_daemon );
     listener_info->switch_daemon = NULL;
@@ -312,6 +316,20 @@ strtoport( const char *str ) {
 }
 
 
+static int
+strtoworkers( const char *str ) {
+  char *ep;
+  long l;
+
+  l = strtol( str, &ep, 0 );
+  if ( l <= 0 || l > SWITCH_WORKERS_MAX || *ep != '\0' ) {
+    die( "Invalid number of workers. %s", str );
+    return 0;
+  }
+  return ( int ) l;
+}
+
+
 static bool
 parse_argument( struct listener_info *listener_info, int argc, char *argv[] ) {
   int c;
@@ -328,6 +346,12 @@ parse_argument( struct listener_info *listener_info, int argc, char *argv[] ) {
         xfree( ( void * ) ( uintptr_t ) listener_info->switch_daemon );
         listener_info->switch_daemon = xstrdup( optarg );
         break;
+      case 'w':
+        listener_info->n_workers = strtoworkers( optarg );
+        if ( listener_info->n_workers == 0 ) {
+          return false;
+        }
+        break;
       default:
         usage();
         exit( EXIT_SUCCESS );
@@ -600,6 +624,11 @@ main( int argc, char *argv[] ) {
     exit( EXIT_FAILURE );
   }
 
+  if ( listener_info.n_workers > 0 && !start_switch_workers( &listener_info ) ) {
+    finalize_listener_info( &listener_info );
+    exit( EXIT_FAILURE );
+  }
+
   set_fd_handler( listener_info.listen_fd, secure_channel_accept, &listener_info, NULL, NULL );
   set_readable( listener_info.listen_fd, true );
 
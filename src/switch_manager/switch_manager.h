@@ -23,6 +23,7 @@
 
 
 #include <sys/types.h>
+#include "switch_worker.h"
 
 
 static const char SWITCH_MANAGER_NAME_OPTION[] = "--name=";
@@ -30,12 +31,15 @@ static const uint SWITCH_MANAGER_NAME_OPTION_STR_LEN = sizeof( SWITCH_MANAGER_NA
 static const char SWITCH_MANAGER_SOCKET_OPTION[] = "--socket=";
 static const uint SWITCH_MANAGER_SOCKET_OPTION_STR_LEN = sizeof( SWITCH_MANAGER_SOCKET_OPTION );
 static const char SWITCH_MANAGER_DAEMONIZE_OPTION[] = "--daemonize";
+static const char SWITCH_MANAGER_WORKER_OPTION[] = "--worker";
 static const uint SWITCH_MANAGER_SOCKET_STR_LEN = sizeof( "2147483647" );
 static const char SWITCH_MANAGER_COMMAND_PREFIX[] = "switch.";
 static const uint SWITCH_MANAGER_COMMAND_PREFIX_STR_LEN = sizeof( SWITCH_MANAGER_COMMAND_PREFIX );
 static const char SWITCH_MANAGER_PREFIX[] = "switch.";
 static const uint SWITCH_MANAGER_PREFIX_STR_LEN = sizeof( SWITCH_MANAGER_PREFIX );
 static const uint SWITCH_MANAGER_ADDR_STR_LEN = sizeof( "255.255.255.255:65535" );
+static const char SWITCH_WORKER_PREFIX[] = "switch_worker.";
+static const int SWITCH_WORKERS_MAX = 256;
 
 static const char SWITCH_MANAGER_PATH[] = "objects/switch_manager/switch";
 static const char SWITCH_MANAGER_STATE_PREFIX[] = "state_notify::";
@@ -51,6 +55,8 @@ struct listener_info {
   list_element *packetin_service_name_list;   // packetin manager service
   list_element *portstatus_service_name_list; // portstatus manager service
   list_element *state_service_name_list;      // switch state manager service
+  int n_workers;                              // 0 to run a switch daemon per switch
+  struct switch_worker *workers;
 };
 
 
@@ -23,6 +23,7 @@ struct option switch_long_options[] = {
   { "no-flow-cleanup", 0, NULL, NO_FLOW_CLEANUP_LONG_OPTION_VALUE },
   { "no-cookie-translation", 0, NULL, NO_COOKIE_TRANSLATION_LONG_OPTION_VALUE },
   { "no-packet_in", 0, NULL, NO_PACKET_IN_LONG_OPTION_VALUE },
+  { "worker", 0, NULL, WORKER_LONG_OPTION_VALUE },
   { NULL, 0, NULL, 0  },
 };
 
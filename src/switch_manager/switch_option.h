@@ -24,6 +24,7 @@ enum switch_long_options_val {
   NO_FLOW_CLEANUP_LONG_OPTION_VALUE = 1,
   NO_COOKIE_TRANSLATION_LONG_OPTION_VALUE = 2,
   NO_PACKET_IN_LONG_OPTION_VALUE = 3,
+  WORKER_LONG_OPTION_VALUE = 4,
 };
 
 
@@ -0,0 +1,262 @@
+/*
+ * OpenFlow Switch Manager
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "trema.h"
+#include "switch_worker.h"
+
+
+typedef struct {
+  int fd;
+  switch_connection *connection;
+} switch_handoff;
+
+
+int
+select_switch_worker( uint64_t datapath_id, int n_workers ) {
+  assert( n_workers > 0 );
+
+  return ( int ) ( datapath_id % ( uint64_t ) n_workers );
+}
+
+
+/*
+ * Returns false with errno set to EAGAIN if socket is non-blocking and
+ * its buffer is full. The secure channel is not passed in that case.
+ */
+bool
+send_switch_connection( int socket, int fd, const switch_connection *connection ) {
+  assert( connection != NULL );
+
+  size_t length = offsetof( switch_connection, data ) + connection->service_names_length + connection->data_length;
+  struct iovec iov;
+  iov.iov_base = ( void * ) ( uintptr_t ) connection;
+  iov.iov_len = length;
+
+  union {
+    struct cmsghdr header;
+    char buf[ CMSG_SPACE( sizeof( int ) ) ];
+  } control;
+  memset( &control, 0, sizeof( control ) );
+
+  struct msghdr msg;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof( control.buf );
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN( sizeof( int ) );
+  memcpy( CMSG_DATA( cmsg ), &fd, sizeof( int ) );
+
+  ssize_t ret;
+  do {
+    ret = sendmsg( socket, &msg, MSG_NOSIGNAL );
+  } while ( ret < 0 && errno == EINTR );
+  if ( ret < 0 ) {
+    if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
+      error( "Failed to hand over a secure channel ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
+    }
+    return false;
+  }
+
+  return true;
+}
+
+
+/*
+ * Stores the secure channel to fd, or -1 if the message is broken.
+ * Returns false if the socket is closed ( e.g. switch_manager has exited ).
+ */
+bool
+recv_switch_connection( int socket, switch_connection *connection, size_t length, int *fd ) {
+  assert( connection != NULL );
+  assert( length >= sizeof( switch_connection ) );
+  assert( fd != NULL );
+
+  *fd = -1;
+
+  struct iovec iov;
+  iov.iov_base = connection;
+  iov.iov_len = length;
+
+  union {
+    struct cmsghdr header;
+    char buf[ CMSG_SPACE( sizeof( int ) ) ];
+  } control;
+  memset( &control, 0, sizeof( control ) );
+
+  struct msghdr msg;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof( control.buf );
+
+  ssize_t ret;
+  do {
+    ret = recvmsg( socket, &msg, MSG_CMSG_CLOEXEC );
+  } while ( ret < 0 && errno == EINTR );
+  if ( ret <= 0 ) {
+    if ( ret < 0 ) {
+      error( "Failed to receive a secure channel ( errno = %s [%d] ).", strerror( errno ), errno );
+    }
+    return false;
+  }
+
+  int received_fd = -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+  if ( cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS ) {
+    memcpy( &received_fd, CMSG_DATA( cmsg ), sizeof( int ) );
+  }
+  if ( received_fd < 0 ) {
+    error( "No secure channel is passed." );
+    return true;
+  }
+  if ( ( msg.msg_flags & MSG_TRUNC ) != 0 || ( size_t ) ret < offsetof( switch_connection, data ) ||
+       ( size_t ) ret != offsetof( switch_connection, data ) + connection->service_names_length + connection->data_length ||
+       ( connection->service_names_length > 0 && connection->data[ connection->service_names_length - 1 ] != '\0' ) ) {
+    error( "Invalid secure channel handover ( length = %zd ).", ret );
+    close( received_fd );
+    return true;
+  }
+  *fd = received_fd;
+
+  return true;
+}
+
+
+static void
+free_switch_handoff( switch_handoff *handoff ) {
+  close( handoff->fd );
+  xfree( handoff->connection );
+  xfree( handoff );
+}
+
+
+/*
+ * Passes the queued secure channels to the worker in order until its
+ * socket would block. A channel that cannot be passed for any other
+ * reason is closed, and the switch connects again.
+ */
+static void
+flush_switch_worker_handoffs( struct switch_worker *worker ) {
+  while ( worker->handoffs != NULL ) {
+    switch_handoff *handoff = worker->handoffs->data;
+    if ( !send_switch_connection( worker->socket, handoff->fd, handoff->connection ) ) {
+      if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+        break;
+      }
+    }
+    delete_element( &worker->handoffs, handoff );
+    worker->n_handoffs--;
+    free_switch_handoff( handoff );
+  }
+  set_writable( worker->socket, worker->handoffs != NULL );
+}
+
+
+static void
+switch_worker_writable( int fd, void *data ) {
+  UNUSED( fd );
+
+  flush_switch_worker_handoffs( data );
+}
+
+
+/*
+ * Starts watching the socket of a worker that has just been started.
+ */
+void
+init_switch_worker_handoffs( struct switch_worker *worker ) {
+  assert( worker != NULL );
+  assert( worker->socket >= 0 );
+
+  create_list( &worker->handoffs );
+  worker->n_handoffs = 0;
+  set_fd_handler( worker->socket, NULL, NULL, switch_worker_writable, worker );
+}
+
+
+/*
+ * Queues a secure channel for the worker and sends as much of the queue
+ * as its socket accepts without blocking. The rest is sent when the
+ * socket becomes writable. fd and connection are owned by the queue from
+ * now on. Returns false if the queue is full and the channel is closed.
+ */
+bool
+hand_over_switch_connection( struct switch_worker *worker, int fd, switch_connection *connection ) {
+  assert( worker != NULL );
+  assert( worker->socket >= 0 );
+  assert( connection != NULL );
+
+  if ( worker->n_handoffs >= SWITCH_WORKER_MAX_HANDOFFS ) {
+    error( "Too many secure channels are waiting for switch worker ( pid = %d ).", worker->pid );
+    close( fd );
+    xfree( connection );
+    return false;
+  }
+
+  switch_handoff *handoff = xmalloc( sizeof( switch_handoff ) );
+  handoff->fd = fd;
+  handoff->connection = connection;
+  append_to_tail( &worker->handoffs, handoff );
+  worker->n_handoffs++;
+  flush_switch_worker_handoffs( worker );
+
+  return true;
+}
+
+
+/*
+ * Closes the secure channels that have not been passed yet and stops
+ * watching the socket of the worker. The socket itself is not closed.
+ */
+void
+finalize_switch_worker_handoffs( struct switch_worker *worker ) {
+  assert( worker != NULL );
+
+  for ( list_element *e = worker->handoffs; e != NULL; e = e->next ) {
+    free_switch_handoff( e->data );
+  }
+  delete_list( worker->handoffs );
+  worker->handoffs = NULL;
+  worker->n_handoffs = 0;
+  set_writable( worker->socket, false );
+  delete_fd_handler( worker->socket );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,73 @@
+/*
+ * OpenFlow Switch Manager
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef SWITCH_WORKER_H
+#define SWITCH_WORKER_H
+
+
+#include <sys/types.h>
+#include <time.h>
+#include "trema.h"
+
+
+#define SWITCH_CONNECTION_MAX_LENGTH 131072
+#define SWITCH_WORKER_MAX_HANDOFFS 1024
+
+
+/*
+ * A secure channel handed over from switch_manager to a switch worker
+ * once the datapath id is known. The data consists of NUL-terminated
+ * destination rules ( e.g. "packet_in::filter" ) followed by the OpenFlow
+ * messages switch_manager has already read after the hello message.
+ */
+typedef struct {
+  uint64_t datapath_id;
+  uint32_t service_names_length;
+  uint32_t data_length;
+  char data[ 0 ];
+} switch_connection;
+
+
+struct switch_worker {
+  pid_t pid;
+  int socket;  // -1 if the worker is not running. non-blocking
+  time_t started_at;
+  list_element *handoffs; // secure channels waiting for socket to be writable
+  unsigned int n_handoffs;
+};
+
+
+int select_switch_worker( uint64_t datapath_id, int n_workers );
+bool send_switch_connection( int socket, int fd, const switch_connection *connection );
+bool recv_switch_connection( int socket, switch_connection *connection, size_t length, int *fd );
+void init_switch_worker_handoffs( struct switch_worker *worker );
+bool hand_over_switch_connection( struct switch_worker *worker, int fd, switch_connection *connection );
+void finalize_switch_worker_handoffs( struct switch_worker *worker );
+
+
+#endif // SWITCH_WORKER_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -22,7 +22,11 @@
 #define SWITCHINFO_H
 
 
+#include "cookie_table.h"
+#include "latency_stats.h"
 #include "message_queue.h"
+#include "messenger.h"
+#include "xid_table.h"
 
 
 #define SWITCH_STATE_CONNECTED           0
@@ -32,12 +36,25 @@
 #define SWITCH_STATE_DISCONNECTED        4
 
 
+// Messenger ids of the services in a service name list.
+typedef struct {
+  messenger_service_id *ids;
+  unsigned int length;
+} service_id_list;
+
+
 struct switch_info {
   list_element *vendor_service_name_list;     // vender manager service
   list_element *packetin_service_name_list;   // packetin manager service
   list_element *portstatus_service_name_list; // portstatus manager service
   list_element *state_service_name_list;      // switch state manager service
 
+  // The service name lists above resolved by update_service_id_list().
+  service_id_list vendor_services;
+  service_id_list packetin_services;
+  service_id_list portstatus_services;
+  service_id_list state_services;
+
   char *dpid_service_name;      // service name of messenger
   struct notify_info *notify_info;
 
@@ -59,10 +76,18 @@ struct switch_info {
 
   message_queue *send_queue;
   message_queue *recv_queue;
+  uint64_t send_queue_bytes;    // bytes in send_queue not written yet
+  bool congested;               // send_queue_bytes went over the high watermark
 
   bool running_timer;
 
   uint32_t echo_request_xid;
+
+  xid_table_t xid_table;        // pending requests of applications
+  cookie_table_t cookie_table;  // used if cookie_translation is set
+  bool cookie_aging;            // cookie_table is aged periodically
+
+  latency_stats latency;
 };
 
 
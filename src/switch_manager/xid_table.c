@@ -25,151 +25,149 @@
 
 static uint32_t transaction_id = 0U;
 
-#define XID_MAX_ENTRIES 4096
+/*
+ * A translated xid encodes the slot of its entry, so that lookups need no
+ * hash. The most significant bit tells translated xids from the ones
+ * generate_xid() returns, and the generation tells a reply for an entry
+ * that has since been evicted from the new entry in the same slot.
+ */
+#define XID_INDEX_MASK ( XID_MAX_ENTRIES - 1 )
+#define XID_INDEX_BITS 12
+#define XID_TRANSLATED 0x80000000U
+#define XID_GENERATION_MASK ( ~XID_TRANSLATED >> XID_INDEX_BITS )
 
-typedef struct xid_table {
-  xid_entry_t *entries[ XID_MAX_ENTRIES ];
-  hash_table *hash;
-  int next_index;
-} xid_table_t;
+#define XID_EVICTION_STAT "xid_table.evicted_pending_entries"
 
-static xid_table_t xid_table;
+static stat_counter *eviction_counter = NULL;
 
 
 uint32_t
 generate_xid( void ) {
-  uint32_t initial_value = ( transaction_id != UINT32_MAX ) ? ++transaction_id : 0;
-
-  while ( lookup_xid_entry( transaction_id ) != NULL ) {
-    if ( transaction_id != UINT32_MAX ) {
-      transaction_id++;
-    }
-    else {
-      transaction_id = 0;
-    }
-    if ( initial_value == transaction_id ) {
-      error( "Failed to generate transaction id value." );
-      transaction_id = 0;
-      break;
-    }
-  }
+  transaction_id = ( transaction_id + 1 ) & ~XID_TRANSLATED;
 
   return transaction_id;
 }
 
 
-static xid_entry_t *
-allocate_xid_entry( uint32_t original_xid, char *service_name, int index ) {
-  xid_entry_t *new_entry;
-
-  new_entry = xmalloc( sizeof( xid_entry_t ) );
-  new_entry->xid = generate_xid();
-  new_entry->original_xid = original_xid;
-  new_entry->service_name = xstrdup( service_name );
-  new_entry->index = index;
+void
+init_xid_table( xid_table_t *table ) {
+  assert( table != NULL );
 
-  return new_entry;
+  memset( table, 0, sizeof( xid_table_t ) );
+  for ( int i = 0; i < XID_MAX_ENTRIES; i++ ) {
+    table->entries[ i ].index = i;
+  }
+  table->next_index = 0;
 }
 
 
+// Keeps the index set by init_xid_table().
 static void
-free_xid_entry( xid_entry_t *free_entry ) {
-  xfree( free_entry->service_name );
-  xfree( free_entry );
+clear_xid_entry( xid_entry_t *entry ) {
+  release_messenger_service_id( entry->service );
+  entry->xid = 0;
+  entry->original_xid = 0;
+  entry->service = MESSENGER_INVALID_SERVICE_ID;
+  entry->sent_at = 0;
 }
 
 
 void
-init_xid_table( void ) {
-  memset( &xid_table, 0, sizeof( xid_table_t ) );
-  xid_table.hash = create_hash( compare_uint32, hash_uint32 );
-  xid_table.next_index = 0;
-}
+finalize_xid_table( xid_table_t *table ) {
+  assert( table != NULL );
 
-
-void
-finalize_xid_table( void ) {
   for ( int i = 0; i < XID_MAX_ENTRIES; i++ ) {
-    if ( xid_table.entries[ i ] != NULL ) {
-      free_xid_entry( xid_table.entries[ i ] );
-      xid_table.entries[ i ] = NULL;
-    }
+    clear_xid_entry( &table->entries[ i ] );
   }
-  delete_hash( xid_table.hash );
-  xid_table.hash = NULL;
-  xid_table.next_index = 0;
+  table->next_index = 0;
 }
 
 
 uint32_t
-insert_xid_entry( uint32_t original_xid, char *service_name ) {
-  xid_entry_t *new_entry;
+insert_xid_entry( xid_table_t *table, uint32_t original_xid, messenger_service_id service ) {
+  assert( table != NULL );
 
   debug( "Inserting xid entry ( original_xid = %#" PRIx32 ", service_name = %s ).",
-         original_xid, service_name );
-
-  if ( xid_table.next_index >= XID_MAX_ENTRIES ) {
-    xid_table.next_index = 0;
-  }
-
-  if ( xid_table.entries[ xid_table.next_index ] != NULL ) {
-    delete_xid_entry( xid_table.entries[ xid_table.next_index ] );
+         original_xid, get_messenger_service_name( service ) );
+
+  int index = table->next_index;
+  table->next_index = ( table->next_index + 1 ) & XID_INDEX_MASK;
+
+  xid_entry_t *entry = &table->entries[ index ];
+  if ( entry->xid != 0 ) {
+    debug( "Evicting pending xid entry ( xid = %#" PRIx32 ", original_xid = %#" PRIx32 ", service_name = %s ).",
+           entry->xid, entry->original_xid, get_messenger_service_name( entry->service ) );
+    table->n_evictions++;
+    if ( eviction_counter == NULL ) {
+      eviction_counter = register_stat_counter( XID_EVICTION_STAT );
+    }
+    if ( eviction_counter != NULL ) {
+      increment_stat_counter( eviction_counter );
+    }
+    release_messenger_service_id( entry->service );
   }
 
-  new_entry = allocate_xid_entry( original_xid, service_name, xid_table.next_index );
-  xid_entry_t *old = insert_hash_entry( xid_table.hash, &new_entry->xid, new_entry );
-  if ( old != NULL ) {
-    xid_table.entries[ old->index ] = NULL;
-    free_xid_entry( old );
-  }
-  xid_table.entries[ xid_table.next_index ] = new_entry;
-  xid_table.next_index++;
+  uint32_t generation = ( table->generations[ index ] + 1 ) & XID_GENERATION_MASK;
+  table->generations[ index ] = generation;
+  entry->xid = XID_TRANSLATED | ( generation << XID_INDEX_BITS ) | ( uint32_t ) index;
+  entry->original_xid = original_xid;
+  retain_messenger_service_id( service );
+  entry->service = service;
+  entry->sent_at = 0;
 
-  return new_entry->xid;
+  return entry->xid;
 }
 
 
 void
-delete_xid_entry( xid_entry_t *delete_entry ) {
+delete_xid_entry( xid_table_t *table, xid_entry_t *delete_entry ) {
   debug( "Deleting xid entry ( xid = %#" PRIx32 ", original_xid = %#" PRIx32 ", service_name = %s, index = %d ).",
-         delete_entry->xid, delete_entry->original_xid, delete_entry->service_name, delete_entry->index );
-
-  xid_entry_t *deleted = delete_hash_entry( xid_table.hash, &delete_entry->xid );
+         delete_entry->xid, delete_entry->original_xid, get_messenger_service_name( delete_entry->service ), delete_entry->index );
 
-  if ( deleted == NULL ) {
+  if ( lookup_xid_entry( table, delete_entry->xid ) != delete_entry ) {
     error( "Failed to delete xid entry ( xid = %#" PRIx32 " ).", delete_entry->xid );
-    free_xid_entry( ( xid_entry_t * ) delete_entry );
     return;
   }
 
-  xid_table.entries[ deleted->index ] = NULL;
-  free_xid_entry( deleted );
+  clear_xid_entry( delete_entry );
 }
 
 
 xid_entry_t *
-lookup_xid_entry( uint32_t xid ) {
-  return lookup_hash_entry( xid_table.hash, &xid );
+lookup_xid_entry( xid_table_t *table, uint32_t xid ) {
+  assert( table != NULL );
+
+  if ( ( xid & XID_TRANSLATED ) == 0 ) {
+    return NULL;
+  }
+
+  xid_entry_t *entry = &table->entries[ xid & XID_INDEX_MASK ];
+  if ( entry->xid != xid ) {
+    return NULL;
+  }
+
+  return entry;
 }
 
 
 static void
 dump_xid_entry( xid_entry_t *entry ) {
   info( "xid = %#" PRIx32 ", original_xid = %#" PRIx32 ", service_name = %s, index = %d",
-        entry->xid, entry->original_xid, entry->service_name, entry->index );
+        entry->xid, entry->original_xid, get_messenger_service_name( entry->service ), entry->index );
 }
 
 
 void
-dump_xid_table( void ) {
-  hash_iterator iter;
-  hash_entry *e;
+dump_xid_table( xid_table_t *table ) {
+  assert( table != NULL );
 
   info( "#### XID TABLE ####" );
-  init_hash_iterator( xid_table.hash, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
-    dump_xid_entry( e->value );
+  for ( int i = 0; i < XID_MAX_ENTRIES; i++ ) {
+    if ( table->entries[ i ].xid != 0 ) {
+      dump_xid_entry( &table->entries[ i ] );
+    }
   }
+  info( "evicted pending entries = %" PRIu64, table->n_evictions );
   info( "#### END ####" );
 }
 
@@ -25,21 +25,34 @@
 #include "trema.h"
 
 
+#define XID_MAX_ENTRIES 4096
+
+
 typedef struct xid_entry {
-  uint32_t xid;
+  uint32_t xid;                 // 0 if the entry is not in use
   uint32_t original_xid;
-  char *service_name;
+  messenger_service_id service;
+  uint64_t sent_at;             // see latency_stats, 0 if not measured
   int index;
 } xid_entry_t;
 
+// Pending requests to a switch. Each switch has its own table, so that
+// busy switches do not evict the pending requests of others.
+typedef struct xid_table {
+  xid_entry_t entries[ XID_MAX_ENTRIES ];
+  uint32_t generations[ XID_MAX_ENTRIES ];
+  int next_index;
+  uint64_t n_evictions;
+} xid_table_t;
+
 
 uint32_t generate_xid( void );
-void init_xid_table( void );
-void finalize_xid_table( void );
-uint32_t insert_xid_entry( uint32_t original_xid, char *service_name );
-void delete_xid_entry( xid_entry_t *entry );
-xid_entry_t *lookup_xid_entry( uint32_t xid );
-void dump_xid_table( void );
+void init_xid_table( xid_table_t *table );
+void finalize_xid_table( xid_table_t *table );
+uint32_t insert_xid_entry( xid_table_t *table, uint32_t original_xid, messenger_service_id service );
+void delete_xid_entry( xid_table_t *table, xid_entry_t *entry );
+xid_entry_t *lookup_xid_entry( xid_table_t *table, uint32_t xid );
+void dump_xid_table( xid_table_t *table );
 
 
 #endif // XID_TABLE_H
@@ -0,0 +1,284 @@
+/*
+ * Unit tests for actions of the datapath switch.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "action.h"
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+static void
+setup() {
+  setup_leak_detector();
+}
+
+
+static void
+teardown() {
+  teardown_leak_detector();
+}
+
+
+/*************************************************************************
+ * Helper.
+ *************************************************************************/
+
+#define FRAME_LENGTH 60
+#define ETH_HEADER_LENGTH 14
+#define IPV4_HEADER_LENGTH 20
+#define UDP_LENGTH 26
+
+static const uint8_t FRAME[ FRAME_LENGTH ] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x02, // dl_dst
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x01, // dl_src
+  0x08, 0x00,                         // dl_type
+  0x45, 0x00, 0x00, 0x2e, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+  0x0a, 0x00, 0x00, 0x01,             // nw_src
+  0x0a, 0x00, 0x00, 0x02,             // nw_dst
+  0x04, 0x00, 0x08, 0x00,             // tp_src and tp_dst
+  0x00, UDP_LENGTH, 0x00, 0x00,
+  'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r',
+};
+
+static const uint8_t DL_ADDR_A[ ETH_ADDRLEN ] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0a };
+static const uint8_t DL_ADDR_B[ ETH_ADDRLEN ] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0b };
+static void *USER_DATA = ( void * ) 0x12345678;
+
+static uint64_t actions[ 32 ];
+static uint16_t actions_length = 0;
+
+
+static void *
+append_action( uint16_t type, uint16_t length ) {
+  struct ofp_action_header *action = ( struct ofp_action_header * ) ( ( char * ) actions + actions_length );
+  memset( action, 0, length );
+  action->type = type;
+  action->len = length;
+  actions_length = ( uint16_t ) ( actions_length + length );
+
+  return action;
+}
+
+
+static void
+append_output( uint16_t port, uint16_t max_len ) {
+  struct ofp_action_output *output = append_action( OFPAT_OUTPUT, sizeof( struct ofp_action_output ) );
+  output->port = port;
+  output->max_len = max_len;
+}
+
+
+// Checksum of the UDP segment with its pseudo header.
+static uint16_t
+get_udp_checksum( const uint8_t *ipv4 ) {
+  uint16_t pseudo[ ( 12 + UDP_LENGTH ) / 2 ];
+  uint8_t *p = ( uint8_t * ) pseudo;
+  memcpy( p, ipv4 + 12, 8 );
+  p[ 8 ] = 0;
+  p[ 9 ] = IPPROTO_UDP;
+  p[ 10 ] = 0;
+  p[ 11 ] = UDP_LENGTH;
+  memcpy( p + 12, ipv4 + IPV4_HEADER_LENGTH, UDP_LENGTH );
+
+  return get_checksum( pseudo, sizeof( pseudo ) );
+}
+
+
+static buffer *
+create_frame() {
+  buffer *frame = alloc_buffer_with_length( FRAME_LENGTH );
+  uint8_t *data = append_back_buffer( frame, FRAME_LENGTH );
+  memcpy( data, FRAME, FRAME_LENGTH );
+
+  uint8_t *ipv4 = data + ETH_HEADER_LENGTH;
+  uint16_t checksum = get_checksum( ( uint16_t * ) ipv4, IPV4_HEADER_LENGTH );
+  memcpy( ipv4 + 10, &checksum, sizeof( checksum ) );
+  checksum = get_udp_checksum( ipv4 );
+  memcpy( ipv4 + IPV4_HEADER_LENGTH + 6, &checksum, sizeof( checksum ) );
+  assert_true( parse_packet( frame ) );
+
+  return frame;
+}
+
+
+static void
+mock_output( uint16_t port_no, uint16_t max_len, const buffer *frame, void *user_data ) {
+  uint32_t port_no32 = port_no;
+  uint32_t max_len32 = max_len;
+  const void *dl_dst = frame->data;
+
+  check_expected( port_no32 );
+  check_expected( max_len32 );
+  check_expected( dl_dst );
+  check_expected( user_data );
+}
+
+
+/*************************************************************************
+ * execute_actions() tests.
+ *************************************************************************/
+
+static void
+test_execute_actions_outputs_frame_as_modified_so_far() {
+  buffer *frame = create_frame();
+  actions_length = 0;
+  struct ofp_action_dl_addr *set_dl_dst = append_action( OFPAT_SET_DL_DST, sizeof( struct ofp_action_dl_addr ) );
+  memcpy( set_dl_dst->dl_addr, DL_ADDR_A, ETH_ADDRLEN );
+  append_output( 1, 0 );
+  set_dl_dst = append_action( OFPAT_SET_DL_DST, sizeof( struct ofp_action_dl_addr ) );
+  memcpy( set_dl_dst->dl_addr, DL_ADDR_B, ETH_ADDRLEN );
+  append_output( OFPP_CONTROLLER, 128 );
+
+  expect_value( mock_output, port_no32, 1 );
+  expect_value( mock_output, max_len32, 0 );
+  expect_memory( mock_output, dl_dst, DL_ADDR_A, ETH_ADDRLEN );
+  expect_value( mock_output, user_data, USER_DATA );
+  expect_value( mock_output, port_no32, OFPP_CONTROLLER );
+  expect_value( mock_output, max_len32, 128 );
+  expect_memory( mock_output, dl_dst, DL_ADDR_B, ETH_ADDRLEN );
+  expect_value( mock_output, user_data, USER_DATA );
+
+  execute_actions( frame, ( struct ofp_action_header * ) actions, actions_length, mock_output, USER_DATA );
+
+  free_buffer( frame );
+}
+
+
+static void
+test_execute_actions_sets_dl_src() {
+  buffer *frame = create_frame();
+  actions_length = 0;
+  struct ofp_action_dl_addr *set_dl_src = append_action( OFPAT_SET_DL_SRC, sizeof( struct ofp_action_dl_addr ) );
+  memcpy( set_dl_src->dl_addr, DL_ADDR_A, ETH_ADDRLEN );
+
+  execute_actions( frame, ( struct ofp_action_header * ) actions, actions_length, mock_output, USER_DATA );
+
+  assert_memory_equal( ( uint8_t * ) frame->data + ETH_ADDRLEN, DL_ADDR_A, ETH_ADDRLEN );
+  assert_memory_equal( frame->data, FRAME, ETH_ADDRLEN );
+
+  free_buffer( frame );
+}
+
+
+static void
+test_execute_actions_pushes_and_strips_vlan_tag() {
+  buffer *frame = create_frame();
+  buffer *original = duplicate_buffer( frame );
+  actions_length = 0;
+  struct ofp_action_vlan_vid *set_vlan_vid = append_action( OFPAT_SET_VLAN_VID, sizeof( struct ofp_action_vlan_vid ) );
+  set_vlan_vid->vlan_vid = 5;
+  struct ofp_action_vlan_pcp *set_vlan_pcp = append_action( OFPAT_SET_VLAN_PCP, sizeof( struct ofp_action_vlan_pcp ) );
+  set_vlan_pcp->vlan_pcp = 3;
+
+  execute_actions( frame, ( struct ofp_action_header * ) actions, actions_length, mock_output, USER_DATA );
+
+  static const uint8_t tag[] = { 0x81, 0x00, 0x60, 0x05 };
+  assert_int_equal( frame->length, FRAME_LENGTH + sizeof( tag ) );
+  assert_memory_equal( frame->data, FRAME, ETH_ADDRLEN * 2 );
+  assert_memory_equal( ( uint8_t * ) frame->data + ETH_ADDRLEN * 2, tag, sizeof( tag ) );
+  assert_true( packet_type_eth_vtag( frame ) );
+
+  actions_length = 0;
+  append_action( OFPAT_STRIP_VLAN, sizeof( struct ofp_action_header ) );
+
+  execute_actions( frame, ( struct ofp_action_header * ) actions, actions_length, mock_output, USER_DATA );
+
+  assert_int_equal( frame->length, FRAME_LENGTH );
+  assert_memory_equal( frame->data, original->data, FRAME_LENGTH );
+  assert_false( packet_type_eth_vtag( frame ) );
+
+  free_buffer( original );
+  free_buffer( frame );
+}
+
+
+static void
+test_execute_actions_keeps_checksums_valid() {
+  buffer *frame = create_frame();
+  actions_length = 0;
+  struct ofp_action_nw_addr *set_nw_src = append_action( OFPAT_SET_NW_SRC, sizeof( struct ofp_action_nw_addr ) );
+  set_nw_src->nw_addr = 0xc0a80001;
+  struct ofp_action_nw_addr *set_nw_dst = append_action( OFPAT_SET_NW_DST, sizeof( struct ofp_action_nw_addr ) );
+  set_nw_dst->nw_addr = 0xc0a80002;
+  struct ofp_action_nw_tos *set_nw_tos = append_action( OFPAT_SET_NW_TOS, sizeof( struct ofp_action_nw_tos ) );
+  set_nw_tos->nw_tos = 0xb8;
+  struct ofp_action_tp_port *set_tp_src = append_action( OFPAT_SET_TP_SRC, sizeof( struct ofp_action_tp_port ) );
+  set_tp_src->tp_port = 5000;
+  struct ofp_action_tp_port *set_tp_dst = append_action( OFPAT_SET_TP_DST, sizeof( struct ofp_action_tp_port ) );
+  set_tp_dst->tp_port = 6000;
+
+  execute_actions( frame, ( struct ofp_action_header * ) actions, actions_length, mock_output, USER_DATA );
+
+  uint8_t *ipv4 = ( uint8_t * ) frame->data + ETH_HEADER_LENGTH;
+  static const uint8_t addrs[] = { 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0x02 };
+  static const uint8_t ports[] = { 0x13, 0x88, 0x17, 0x70 };
+  assert_int_equal( ipv4[ 1 ], 0xb8 );
+  assert_memory_equal( ipv4 + 12, addrs, sizeof( addrs ) );
+  assert_memory_equal( ipv4 + IPV4_HEADER_LENGTH, ports, sizeof( ports ) );
+  assert_int_equal( get_checksum( ( uint16_t * ) ipv4, IPV4_HEADER_LENGTH ), 0 );
+  assert_int_equal( get_udp_checksum( ipv4 ), 0 );
+
+  free_buffer( frame );
+}
+
+
+static void
+test_execute_actions_stops_at_zero_length_action() {
+  buffer *frame = create_frame();
+  actions_length = 0;
+  append_output( 1, 0 );
+  ( ( struct ofp_action_header * ) actions )->len = 0;
+
+  execute_actions( frame, ( struct ofp_action_header * ) actions, actions_length, mock_output, USER_DATA );
+
+  free_buffer( frame );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_execute_actions_outputs_frame_as_modified_so_far, setup, teardown ),
+    unit_test_setup_teardown( test_execute_actions_sets_dl_src, setup, teardown ),
+    unit_test_setup_teardown( test_execute_actions_pushes_and_strips_vlan_tag, setup, teardown ),
+    unit_test_setup_teardown( test_execute_actions_keeps_checksums_valid, setup, teardown ),
+    unit_test_setup_teardown( test_execute_actions_stops_at_zero_length_action, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
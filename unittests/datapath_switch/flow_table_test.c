@@ -0,0 +1,440 @@
+/*
+ * Unit tests for the flow table of the datapath switch.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "flow_table.h"
+
+
+/*************************************************************************
+ * Mock functions.
+ *************************************************************************/
+
+static timer_id ( *original_add_timer_event_callback )( struct itimerspec *interval, timer_callback callback, void *user_data );
+static bool ( *original_delete_timer_event_by_id )( timer_id id );
+
+static timer_callback expiry_callback = NULL;
+static void *expiry_user_data = NULL;
+static struct itimerspec expiry_interval;
+
+
+static timer_id
+mock_add_timer_event_callback( struct itimerspec *interval, timer_callback callback, void *user_data ) {
+  expiry_interval = *interval;
+  expiry_callback = callback;
+  expiry_user_data = user_data;
+
+  return ( timer_id ) mock();
+}
+
+
+static bool
+mock_delete_timer_event_by_id( timer_id id ) {
+  check_expected( id );
+
+  return true;
+}
+
+
+static void
+mock_flow_entry_removed_handler( const flow_entry *entry, uint8_t reason, void *user_data ) {
+  uint32_t priority = entry->priority;
+  uint32_t reason32 = reason;
+
+  check_expected( priority );
+  check_expected( reason32 );
+  check_expected( user_data );
+}
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+static void *USER_DATA = ( void * ) 0x12345678;
+
+
+static void
+setup() {
+  original_add_timer_event_callback = add_timer_event_callback;
+  add_timer_event_callback = mock_add_timer_event_callback;
+  original_delete_timer_event_by_id = delete_timer_event_by_id;
+  delete_timer_event_by_id = mock_delete_timer_event_by_id;
+  expiry_callback = NULL;
+  expiry_user_data = NULL;
+  init_flow_table( mock_flow_entry_removed_handler, USER_DATA );
+}
+
+
+static void
+teardown() {
+  finalize_flow_table();
+  add_timer_event_callback = original_add_timer_event_callback;
+  delete_timer_event_by_id = original_delete_timer_event_by_id;
+}
+
+
+/*************************************************************************
+ * Helper.
+ *************************************************************************/
+
+static struct ofp_match
+packet_match( uint16_t in_port ) {
+  struct ofp_match match;
+  memset( &match, 0, sizeof( match ) );
+  match.in_port = in_port;
+  uint8_t dl_src[ OFP_ETH_ALEN ] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 };
+  uint8_t dl_dst[ OFP_ETH_ALEN ] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x02 };
+  memcpy( match.dl_src, dl_src, OFP_ETH_ALEN );
+  memcpy( match.dl_dst, dl_dst, OFP_ETH_ALEN );
+  match.dl_vlan = UINT16_MAX;
+  match.dl_type = 0x0800;
+  match.nw_proto = 17;
+  match.nw_src = 0x0a000001;
+  match.nw_dst = 0x0a000002;
+  match.tp_src = 1024;
+  match.tp_dst = 2048;
+
+  return match;
+}
+
+
+static struct ofp_match
+wildcards_match( uint32_t wildcards, uint16_t in_port ) {
+  struct ofp_match match = packet_match( in_port );
+  match.wildcards = wildcards;
+
+  return match;
+}
+
+
+static void
+add_flow( struct ofp_match match, uint16_t priority, uint16_t flags, uint16_t out_port ) {
+  openflow_actions *actions = create_actions();
+  if ( out_port != OFPP_NONE ) {
+    append_action_output( actions, out_port, 0 );
+  }
+  uint16_t error_code = 0;
+  assert_true( add_flow_entry( &match, priority, 0, 0, 0, flags, actions, &error_code ) );
+  delete_actions( actions );
+}
+
+
+static uint16_t
+output_port_of( const flow_entry *entry ) {
+  assert_true( entry != NULL );
+  if ( entry->actions_length == 0 ) {
+    return OFPP_NONE;
+  }
+  assert_int_equal( entry->actions->type, OFPAT_OUTPUT );
+
+  return ( ( const struct ofp_action_output * ) entry->actions )->port;
+}
+
+
+static uint32_t
+n_active_flows() {
+  uint32_t active_count;
+  uint64_t lookup_count, matched_count;
+  get_flow_table_stats( &active_count, &lookup_count, &matched_count );
+
+  return active_count;
+}
+
+
+#define IN_PORT_ONLY ( OFPFW_ALL & ~( uint32_t ) OFPFW_IN_PORT )
+
+
+/*************************************************************************
+ * lookup_flow_entry() tests.
+ *************************************************************************/
+
+static void
+test_lookup_flow_entry_prefers_exact_flow() {
+  struct ofp_match packet = packet_match( 1 );
+  add_flow( wildcards_match( OFPFW_ALL, 1 ), UINT16_MAX, 0, 1 );
+  add_flow( packet, 0, 0, 2 );
+
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 2 );
+}
+
+
+static void
+test_lookup_flow_entry_prefers_higher_priority_wildcards_flow() {
+  add_flow( wildcards_match( OFPFW_ALL, 1 ), 10, 0, 1 );
+  add_flow( wildcards_match( IN_PORT_ONLY, 1 ), 20, 0, 2 );
+
+  struct ofp_match packet = packet_match( 1 );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 2 );
+  packet = packet_match( 2 );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 1 );
+}
+
+
+static void
+test_lookup_flow_entry_sees_table_changes() {
+  struct ofp_match packet = packet_match( 1 );
+  assert_true( lookup_flow_entry( &packet ) == NULL );
+
+  add_flow( wildcards_match( IN_PORT_ONLY, 1 ), 10, 0, 1 );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 1 );
+
+  struct ofp_match all = wildcards_match( OFPFW_ALL, 0 );
+  delete_flow_entries( &all, 0, false, OFPP_NONE );
+  assert_true( lookup_flow_entry( &packet ) == NULL );
+
+  uint32_t active_count;
+  uint64_t lookup_count, matched_count;
+  get_flow_table_stats( &active_count, &lookup_count, &matched_count );
+  assert_int_equal( active_count, 0 );
+  assert_true( lookup_count == 3 );
+  assert_true( matched_count == 1 );
+}
+
+
+/*************************************************************************
+ * add_flow_entry() tests.
+ *************************************************************************/
+
+static void
+test_add_flow_entry_replaces_identical_flow() {
+  add_flow( wildcards_match( IN_PORT_ONLY, 1 ), 10, OFPFF_SEND_FLOW_REM, 1 );
+  add_flow( wildcards_match( IN_PORT_ONLY, 1 ), 10, 0, 2 );
+
+  struct ofp_match packet = packet_match( 1 );
+  assert_int_equal( n_active_flows(), 1 );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 2 );
+}
+
+
+static void
+test_add_flow_entry_fails_if_flow_overlaps() {
+  add_flow( wildcards_match( IN_PORT_ONLY, 1 ), 10, 0, 1 );
+
+  struct ofp_match all = wildcards_match( OFPFW_ALL, 0 );
+  uint16_t error_code = 0;
+  assert_false( add_flow_entry( &all, 10, 0, 0, 0, OFPFF_CHECK_OVERLAP, NULL, &error_code ) );
+  assert_int_equal( error_code, OFPFMFC_OVERLAP );
+  // A different priority does not overlap.
+  assert_true( add_flow_entry( &all, 11, 0, 0, 0, OFPFF_CHECK_OVERLAP, NULL, &error_code ) );
+  assert_int_equal( n_active_flows(), 2 );
+}
+
+
+/*************************************************************************
+ * modify_flow_entries() tests.
+ *************************************************************************/
+
+static void
+test_modify_flow_entries_strict_modifies_identical_flow_only() {
+  add_flow( wildcards_match( OFPFW_ALL, 0 ), 10, 0, 1 );
+  add_flow( wildcards_match( OFPFW_ALL, 0 ), 20, 0, 1 );
+  openflow_actions *actions = create_actions();
+  append_action_output( actions, 5, 0 );
+
+  struct ofp_match all = wildcards_match( OFPFW_ALL, 0 );
+  assert_true( modify_flow_entries( &all, 10, true, actions ) );
+  assert_false( modify_flow_entries( &all, 30, true, actions ) );
+
+  struct ofp_match packet = packet_match( 1 );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 1 );
+  struct ofp_match criteria = wildcards_match( OFPFW_ALL, 0 );
+  delete_flow_entries( &criteria, 20, true, OFPP_NONE );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 5 );
+
+  delete_actions( actions );
+}
+
+
+static void
+test_modify_flow_entries_loose_modifies_covered_flows() {
+  add_flow( wildcards_match( IN_PORT_ONLY, 1 ), 10, 0, 1 );
+  add_flow( wildcards_match( IN_PORT_ONLY, 2 ), 10, 0, 1 );
+  add_flow( packet_match( 1 ), 10, 0, 1 );
+  openflow_actions *actions = create_actions();
+  append_action_output( actions, 5, 0 );
+
+  struct ofp_match in_port_1 = wildcards_match( IN_PORT_ONLY, 1 );
+  assert_true( modify_flow_entries( &in_port_1, 0, false, actions ) );
+
+  struct ofp_match packet = packet_match( 1 );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 5 );
+  struct ofp_match exact = packet_match( 1 );
+  delete_flow_entries( &exact, 10, true, OFPP_NONE );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 5 );
+  packet = packet_match( 2 );
+  assert_int_equal( output_port_of( lookup_flow_entry( &packet ) ), 1 );
+
+  delete_actions( actions );
+}
+
+
+/*************************************************************************
+ * delete_flow_entries() tests.
+ *************************************************************************/
+
+static void
+test_delete_flow_entries_strict_deletes_identical_flow_only() {
+  add_flow( wildcards_match( OFPFW_ALL, 0 ), 10, OFPFF_SEND_FLOW_REM, 1 );
+  add_flow( wildcards_match( OFPFW_ALL, 0 ), 20, OFPFF_SEND_FLOW_REM, 1 );
+
+  expect_value( mock_flow_entry_removed_handler, priority, 20 );
+  expect_value( mock_flow_entry_removed_handler, reason32, OFPRR_DELETE );
+  expect_value( mock_flow_entry_removed_handler, user_data, USER_DATA );
+
+  struct ofp_match all = wildcards_match( OFPFW_ALL, 0 );
+  delete_flow_entries( &all, 20, true, OFPP_NONE );
+
+  struct ofp_match packet = packet_match( 1 );
+  assert_int_equal( n_active_flows(), 1 );
+  assert_int_equal( lookup_flow_entry( &packet )->priority, 10 );
+}
+
+
+static void
+test_delete_flow_entries_loose_deletes_covered_flows_to_out_port() {
+  add_flow( wildcards_match( IN_PORT_ONLY, 1 ), 10, OFPFF_SEND_FLOW_REM, 1 );
+  add_flow( wildcards_match( IN_PORT_ONLY, 2 ), 10, 0, 2 );
+  add_flow( packet_match( 1 ), 10, 0, 2 );
+  add_flow( wildcards_match( OFPFW_ALL, 0 ), 10, 0, 2 );
+
+  // Only the flow with SEND_FLOW_REM is notified.
+  struct ofp_match in_port_1 = wildcards_match( IN_PORT_ONLY, 1 );
+  delete_flow_entries( &in_port_1, 0, false, 2 );
+  assert_int_equal( n_active_flows(), 3 );
+
+  expect_value( mock_flow_entry_removed_handler, priority, 10 );
+  expect_value( mock_flow_entry_removed_handler, reason32, OFPRR_DELETE );
+  expect_value( mock_flow_entry_removed_handler, user_data, USER_DATA );
+
+  delete_flow_entries( &in_port_1, 0, false, OFPP_NONE );
+  assert_int_equal( n_active_flows(), 2 );
+
+  struct ofp_match packet = packet_match( 1 );
+  assert_true( lookup_flow_entry( &packet )->match.wildcards == OFPFW_ALL );
+}
+
+
+/*************************************************************************
+ * Flow expiry tests.
+ *************************************************************************/
+
+static void
+test_flow_entry_expires_on_hard_timeout() {
+  struct ofp_match match = wildcards_match( IN_PORT_ONLY, 1 );
+  uint16_t error_code = 0;
+  will_return( mock_add_timer_event_callback, 7 );
+  assert_true( add_flow_entry( &match, 10, 0, 0, 10, OFPFF_SEND_FLOW_REM, NULL, &error_code ) );
+  assert_true( expiry_interval.it_value.tv_sec == 10 );
+  assert_true( expiry_interval.it_interval.tv_sec == 0 && expiry_interval.it_interval.tv_nsec == 0 );
+
+  struct ofp_match packet = packet_match( 1 );
+  flow_entry *entry = lookup_flow_entry( &packet );
+  entry->created_at.tv_sec -= 10;
+
+  expect_value( mock_flow_entry_removed_handler, priority, 10 );
+  expect_value( mock_flow_entry_removed_handler, reason32, OFPRR_HARD_TIMEOUT );
+  expect_value( mock_flow_entry_removed_handler, user_data, USER_DATA );
+
+  expiry_callback( expiry_user_data );
+
+  assert_int_equal( n_active_flows(), 0 );
+  assert_true( lookup_flow_entry( &packet ) == NULL );
+}
+
+
+static void
+test_flow_entry_expires_on_idle_timeout_once_unused() {
+  struct ofp_match match = wildcards_match( IN_PORT_ONLY, 1 );
+  uint16_t error_code = 0;
+  will_return( mock_add_timer_event_callback, 7 );
+  assert_true( add_flow_entry( &match, 10, 0, 5, 0, OFPFF_SEND_FLOW_REM, NULL, &error_code ) );
+  assert_true( expiry_interval.it_value.tv_sec == 5 );
+
+  // Not idle for long enough yet, so the expiry is scheduled again.
+  will_return( mock_add_timer_event_callback, 8 );
+  expiry_callback( expiry_user_data );
+  assert_int_equal( n_active_flows(), 1 );
+
+  struct ofp_match packet = packet_match( 1 );
+  flow_entry *entry = lookup_flow_entry( &packet );
+  entry->last_used_at -= 5;
+
+  expect_value( mock_flow_entry_removed_handler, priority, 10 );
+  expect_value( mock_flow_entry_removed_handler, reason32, OFPRR_IDLE_TIMEOUT );
+  expect_value( mock_flow_entry_removed_handler, user_data, USER_DATA );
+
+  expiry_callback( expiry_user_data );
+
+  assert_int_equal( n_active_flows(), 0 );
+}
+
+
+static void
+test_deleting_flow_entry_cancels_expiry() {
+  struct ofp_match match = wildcards_match( IN_PORT_ONLY, 1 );
+  uint16_t error_code = 0;
+  will_return( mock_add_timer_event_callback, 7 );
+  assert_true( add_flow_entry( &match, 10, 0, 0, 10, 0, NULL, &error_code ) );
+
+  expect_value( mock_delete_timer_event_by_id, id, 7 );
+
+  delete_flow_entries( &match, 10, true, OFPP_NONE );
+  assert_int_equal( n_active_flows(), 0 );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_lookup_flow_entry_prefers_exact_flow, setup, teardown ),
+    unit_test_setup_teardown( test_lookup_flow_entry_prefers_higher_priority_wildcards_flow, setup, teardown ),
+    unit_test_setup_teardown( test_lookup_flow_entry_sees_table_changes, setup, teardown ),
+
+    unit_test_setup_teardown( test_add_flow_entry_replaces_identical_flow, setup, teardown ),
+    unit_test_setup_teardown( test_add_flow_entry_fails_if_flow_overlaps, setup, teardown ),
+
+    unit_test_setup_teardown( test_modify_flow_entries_strict_modifies_identical_flow_only, setup, teardown ),
+    unit_test_setup_teardown( test_modify_flow_entries_loose_modifies_covered_flows, setup, teardown ),
+
+    unit_test_setup_teardown( test_delete_flow_entries_strict_deletes_identical_flow_only, setup, teardown ),
+    unit_test_setup_teardown( test_delete_flow_entries_loose_deletes_covered_flows_to_out_port, setup, teardown ),
+
+    unit_test_setup_teardown( test_flow_entry_expires_on_hard_timeout, setup, teardown ),
+    unit_test_setup_teardown( test_flow_entry_expires_on_idle_timeout_once_unused, setup, teardown ),
+    unit_test_setup_teardown( test_deleting_flow_entry_cancels_expiry, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,316 @@
+/*
+ * Unit tests for switch ports of the datapath switch.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <linux/if_packet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "port.h"
+
+
+void receive_frames( int fd, void *user_data );
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+static void
+setup() {
+  setup_leak_detector();
+}
+
+
+static void
+teardown() {
+  teardown_leak_detector();
+}
+
+
+/*************************************************************************
+ * Helper.
+ *************************************************************************/
+
+#define BLOCK_SIZE 4096
+#define FIRST_FRAME_OFFSET 64
+#define FRAME_SLOT_SIZE 256
+#define MAC_OFFSET 128
+#define FRAME_LENGTH 60
+#define VLAN_TCI 0x2005
+
+static uint8_t FRAME[ FRAME_LENGTH ] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x02, // dl_dst
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x01, // dl_src
+  0x08, 0x00,                         // dl_type
+};
+
+static int n_received = 0;
+static uint8_t received_frame[ FRAME_LENGTH + 4 ];
+static size_t received_length = 0;
+
+
+static void
+handle_frame_received( switch_port *port, buffer *frame, void *user_data ) {
+  UNUSED( port );
+  UNUSED( user_data );
+
+  n_received++;
+  received_length = frame->length;
+  memcpy( received_frame, frame->data, frame->length < sizeof( received_frame ) ? frame->length : sizeof( received_frame ) );
+}
+
+
+static void
+init_port( switch_port *port, int fd ) {
+  memset( port, 0, sizeof( switch_port ) );
+  port->port_no = 1;
+  port->fd = fd;
+  port->received_callback = handle_frame_received;
+  n_received = 0;
+  received_length = 0;
+}
+
+
+static struct tpacket3_hdr *
+append_frame( uint8_t *block, uint32_t index, uint32_t status, uint8_t pkttype ) {
+  struct tpacket_block_desc *desc = ( struct tpacket_block_desc * ) block;
+  desc->hdr.bh1.num_pkts = index + 1;
+  desc->hdr.bh1.offset_to_first_pkt = FIRST_FRAME_OFFSET;
+
+  struct tpacket3_hdr *header = ( struct tpacket3_hdr * ) ( block + FIRST_FRAME_OFFSET + index * FRAME_SLOT_SIZE );
+  header->tp_next_offset = FRAME_SLOT_SIZE;
+  header->tp_snaplen = FRAME_LENGTH;
+  header->tp_len = FRAME_LENGTH;
+  header->tp_status = status;
+  header->tp_mac = MAC_OFFSET;
+  header->hv1.tp_vlan_tci = VLAN_TCI;
+  size_t sll_offset = ( sizeof( struct tpacket3_hdr ) + TPACKET_ALIGNMENT - 1 ) & ~( ( size_t ) TPACKET_ALIGNMENT - 1 );
+  struct sockaddr_ll *sll = ( struct sockaddr_ll * ) ( ( uint8_t * ) header + sll_offset );
+  sll->sll_pkttype = pkttype;
+  memcpy( ( uint8_t * ) header + MAC_OFFSET, FRAME, FRAME_LENGTH );
+
+  return header;
+}
+
+
+static uint8_t *
+create_ring( switch_port *port ) {
+  uint8_t *block = xcalloc( 1, BLOCK_SIZE );
+  ( ( struct tpacket_block_desc * ) block )->hdr.bh1.block_status = TP_STATUS_USER;
+  port->ring = block;
+  port->ring_size = BLOCK_SIZE;
+  port->block_size = BLOCK_SIZE;
+  port->n_blocks = 1;
+  port->current_block = 0;
+
+  return block;
+}
+
+
+/*************************************************************************
+ * receive_frames() tests.
+ *************************************************************************/
+
+static void
+test_receive_frames_reinserts_vlan_tag_and_skips_outgoing_frames() {
+  switch_port port;
+  init_port( &port, -1 );
+  uint8_t *block = create_ring( &port );
+  append_frame( block, 0, TP_STATUS_VLAN_VALID, PACKET_HOST );
+  append_frame( block, 1, 0, PACKET_OUTGOING );
+
+  receive_frames( port.fd, &port );
+
+  assert_int_equal( n_received, 1 );
+  assert_int_equal( received_length, FRAME_LENGTH + 4 );
+  static const uint8_t tag[] = { 0x81, 0x00, VLAN_TCI >> 8, VLAN_TCI & 0xff };
+  assert_memory_equal( received_frame, FRAME, 12 );
+  assert_memory_equal( received_frame + 12, tag, sizeof( tag ) );
+  assert_memory_equal( received_frame + 16, FRAME + 12, FRAME_LENGTH - 12 );
+  assert_true( port.stats.rx_packets == 1 );
+  assert_true( port.stats.rx_bytes == FRAME_LENGTH );
+  assert_int_equal( ( ( struct tpacket_block_desc * ) block )->hdr.bh1.block_status, TP_STATUS_KERNEL );
+
+  xfree( block );
+}
+
+
+static void
+test_receive_frames_counts_but_drops_frames_if_port_does_not_receive() {
+  switch_port port;
+  init_port( &port, -1 );
+  port.config = OFPPC_NO_RECV;
+  uint8_t *block = create_ring( &port );
+  append_frame( block, 0, 0, PACKET_HOST );
+
+  receive_frames( port.fd, &port );
+
+  assert_int_equal( n_received, 0 );
+  assert_true( port.stats.rx_packets == 1 );
+
+  xfree( block );
+}
+
+
+static void
+test_receive_frames_skips_blocks_owned_by_kernel() {
+  switch_port port;
+  init_port( &port, -1 );
+  uint8_t *block = create_ring( &port );
+  append_frame( block, 0, 0, PACKET_HOST );
+  ( ( struct tpacket_block_desc * ) block )->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+  receive_frames( port.fd, &port );
+
+  assert_int_equal( n_received, 0 );
+  assert_true( port.stats.rx_packets == 0 );
+
+  xfree( block );
+}
+
+
+/*************************************************************************
+ * send_to_switch_port() tests.
+ *************************************************************************/
+
+static void
+test_send_to_switch_port_succeeds() {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sockets ), 0 );
+  switch_port port;
+  init_port( &port, sockets[ 0 ] );
+  buffer *frame = alloc_buffer_with_length( FRAME_LENGTH );
+  memcpy( append_back_buffer( frame, FRAME_LENGTH ), FRAME, FRAME_LENGTH );
+
+  assert_true( send_to_switch_port( &port, frame ) );
+
+  uint8_t data[ FRAME_LENGTH * 2 ];
+  assert_int_equal( recv( sockets[ 1 ], data, sizeof( data ), 0 ), FRAME_LENGTH );
+  assert_memory_equal( data, FRAME, FRAME_LENGTH );
+  assert_true( port.stats.tx_packets == 1 );
+  assert_true( port.stats.tx_bytes == FRAME_LENGTH );
+
+  free_buffer( frame );
+  close( sockets[ 0 ] );
+  close( sockets[ 1 ] );
+}
+
+
+static void
+test_send_to_switch_port_drops_frame_if_port_does_not_forward() {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sockets ), 0 );
+  switch_port port;
+  init_port( &port, sockets[ 0 ] );
+  port.config = OFPPC_NO_FWD;
+  buffer *frame = alloc_buffer_with_length( FRAME_LENGTH );
+  memcpy( append_back_buffer( frame, FRAME_LENGTH ), FRAME, FRAME_LENGTH );
+
+  assert_false( send_to_switch_port( &port, frame ) );
+
+  uint8_t data[ FRAME_LENGTH ];
+  assert_int_equal( recv( sockets[ 1 ], data, sizeof( data ), 0 ), -1 );
+  assert_true( port.stats.tx_dropped == 1 );
+  assert_true( port.stats.tx_packets == 0 );
+
+  free_buffer( frame );
+  close( sockets[ 0 ] );
+  close( sockets[ 1 ] );
+}
+
+
+static void
+test_send_to_switch_port_counts_errors() {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sockets ), 0 );
+  close( sockets[ 1 ] );
+  switch_port port;
+  init_port( &port, sockets[ 0 ] );
+  buffer *frame = alloc_buffer_with_length( FRAME_LENGTH );
+  memcpy( append_back_buffer( frame, FRAME_LENGTH ), FRAME, FRAME_LENGTH );
+
+  assert_false( send_to_switch_port( &port, frame ) );
+
+  assert_true( port.stats.tx_errors == 1 );
+  assert_true( port.stats.tx_packets == 0 );
+
+  free_buffer( frame );
+  close( sockets[ 0 ] );
+}
+
+
+/*************************************************************************
+ * get_switch_port_stats() tests.
+ *************************************************************************/
+
+static void
+test_get_switch_port_stats_returns_counters() {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_DGRAM, 0, sockets ), 0 );
+  switch_port port;
+  init_port( &port, sockets[ 0 ] );
+  port.stats.port_no = 1;
+  port.stats.rx_packets = 10;
+  port.stats.tx_packets = 20;
+
+  struct ofp_port_stats stats;
+  get_switch_port_stats( &port, &stats );
+
+  assert_int_equal( stats.port_no, 1 );
+  assert_true( stats.rx_packets == 10 );
+  assert_true( stats.tx_packets == 20 );
+  assert_true( stats.rx_dropped == 0 );
+
+  close( sockets[ 0 ] );
+  close( sockets[ 1 ] );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_receive_frames_reinserts_vlan_tag_and_skips_outgoing_frames, setup, teardown ),
+    unit_test_setup_teardown( test_receive_frames_counts_but_drops_frames_if_port_does_not_receive, setup, teardown ),
+    unit_test_setup_teardown( test_receive_frames_skips_blocks_owned_by_kernel, setup, teardown ),
+
+    unit_test_setup_teardown( test_send_to_switch_port_succeeds, setup, teardown ),
+    unit_test_setup_teardown( test_send_to_switch_port_drops_frame_if_port_does_not_forward, setup, teardown ),
+    unit_test_setup_teardown( test_send_to_switch_port_counts_errors, setup, teardown ),
+
+    unit_test_setup_teardown( test_get_switch_port_stats_returns_counters, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
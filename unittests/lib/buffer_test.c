@@ -41,7 +41,8 @@ typedef struct private_buffer {
   buffer public;
   size_t real_length;
   void *top;
-  pthread_mutex_t *mutex;
+  pthread_mutex_t mutex;
+  void *storage;
 } private_buffer;
 
 
@@ -309,6 +310,161 @@ dump_function( const char *format, ... ) {
 }
 
 
+static void
+test_alloc_buffer_view_refers_to_data() {
+  char data[] = "Ceylon";
+
+  buffer *buf = alloc_buffer_view( data, sizeof( data ) );
+  assert_true( buf != NULL );
+  assert_true( buf->data == data );
+  assert_int_equal( buf->length, sizeof( data ) );
+  assert_true( is_shared_buffer( buf ) );
+
+  free_buffer( buf );
+  assert_string_equal( data, "Ceylon" );
+}
+
+
+static void
+test_append_back_buffer_copies_view() {
+  char data[] = "Ceylon";
+
+  buffer *buf = alloc_buffer_view( data, strlen( data ) );
+  char *p = append_back_buffer( buf, 1 );
+  *p = '\0';
+  assert_true( buf->data != data );
+  assert_string_equal( buf->data, "Ceylon" );
+  assert_false( is_shared_buffer( buf ) );
+
+  free_buffer( buf );
+}
+
+
+static void
+test_slice_buffer_shares_data() {
+  buffer *buf = alloc_buffer_with_length( sizeof( tea ) * 2 );
+  tea *teas = append_back_buffer( buf, sizeof( tea ) * 2 );
+  teas[ 0 ] = CEYLON;
+  teas[ 1 ] = DARJEELING;
+  assert_false( is_shared_buffer( buf ) );
+
+  buffer *slice = slice_buffer( buf, sizeof( tea ), sizeof( tea ) );
+  assert_true( slice->data == &teas[ 1 ] );
+  assert_int_equal( slice->length, sizeof( tea ) );
+  assert_true( is_shared_buffer( buf ) );
+  assert_true( is_shared_buffer( slice ) );
+
+  free_buffer( buf );
+  assert_false( is_shared_buffer( slice ) );
+  assert_string_equal( ( ( tea * ) slice->data )->name, DARJEELING.name );
+
+  free_buffer( slice );
+}
+
+
+static void
+test_append_front_buffer_does_not_overwrite_slice() {
+  buffer *buf = alloc_buffer_with_length( sizeof( tea ) * 2 );
+  tea *teas = append_back_buffer( buf, sizeof( tea ) * 2 );
+  teas[ 0 ] = CEYLON;
+  teas[ 1 ] = DARJEELING;
+
+  buffer *slice = slice_buffer( buf, 0, sizeof( tea ) );
+  remove_front_buffer( buf, sizeof( tea ) );
+  tea *front = append_front_buffer( buf, sizeof( tea ) );
+  *front = DARJEELING;
+
+  assert_true( slice->data == &teas[ 0 ] );
+  assert_string_equal( ( ( tea * ) slice->data )->name, CEYLON.name );
+  assert_string_equal( ( ( tea * ) buf->data )->name, DARJEELING.name );
+
+  free_buffer( slice );
+  free_buffer( buf );
+}
+
+
+static void
+test_append_front_buffer_uses_headroom() {
+  buffer *buf = alloc_buffer_with_length( sizeof( tea ) * 2 );
+  append_back_buffer( buf, sizeof( tea ) * 2 );
+  void *top = buf->data;
+
+  remove_front_buffer( buf, sizeof( tea ) );
+  void *data_pointer = append_front_buffer( buf, sizeof( tea ) );
+  assert_true( data_pointer == top );
+  assert_int_equal( buf->length, sizeof( tea ) * 2 );
+
+  free_buffer( buf );
+}
+
+
+static void
+test_append_front_buffer_within_headroom_does_not_copy() {
+  buffer *buf = alloc_buffer_with_headroom( sizeof( tea ), sizeof( tea ) );
+  assert_int_equal( buf->length, 0 );
+  assert_int_equal( headroom_of_buffer( buf ), sizeof( tea ) );
+
+  tea *back = append_back_buffer( buf, sizeof( tea ) );
+  memcpy( back, &CEYLON, sizeof( tea ) );
+  tea *front = append_front_buffer( buf, sizeof( tea ) );
+  assert_true( front + 1 == back );
+  assert_int_equal( headroom_of_buffer( buf ), 0 );
+  assert_int_equal( buf->length, sizeof( tea ) * 2 );
+  assert_string_equal( back->name, "Ceylon" );
+
+  free_buffer( buf );
+}
+
+
+static void
+test_headroom_of_shared_buffer_is_0() {
+  buffer *buf = alloc_buffer_with_headroom( sizeof( tea ), sizeof( tea ) );
+  append_back_buffer( buf, sizeof( tea ) );
+  buffer *slice = slice_buffer( buf, 0, sizeof( tea ) );
+
+  assert_int_equal( headroom_of_buffer( buf ), 0 );
+
+  free_buffer( slice );
+  free_buffer( buf );
+}
+
+
+static void
+count_pool_stat( const char *key, const uint64_t value, void *user_data ) {
+  if ( strcmp( key, "buffer_pool.reused" ) == 0 ) {
+    *( uint64_t * ) user_data = value;
+  }
+}
+
+
+static void
+test_free_buffer_returns_buffer_to_pool() {
+  init_buffer_pool();
+
+  uint64_t reused_before = 0;
+  foreach_buffer_pool_stat( count_pool_stat, &reused_before );
+
+  buffer *buf = alloc_buffer_with_length( sizeof( tea ) );
+  void *data = buf->data;
+  free_buffer( buf );
+
+  buffer *reused = alloc_buffer_with_length( sizeof( tea ) * 2 );
+  assert_true( reused == buf );
+  assert_true( reused->data == data );
+  assert_int_equal( reused->length, 0 );
+  assert_true( reused->user_data == NULL );
+  append_back_buffer( reused, sizeof( tea ) * 2 );
+  assert_true( reused->data == data );
+
+  uint64_t reused_after = 0;
+  foreach_buffer_pool_stat( count_pool_stat, &reused_after );
+  assert_true( reused_after == reused_before + 2 );
+
+  free_buffer( reused );
+  finalize_buffer_pool();
+}
+
+
 static void
 test_dump_buffer() {
   buffer *buf = alloc_buffer();
@@ -353,6 +509,16 @@ main() {
     unit_test( test_duplicate_buffer_succeeds ),
     unit_test( test_duplicate_buffer_succeeds_if_initialize_length_is_0 ),
 
+    unit_test( test_alloc_buffer_view_refers_to_data ),
+    unit_test( test_append_back_buffer_copies_view ),
+    unit_test( test_slice_buffer_shares_data ),
+    unit_test( test_append_front_buffer_does_not_overwrite_slice ),
+    unit_test( test_append_front_buffer_uses_headroom ),
+    unit_test( test_append_front_buffer_within_headroom_does_not_copy ),
+    unit_test( test_headroom_of_shared_buffer_is_0 ),
+
+    unit_test( test_free_buffer_returns_buffer_to_pool ),
+
     unit_test( test_dump_buffer ),
   };
   setup_leak_detector();
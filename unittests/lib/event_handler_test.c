@@ -0,0 +1,204 @@
+/*
+ * Unit tests for event handler.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "event_handler.h"
+
+
+/*************************************************************************
+ * Helper.
+ *************************************************************************/
+
+static int fds[ 2 ];
+static int read_count;
+static int write_count;
+
+
+static void
+read_callback( int fd, void *data ) {
+  char buf[ 16 ];
+  ssize_t ret = read( fd, buf, sizeof( buf ) );
+  assert_true( ret > 0 );
+  assert_string_equal( data, "READ" );
+  read_count++;
+}
+
+
+static void
+write_callback( int fd, void *data ) {
+  UNUSED( fd );
+  assert_string_equal( data, "WRITE" );
+  write_count++;
+}
+
+
+static void
+delete_callback( int fd, void *data ) {
+  UNUSED( data );
+  set_readable( fd, false );
+  set_writable( fd, false );
+  delete_fd_handler( fd );
+  write_count++;
+}
+
+
+static void
+setup( event_handler_backend backend ) {
+  read_count = 0;
+  write_count = 0;
+  assert_int_equal( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ), 0 );
+  assert_true( set_event_handler_backend( backend ) );
+  init_event_handler();
+}
+
+
+static void
+setup_select() {
+  setup( EVENT_HANDLER_BACKEND_SELECT );
+}
+
+
+static void
+setup_epoll() {
+  setup( EVENT_HANDLER_BACKEND_EPOLL );
+}
+
+
+static void
+teardown() {
+  finalize_event_handler();
+  close( fds[ 0 ] );
+  close( fds[ 1 ] );
+  set_event_handler_backend( EVENT_HANDLER_BACKEND_DEFAULT );
+}
+
+
+/*************************************************************************
+ * Dispatch tests.
+ *************************************************************************/
+
+static void
+test_backend_is_selected() {
+  assert_int_equal( get_event_handler_backend(), EVENT_HANDLER_BACKEND_EPOLL );
+}
+
+
+static void
+test_readable_fd_is_dispatched() {
+  set_fd_handler( fds[ 0 ], read_callback, ( void * ) ( uintptr_t ) "READ", write_callback, ( void * ) ( uintptr_t ) "WRITE" );
+  set_readable( fds[ 0 ], true );
+  assert_true( readable( fds[ 0 ] ) );
+  assert_false( writable( fds[ 0 ] ) );
+
+  assert_true( run_event_handler_once( 0 ) );
+  assert_int_equal( read_count, 0 );
+
+  assert_int_equal( write( fds[ 1 ], "x", 1 ), 1 );
+  assert_true( run_event_handler_once( 100000 ) );
+  assert_int_equal( read_count, 1 );
+  assert_int_equal( write_count, 0 );
+
+  set_writable( fds[ 0 ], true );
+  assert_true( run_event_handler_once( 100000 ) );
+  assert_int_equal( read_count, 1 );
+  assert_int_equal( write_count, 1 );
+
+  set_readable( fds[ 0 ], false );
+  set_writable( fds[ 0 ], false );
+  assert_false( readable( fds[ 0 ] ) );
+  delete_fd_handler( fds[ 0 ] );
+}
+
+
+static void
+test_handler_deleted_in_callback_is_not_dispatched() {
+  set_fd_handler( fds[ 0 ], read_callback, ( void * ) ( uintptr_t ) "READ", delete_callback, NULL );
+  set_readable( fds[ 0 ], true );
+  set_writable( fds[ 0 ], true );
+  assert_int_equal( write( fds[ 1 ], "x", 1 ), 1 );
+
+  assert_true( run_event_handler_once( 100000 ) );
+  assert_int_equal( write_count, 1 );
+  assert_int_equal( read_count, 0 );
+}
+
+
+static void
+test_fd_beyond_fd_setsize_is_dispatched() {
+  struct rlimit limit;
+  assert_int_equal( getrlimit( RLIMIT_NOFILE, &limit ), 0 );
+  int high_fd = FD_SETSIZE + 10;
+  if ( limit.rlim_max <= ( rlim_t ) high_fd ) {
+    return;
+  }
+  if ( limit.rlim_cur <= ( rlim_t ) high_fd ) {
+    limit.rlim_cur = ( rlim_t ) high_fd + 1;
+    assert_int_equal( setrlimit( RLIMIT_NOFILE, &limit ), 0 );
+  }
+  assert_int_equal( dup2( fds[ 0 ], high_fd ), high_fd );
+
+  set_fd_handler( high_fd, read_callback, ( void * ) ( uintptr_t ) "READ", NULL, NULL );
+  set_readable( high_fd, true );
+  assert_int_equal( write( fds[ 1 ], "x", 1 ), 1 );
+  assert_true( run_event_handler_once( 100000 ) );
+  assert_int_equal( read_count, 1 );
+
+  set_readable( high_fd, false );
+  delete_fd_handler( high_fd );
+  close( high_fd );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_backend_is_selected, setup_epoll, teardown ),
+
+    unit_test_setup_teardown( test_readable_fd_is_dispatched, setup_select, teardown ),
+    unit_test_setup_teardown( test_readable_fd_is_dispatched, setup_epoll, teardown ),
+
+    unit_test_setup_teardown( test_handler_deleted_in_callback_is_not_dispatched, setup_select, teardown ),
+    unit_test_setup_teardown( test_handler_deleted_in_callback_is_not_dispatched, setup_epoll, teardown ),
+
+    unit_test_setup_teardown( test_fd_beyond_fd_setsize_is_dispatched, setup_epoll, teardown ),
+  };
+
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
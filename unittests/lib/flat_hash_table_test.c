@@ -0,0 +1,223 @@
+/*
+ * Unit tests for flat hash table.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "flat_hash_table.h"
+#include "utility.h"
+
+
+/********************************************************************************
+ * Test functions.
+ ********************************************************************************/
+
+static flat_hash_table *table;
+
+static char alpha[] = "alpha";
+static char bravo[] = "bravo";
+static char charlie[] = "charlie";
+
+#define MANY_ENTRIES 10000
+static uint32_t keys[ MANY_ENTRIES ];
+
+
+static void
+setup_no_lock() {
+  table = create_flat_hash( compare_string, hash_string, FLAT_HASH_NO_LOCK );
+}
+
+
+static void
+setup_lock() {
+  table = create_flat_hash( compare_string, hash_string, 0 );
+}
+
+
+static void
+teardown() {
+  delete_flat_hash( table );
+}
+
+
+static void
+test_lookup_empty_table_returns_NULL() {
+  assert_true( lookup_flat_hash_entry( table, alpha ) == NULL );
+}
+
+
+static void
+test_insert_and_lookup() {
+  insert_flat_hash_entry( table, alpha, alpha );
+  assert_string_equal( lookup_flat_hash_entry( table, alpha ), "alpha" );
+  assert_int_equal( table->length, 1 );
+}
+
+
+static void
+test_insert_twice_overwrites_old_value() {
+  char key[] = "key";
+  char old_value[] = "old value";
+  char new_value[] = "new value";
+
+  insert_flat_hash_entry( table, key, old_value );
+  char *prev = insert_flat_hash_entry( table, key, new_value );
+
+  assert_string_equal( lookup_flat_hash_entry( table, key ), "new value" );
+  assert_string_equal( prev, "old value" );
+  assert_int_equal( table->length, 1 );
+}
+
+
+static void
+test_delete_entry() {
+  insert_flat_hash_entry( table, alpha, alpha );
+  insert_flat_hash_entry( table, bravo, bravo );
+  insert_flat_hash_entry( table, charlie, charlie );
+
+  assert_string_equal( delete_flat_hash_entry( table, bravo ), "bravo" );
+  assert_string_equal( lookup_flat_hash_entry( table, alpha ), "alpha" );
+  assert_true( lookup_flat_hash_entry( table, bravo ) == NULL );
+  assert_string_equal( lookup_flat_hash_entry( table, charlie ), "charlie" );
+  assert_true( delete_flat_hash_entry( table, "NO SUCH KEY" ) == NULL );
+  assert_int_equal( table->length, 2 );
+}
+
+
+static void
+delete_foreach( void *key, void *value, void *user_data ) {
+  assert_true( strcmp( key, value ) == 0 );
+  ( *( int * ) user_data )++;
+  delete_flat_hash_entry( table, key );
+}
+
+
+static void
+test_foreach_deleting_entries() {
+  insert_flat_hash_entry( table, alpha, alpha );
+  insert_flat_hash_entry( table, bravo, bravo );
+  insert_flat_hash_entry( table, charlie, charlie );
+
+  int count = 0;
+  foreach_flat_hash( table, delete_foreach, &count );
+
+  assert_int_equal( count, 3 );
+  assert_int_equal( table->length, 0 );
+}
+
+
+static void
+test_many_entries_grow_table() {
+  flat_hash_table *numbers = create_flat_hash( compare_uint32, hash_uint32, FLAT_HASH_NO_LOCK );
+
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i++ ) {
+    keys[ i ] = i * 64;
+    assert_true( insert_flat_hash_entry( numbers, &keys[ i ], &keys[ i ] ) == NULL );
+  }
+  assert_int_equal( numbers->length, MANY_ENTRIES );
+  assert_true( numbers->capacity >= MANY_ENTRIES );
+
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i += 2 ) {
+    assert_true( delete_flat_hash_entry( numbers, &keys[ i ] ) == &keys[ i ] );
+  }
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i++ ) {
+    uint32_t key = i * 64;
+    void *expected = ( i % 2 ) == 0 ? NULL : &keys[ i ];
+    assert_true( lookup_flat_hash_entry( numbers, &key ) == expected );
+  }
+
+  uint64_t sum = 0;
+  unsigned int count = 0;
+  flat_hash_iterator iter;
+  hash_entry *e;
+  init_flat_hash_iterator( numbers, &iter );
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
+    sum += *( uint32_t * ) e->value;
+    count++;
+  }
+  assert_int_equal( count, MANY_ENTRIES / 2 );
+  assert_true( sum == ( uint64_t ) 64 * ( MANY_ENTRIES / 2 ) * ( MANY_ENTRIES / 2 ) );
+
+  delete_flat_hash( numbers );
+}
+
+
+static void
+test_reinserting_deleted_entries_does_not_grow_table() {
+  flat_hash_table *numbers = create_flat_hash_with_size( compare_uint32, hash_uint32, 64, FLAT_HASH_NO_LOCK );
+  unsigned int capacity = numbers->capacity;
+
+  for ( uint32_t n = 0; n < 100; n++ ) {
+    for ( uint32_t i = 0; i < 64; i++ ) {
+      keys[ i ] = n * 64 + i;
+      insert_flat_hash_entry( numbers, &keys[ i ], &keys[ i ] );
+    }
+    for ( uint32_t i = 0; i < 64; i++ ) {
+      assert_true( delete_flat_hash_entry( numbers, &keys[ i ] ) == &keys[ i ] );
+    }
+  }
+  assert_int_equal( numbers->length, 0 );
+  assert_int_equal( numbers->capacity, capacity );
+
+  delete_flat_hash( numbers );
+}
+
+
+static void
+test_iterate_empty_hash() {
+  flat_hash_iterator iter;
+  init_flat_hash_iterator( table, &iter );
+
+  while ( iterate_flat_hash_next( &iter ) != NULL ) {
+    UNREACHABLE_CODE();
+  }
+}
+
+
+/********************************************************************************
+ * Run tests.
+ ********************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_lookup_empty_table_returns_NULL, setup_no_lock, teardown ),
+    unit_test_setup_teardown( test_insert_and_lookup, setup_no_lock, teardown ),
+    unit_test_setup_teardown( test_insert_and_lookup, setup_lock, teardown ),
+    unit_test_setup_teardown( test_insert_twice_overwrites_old_value, setup_no_lock, teardown ),
+    unit_test_setup_teardown( test_delete_entry, setup_no_lock, teardown ),
+    unit_test_setup_teardown( test_delete_entry, setup_lock, teardown ),
+    unit_test_setup_teardown( test_foreach_deleting_entries, setup_no_lock, teardown ),
+    unit_test( test_many_entries_grow_table ),
+    unit_test( test_reinserting_deleted_entries_does_not_grow_table ),
+    unit_test_setup_teardown( test_iterate_empty_hash, setup_no_lock, teardown ),
+  };
+  setup_leak_detector();
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
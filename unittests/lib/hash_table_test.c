@@ -21,6 +21,7 @@
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -247,6 +248,69 @@ test_iterate_empty_hash() {
 }
 
 
+#define MANY_ENTRIES 10000
+static uint32_t keys[ MANY_ENTRIES ];
+
+
+static void
+test_table_grows_and_shrinks_with_entries() {
+  table = create_small_hash( compare_uint32, hash_uint32 );
+  unsigned int initial_buckets = table->number_of_buckets;
+
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i++ ) {
+    keys[ i ] = i;
+    assert_true( insert_hash_entry( table, &keys[ i ], &keys[ i ] ) == NULL );
+    // Entries stay reachable while being moved to the new buckets.
+    assert_true( lookup_hash_entry( table, &keys[ i / 2 ] ) == &keys[ i / 2 ] );
+  }
+  assert_int_equal( table->length, MANY_ENTRIES );
+  assert_true( table->number_of_buckets >= MANY_ENTRIES / 2 );
+
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i++ ) {
+    assert_true( lookup_hash_entry( table, &keys[ i ] ) == &keys[ i ] );
+  }
+
+  for ( uint32_t i = 0; i < MANY_ENTRIES - 1; i++ ) {
+    assert_true( delete_hash_entry( table, &keys[ i ] ) == &keys[ i ] );
+  }
+  for ( uint32_t i = 0; i < 64; i++ ) {
+    lookup_hash_entry( table, &keys[ MANY_ENTRIES - 1 ] );
+  }
+  assert_int_equal( table->length, 1 );
+  assert_true( table->number_of_buckets < 64 );
+  assert_true( table->number_of_buckets >= initial_buckets );
+  assert_true( lookup_hash_entry( table, &keys[ MANY_ENTRIES - 1 ] ) == &keys[ MANY_ENTRIES - 1 ] );
+
+  delete_hash( table );
+}
+
+
+static void
+test_iterate_and_delete_while_resizing() {
+  table = create_small_hash( compare_uint32, hash_uint32 );
+
+  uint64_t expected = 0;
+  for ( uint32_t i = 0; i < 1000; i++ ) {
+    keys[ i ] = i;
+    insert_hash_entry( table, &keys[ i ], &keys[ i ] );
+    expected += i;
+  }
+
+  uint64_t sum = 0;
+  hash_iterator iter;
+  hash_entry *e;
+  init_hash_iterator( table, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    sum += *( uint32_t * ) e->value;
+    delete_hash_entry( table, e->key );
+  }
+  assert_true( sum == expected );
+  assert_int_equal( table->length, 0 );
+
+  delete_hash( table );
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -264,6 +328,8 @@ main() {
     unit_test( test_iterator ),
     unit_test( test_multiple_inserts_and_deletes_then_iterate ),
     unit_test( test_iterate_empty_hash ),
+    unit_test( test_table_grows_and_shrinks_with_entries ),
+    unit_test( test_iterate_and_delete_while_resizing ),
   };
   setup_leak_detector();
   return run_tests( tests );
@@ -0,0 +1,151 @@
+/*
+ * Unit tests for histogram.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdint.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "histogram.h"
+
+
+/********************************************************************************
+ * Test functions.
+ ********************************************************************************/
+
+static histogram *h;
+
+
+static void
+setup() {
+  h = create_histogram();
+}
+
+
+static void
+teardown() {
+  delete_histogram( h );
+}
+
+
+static void
+test_empty_histogram_returns_zero() {
+  assert_int_equal( h->n_values, 0 );
+  assert_int_equal( histogram_percentile( h, 50.0 ), 0 );
+  assert_int_equal( histogram_percentile( h, 99.9 ), 0 );
+}
+
+
+static void
+test_small_values_are_exact() {
+  for ( uint64_t i = 1; i <= 20; i++ ) {
+    record_histogram_value( h, i );
+  }
+
+  assert_int_equal( h->n_values, 20 );
+  assert_int_equal( h->min, 1 );
+  assert_int_equal( h->max, 20 );
+  assert_int_equal( histogram_percentile( h, 0.0 ), 1 );
+  assert_int_equal( histogram_percentile( h, 50.0 ), 10 );
+  assert_int_equal( histogram_percentile( h, 100.0 ), 20 );
+}
+
+
+static void
+test_percentiles_are_within_one_sixteenth() {
+  for ( uint64_t i = 1; i <= 100000; i++ ) {
+    record_histogram_value( h, i );
+  }
+
+  uint64_t expected[] = { 50000, 99000, 99900 };
+  uint64_t actual[] = { histogram_percentile( h, 50.0 ), histogram_percentile( h, 99.0 ), histogram_percentile( h, 99.9 ) };
+  for ( int i = 0; i < 3; i++ ) {
+    assert_true( actual[ i ] >= expected[ i ] );
+    assert_true( actual[ i ] <= expected[ i ] + expected[ i ] / 16 );
+  }
+  assert_int_equal( histogram_percentile( h, 100.0 ), 100000 );
+}
+
+
+static void
+test_large_values_are_clamped() {
+  record_histogram_value( h, UINT64_MAX );
+
+  assert_true( h->max == HISTOGRAM_MAX_VALUE );
+  assert_true( histogram_percentile( h, 50.0 ) == HISTOGRAM_MAX_VALUE );
+}
+
+
+static void
+count_bucket( uint64_t lower, uint64_t upper, uint64_t count, void *user_data ) {
+  assert_true( lower <= upper );
+  uint64_t *n_values = user_data;
+  *n_values += count;
+}
+
+
+static void
+test_foreach_bucket_visits_non_empty_buckets() {
+  uint64_t values[] = { 0, 31, 32, 33, 1000, 1001, 123456789, HISTOGRAM_MAX_VALUE };
+  for ( unsigned int i = 0; i < sizeof( values ) / sizeof( values[ 0 ] ); i++ ) {
+    record_histogram_value( h, values[ i ] );
+  }
+
+  uint64_t n_values = 0;
+  foreach_histogram_bucket( h, count_bucket, &n_values );
+  assert_int_equal( n_values, sizeof( values ) / sizeof( values[ 0 ] ) );
+}
+
+
+static void
+test_reset_histogram() {
+  record_histogram_value( h, 100 );
+  reset_histogram( h );
+  record_histogram_value( h, 200 );
+
+  assert_int_equal( h->n_values, 1 );
+  assert_int_equal( h->min, 200 );
+  assert_int_equal( h->max, 200 );
+}
+
+
+/********************************************************************************
+ * Run tests.
+ ********************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_empty_histogram_returns_zero, setup, teardown ),
+    unit_test_setup_teardown( test_small_values_are_exact, setup, teardown ),
+    unit_test_setup_teardown( test_percentiles_are_within_one_sixteenth, setup, teardown ),
+    unit_test_setup_teardown( test_large_values_are_clamped, setup, teardown ),
+    unit_test_setup_teardown( test_foreach_bucket_visits_non_empty_buckets, setup, teardown ),
+    unit_test_setup_teardown( test_reset_histogram, setup, teardown ),
+  };
+  setup_leak_detector();
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
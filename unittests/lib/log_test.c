@@ -18,9 +18,12 @@
  */
 
 
+#include <pthread.h>
+#include <semaphore.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 #include "checks.h"
 #include "cmockery_trema.h"
@@ -178,9 +181,28 @@ setup_logger_syslog() {
 }
 
 
+static void
+setup_logger_file_async() {
+  setup();
+  set_async_logging( true );
+  init_log( "log_test.c", get_trema_tmp(), LOGGING_TYPE_FILE );
+}
+
+
+// The leak detector does not track memory freed by other threads.
+static void
+setup_logger_file_async_without_leak_detector() {
+  setup();
+  teardown_leak_detector();
+  set_async_logging( true );
+  init_log( "log_test.c", get_trema_tmp(), LOGGING_TYPE_FILE );
+}
+
+
 static void
 teardown() {
   finalize_log();
+  set_async_logging( false );
   reset_LOGGING_LEVEL();
   reset_LOGGING_FACILITY();
 
@@ -534,6 +556,23 @@ test_debug_fail_if_NULL() {
 }
 
 
+static int evaluated_count;
+
+static int
+evaluate() {
+  return ++evaluated_count;
+}
+
+
+void
+test_DEBUG_does_not_evaluate_arguments_if_logging_level_is_INFO() {
+  evaluated_count = 0;
+  set_logging_level( "info" );
+  debug( "This message must not be logged ( %d ).", evaluate() );
+  assert_int_equal( evaluated_count, 0 );
+}
+
+
 /********************************************************************************
  * Output type tests.
  ********************************************************************************/
@@ -564,6 +603,88 @@ test_output_to_syslog() {
 }
 
 
+/********************************************************************************
+ * Asynchronous logging tests.
+ ********************************************************************************/
+
+static void
+read_log_file( char *content, size_t length ) {
+  char path[ 256 ];
+  snprintf( path, sizeof( path ), "%s/log_test.c.log", get_trema_tmp() );
+  FILE *log = fopen( path, "r" );
+  assert_true( log != NULL );
+  size_t read_length = fread( content, 1, length - 1, log );
+  content[ read_length ] = '\0';
+  fclose( log );
+}
+
+
+void
+test_async_logging_writes_messages_on_flush_log() {
+  char content[ 4096 ];
+
+  for ( int i = 0; i < 3; i++ ) {
+    info( "Hello World %d", i );
+  }
+  debug( "This message must not be logged." );
+  flush_log();
+
+  read_log_file( content, sizeof( content ) );
+  char *first = strstr( content, "[info] Hello World 0\n" );
+  assert_true( first != NULL );
+  char *second = strstr( first, "[info] Hello World 1\n" );
+  assert_true( second != NULL );
+  assert_true( strstr( second, "[info] Hello World 2\n" ) != NULL );
+  assert_true( strstr( content, "must not be logged" ) == NULL );
+}
+
+
+void
+test_async_logging_writes_errors_immediately() {
+  char content[ 4096 ];
+
+  error( "Something went wrong." );
+
+  read_log_file( content, sizeof( content ) );
+  assert_true( strstr( content, "[error] Something went wrong.\n" ) != NULL );
+}
+
+
+static sem_t logged;
+static sem_t finalized;
+
+
+static void *
+log_and_wait( void *data ) {
+  UNUSED( data );
+
+  info( "Logged from a thread." );
+  sem_post( &logged );
+  sem_wait( &finalized );
+
+  // Exits without logging again after finalize_log().
+  return NULL;
+}
+
+
+void
+test_thread_exiting_after_finalize_log_frees_its_ring() {
+  sem_init( &logged, 0, 0 );
+  sem_init( &finalized, 0, 0 );
+  pthread_t thread;
+  assert_int_equal( pthread_create( &thread, NULL, log_and_wait, NULL ), 0 );
+  sem_wait( &logged );
+
+  finalize_log();
+  set_async_logging( false );
+  sem_post( &finalized );
+  assert_int_equal( pthread_join( thread, NULL ), 0 );
+
+  sem_destroy( &logged );
+  sem_destroy( &finalized );
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -652,6 +773,8 @@ main() {
                               setup_logger_file, teardown ),
     unit_test_setup_teardown( test_debug_fail_if_NULL,
                               setup_logger_file, teardown ),
+    unit_test_setup_teardown( test_DEBUG_does_not_evaluate_arguments_if_logging_level_is_INFO,
+                              setup_logger_file, teardown ),
 
     unit_test_setup_teardown( test_output_to_stdout,
                               setup_logger_stdout, teardown ),
@@ -659,6 +782,13 @@ main() {
                               setup_logger_file_stdout, teardown ),
     unit_test_setup_teardown( test_output_to_syslog,
                               setup_logger_syslog, teardown ),
+
+    unit_test_setup_teardown( test_async_logging_writes_messages_on_flush_log,
+                              setup_logger_file_async, teardown ),
+    unit_test_setup_teardown( test_async_logging_writes_errors_immediately,
+                              setup_logger_file_async, teardown ),
+    unit_test_setup_teardown( test_thread_exiting_after_finalize_log_frees_its_ring,
+                              setup_logger_file_async_without_leak_detector, teardown ),
   };
   return run_tests( tests );
 }
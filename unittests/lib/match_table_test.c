@@ -19,6 +19,7 @@
 
 
 #include <net/ethernet.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,13 +33,6 @@
 #include "wrapper.h"
 
 
-typedef struct match_table {
-  hash_table *exact_table;
-  list_element *wildcards_table;
-  pthread_mutex_t *mutex;
-} match_table;
-
-
 extern match_table *_match_table_head;
 
 
@@ -974,6 +968,78 @@ test_delete_different_priority_wildcards_entry_fails() {
 }
 
 
+static void
+set_ip_wildcards_entry( struct ofp_match *match ) {
+  memset( match, 0, sizeof( struct ofp_match ) );
+  match->wildcards = OFPFW_ALL & ~OFPFW_DL_TYPE;
+  match->dl_type = ETHERTYPE_IP;
+}
+
+
+#define IP_MATCH_SERVICE_NAME "service-name-ip"
+
+
+static void
+test_lookup_wildcards_entry_prefers_first_inserted_of_same_priority() {
+  struct ofp_match alice;
+  set_alice_match_entry( &alice );
+  struct ofp_match ip_wildcards;
+  set_ip_wildcards_entry( &ip_wildcards );
+  assert_true( insert_match_entry( ip_wildcards, DEFAULT_PRIORITY, xstrdup( IP_MATCH_SERVICE_NAME ) ) );
+  struct ofp_match alice_wildcards;
+  set_alice_wildcards_entry( &alice_wildcards );
+  assert_true( insert_match_entry( alice_wildcards, DEFAULT_PRIORITY, xstrdup( ALICE_MATCH_SERVICE_NAME ) ) );
+
+  void *data = lookup_match_entry( alice );
+  assert_true( data != NULL );
+  assert_string_equal( ( char * ) data, IP_MATCH_SERVICE_NAME );
+
+  XFREE( delete_match_strict_entry( ip_wildcards, DEFAULT_PRIORITY ) );
+  data = lookup_match_entry( alice );
+  assert_true( data != NULL );
+  assert_string_equal( ( char * ) data, ALICE_MATCH_SERVICE_NAME );
+
+  XFREE( delete_match_strict_entry( alice_wildcards, DEFAULT_PRIORITY ) );
+  assert_true( lookup_match_entry( alice ) == NULL );
+}
+
+
+static void
+test_lookup_wildcards_entry_after_deleting_highest_priority_entry() {
+  struct ofp_match alice;
+  set_alice_match_entry( &alice );
+  struct ofp_match alice_wildcards;
+  set_alice_wildcards_entry( &alice_wildcards );
+  assert_true( insert_match_entry( alice_wildcards, LOW_PRIORITY, xstrdup( ALICE_MATCH_SERVICE_NAME ) ) );
+  assert_true( insert_match_entry( alice_wildcards, HIGH_PRIORITY, xstrdup( CAROL_MATCH_SERVICE_NAME ) ) );
+  struct ofp_match ip_wildcards;
+  set_ip_wildcards_entry( &ip_wildcards );
+  assert_true( insert_match_entry( ip_wildcards, DEFAULT_PRIORITY, xstrdup( IP_MATCH_SERVICE_NAME ) ) );
+  struct ofp_match bob;
+  set_bob_match_entry( &bob );
+
+  void *data = lookup_match_entry( alice );
+  assert_true( data != NULL );
+  assert_string_equal( ( char * ) data, CAROL_MATCH_SERVICE_NAME );
+  data = lookup_match_entry( bob );
+  assert_true( data != NULL );
+  assert_string_equal( ( char * ) data, IP_MATCH_SERVICE_NAME );
+
+  XFREE( delete_match_strict_entry( alice_wildcards, HIGH_PRIORITY ) );
+  data = lookup_match_entry( alice );
+  assert_true( data != NULL );
+  assert_string_equal( ( char * ) data, IP_MATCH_SERVICE_NAME );
+
+  XFREE( delete_match_strict_entry( ip_wildcards, DEFAULT_PRIORITY ) );
+  data = lookup_match_entry( alice );
+  assert_true( data != NULL );
+  assert_string_equal( ( char * ) data, ALICE_MATCH_SERVICE_NAME );
+  assert_true( lookup_match_entry( bob ) == NULL );
+
+  XFREE( delete_match_strict_entry( alice_wildcards, LOW_PRIORITY ) );
+}
+
+
 /*************************************************************************
  * foreach entry tests.
  *************************************************************************/
@@ -1432,6 +1498,115 @@ test_map_entry_if_match_set_nw_prefix() {
 }
 
 
+/*************************************************************************
+ * match table instance tests.
+ *************************************************************************/
+
+static char alice_service[] = ALICE_MATCH_SERVICE_NAME;
+static char ip_service[] = IP_MATCH_SERVICE_NAME;
+
+
+static void
+test_match_tables_are_independent() {
+  match_table *table0 = create_match_table();
+  match_table *table1 = create_match_table();
+
+  struct ofp_match alice;
+  set_alice_match_entry( &alice );
+  struct ofp_match alice_wildcards;
+  set_alice_wildcards_entry( &alice_wildcards );
+  struct ofp_match ip_wildcards;
+  set_ip_wildcards_entry( &ip_wildcards );
+  assert_true( insert_match_table_entry( table0, alice_wildcards, DEFAULT_PRIORITY, alice_service ) );
+  assert_true( insert_match_table_entry( table1, ip_wildcards, DEFAULT_PRIORITY, ip_service ) );
+
+  assert_string_equal( lookup_match_table_entry( table0, alice ), ALICE_MATCH_SERVICE_NAME );
+  assert_string_equal( lookup_match_table_entry( table1, alice ), IP_MATCH_SERVICE_NAME );
+
+  assert_true( delete_match_table_strict_entry( table0, alice_wildcards, DEFAULT_PRIORITY ) != NULL );
+  assert_true( lookup_match_table_entry( table0, alice ) == NULL );
+  assert_string_equal( lookup_match_table_entry( table1, alice ), IP_MATCH_SERVICE_NAME );
+
+  delete_match_table( table0 );
+  delete_match_table( table1 );
+}
+
+
+static void *
+lookup_repeatedly( void *table ) {
+  struct ofp_match alice;
+  set_alice_match_entry( &alice );
+
+  for ( int i = 0; i < 10000; i++ ) {
+    void *data = lookup_match_table_entry( table, alice );
+    if ( data != NULL && strcmp( data, ALICE_MATCH_SERVICE_NAME ) != 0 && strcmp( data, IP_MATCH_SERVICE_NAME ) != 0 ) {
+      return data;
+    }
+  }
+  return NULL;
+}
+
+
+static void
+test_lookup_match_table_entry_while_updating() {
+  match_table *table = create_match_table();
+  struct ofp_match ip_wildcards;
+  set_ip_wildcards_entry( &ip_wildcards );
+  assert_true( insert_match_table_entry( table, ip_wildcards, LOW_PRIORITY, ip_service ) );
+
+  pthread_t reader;
+  assert_int_equal( pthread_create( &reader, NULL, lookup_repeatedly, table ), 0 );
+
+  struct ofp_match alice_wildcards;
+  set_alice_wildcards_entry( &alice_wildcards );
+  for ( int i = 0; i < 200; i++ ) {
+    assert_true( insert_match_table_entry( table, alice_wildcards, HIGH_PRIORITY, alice_service ) );
+    assert_true( delete_match_table_strict_entry( table, alice_wildcards, HIGH_PRIORITY ) != NULL );
+  }
+
+  void *unexpected = ( void * ) 1;
+  assert_int_equal( pthread_join( reader, &unexpected ), 0 );
+  assert_true( unexpected == NULL );
+
+  delete_match_table( table );
+}
+
+
+#define MANY_ENTRIES 1000
+
+
+static void
+test_lookup_match_table_entry_after_many_updates() {
+  match_table *table = create_match_table();
+  static char data[ MANY_ENTRIES ];
+
+  struct ofp_match match;
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i++ ) {
+    set_alice_match_entry( &match );
+    match.nw_dst = i;
+    assert_true( insert_match_table_entry( table, match, DEFAULT_PRIORITY, &data[ i ] ) );
+    set_alice_wildcards_entry( &match );
+    match.nw_src = i;
+    assert_true( insert_match_table_entry( table, match, DEFAULT_PRIORITY, &data[ i ] ) );
+  }
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i += 2 ) {
+    set_alice_match_entry( &match );
+    match.nw_dst = i;
+    assert_true( delete_match_table_strict_entry( table, match, DEFAULT_PRIORITY ) == &data[ i ] );
+  }
+
+  for ( uint32_t i = 0; i < MANY_ENTRIES; i++ ) {
+    set_alice_match_entry( &match );
+    match.nw_dst = i;
+    assert_true( lookup_match_table_entry( table, match ) == ( i % 2 == 0 ? NULL : &data[ i ] ) );
+    match.nw_src = i;
+    assert_true( lookup_match_table_entry( table, match ) == &data[ i ] );
+  }
+
+  delete_match_table( table );
+}
+
+
 /*************************************************************************
  * Run tests.
  *************************************************************************/
@@ -1484,6 +1659,8 @@ main() {
     unit_test_setup_teardown( test_delete_nonexistent_wildcards_entry_fails, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_delete_of_deleted_wildcards_entry_fails, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_delete_different_priority_wildcards_entry_fails, setup_and_init, finalize_and_teardown ),
+    unit_test_setup_teardown( test_lookup_wildcards_entry_prefers_first_inserted_of_same_priority, setup_and_init, finalize_and_teardown ),
+    unit_test_setup_teardown( test_lookup_wildcards_entry_after_deleting_highest_priority_entry, setup_and_init, finalize_and_teardown ),
 
     // foreach tests.
     unit_test_setup_teardown( test_foreach_match_entry_dies_if_function_is_null, setup_and_init, finalize_and_teardown ),
@@ -1493,6 +1670,11 @@ main() {
     unit_test_setup_teardown( test_foreach_entry, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_map_entry_if_match_set_nw_src, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_map_entry_if_match_set_nw_prefix, setup_and_init, finalize_and_teardown ),
+
+    // match table instance tests.
+    unit_test_setup_teardown( test_match_tables_are_independent, setup, teardown ),
+    unit_test_setup_teardown( test_lookup_match_table_entry_after_many_updates, setup, teardown ),
+    unit_test_setup_teardown( test_lookup_match_table_entry_while_updating, setup, teardown ),
   };
 
   return run_tests( tests );
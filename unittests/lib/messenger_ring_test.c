@@ -0,0 +1,188 @@
+/*
+ * Unit tests for messenger ring.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "messenger_ring.h"
+
+
+#define RING_SIZE 256
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static messenger_ring *producer;
+static messenger_ring *consumer;
+
+
+static void
+setup() {
+  producer = create_messenger_ring( RING_SIZE );
+  assert_true( producer != NULL );
+  consumer = attach_messenger_ring( dup( producer->memory_fd ), dup( producer->data_event_fd ), dup( producer->space_event_fd ) );
+  assert_true( consumer != NULL );
+}
+
+
+static void
+teardown() {
+  delete_messenger_ring( consumer );
+  delete_messenger_ring( producer );
+}
+
+
+static bool
+put( uint16_t tag, size_t value_length ) {
+  size_t length = sizeof( message_header ) + value_length;
+  message_header *header = reserve_messenger_ring( producer, length );
+  if ( header == NULL ) {
+    return false;
+  }
+  header->version = 0;
+  header->message_type = 0;
+  header->tag = htons( tag );
+  header->message_length = htonl( ( uint32_t ) length );
+  memset( header->value, tag, value_length );
+  commit_messenger_ring( producer, length );
+
+  return true;
+}
+
+
+static void
+get( uint16_t tag, size_t value_length ) {
+  message_header *header = peek_messenger_ring( consumer );
+  assert_true( header != NULL );
+  assert_int_equal( ntohs( header->tag ), tag );
+  assert_int_equal( ntohl( header->message_length ), sizeof( message_header ) + value_length );
+  for ( size_t i = 0; i < value_length; i++ ) {
+    assert_int_equal( header->value[ i ], ( uint8_t ) tag );
+  }
+  consume_messenger_ring( consumer, header );
+}
+
+
+static bool
+signaled( int fd ) {
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  return poll( &pfd, 1, 0 ) == 1;
+}
+
+
+/*************************************************************************
+ * Tests.
+ *************************************************************************/
+
+static void
+test_messages_are_received_in_order() {
+  assert_true( peek_messenger_ring( consumer ) == NULL );
+
+  assert_true( put( 1, 10 ) );
+  assert_true( put( 2, 0 ) );
+  assert_true( put( 3, 20 ) );
+
+  get( 1, 10 );
+  get( 2, 0 );
+  get( 3, 20 );
+  assert_true( peek_messenger_ring( consumer ) == NULL );
+}
+
+
+static void
+test_message_is_not_split_at_end_of_ring() {
+  for ( uint16_t tag = 1; tag <= 20; tag++ ) {
+    assert_true( put( tag, 50 ) );
+    get( tag, 50 );
+  }
+}
+
+
+static void
+test_full_ring_notifies_producer_when_space_is_made() {
+  uint16_t tag = 0;
+  while ( put( ++tag, 50 ) ) {
+  }
+  assert_true( tag > 1 );
+  assert_false( signaled( producer->space_event_fd ) );
+
+  get( 1, 50 );
+  assert_true( signaled( producer->space_event_fd ) );
+  clear_messenger_ring_event( producer->space_event_fd );
+  assert_false( signaled( producer->space_event_fd ) );
+}
+
+
+static void
+test_waiting_consumer_is_notified() {
+  assert_true( put( 1, 0 ) );
+  assert_true( signaled( consumer->data_event_fd ) );
+  clear_messenger_ring_event( consumer->data_event_fd );
+  assert_true( put( 2, 0 ) );
+  assert_false( signaled( consumer->data_event_fd ) );
+
+  assert_false( wait_messenger_ring( consumer ) );
+  get( 1, 0 );
+  get( 2, 0 );
+  assert_true( wait_messenger_ring( consumer ) );
+
+  assert_true( put( 3, 0 ) );
+  assert_true( signaled( consumer->data_event_fd ) );
+  clear_messenger_ring_event( consumer->data_event_fd );
+  assert_true( put( 4, 0 ) );
+  assert_false( signaled( consumer->data_event_fd ) );
+}
+
+
+static void
+test_too_large_message_is_rejected() {
+  assert_true( reserve_messenger_ring( producer, RING_SIZE + 8 ) == NULL );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_messages_are_received_in_order, setup, teardown ),
+    unit_test_setup_teardown( test_message_is_not_split_at_end_of_ring, setup, teardown ),
+    unit_test_setup_teardown( test_full_ring_notifies_producer_when_space_is_made, setup, teardown ),
+    unit_test_setup_teardown( test_waiting_consumer_is_notified, setup, teardown ),
+    unit_test_setup_teardown( test_too_large_message_is_rejected, setup, teardown ),
+  };
+
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -235,6 +235,18 @@ mock_recv( int sockfd, void *buf, size_t len, int flags ) {
 }
 
 
+ssize_t
+mock_recvmsg( int sockfd, struct msghdr *msg, int flags ) {
+  return fail_mock_recv ? -1 : recvmsg( sockfd, msg, flags );
+}
+
+
+int
+mock_recvmmsg( int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout ) {
+  return fail_mock_recv ? -1 : recvmmsg( sockfd, msgvec, vlen, flags, timeout );
+}
+
+
 static bool fail_mock_send = false;
 ssize_t
 mock_send( int sockfd, const void *buf, size_t len, int flags ) {
@@ -242,6 +254,12 @@ mock_send( int sockfd, const void *buf, size_t len, int flags ) {
 }
 
 
+int
+mock_sendmmsg( int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags ) {
+  return fail_mock_send ? -1 : sendmmsg( sockfd, msgvec, vlen, flags );
+}
+
+
 int
 mock_setsockopt( int s, int level, int optname, const void *optval, socklen_t optlen ) {
   UNUSED( s );
@@ -416,6 +434,342 @@ test_send_then_message_received_callback_is_called() {
 }
 
 
+static void
+test_send_message_to_handle_then_message_received_callback_is_called() {
+  init_messenger( "/tmp" );
+
+  const char service_name[] = "Say HELLO";
+
+  messenger_service_id id = get_messenger_service_id( service_name );
+  assert_true( id != MESSENGER_INVALID_SERVICE_ID );
+  assert_int_equal( get_messenger_service_id( service_name ), id );
+  assert_string_equal( get_messenger_service_name( id ), service_name );
+  assert_true( get_messenger_service_name( MESSENGER_INVALID_SERVICE_ID ) == NULL );
+
+  expect_value( callback_hello, tag, 43556 );
+  expect_string( callback_hello, data, "HELLO" );
+  expect_value( callback_hello, len, 6 );
+
+  add_message_received_callback( service_name, callback_hello );
+  send_message_to_handle( id, 43556, "HELLO", strlen( "HELLO" ) + 1 );
+  start_messenger();
+  start_event_handler();
+
+  delete_message_received_callback( service_name, callback_hello );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+
+  finalize_messenger();
+}
+
+
+#define BURST_MESSAGE_COUNT 200
+#define BURST_MESSAGE_LENGTH 1000
+static int burst_received;
+static int burst_batches;
+
+
+static void
+callback_burst( uint16_t tag, void *data, size_t len ) {
+  assert_int_equal( tag, burst_received );
+  assert_int_equal( len, sizeof( int ) + BURST_MESSAGE_LENGTH );
+  assert_int_equal( *( int * ) data, burst_received );
+  for ( size_t i = 0; i < BURST_MESSAGE_LENGTH; i++ ) {
+    assert_int_equal( ( ( uint8_t * ) data )[ sizeof( int ) + i ], ( uint8_t ) ( ( size_t ) burst_received + i ) );
+  }
+
+  if ( ++burst_received == BURST_MESSAGE_COUNT ) {
+    stop_event_handler();
+    stop_messenger();
+  }
+}
+
+
+static void
+callback_burst_batch( const messenger_message *messages, size_t count ) {
+  assert_true( count > 0 );
+  burst_batches++;
+  for ( size_t i = 0; i < count; i++ ) {
+    callback_burst( messages[ i ].tag, messages[ i ].data, messages[ i ].len );
+  }
+}
+
+
+static void
+send_burst_then_receive_in_order( messenger_transport transport, bool batch_mode, bool batch_callback ) {
+  set_messenger_transport( transport );
+  set_messenger_batch_mode( batch_mode );
+  init_messenger( "/tmp" );
+  assert_int_equal( get_messenger_transport(), transport );
+  assert_true( get_messenger_batch_mode() == batch_mode );
+
+  const char service_name[] = "Burst";
+  uint8_t body[ BURST_MESSAGE_LENGTH ];
+
+  burst_received = 0;
+  burst_batches = 0;
+  if ( batch_callback ) {
+    add_message_batch_received_callback( service_name, callback_burst_batch );
+  }
+  else {
+    add_message_received_callback( service_name, callback_burst );
+  }
+  for ( int n = 0; n < BURST_MESSAGE_COUNT; n++ ) {
+    for ( size_t i = 0; i < sizeof( body ); i++ ) {
+      body[ i ] = ( uint8_t ) ( n + ( int ) i );
+    }
+    struct iovec iov[ 2 ] = { { &n, sizeof( int ) }, { body, sizeof( body ) } };
+    assert_true( send_message_iov( service_name, ( uint16_t ) n, iov, 2 ) );
+  }
+  start_messenger();
+  start_event_handler();
+
+  assert_int_equal( burst_received, BURST_MESSAGE_COUNT );
+
+  if ( batch_callback ) {
+    assert_true( burst_batches < BURST_MESSAGE_COUNT );
+    delete_message_batch_received_callback( service_name, callback_burst_batch );
+  }
+  else {
+    delete_message_received_callback( service_name, callback_burst );
+  }
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+
+  finalize_messenger();
+  set_messenger_transport( MESSENGER_TRANSPORT_DEFAULT );
+  set_messenger_batch_mode( false );
+}
+
+
+static void
+test_send_message_iov_then_burst_is_received_in_order() {
+  send_burst_then_receive_in_order( MESSENGER_TRANSPORT_SOCKET, false, false );
+}
+
+
+static void
+test_burst_over_shared_memory_is_received_in_order() {
+  send_burst_then_receive_in_order( MESSENGER_TRANSPORT_SHARED_MEMORY, false, false );
+}
+
+
+static void
+test_burst_in_batch_mode_is_received_in_order() {
+  send_burst_then_receive_in_order( MESSENGER_TRANSPORT_SOCKET, true, false );
+}
+
+
+static void
+test_burst_in_batch_mode_is_delivered_to_batch_callback() {
+  send_burst_then_receive_in_order( MESSENGER_TRANSPORT_SOCKET, true, true );
+}
+
+
+static void
+test_burst_over_shared_memory_is_delivered_to_batch_callback() {
+  send_burst_then_receive_in_order( MESSENGER_TRANSPORT_SHARED_MEMORY, false, true );
+}
+
+
+/********************************************************************************
+ * Queue length tests.
+ ********************************************************************************/
+
+static uint64_t queue_high_water;
+static uint64_t queue_overflow;
+static uint64_t queue_bytes;
+
+
+static void
+collect_queue_stat( const char *key, const uint64_t value, void *user_data ) {
+  const char *prefix = user_data;
+  if ( strncmp( key, prefix, strlen( prefix ) ) != 0 ) {
+    return;
+  }
+  const char *name = key + strlen( prefix );
+  if ( strcmp( name, "high_water" ) == 0 ) {
+    queue_high_water = value;
+  }
+  else if ( strcmp( name, "overflow" ) == 0 ) {
+    queue_overflow = value;
+  }
+  else if ( strcmp( name, "bytes" ) == 0 ) {
+    queue_bytes = value;
+  }
+}
+
+
+static int
+queue_messages_to_unreachable_service( int count ) {
+  const char service_name[] = "Unreachable";
+  uint8_t body[ BURST_MESSAGE_LENGTH ];
+  memset( body, 0, sizeof( body ) );
+
+  // The send queue waits for the service on a reconnect timer.
+  init_timer();
+  will_return( mock_clock_gettime, 0 );
+
+  int queued = 0;
+  for ( int n = 0; n < count; n++ ) {
+    if ( send_message( service_name, ( uint16_t ) n, body, sizeof( body ) ) ) {
+      queued++;
+    }
+  }
+
+  queue_high_water = queue_overflow = queue_bytes = 0;
+  foreach_messenger_queue_stat( collect_queue_stat, ( void * ) ( uintptr_t ) "messenger.send_queue.Unreachable." );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+  finalize_timer();
+
+  return queued;
+}
+
+
+static void
+test_set_messenger_queue_length_fails_if_length_is_too_short() {
+  assert_false( set_messenger_queue_length( MESSENGER_MIN_QUEUE_LENGTH - 1, 0 ) );
+  assert_false( set_messenger_queue_length( 0, MESSENGER_MIN_QUEUE_LENGTH - 1 ) );
+  assert_true( set_messenger_queue_length( MESSENGER_MIN_QUEUE_LENGTH, MESSENGER_MIN_QUEUE_LENGTH ) );
+
+  init_messenger( "/tmp" );
+  size_t send_queue_length, recv_queue_length;
+  get_messenger_queue_length( &send_queue_length, &recv_queue_length );
+  assert_int_equal( send_queue_length, MESSENGER_MIN_QUEUE_LENGTH );
+  assert_int_equal( recv_queue_length, MESSENGER_MIN_QUEUE_LENGTH );
+  finalize_messenger();
+
+  assert_true( set_messenger_queue_length( 0, 0 ) );
+}
+
+
+static void
+test_send_queue_overflows_at_default_length() {
+  init_messenger( "/tmp" );
+
+  int queued = queue_messages_to_unreachable_service( 1000 );
+
+  size_t message_length = BURST_MESSAGE_LENGTH + sizeof( message_header );
+  assert_int_equal( queued, MESSENGER_DEFAULT_SEND_QUEUE_LENGTH / message_length );
+  assert_int_equal( queue_overflow, 1000 - queued );
+  assert_true( queue_high_water <= MESSENGER_DEFAULT_SEND_QUEUE_LENGTH );
+  assert_true( queue_bytes == ( uint64_t ) queued * message_length );
+
+  finalize_messenger();
+}
+
+
+static void
+test_send_queue_grows_up_to_configured_length() {
+  assert_true( set_messenger_queue_length( 2 * 1024 * 1024, 0 ) );
+  init_messenger( "/tmp" );
+
+  int queued = queue_messages_to_unreachable_service( 1000 );
+
+  size_t message_length = BURST_MESSAGE_LENGTH + sizeof( message_header );
+  assert_int_equal( queued, 1000 );
+  assert_int_equal( queue_overflow, 0 );
+  assert_true( queue_high_water == 1000 * message_length );
+
+  finalize_messenger();
+  assert_true( set_messenger_queue_length( 0, 0 ) );
+}
+
+
+static void
+test_send_message_to_handle_fails_with_einval_if_id_is_invalid() {
+  init_messenger( "/tmp" );
+
+  errno = 0;
+  assert_false( send_message_to_handle( MESSENGER_INVALID_SERVICE_ID, 0, "HELLO", strlen( "HELLO" ) + 1 ) );
+  assert_int_equal( errno, EINVAL );
+
+  finalize_messenger();
+}
+
+
+static void
+test_released_service_id_is_reused() {
+  init_messenger( "/tmp" );
+
+  messenger_service_id id = get_messenger_service_id( "Service A" );
+  assert_int_equal( get_messenger_service_id( "Service A" ), id );
+  retain_messenger_service_id( id );
+
+  release_messenger_service_id( id );
+  release_messenger_service_id( id );
+  assert_string_equal( get_messenger_service_name( id ), "Service A" );
+
+  release_messenger_service_id( id );
+  assert_true( get_messenger_service_name( id ) == NULL );
+  errno = 0;
+  assert_false( send_message_to_handle( id, 0, "HELLO", strlen( "HELLO" ) + 1 ) );
+  assert_int_equal( errno, EINVAL );
+
+  assert_int_equal( get_messenger_service_id( "Service B" ), id );
+  assert_string_equal( get_messenger_service_name( id ), "Service B" );
+  assert_true( get_messenger_service_id( "Service A" ) != id );
+
+  finalize_messenger();
+}
+
+
+static void
+test_release_service_id_after_finalize_does_nothing() {
+  init_messenger( "/tmp" );
+  messenger_service_id id = get_messenger_service_id( "Service A" );
+  finalize_messenger();
+
+  release_messenger_service_id( id );
+  release_messenger_service_id( MESSENGER_INVALID_SERVICE_ID );
+}
+
+
+static void
+test_send_message_fails_with_enotconn_if_not_initialized() {
+  errno = 0;
+  assert_false( send_message( "Unreachable", 0, "HELLO", strlen( "HELLO" ) + 1 ) );
+  assert_int_equal( errno, ENOTCONN );
+}
+
+
+static void
+test_send_message_fails_with_emsgsize_if_message_is_longer_than_queue() {
+  init_messenger( "/tmp" );
+  init_timer();
+  will_return( mock_clock_gettime, 0 );
+
+  size_t length = MESSENGER_DEFAULT_SEND_QUEUE_LENGTH;
+  void *body = xcalloc( 1, length );
+  errno = 0;
+  assert_false( send_message( "Unreachable", 0, body, length ) );
+  assert_int_equal( errno, EMSGSIZE );
+  xfree( body );
+
+  delete_send_queue( lookup_hash_entry( send_queues, "Unreachable" ) );
+  finalize_timer();
+  finalize_messenger();
+}
+
+
+static void
+test_send_message_fails_with_eagain_if_queue_is_full() {
+  init_messenger( "/tmp" );
+  init_timer();
+  will_return( mock_clock_gettime, 0 );
+
+  size_t length = MESSENGER_DEFAULT_SEND_QUEUE_LENGTH / 2;
+  void *body = xcalloc( 1, length );
+  assert_true( send_message( "Unreachable", 0, body, length ) );
+  errno = 0;
+  assert_false( send_message( "Unreachable", 0, body, length ) );
+  assert_int_equal( errno, EAGAIN );
+  xfree( body );
+
+  delete_send_queue( lookup_hash_entry( send_queues, "Unreachable" ) );
+  finalize_timer();
+  finalize_messenger();
+}
+
+
 static void callback_req_hello( const messenger_context_handle *handle, uint16_t tag, void *data, size_t len ) {
   UNUSED( handle );
   check_expected( tag );
@@ -573,7 +927,44 @@ main() {
     unit_test_setup_teardown( test_send_then_message_received_callback_is_called,
                               reset_messenger,
                               reset_messenger ),
+unit_test_setup_teardown( test_send_message_to_handle_then_message_received_callback_is_called,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_send_message_iov_then_burst_is_received_in_order,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_burst_over_shared_memory_is_received_in_order,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_burst_in_batch_mode_is_received_in_order,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_burst_in_batch_mode_is_delivered_to_batch_callback,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_burst_over_shared_memory_is_delivered_to_batch_callback,
+                              reset_messenger,
+                              reset_messenger ),
     // Message request callback tests.
+    unit_test_setup_teardown( test_set_messenger_queue_length_fails_if_length_is_too_short,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_send_queue_overflows_at_default_length,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_send_queue_grows_up_to_configured_length,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_send_message_to_handle_fails_with_einval_if_id_is_invalid,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_released_service_id_is_reused,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_release_service_id_after_finalize_does_nothing,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_send_message_fails_with_enotconn_if_not_initialized,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_send_message_fails_with_emsgsize_if_message_is_longer_than_queue,
+                              reset_messenger, reset_messenger ),
+    unit_test_setup_teardown( test_send_message_fails_with_eagain_if_queue_is_full,
+                              reset_messenger, reset_messenger ),
+
     unit_test_setup_teardown( test_send_then_message_requested_and_replied_callback_is_called,
                               reset_messenger,
                               reset_messenger ),
@@ -25,7 +25,7 @@
 #include "bool.h"
 #include "checks.h"
 #include "cmockery_trema.h"
-#include "hash_table.h"
+#include "flat_hash_table.h"
 #include "linked_list.h"
 #include "log.h"
 #include "messenger.h"
@@ -42,7 +42,8 @@
 extern bool openflow_application_interface_initialized;
 extern openflow_event_handlers_t event_handlers;
 extern char service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
-extern hash_table *stats;
+extern flat_hash_table *stats;
+extern list_element *pending_flow_batches;
 
 extern void assert_if_not_initialized();
 extern void handle_error( const uint64_t datapath_id, buffer *data );
@@ -55,6 +56,7 @@ extern void handle_flow_removed( const uint64_t datapath_id, buffer *data );
 extern void handle_port_status( const uint64_t datapath_id, buffer *data );
 extern void handle_stats_reply( const uint64_t datapath_id, buffer *data );
 extern void handle_barrier_reply( const uint64_t datapath_id, buffer *data );
+extern void delete_pending_flow_batches( uint64_t datapath_id );
 extern void handle_queue_get_config_reply( const uint64_t datapath_id, buffer *data );
 extern void dump_buf( const buffer *data );
 extern void handle_switch_events( uint16_t type, void *data, size_t length );
@@ -62,6 +64,7 @@ extern void handle_openflow_message( void *data, size_t length );
 extern void handle_message( uint16_t type, void *data, size_t length );
 extern void insert_dpid( list_element **head, uint64_t *dpid );
 extern void handle_list_switches_reply( uint16_t message_type, void *data, size_t length, void *user_data );
+extern void clear_stat_counters( void );
 
 
 #define SWITCH_READY_HANDLER ( ( void * ) 0x00020001 )
@@ -92,6 +95,8 @@ extern void handle_list_switches_reply( uint16_t message_type, void *data, size_
 #define QUEUE_GET_CONFIG_REPLY_USER_DATA ( ( void * ) 0x000100b1 )
 #define LIST_SWITCHES_REPLY_HANDLER ( ( void * ) 0x0001000c )
 #define LIST_SWITCHES_REPLY_USER_DATA ( ( void * ) 0x000100c1 )
+#define SWITCH_CONGESTION_HANDLER ( ( void * ) 0x00020003 )
+#define SWITCH_CONGESTION_USER_DATA ( ( void * ) 0x00020031 )
 
 static const pid_t PID = 12345;
 static char SERVICE_NAME[] = "learning switch application 0";
@@ -108,7 +113,8 @@ static openflow_event_handlers_t NULL_EVENT_HANDLERS = { false, ( void * ) 0, (
                                                          ( void * ) 0, ( void * ) 0,
                                                          ( void * ) 0, ( void * ) 0,
                                                          ( void * ) 0, ( void * ) 0,
-                                                         ( void * ) 0 };
+                                                         ( void * ) 0,
+                                                         ( void * ) 0, ( void * ) 0 };
 static openflow_event_handlers_t EVENT_HANDLERS = {
   false, SWITCH_READY_HANDLER, SWITCH_READY_USER_DATA,
   SWITCH_DISCONNECTED_HANDLER, SWITCH_DISCONNECTED_USER_DATA,
@@ -123,7 +129,8 @@ static openflow_event_handlers_t EVENT_HANDLERS = {
   STATS_REPLY_HANDLER, STATS_REPLY_USER_DATA,
   BARRIER_REPLY_HANDLER, BARRIER_REPLY_USER_DATA,
   QUEUE_GET_CONFIG_REPLY_HANDLER, QUEUE_GET_CONFIG_REPLY_USER_DATA,
-  LIST_SWITCHES_REPLY_HANDLER
+  LIST_SWITCHES_REPLY_HANDLER,
+  SWITCH_CONGESTION_HANDLER, SWITCH_CONGESTION_USER_DATA
 };
 static uint64_t DATAPATH_ID = 0x0102030405060708ULL;
 static char REMOTE_SERVICE_NAME[] = "switch.0x102030405060708";
@@ -238,6 +245,48 @@ mock_delete_message_replied_callback( char *service_name,
 }
 
 
+// Service names are interned without allocation so that nothing leaks
+// across tests.
+#define MOCK_SERVICES_MAX 16
+static char mock_services[ MOCK_SERVICES_MAX ][ MESSENGER_SERVICE_NAME_LENGTH ];
+static messenger_service_id mock_n_services = 0;
+
+
+messenger_service_id
+mock_get_messenger_service_id( const char *service_name ) {
+  for ( messenger_service_id i = 0; i < mock_n_services; i++ ) {
+    if ( strcmp( mock_services[ i ], service_name ) == 0 ) {
+      return i + 1;
+    }
+  }
+  assert_true( mock_n_services < MOCK_SERVICES_MAX );
+  strncpy( mock_services[ mock_n_services ], service_name, MESSENGER_SERVICE_NAME_LENGTH - 1 );
+
+  return ++mock_n_services;
+}
+
+
+void
+mock_release_messenger_service_id( messenger_service_id id ) {
+  UNUSED( id );
+}
+
+
+const char *
+mock_get_messenger_service_name( messenger_service_id id ) {
+  if ( id == MESSENGER_INVALID_SERVICE_ID || id > mock_n_services ) {
+    return NULL;
+  }
+  return mock_services[ id - 1 ];
+}
+
+
+bool
+mock_send_message_to_handle( messenger_service_id id, uint16_t tag, void *data, size_t len ) {
+  return mock_send_message( ( char * ) ( uintptr_t ) mock_get_messenger_service_name( id ), tag, data, len );
+}
+
+
 bool
 mock_clear_send_queue( const char *service_name ) {
   check_expected( service_name );
@@ -260,6 +309,18 @@ mock_switch_disconnected_handler( uint64_t datapath_id, void *user_data ) {
 }
 
 
+static void
+mock_switch_congestion_handler( uint64_t datapath_id, bool congested, uint32_t queue_length, uint64_t queue_bytes, void *user_data ) {
+  uint32_t congested32 = congested;
+
+  check_expected( &datapath_id );
+  check_expected( congested32 );
+  check_expected( queue_length );
+  check_expected( &queue_bytes );
+  check_expected( user_data );
+}
+
+
 static void
 mock_error_handler( uint64_t datapath_id, uint32_t transaction_id, uint16_t type, uint16_t code,
                     const buffer *data, void *user_data ) {
@@ -417,6 +478,14 @@ mock_barrier_reply_handler( uint64_t datapath_id, uint32_t transaction_id, void
 }
 
 
+static void
+mock_flow_batch_completed_handler( uint64_t datapath_id, uint32_t transaction_id, void *user_data ) {
+  check_expected( &datapath_id );
+  check_expected( transaction_id );
+  check_expected( user_data );
+}
+
+
 static void
 mock_queue_get_config_reply_handler( uint64_t datapath_id, uint32_t transaction_id,
                                      uint16_t port, const list_element *queues, void *user_data ) {
@@ -510,8 +579,9 @@ cleanup() {
   memset( service_name, 0, sizeof( service_name ) );
   memset( &event_handlers, 0, sizeof( event_handlers ) );
   memset( USER_DATA, 'Z', sizeof( USER_DATA ) );
+  clear_stat_counters();
   if ( stats != NULL ) {
-    delete_hash( stats );
+    delete_flat_hash( stats );
     stats = NULL;
   }
 }
@@ -729,11 +799,11 @@ test_handle_switch_ready() {
   set_switch_ready_handler( mock_switch_ready_handler, user_data );
   handle_message( MESSENGER_OPENFLOW_READY, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" ) );
 }
 
 
@@ -750,11 +820,11 @@ test_handle_switch_ready_with_simple_handler() {
   set_switch_ready_handler( mock_simple_switch_ready_handler, user_data );
   handle_message( MESSENGER_OPENFLOW_READY, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_ready_receive_succeeded" ) );
 }
 
 
@@ -778,6 +848,26 @@ test_set_switch_disconnected_handler_if_handler_is_NULL() {
 }
 
 
+/********************************************************************************
+ * set_switch_congestion_handler() tests.
+ ********************************************************************************/
+
+static void
+test_set_switch_congestion_handler() {
+  assert_true( set_switch_congestion_handler( SWITCH_CONGESTION_HANDLER, SWITCH_CONGESTION_USER_DATA ) );
+  assert_int_equal( event_handlers.switch_congestion_callback, SWITCH_CONGESTION_HANDLER );
+  assert_int_equal( event_handlers.switch_congestion_user_data, SWITCH_CONGESTION_USER_DATA );
+}
+
+
+static void
+test_set_switch_congestion_handler_if_handler_is_NULL() {
+  expect_string( mock_die, format, "Callback function ( switch_congestion_handler ) must not be NULL." );
+  expect_assert_failure( set_switch_congestion_handler( NULL, NULL ) );
+  assert_memory_equal( &event_handlers, &NULL_EVENT_HANDLERS, sizeof( event_handlers ) );
+}
+
+
 /********************************************************************************
  * set_error_handler() tests.
  ********************************************************************************/
@@ -1313,12 +1403,12 @@ test_send_openflow_message() {
   ret = send_openflow_message( DATAPATH_ID, buffer );
 
   assert_true( ret );
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( buffer );
   xfree( expected_data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" ) );
 }
 
 
@@ -1342,6 +1432,229 @@ test_send_openflow_message_if_message_length_is_zero() {
 }
 
 
+/********************************************************************************
+ * Flow batch tests.
+ ********************************************************************************/
+
+static void
+test_commit_flow_batch_sends_flow_mods_and_barrier_at_once() {
+  struct ofp_match match;
+  memset( &match, 0, sizeof( match ) );
+  match.wildcards = OFPFW_ALL;
+  buffer *flow_mod = create_flow_mod( TRANSACTION_ID, match, 0, OFPFC_ADD, 0, 0, 0, UINT32_MAX, OFPP_NONE, 0, NULL );
+
+  size_t header_length = sizeof( openflow_service_header_t ) + strlen( SERVICE_NAME ) + 1;
+  size_t expected_length = header_length + flow_mod->length * 2 + sizeof( struct ofp_header );
+  char *expected_data = xcalloc( 1, expected_length );
+  openflow_service_header_t *header = ( openflow_service_header_t * ) expected_data;
+  header->datapath_id = htonll( DATAPATH_ID );
+  header->service_name_length = htons( ( uint16_t ) ( strlen( SERVICE_NAME ) + 1 ) );
+  memcpy( expected_data + sizeof( openflow_service_header_t ), SERVICE_NAME, strlen( SERVICE_NAME ) + 1 );
+  memcpy( expected_data + header_length, flow_mod->data, flow_mod->length );
+  memcpy( expected_data + header_length + flow_mod->length, flow_mod->data, flow_mod->length );
+
+  uint32_t barrier_transaction_id = get_transaction_id() + 1;
+
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, expected_length );
+  expect_memory( mock_send_message, data, expected_data, header_length + flow_mod->length * 2 );
+  will_return( mock_send_message, true );
+
+  flow_batch *batch = begin_flow_batch( DATAPATH_ID );
+  assert_true( add_flow_to_batch( batch, flow_mod ) );
+  assert_true( add_flow_to_batch( batch, flow_mod ) );
+  assert_true( commit_flow_batch( batch, mock_flow_batch_completed_handler, USER_DATA ) );
+
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.flow_mod_send_succeeded" );
+  assert_int_equal( ( int ) stat->value, 2 );
+
+  // The barrier reply goes to the completion callback only.
+  set_barrier_reply_handler( mock_barrier_reply_handler, USER_DATA );
+  expect_memory( mock_flow_batch_completed_handler, &datapath_id, &DATAPATH_ID, sizeof( uint64_t ) );
+  expect_value( mock_flow_batch_completed_handler, transaction_id, barrier_transaction_id );
+  expect_memory( mock_flow_batch_completed_handler, user_data, USER_DATA, USER_DATA_LEN );
+  buffer *barrier_reply = create_barrier_reply( barrier_transaction_id );
+  handle_barrier_reply( DATAPATH_ID, barrier_reply );
+  assert_true( pending_flow_batches == NULL );
+
+  free_buffer( barrier_reply );
+  free_buffer( flow_mod );
+  xfree( expected_data );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.flow_mod_send_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.barrier_request_send_succeeded" ) );
+}
+
+
+static void
+test_commit_flow_batch_without_callback_sends_no_barrier() {
+  buffer *hello = create_hello( TRANSACTION_ID );
+  size_t expected_length = sizeof( openflow_service_header_t ) + strlen( SERVICE_NAME ) + 1 + hello->length;
+
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, expected_length );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, true );
+
+  flow_batch *batch = begin_flow_batch( DATAPATH_ID );
+  assert_true( add_flow_to_batch( batch, hello ) );
+  assert_true( commit_flow_batch( batch, NULL, NULL ) );
+  assert_true( pending_flow_batches == NULL );
+
+  free_buffer( hello );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" ) );
+}
+
+
+static void
+test_commit_empty_flow_batch_sends_nothing() {
+  flow_batch *batch = begin_flow_batch( DATAPATH_ID );
+  assert_true( commit_flow_batch( batch, NULL, NULL ) );
+}
+
+
+static buffer *
+create_long_hello( size_t length ) {
+  buffer *hello = create_hello( TRANSACTION_ID );
+  append_back_buffer( hello, length - hello->length );
+  ( ( struct ofp_header * ) hello->data )->length = htons( ( uint16_t ) length );
+
+  return hello;
+}
+
+
+static void
+test_add_flow_to_batch_keeps_messages_if_flush_fails() {
+  buffer *hello = create_long_hello( 40000 );
+  size_t header_length = sizeof( openflow_service_header_t ) + strlen( SERVICE_NAME ) + 1;
+
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, header_length + hello->length );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, false );
+
+  flow_batch *batch = begin_flow_batch( DATAPATH_ID );
+  assert_true( add_flow_to_batch( batch, hello ) );
+  assert_false( add_flow_to_batch( batch, hello ) );
+
+  // The first message is sent on commit, the refused one is not.
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, header_length + hello->length );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, true );
+
+  assert_true( commit_flow_batch( batch, NULL, NULL ) );
+
+  // The failed attempt is not counted.
+  assert_true( lookup_flat_hash_entry( stats, "openflow_application_interface.hello_send_failed" ) == NULL );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" );
+  assert_int_equal( ( int ) stat->value, 1 );
+
+  free_buffer( hello );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" ) );
+}
+
+
+static void
+test_commit_flow_batch_keeps_batch_if_send_fails() {
+  buffer *hello = create_hello( TRANSACTION_ID );
+  size_t header_length = sizeof( openflow_service_header_t ) + strlen( SERVICE_NAME ) + 1;
+  size_t expected_length = header_length + hello->length + sizeof( struct ofp_header );
+
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, expected_length );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, false );
+
+  flow_batch *batch = begin_flow_batch( DATAPATH_ID );
+  assert_true( add_flow_to_batch( batch, hello ) );
+  assert_false( commit_flow_batch( batch, mock_flow_batch_completed_handler, USER_DATA ) );
+  assert_true( pending_flow_batches == NULL );
+
+  // A retry sends the same messages with a single barrier request.
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, expected_length );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, true );
+
+  assert_true( commit_flow_batch( batch, mock_flow_batch_completed_handler, USER_DATA ) );
+  assert_true( pending_flow_batches != NULL );
+  delete_pending_flow_batches( DATAPATH_ID );
+  assert_true( pending_flow_batches == NULL );
+
+  assert_true( lookup_flat_hash_entry( stats, "openflow_application_interface.hello_send_failed" ) == NULL );
+  assert_true( lookup_flat_hash_entry( stats, "openflow_application_interface.barrier_request_send_failed" ) == NULL );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" );
+  assert_int_equal( ( int ) stat->value, 1 );
+
+  free_buffer( hello );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.barrier_request_send_succeeded" ) );
+}
+
+
+static void
+test_commit_flow_batch_drops_only_barrier_if_batch_was_flushed_for_it() {
+  size_t header_length = sizeof( openflow_service_header_t ) + strlen( SERVICE_NAME ) + 1;
+  // Leaves too little room for a barrier request.
+  buffer *hello = create_long_hello( 65536 - header_length - 4 );
+
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, header_length + hello->length );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, true );
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, header_length + sizeof( struct ofp_header ) );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, false );
+
+  flow_batch *batch = begin_flow_batch( DATAPATH_ID );
+  assert_true( add_flow_to_batch( batch, hello ) );
+  assert_false( commit_flow_batch( batch, mock_flow_batch_completed_handler, USER_DATA ) );
+  assert_true( pending_flow_batches == NULL );
+
+  // Only a new barrier request is sent on retry.
+  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGES );
+  expect_value( mock_send_message, len, header_length + sizeof( struct ofp_header ) );
+  expect_any( mock_send_message, data );
+  will_return( mock_send_message, true );
+
+  assert_true( commit_flow_batch( batch, mock_flow_batch_completed_handler, USER_DATA ) );
+  delete_pending_flow_batches( DATAPATH_ID );
+
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.barrier_request_send_succeeded" );
+  assert_int_equal( ( int ) stat->value, 1 );
+
+  free_buffer( hello );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.hello_send_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.barrier_request_send_succeeded" ) );
+}
+
+
+static void
+test_discard_flow_batch_sends_nothing() {
+  buffer *hello = create_hello( TRANSACTION_ID );
+
+  flow_batch *batch = begin_flow_batch( DATAPATH_ID );
+  assert_true( add_flow_to_batch( batch, hello ) );
+  discard_flow_batch( batch );
+
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.hello_send_failed" );
+  assert_int_equal( ( int ) stat->value, 1 );
+
+  free_buffer( hello );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.hello_send_failed" ) );
+}
+
+
 /********************************************************************************
  * handle_error() tests.
  ********************************************************************************/
@@ -2773,11 +3086,11 @@ test_handle_switch_events_if_type_is_MESSENGER_OPENFLOW_CONNECTED() {
 
   handle_switch_events( MESSENGER_OPENFLOW_CONNECTED, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" ) );
 }
 
 
@@ -2800,11 +3113,11 @@ test_handle_switch_events_if_type_is_MESSENGER_OPENFLOW_DISCONNECTED() {
   set_switch_disconnected_handler( mock_switch_disconnected_handler, SWITCH_DISCONNECTED_USER_DATA );
   handle_switch_events( MESSENGER_OPENFLOW_DISCONNECTED, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" ) );
 }
 
 
@@ -2849,11 +3162,11 @@ test_handle_switch_events_if_unhandled_message_type() {
   // FIXME
   handle_switch_events( MESSENGER_OPENFLOW_MESSAGE, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" ) );
 }
 
 
@@ -2891,12 +3204,12 @@ test_handle_openflow_message() {
     set_error_handler( mock_error_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.error_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.error_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( data );
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.error_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.error_receive_succeeded" ) );
   }
 
   // vendor
@@ -2921,12 +3234,12 @@ test_handle_openflow_message() {
     set_vendor_handler( mock_vendor_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.vendor_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.vendor_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( data );
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.vendor_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.vendor_receive_succeeded" ) );
   }
 
   // features_reply
@@ -2985,14 +3298,14 @@ test_handle_openflow_message() {
     set_features_reply_handler( mock_features_reply_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.features_reply_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.features_reply_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     xfree( phy_port[ 0 ] );
     xfree( phy_port[ 1 ] );
     delete_list( ports );
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.features_reply_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.features_reply_receive_succeeded" ) );
   }
 
   // get_config_reply
@@ -3014,11 +3327,11 @@ test_handle_openflow_message() {
     set_get_config_reply_handler( mock_get_config_reply_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.get_config_reply_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.get_config_reply_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.get_config_reply_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.get_config_reply_receive_succeeded" ) );
   }
 
   // packet_in
@@ -3055,12 +3368,12 @@ test_handle_openflow_message() {
     set_packet_in_handler( mock_packet_in_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.packet_in_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.packet_in_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( data );
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.packet_in_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.packet_in_receive_succeeded" ) );
   }
 
   // flow_removed
@@ -3097,11 +3410,11 @@ test_handle_openflow_message() {
     set_flow_removed_handler( mock_flow_removed_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.flow_removed_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.flow_removed_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.flow_removed_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.flow_removed_receive_succeeded" ) );
   }
 
   // port_status
@@ -3134,11 +3447,11 @@ test_handle_openflow_message() {
     set_port_status_handler( mock_port_status_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.port_status_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.port_status_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.port_status_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.port_status_receive_succeeded" ) );
   }
 
   // stats_reply
@@ -3187,11 +3500,11 @@ test_handle_openflow_message() {
     set_stats_reply_handler( mock_stats_reply_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.stats_reply_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.stats_reply_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.stats_reply_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.stats_reply_receive_succeeded" ) );
   }
 
   // barrier_reply
@@ -3209,11 +3522,11 @@ test_handle_openflow_message() {
     set_barrier_reply_handler( mock_barrier_reply_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" ) );
   }
 
   // queue_get_config_reply
@@ -3260,14 +3573,14 @@ test_handle_openflow_message() {
     set_queue_get_config_reply_handler( mock_queue_get_config_reply_handler, USER_DATA );
     handle_openflow_message( buffer->data, buffer->length );
 
-    stat = lookup_hash_entry( stats, "openflow_application_interface.queue_get_config_reply_receive_succeeded" );
+    stat = lookup_flat_hash_entry( stats, "openflow_application_interface.queue_get_config_reply_receive_succeeded" );
     assert_int_equal( ( int ) stat->value, 1 );
 
     xfree( queue[ 0 ] );
     xfree( queue[ 1 ] );
     delete_list( queues );
     free_buffer( buffer );
-    xfree( delete_hash_entry( stats, "openflow_application_interface.queue_get_config_reply_receive_succeeded" ) );
+    xfree( delete_flat_hash_entry( stats, "openflow_application_interface.queue_get_config_reply_receive_succeeded" ) );
   }
 
   // unhandled message
@@ -3367,12 +3680,12 @@ test_handle_message_if_type_is_MESSENGER_OPENFLOW_MESSAGE() {
   set_barrier_reply_handler( mock_barrier_reply_handler, BARRIER_REPLY_USER_DATA );
   handle_message( MESSENGER_OPENFLOW_MESSAGE, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.barrier_reply_receive_succeeded" ) );
 }
 
 
@@ -3383,11 +3696,11 @@ test_handle_message_if_type_is_MESSENGER_OPENFLOW_CONNECTED() {
 
   handle_message( MESSENGER_OPENFLOW_CONNECTED, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_connected_receive_succeeded" ) );
 }
 
 
@@ -3410,11 +3723,64 @@ test_handle_message_if_type_is_MESSENGER_OPENFLOW_DISCONNECTED() {
   set_switch_disconnected_handler( mock_switch_disconnected_handler, SWITCH_DISCONNECTED_USER_DATA );
   handle_message( MESSENGER_OPENFLOW_DISCONNECTED, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_disconnected_receive_succeeded" ) );
+}
+
+
+static void
+test_handle_message_if_type_is_MESSENGER_OPENFLOW_CONGESTED() {
+  uint64_t queue_bytes = 0x123456789ULL;
+  buffer *data = alloc_buffer_with_length( sizeof( openflow_service_header_t ) + sizeof( openflow_send_queue_status_t ) );
+  openflow_service_header_t *header = append_back_buffer( data, sizeof( openflow_service_header_t ) );
+  header->datapath_id = htonll( DATAPATH_ID );
+  header->service_name_length = 0;
+  openflow_send_queue_status_t *status = append_back_buffer( data, sizeof( openflow_send_queue_status_t ) );
+  status->queue_length = htonl( 1234 );
+  status->queue_bytes = htonll( queue_bytes );
+
+  expect_memory( mock_switch_congestion_handler, &datapath_id, &DATAPATH_ID, sizeof( uint64_t ) );
+  expect_value( mock_switch_congestion_handler, congested32, true );
+  expect_value( mock_switch_congestion_handler, queue_length, 1234 );
+  expect_memory( mock_switch_congestion_handler, &queue_bytes, &queue_bytes, sizeof( uint64_t ) );
+  expect_value( mock_switch_congestion_handler, user_data, SWITCH_CONGESTION_USER_DATA );
+
+  set_switch_congestion_handler( mock_switch_congestion_handler, SWITCH_CONGESTION_USER_DATA );
+  handle_message( MESSENGER_OPENFLOW_CONGESTED, data->data, data->length );
+
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.switch_congested_receive_succeeded" );
+  assert_int_equal( ( int ) stat->value, 1 );
+
+  free_buffer( data );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_congested_receive_succeeded" ) );
+}
+
+
+static void
+test_handle_message_if_type_is_MESSENGER_OPENFLOW_UNCONGESTED() {
+  uint64_t queue_bytes = 0;
+  buffer *data = alloc_buffer_with_length( sizeof( openflow_service_header_t ) + sizeof( openflow_send_queue_status_t ) );
+  openflow_service_header_t *header = append_back_buffer( data, sizeof( openflow_service_header_t ) );
+  header->datapath_id = htonll( DATAPATH_ID );
+  header->service_name_length = 0;
+  openflow_send_queue_status_t *status = append_back_buffer( data, sizeof( openflow_send_queue_status_t ) );
+  status->queue_length = 0;
+  status->queue_bytes = 0;
+
+  expect_memory( mock_switch_congestion_handler, &datapath_id, &DATAPATH_ID, sizeof( uint64_t ) );
+  expect_value( mock_switch_congestion_handler, congested32, false );
+  expect_value( mock_switch_congestion_handler, queue_length, 0 );
+  expect_memory( mock_switch_congestion_handler, &queue_bytes, &queue_bytes, sizeof( uint64_t ) );
+  expect_value( mock_switch_congestion_handler, user_data, SWITCH_CONGESTION_USER_DATA );
+
+  set_switch_congestion_handler( mock_switch_congestion_handler, SWITCH_CONGESTION_USER_DATA );
+  handle_message( MESSENGER_OPENFLOW_UNCONGESTED, data->data, data->length );
+
+  free_buffer( data );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.switch_uncongested_receive_succeeded" ) );
 }
 
 
@@ -3446,11 +3812,11 @@ test_handle_message_if_unhandled_message_type() {
   // FIXME
   handle_message( MESSENGER_OPENFLOW_DISCONNECTED + 1, data->data, data->length );
 
-  stat_entry *stat = lookup_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" );
+  stat_entry *stat = lookup_flat_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" );
   assert_int_equal( ( int ) stat->value, 1 );
 
   free_buffer( data );
-  xfree( delete_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" ) );
+  xfree( delete_flat_hash_entry( stats, "openflow_application_interface.undefined_switch_event_receive_succeeded" ) );
 }
 
 
@@ -3550,6 +3916,10 @@ main() {
     unit_test_setup_teardown( test_set_switch_disconnected_handler, init, cleanup ),
     unit_test_setup_teardown( test_set_switch_disconnected_handler_if_handler_is_NULL, init, cleanup ),
 
+    // switch congestion handler tests.
+    unit_test_setup_teardown( test_set_switch_congestion_handler, init, cleanup ),
+    unit_test_setup_teardown( test_set_switch_congestion_handler_if_handler_is_NULL, init, cleanup ),
+
     // error handler tests.
     unit_test_setup_teardown( test_set_error_handler, init, cleanup ),
     unit_test_setup_teardown( test_set_error_handler_if_handler_is_NULL, init, cleanup ),
@@ -3684,6 +4054,8 @@ main() {
     unit_test_setup_teardown( test_handle_message_if_type_is_MESSENGER_OPENFLOW_MESSAGE, init, cleanup ),
     unit_test_setup_teardown( test_handle_message_if_type_is_MESSENGER_OPENFLOW_CONNECTED, init, cleanup ),
     unit_test_setup_teardown( test_handle_message_if_type_is_MESSENGER_OPENFLOW_DISCONNECTED, init, cleanup ),
+    unit_test_setup_teardown( test_handle_message_if_type_is_MESSENGER_OPENFLOW_CONGESTED, init, cleanup ),
+    unit_test_setup_teardown( test_handle_message_if_type_is_MESSENGER_OPENFLOW_UNCONGESTED, init, cleanup ),
     unit_test_setup_teardown( test_handle_message_if_message_is_NULL, init, cleanup ),
     unit_test_setup_teardown( test_handle_message_if_message_length_is_zero, init, cleanup ),
     unit_test_setup_teardown( test_handle_message_if_unhandled_message_type, init, cleanup ),
@@ -3693,6 +4065,15 @@ main() {
     unit_test_setup_teardown( test_send_openflow_message_if_message_is_NULL, init, cleanup ),
     unit_test_setup_teardown( test_send_openflow_message_if_message_length_is_zero, init, cleanup ),
 
+    // Flow batch tests.
+    unit_test_setup_teardown( test_commit_flow_batch_sends_flow_mods_and_barrier_at_once, init, cleanup ),
+    unit_test_setup_teardown( test_commit_flow_batch_without_callback_sends_no_barrier, init, cleanup ),
+    unit_test_setup_teardown( test_commit_empty_flow_batch_sends_nothing, init, cleanup ),
+    unit_test_setup_teardown( test_add_flow_to_batch_keeps_messages_if_flush_fails, init, cleanup ),
+    unit_test_setup_teardown( test_commit_flow_batch_keeps_batch_if_send_fails, init, cleanup ),
+    unit_test_setup_teardown( test_commit_flow_batch_drops_only_barrier_if_batch_was_flushed_for_it, init, cleanup ),
+    unit_test_setup_teardown( test_discard_flow_batch_sends_nothing, init, cleanup ),
+
     // delete_openflow_messages() tests.
     unit_test_setup_teardown( test_delete_openflow_messages, init, cleanup ),
     unit_test_setup_teardown( test_delete_openflow_messages_if_clear_send_queue_fails, init, cleanup ),
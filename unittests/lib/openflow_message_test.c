@@ -1459,6 +1459,112 @@ test_create_flow_mod() {
 }
 
 
+/********************************************************************************
+ * Packed actions tests.
+ ********************************************************************************/
+
+static void
+append_all_actions( openflow_actions *actions, buffer *packed_actions, const buffer *vendor_body ) {
+  uint8_t hw_addr[ OFP_ETH_ALEN ] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+
+  append_action_output( actions, 1, 128 );
+  append_action_set_vlan_vid( actions, 0x0123 );
+  append_action_set_vlan_pcp( actions, 5 );
+  append_action_strip_vlan( actions );
+  append_action_set_dl_src( actions, hw_addr );
+  append_action_set_dl_dst( actions, hw_addr );
+  append_action_set_nw_src( actions, 0x0a000001 );
+  append_action_set_nw_dst( actions, 0x0a000002 );
+  append_action_set_nw_tos( actions, 0xb8 );
+  append_action_set_tp_src( actions, 1024 );
+  append_action_set_tp_dst( actions, 80 );
+  append_action_enqueue( actions, 2, 7 );
+  append_action_vendor( actions, VENDOR_ID, vendor_body );
+
+  append_packed_action_output( packed_actions, 1, 128 );
+  append_packed_action_set_vlan_vid( packed_actions, 0x0123 );
+  append_packed_action_set_vlan_pcp( packed_actions, 5 );
+  append_packed_action_strip_vlan( packed_actions );
+  append_packed_action_set_dl_src( packed_actions, hw_addr );
+  append_packed_action_set_dl_dst( packed_actions, hw_addr );
+  append_packed_action_set_nw_src( packed_actions, 0x0a000001 );
+  append_packed_action_set_nw_dst( packed_actions, 0x0a000002 );
+  append_packed_action_set_nw_tos( packed_actions, 0xb8 );
+  append_packed_action_set_tp_src( packed_actions, 1024 );
+  append_packed_action_set_tp_dst( packed_actions, 80 );
+  append_packed_action_enqueue( packed_actions, 2, 7 );
+  append_packed_action_vendor( packed_actions, VENDOR_ID, vendor_body );
+}
+
+
+static void
+test_create_flow_mod_with_packed_actions() {
+  openflow_actions *actions = create_actions();
+  buffer *packed_actions = create_packed_actions();
+  buffer *vendor_body = create_dummy_data( 16 );
+  append_all_actions( actions, packed_actions, vendor_body );
+
+  assert_int_equal( ( int ) packed_actions->length, get_actions_length( actions ) );
+
+  buffer *expected = create_flow_mod( MY_TRANSACTION_ID, MATCH, 10, OFPFC_ADD, 5, 10, PRIORITY,
+                                      BUFFER_ID, OFPP_NONE, OFPFF_SEND_FLOW_REM, actions );
+  buffer *flow_mod = create_flow_mod_with_packed_actions( MY_TRANSACTION_ID, MATCH, 10, OFPFC_ADD, 5, 10, PRIORITY,
+                                                          BUFFER_ID, OFPP_NONE, OFPFF_SEND_FLOW_REM, packed_actions );
+  assert_int_equal( ( int ) flow_mod->length, ( int ) expected->length );
+  assert_memory_equal( flow_mod->data, expected->data, expected->length );
+
+  free_buffer( flow_mod );
+  free_buffer( expected );
+  free_buffer( vendor_body );
+  free_buffer( packed_actions );
+  delete_actions( actions );
+}
+
+
+static void
+test_create_packet_out_with_packed_actions() {
+  openflow_actions *actions = create_actions();
+  buffer *packed_actions = create_packed_actions();
+  buffer *vendor_body = create_dummy_data( 16 );
+  append_all_actions( actions, packed_actions, vendor_body );
+  buffer *data = create_dummy_data( LONG_DATA_LENGTH );
+
+  buffer *expected = create_packet_out( MY_TRANSACTION_ID, UINT32_MAX, 2, actions, data );
+  buffer *packet_out = create_packet_out_with_packed_actions( MY_TRANSACTION_ID, UINT32_MAX, 2, packed_actions, data );
+  assert_int_equal( ( int ) packet_out->length, ( int ) expected->length );
+  assert_memory_equal( packet_out->data, expected->data, expected->length );
+
+  free_buffer( packet_out );
+  free_buffer( expected );
+  free_buffer( data );
+  free_buffer( vendor_body );
+  free_buffer( packed_actions );
+  delete_actions( actions );
+}
+
+
+static void
+test_packed_actions_are_reusable() {
+  buffer *packed_actions = create_packed_actions();
+  append_packed_action_output( packed_actions, 3, UINT16_MAX );
+
+  for ( int i = 0; i < 2; i++ ) {
+    buffer *packet_out = create_packet_out_with_packed_actions( MY_TRANSACTION_ID, BUFFER_ID, 1, packed_actions, NULL );
+    struct ofp_packet_out *po = packet_out->data;
+    struct ofp_action_output *action = ( struct ofp_action_output * ) po->actions;
+    assert_int_equal( ntohs( po->actions_len ), sizeof( struct ofp_action_output ) );
+    assert_int_equal( ntohs( action->type ), OFPAT_OUTPUT );
+    assert_int_equal( ntohs( action->len ), sizeof( struct ofp_action_output ) );
+    assert_int_equal( ntohs( action->port ), 3 );
+    assert_int_equal( ntohs( action->max_len ), UINT16_MAX );
+    free_buffer( packet_out );
+  }
+  assert_int_equal( ( int ) packed_actions->length, sizeof( struct ofp_action_output ) );
+
+  free_buffer( packed_actions );
+}
+
+
 /********************************************************************************
  * create_stats_request() test.
  ********************************************************************************/
@@ -7751,6 +7857,9 @@ main() {
     unit_test_setup_teardown( test_create_packet_out, init, teardown ),
     unit_test_setup_teardown( test_create_packet_out_without_actions, init, teardown ),
     unit_test_setup_teardown( test_create_flow_mod, init, teardown ),
+    unit_test_setup_teardown( test_create_flow_mod_with_packed_actions, init, teardown ),
+    unit_test_setup_teardown( test_create_packet_out_with_packed_actions, init, teardown ),
+    unit_test_setup_teardown( test_packed_actions_are_reusable, init, teardown ),
     unit_test_setup_teardown( test_create_flow_stats_request, init, teardown ),
     unit_test_setup_teardown( test_create_flow_stats_reply, init, teardown ),
 
@@ -37,6 +37,7 @@
 typedef struct {
   void *callback;
   void *user_data;
+  bool with_stats;
 } handler_data;
 
 
@@ -158,6 +159,17 @@ mock_dump_packetin_filter_handler( int status, int n_entries, packetin_filter_en
 }
 
 
+static void
+mock_dump_packetin_filter_stats_handler( int status, int n_entries, packetin_filter_entry *entries,
+                                         packetin_filter_stats *stats, void *user_data ) {
+  check_expected( status );
+  check_expected( n_entries );
+  check_expected( entries );
+  check_expected( stats );
+  check_expected( user_data );
+}
+
+
 /********************************************************************************
  * Setup and teardown functions.
  ********************************************************************************/
@@ -476,6 +488,34 @@ test_dump_packetin_filter_succeeds_if_not_initialized() {
 }
 
 
+/********************************************************************************
+ * dump_packetin_filter_stats() tests.
+ ********************************************************************************/
+
+static void
+test_dump_packetin_filter_stats_succeeds() {
+  uint8_t flags = PACKETIN_FILTER_FLAG_MATCH_STRICT;
+
+  dump_packetin_filter_request expected_data;
+  memset( &expected_data, 0, sizeof( dump_packetin_filter_request ) );
+  hton_match( &expected_data.criteria.match, &MATCH );
+  expected_data.criteria.priority = htons( PRIORITY );
+  strcpy( expected_data.criteria.service_name, SERVICE_NAME );
+  expected_data.flags = flags;
+
+  expect_string( mock_send_request_message, to_service_name, PACKETIN_FILTER_MANAGEMENT_SERVICE );
+  expect_string( mock_send_request_message, from_service_name, CLIENT_SERVICE_NAME );
+  expect_value( mock_send_request_message, tag32, MESSENGER_DUMP_PACKETIN_FILTER_REQUEST );
+  expect_memory( mock_send_request_message, data, &expected_data, sizeof( dump_packetin_filter_request ) );
+  expect_value( mock_send_request_message, len, sizeof( dump_packetin_filter_request ) );
+  expect_value( mock_send_request_message, hd->callback, HANDLER );
+  expect_value( mock_send_request_message, hd->user_data, USER_DATA );
+  will_return( mock_send_request_message, true );
+
+  assert_true( dump_packetin_filter_stats( MATCH, PRIORITY, SERVICE_NAME, flags, HANDLER, USER_DATA ) );
+}
+
+
 /********************************************************************************
  * handle_reply() tests.
  ********************************************************************************/
@@ -504,6 +544,7 @@ test_handle_reply_fails_with_too_short_add_packetin_filter_reply() {
   handler_data user_data;
   user_data.callback = HANDLER;
   user_data.user_data = USER_DATA;
+  user_data.with_stats = false;
   size_t reply_length = sizeof( add_packetin_filter_reply ) - 1;
 
   expect_string( mock_error, message, "Invalid add packetin filter reply ( length = 0 )." );
@@ -520,6 +561,7 @@ test_handle_reply_fails_with_too_long_add_packetin_filter_reply() {
   handler_data user_data;
   user_data.callback = HANDLER;
   user_data.user_data = USER_DATA;
+  user_data.with_stats = false;
   size_t reply_length = sizeof( add_packetin_filter_reply ) + 1;
 
   expect_string( mock_error, message, "Invalid add packetin filter reply ( length = 2 )." );
@@ -556,6 +598,7 @@ test_handle_reply_fails_with_too_short_delete_packetin_filter_reply() {
   handler_data user_data;
   user_data.callback = HANDLER;
   user_data.user_data = USER_DATA;
+  user_data.with_stats = false;
   size_t reply_length = sizeof( delete_packetin_filter_reply ) - 1;
 
   expect_string( mock_error, message, "Invalid delete packetin filter reply ( length = 4 )." );
@@ -573,6 +616,7 @@ test_handle_reply_fails_with_too_long_delete_packetin_filter_reply() {
   handler_data user_data;
   user_data.callback = HANDLER;
   user_data.user_data = USER_DATA;
+  user_data.with_stats = false;
   size_t reply_length = sizeof( delete_packetin_filter_reply ) + 1;
 
   expect_string( mock_error, message, "Invalid delete packetin filter reply ( length = 6 )." );
@@ -604,6 +648,7 @@ test_handle_reply_succeeds_with_dump_packetin_filter_reply() {
   handler_data *user_data = xmalloc( sizeof( handler_data ) );
   user_data->callback = mock_dump_packetin_filter_handler;
   user_data->user_data = USER_DATA;
+  user_data->with_stats = false;
 
   expect_value( mock_dump_packetin_filter_handler, status, PACKETIN_FILTER_OPERATION_SUCCEEDED );
   expect_value( mock_dump_packetin_filter_handler, n_entries, n_entries );
@@ -617,6 +662,87 @@ test_handle_reply_succeeds_with_dump_packetin_filter_reply() {
 }
 
 
+static void
+test_handle_reply_succeeds_with_dump_packetin_filter_reply_with_stats() {
+  int n_entries = 16;
+  size_t entries_length = sizeof( packetin_filter_entry ) * ( size_t ) n_entries;
+  size_t stats_length = sizeof( packetin_filter_stats ) * ( size_t ) n_entries;
+  size_t reply_length = offsetof( dump_packetin_filter_reply, entries ) + entries_length + stats_length;
+  dump_packetin_filter_reply *reply = xmalloc( reply_length );
+  memset( reply, 0, reply_length );
+  reply->status = PACKETIN_FILTER_OPERATION_SUCCEEDED;
+  reply->n_entries = htonl( ( uint32_t ) n_entries );
+  packetin_filter_stats *stats = ( packetin_filter_stats * ) &reply->entries[ n_entries ];
+  struct ofp_match match;
+  hton_match( &match, &MATCH );
+  packetin_filter_entry *expected_entries = xmalloc( entries_length );
+  memset( expected_entries, 0, entries_length );
+  packetin_filter_stats *expected_stats = xmalloc( stats_length );
+  for ( int i = 0; i < n_entries; i++ ) {
+    packetin_filter_entry *entry = &reply->entries[ i ];
+    entry->match = match;
+    entry->priority = htons( PRIORITY );
+    strcpy( entry->service_name, SERVICE_NAME );
+    stats[ i ].n_hits = htonll( ( uint64_t ) i << 32 );
+    packetin_filter_entry *expected_entry = &expected_entries[ i ];
+    expected_entry->match = MATCH;
+    expected_entry->priority = PRIORITY;
+    strcpy( expected_entry->service_name, SERVICE_NAME );
+    expected_stats[ i ].n_hits = ( uint64_t ) i << 32;
+  }
+  handler_data *user_data = xmalloc( sizeof( handler_data ) );
+  user_data->callback = mock_dump_packetin_filter_stats_handler;
+  user_data->user_data = USER_DATA;
+  user_data->with_stats = true;
+
+  expect_value( mock_dump_packetin_filter_stats_handler, status, PACKETIN_FILTER_OPERATION_SUCCEEDED );
+  expect_value( mock_dump_packetin_filter_stats_handler, n_entries, n_entries );
+  expect_memory( mock_dump_packetin_filter_stats_handler, entries, expected_entries, entries_length );
+  expect_memory( mock_dump_packetin_filter_stats_handler, stats, expected_stats, stats_length );
+  expect_value( mock_dump_packetin_filter_stats_handler, user_data, USER_DATA );
+
+  handle_reply( MESSENGER_DUMP_PACKETIN_FILTER_REPLY, reply, reply_length, user_data );
+
+  xfree( reply );
+  xfree( expected_entries );
+  xfree( expected_stats );
+}
+
+
+static void
+test_handle_reply_succeeds_with_dump_packetin_filter_reply_without_stats() {
+  size_t reply_length = offsetof( dump_packetin_filter_reply, entries ) + sizeof( packetin_filter_entry );
+  dump_packetin_filter_reply *reply = xmalloc( reply_length );
+  memset( reply, 0, reply_length );
+  reply->status = PACKETIN_FILTER_OPERATION_SUCCEEDED;
+  reply->n_entries = htonl( 1 );
+  struct ofp_match match;
+  hton_match( &match, &MATCH );
+  reply->entries[ 0 ].match = match;
+  reply->entries[ 0 ].priority = htons( PRIORITY );
+  strcpy( reply->entries[ 0 ].service_name, SERVICE_NAME );
+  packetin_filter_entry expected_entry;
+  memset( &expected_entry, 0, sizeof( packetin_filter_entry ) );
+  expected_entry.match = MATCH;
+  expected_entry.priority = PRIORITY;
+  strcpy( expected_entry.service_name, SERVICE_NAME );
+  handler_data *user_data = xmalloc( sizeof( handler_data ) );
+  user_data->callback = mock_dump_packetin_filter_stats_handler;
+  user_data->user_data = USER_DATA;
+  user_data->with_stats = true;
+
+  expect_value( mock_dump_packetin_filter_stats_handler, status, PACKETIN_FILTER_OPERATION_SUCCEEDED );
+  expect_value( mock_dump_packetin_filter_stats_handler, n_entries, 1 );
+  expect_memory( mock_dump_packetin_filter_stats_handler, entries, &expected_entry, sizeof( packetin_filter_entry ) );
+  expect_value( mock_dump_packetin_filter_stats_handler, stats, NULL );
+  expect_value( mock_dump_packetin_filter_stats_handler, user_data, USER_DATA );
+
+  handle_reply( MESSENGER_DUMP_PACKETIN_FILTER_REPLY, reply, reply_length, user_data );
+
+  xfree( reply );
+}
+
+
 static void
 test_handle_reply_fails_with_too_short_dump_packetin_filter_reply() {
   dump_packetin_filter_reply reply;
@@ -626,6 +752,7 @@ test_handle_reply_fails_with_too_short_dump_packetin_filter_reply() {
   handler_data user_data;
   user_data.callback = HANDLER;
   user_data.user_data = USER_DATA;
+  user_data.with_stats = false;
   size_t reply_length = offsetof( dump_packetin_filter_reply, entries ) - 1;
 
   expect_string( mock_error, message, "Invalid dump packetin filter reply ( length = 4 )." );
@@ -643,6 +770,7 @@ test_handle_reply_fails_with_invalid_dump_packetin_filter_reply() {
   handler_data user_data;
   user_data.callback = HANDLER;
   user_data.user_data = USER_DATA;
+  user_data.with_stats = false;
   size_t reply_length = offsetof( dump_packetin_filter_reply, entries ) + 1;
 
   expect_string( mock_error, message, "Invalid dump packetin filter reply ( length = 6 )." );
@@ -659,6 +787,7 @@ test_handle_reply_fails_with_undefined_reply_type() {
   handler_data user_data;
   user_data.callback = HANDLER;
   user_data.user_data = USER_DATA;
+  user_data.with_stats = false;
 
   expect_string( mock_warn, message, "Undefined reply tag ( tag = 0x16, length = 8 )." );
 
@@ -697,6 +826,9 @@ main() {
     unit_test_setup_teardown( test_dump_packetin_filter_succeeds_with_PACKETIN_FILTER_FLAG_MATCH_LOOSE, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_dump_packetin_filter_succeeds_if_not_initialized, setup, finalize_and_teardown ),
 
+    // dump_packetin_filter_stats() tests.
+    unit_test_setup_teardown( test_dump_packetin_filter_stats_succeeds, setup_and_init, finalize_and_teardown ),
+
     // handle_reply() tests.
     unit_test_setup_teardown( test_handle_reply_succeeds_with_add_packetin_filter_reply, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_handle_reply_fails_with_too_short_add_packetin_filter_reply, setup_and_init, finalize_and_teardown ),
@@ -705,6 +837,8 @@ main() {
     unit_test_setup_teardown( test_handle_reply_fails_with_too_short_delete_packetin_filter_reply, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_handle_reply_fails_with_too_long_delete_packetin_filter_reply, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_handle_reply_succeeds_with_dump_packetin_filter_reply, setup_and_init, finalize_and_teardown ),
+    unit_test_setup_teardown( test_handle_reply_succeeds_with_dump_packetin_filter_reply_with_stats, setup_and_init, finalize_and_teardown ),
+    unit_test_setup_teardown( test_handle_reply_succeeds_with_dump_packetin_filter_reply_without_stats, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_handle_reply_fails_with_too_short_dump_packetin_filter_reply, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_handle_reply_fails_with_invalid_dump_packetin_filter_reply, setup_and_init, finalize_and_teardown ),
     unit_test_setup_teardown( test_handle_reply_fails_with_undefined_reply_type, setup_and_init, finalize_and_teardown ),
@@ -70,6 +70,13 @@ mock_sqlite3_exec( sqlite3 *db, const char *sql, int ( *callback )( void *, int,
 }
 
 
+static int
+mock_sqlite3_step( sqlite3_stmt *stmt ) {
+  sqlite3_step( stmt );
+  return ( int ) mock();
+}
+
+
 static int
 mock_sqlite3_changes( sqlite3 *db ) {
   UNUSED( db );
@@ -111,6 +118,8 @@ setup() {
   setenv( "TREMA_TMP", "/tmp", 1 );
   set_trema_tmp();
   unlink( "/tmp/.trema.db" );
+  unlink( "/tmp/.trema.db-wal" );
+  unlink( "/tmp/.trema.db-shm" );
   original_error = error;
   error = mock_error;
   original_unlink = trema_unlink;
@@ -129,6 +138,8 @@ static void
 teardown() {
   unsetenv( "TREMA_TMP" );
   unlink( "/tmp/.trema.db" );
+  unlink( "/tmp/.trema.db-wal" );
+  unlink( "/tmp/.trema.db-shm" );
   error = original_error;
   trema_unlink = original_unlink;
 }
@@ -312,6 +323,59 @@ test_set_value_updates_value() {
 }
 
 
+static void
+test_set_value_succeeds_after_key_is_deleted_by_another_process() {
+  set_value( "KEY", "VALUE" );
+  char buf[ 256 ];
+  assert_true( get_value( "KEY", buf, sizeof( buf ) ) );
+
+  sqlite3 *db;
+  assert_int_equal( sqlite3_open( "/tmp/.trema.db", &db ), SQLITE_OK );
+  assert_int_equal( sqlite3_exec( db, "DELETE FROM trema WHERE key = 'KEY'", NULL, NULL, NULL ), SQLITE_OK );
+  sqlite3_close( db );
+
+  assert_true( set_value( "KEY", "NEW_VALUE" ) );
+  assert_true( get_value( "KEY", buf, sizeof( buf ) ) );
+  assert_string_equal( "NEW_VALUE", buf );
+}
+
+
+static void
+test_set_value_succeeds_after_key_is_inserted_by_another_process() {
+  set_value( "KEY", "VALUE" );
+  char buf[ 256 ];
+  assert_true( get_value( "KEY", buf, sizeof( buf ) ) );
+
+  sqlite3 *db;
+  assert_int_equal( sqlite3_open( "/tmp/.trema.db", &db ), SQLITE_OK );
+  assert_int_equal( sqlite3_exec( db, "DELETE FROM trema WHERE key = 'KEY'", NULL, NULL, NULL ), SQLITE_OK );
+  assert_int_equal( sqlite3_exec( db, "INSERT INTO trema ( key, value ) VALUES ( 'KEY', 'OTHER_VALUE' )", NULL, NULL, NULL ), SQLITE_OK );
+  sqlite3_close( db );
+
+  assert_true( set_value( "KEY", "NEW_VALUE" ) );
+  assert_true( get_value( "KEY", buf, sizeof( buf ) ) );
+  assert_string_equal( "NEW_VALUE", buf );
+}
+
+
+static void
+test_delete_key_value_fails_after_key_is_deleted_by_another_process() {
+  set_value( "KEY", "VALUE" );
+  char buf[ 256 ];
+  assert_true( get_value( "KEY", buf, sizeof( buf ) ) );
+
+  sqlite3 *db;
+  assert_int_equal( sqlite3_open( "/tmp/.trema.db", &db ), SQLITE_OK );
+  assert_int_equal( sqlite3_exec( db, "DELETE FROM trema WHERE key = 'KEY'", NULL, NULL, NULL ), SQLITE_OK );
+  sqlite3_close( db );
+
+  expect_string( mock_error, message, "An entry for 'KEY' does not exist." );
+  assert_false( delete_key_value( "KEY" ) );
+  expect_string( mock_error, message, "Failed to retrieve a value for 'KEY'." );
+  assert_false( get_value( "KEY", buf, sizeof( buf ) ) );
+}
+
+
 static void
 test_set_value_clears_value() {
   set_value( "KEY", "VALUE" );
@@ -424,57 +488,57 @@ test_set_value_avoids_injection_attacks() {
 
 static void
 test_set_value_fails_if_backend_fails_to_store_key_value() {
-  void *original_sqlite3_exec = trema_sqlite3_exec;
-  trema_sqlite3_exec = mock_sqlite3_exec;
-  void *original_sqlite3_free = trema_sqlite3_free;
-  trema_sqlite3_free = mock_sqlite3_free;
+  void *original_sqlite3_step = trema_sqlite3_step;
+  trema_sqlite3_step = mock_sqlite3_step;
+  void *original_sqlite3_errmsg = trema_sqlite3_errmsg;
+  trema_sqlite3_errmsg = mock_sqlite3_errmsg;
   void *original_sqlite3_changes = trema_sqlite3_changes;
   trema_sqlite3_changes = mock_sqlite3_changes;
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_ERROR );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
+  will_return( mock_sqlite3_step, SQLITE_ERROR );
   expect_string( mock_error, message, "Failed to execute a SQL statement ( statement = INSERT INTO trema (key,value) VALUES ('KEY','VALUE'), error = ERROR )." );
   assert_false( set_value( "KEY", "VALUE" ) );
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_OK );
+  will_return( mock_sqlite3_step, SQLITE_ROW );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
   will_return( mock_sqlite3_changes, 1 );
   delete_key_value( "KEY" );
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_OK );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
   will_return( mock_sqlite3_changes, 2 );
   expect_string( mock_error, message, "Multiple entries are created ( n_changes = 2 )." );
   assert_false( set_value( "KEY", "VALUE" ) );
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_OK );
+  will_return( mock_sqlite3_step, SQLITE_ROW );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
   will_return( mock_sqlite3_changes, 1 );
   delete_key_value( "KEY" );
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_OK );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
   will_return( mock_sqlite3_changes, 0 );
   assert_false( set_value( "KEY", "VALUE" ) );
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_ERROR );
+  will_return( mock_sqlite3_step, SQLITE_ROW );
+  will_return( mock_sqlite3_step, SQLITE_ERROR );
   expect_string( mock_error, message, "Failed to execute a SQL statement ( statement = UPDATE trema SET value = 'NEW_VALUE' WHERE key = 'KEY', error = ERROR )." );
   assert_false( set_value( "KEY", "NEW_VALUE" ) );
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_OK );
+  will_return( mock_sqlite3_step, SQLITE_ROW );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
   will_return( mock_sqlite3_changes, 0 );
   assert_false( set_value( "KEY", "NEW_VALUE" ) );
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_OK );
+  will_return( mock_sqlite3_step, SQLITE_ROW );
+  will_return( mock_sqlite3_step, SQLITE_DONE );
   will_return( mock_sqlite3_changes, 2 );
   expect_string( mock_error, message, "Multiple entries are updated ( n_changes = 2 )." );
   assert_false( set_value( "KEY", "NEW_VALUE" ) );
 
-  trema_sqlite3_exec = original_sqlite3_exec;
-  trema_sqlite3_free = original_sqlite3_free;
+  trema_sqlite3_step = original_sqlite3_step;
+  trema_sqlite3_errmsg = original_sqlite3_errmsg;
   trema_sqlite3_changes = original_sqlite3_changes;
 }
 
@@ -590,23 +654,39 @@ test_get_value_avoids_injection_attacks() {
 
 static void
 test_get_value_fails_if_backend_fails_to_lookup_value() {
-  void *original_sqlite3_exec = trema_sqlite3_exec;
-  trema_sqlite3_exec = mock_sqlite3_exec;
-  void *original_sqlite3_free = trema_sqlite3_free;
-  trema_sqlite3_free = mock_sqlite3_free;
+  void *original_sqlite3_step = trema_sqlite3_step;
+  trema_sqlite3_step = mock_sqlite3_step;
+  void *original_sqlite3_errmsg = trema_sqlite3_errmsg;
+  trema_sqlite3_errmsg = mock_sqlite3_errmsg;
 
-  will_return( mock_sqlite3_exec, SQLITE_ERROR );
+  will_return( mock_sqlite3_step, SQLITE_ERROR );
   expect_string( mock_error, message, "Failed to execute a SQL statement ( statement = SELECT value FROM trema WHERE key = 'KEY', error = ERROR )." );
   expect_string( mock_error, message, "Failed to retrieve a value for 'KEY'." );
   char buf[ 256 ];
   assert_false( get_value( "KEY", buf, sizeof( buf ) ) );
 
-  trema_sqlite3_exec = original_sqlite3_exec;
-  trema_sqlite3_free = original_sqlite3_free;
+  trema_sqlite3_step = original_sqlite3_step;
+  trema_sqlite3_errmsg = original_sqlite3_errmsg;
 }
 
 
 
+static void
+test_get_value_reads_value_updated_by_another_process() {
+  set_value( "KEY", "VALUE" );
+  char buf[ 256 ];
+  assert_true( get_value( "KEY", buf, sizeof( buf ) ) );
+
+  sqlite3 *db;
+  assert_int_equal( sqlite3_open( "/tmp/.trema.db", &db ), SQLITE_OK );
+  assert_int_equal( sqlite3_exec( db, "UPDATE trema SET value = 'NEW_VALUE' WHERE key = 'KEY'", NULL, NULL, NULL ), SQLITE_OK );
+  sqlite3_close( db );
+
+  assert_true( get_value( "KEY", buf, sizeof( buf ) ) );
+  assert_string_equal( "NEW_VALUE", buf );
+}
+
+
 /********************************************************************************
  * delete_key_value() tests.
  ********************************************************************************/
@@ -697,18 +777,17 @@ test_delete_key_value_avoids_injection_attacks() {
 static void
 test_delete_key_value_fails_if_backend_fails_to_delete_key_value() {
   set_value( "KEY", "VALUE" );
-  void *original_sqlite3_exec = trema_sqlite3_exec;
-  trema_sqlite3_exec = mock_sqlite3_exec;
-  void *original_sqlite3_free = trema_sqlite3_free;
-  trema_sqlite3_free = mock_sqlite3_free;
+  void *original_sqlite3_step = trema_sqlite3_step;
+  trema_sqlite3_step = mock_sqlite3_step;
+  void *original_sqlite3_errmsg = trema_sqlite3_errmsg;
+  trema_sqlite3_errmsg = mock_sqlite3_errmsg;
 
-  will_return( mock_sqlite3_exec, SQLITE_OK );
-  will_return( mock_sqlite3_exec, SQLITE_ERROR );
+  will_return( mock_sqlite3_step, SQLITE_ERROR );
   expect_string( mock_error, message, "Failed to execute a SQL statement ( statement = DELETE FROM trema WHERE key = 'KEY', error = ERROR )." );
   assert_false( delete_key_value( "KEY" ) );
 
-  trema_sqlite3_exec = original_sqlite3_exec;
-  trema_sqlite3_free = original_sqlite3_free;
+  trema_sqlite3_step = original_sqlite3_step;
+  trema_sqlite3_errmsg = original_sqlite3_errmsg;
 }
 
 
@@ -726,6 +805,71 @@ test_delete_key_value_fails_if_backend_deletes_multiple_key_values() {
 }
 
 
+/********************************************************************************
+ * begin_persistent_storage_batch() and commit_persistent_storage_batch() tests.
+ ********************************************************************************/
+
+static int
+count_rows( void ) {
+  sqlite3 *db;
+  sqlite3_stmt *statement;
+  sqlite3_open( "/tmp/.trema.db", &db );
+  sqlite3_prepare_v2( db, "SELECT COUNT(*) FROM trema", -1, &statement, NULL );
+  sqlite3_step( statement );
+  int n_rows = sqlite3_column_int( statement, 0 );
+  sqlite3_finalize( statement );
+  sqlite3_close( db );
+
+  return n_rows;
+}
+
+
+static void
+test_batch_is_stored_on_commit() {
+  set_value( "KEY0", "VALUE" );
+
+  assert_true( begin_persistent_storage_batch() );
+  char key[ 16 ];
+  for ( int i = 1; i <= 100; i++ ) {
+    snprintf( key, sizeof( key ), "KEY%d", i );
+    assert_true( set_value( key, "VALUE" ) );
+  }
+  assert_true( delete_key_value( "KEY0" ) );
+  assert_int_equal( count_rows(), 1 );
+  char buf[ 256 ];
+  assert_true( get_value( "KEY100", buf, sizeof( buf ) ) );
+  assert_string_equal( "VALUE", buf );
+
+  assert_true( commit_persistent_storage_batch() );
+  assert_int_equal( count_rows(), 100 );
+}
+
+
+static void
+test_begin_persistent_storage_batch_fails_if_already_in_batch() {
+  begin_persistent_storage_batch();
+
+  expect_string( mock_error, message, "A batch is already in progress." );
+  assert_false( begin_persistent_storage_batch() );
+
+  commit_persistent_storage_batch();
+}
+
+
+static void
+test_begin_persistent_storage_batch_fails_if_not_initialized() {
+  expect_string( mock_error, message, "Backend is not initialized yet." );
+  assert_false( begin_persistent_storage_batch() );
+}
+
+
+static void
+test_commit_persistent_storage_batch_fails_if_not_in_batch() {
+  expect_string( mock_error, message, "No batch is in progress." );
+  assert_false( commit_persistent_storage_batch() );
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -775,6 +919,10 @@ main() {
     unit_test_setup_teardown( test_get_value_escapes_string, setup_and_init, teardown_and_finalize ),
     unit_test_setup_teardown( test_get_value_avoids_injection_attacks, setup_and_init, teardown_and_finalize ),
     unit_test_setup_teardown( test_get_value_fails_if_backend_fails_to_lookup_value, setup_and_init, teardown_and_finalize ),
+    unit_test_setup_teardown( test_get_value_reads_value_updated_by_another_process, setup_and_init, teardown_and_finalize ),
+    unit_test_setup_teardown( test_set_value_succeeds_after_key_is_deleted_by_another_process, setup_and_init, teardown_and_finalize ),
+    unit_test_setup_teardown( test_set_value_succeeds_after_key_is_inserted_by_another_process, setup_and_init, teardown_and_finalize ),
+    unit_test_setup_teardown( test_delete_key_value_fails_after_key_is_deleted_by_another_process, setup_and_init, teardown_and_finalize ),
 
     // delete_key_value() tests.
     unit_test_setup_teardown( test_delete_key_value_succeeds, setup_and_init, teardown_and_finalize ),
@@ -787,6 +935,12 @@ main() {
     unit_test_setup_teardown( test_delete_key_value_avoids_injection_attacks, setup_and_init, teardown_and_finalize ),
     unit_test_setup_teardown( test_delete_key_value_fails_if_backend_fails_to_delete_key_value, setup_and_init, teardown_and_finalize ),
     unit_test_setup_teardown( test_delete_key_value_fails_if_backend_deletes_multiple_key_values, setup_and_init, teardown_and_finalize ),
+
+    // begin_persistent_storage_batch() and commit_persistent_storage_batch() tests.
+    unit_test_setup_teardown( test_batch_is_stored_on_commit, setup_and_init, teardown_and_finalize ),
+    unit_test_setup_teardown( test_begin_persistent_storage_batch_fails_if_already_in_batch, setup_and_init, teardown_and_finalize ),
+    unit_test_setup_teardown( test_begin_persistent_storage_batch_fails_if_not_initialized, setup, teardown ),
+    unit_test_setup_teardown( test_commit_persistent_storage_batch_fails_if_not_in_batch, setup_and_init, teardown_and_finalize ),
   };
   return run_tests( tests );
 }
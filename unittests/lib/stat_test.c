@@ -30,7 +30,7 @@
  * static variable/functions in stat.c
  ********************************************************************************/
 
-extern hash_table *stats;
+extern flat_hash_table *stats;
 
 void create_stats_table();
 void delete_stats_table();
@@ -138,7 +138,7 @@ test_add_stat_entry_succeeds() {
 
   const char *key = "key";
   assert_true( add_stat_entry( key ) );
-  stat_entry *entry = lookup_hash_entry( stats, key );
+  stat_entry *entry = lookup_flat_hash_entry( stats, key );
   assert_string_equal( entry->key, key );
   uint64_t expected_value = 0;
   assert_memory_equal( &entry->value, &expected_value, sizeof( uint64_t ) );
@@ -171,7 +171,7 @@ test_increment_stat_succeeds_with_defined_key() {
   assert_true( add_stat_entry( key ) );
   increment_stat( key );
 
-  stat_entry *entry = lookup_hash_entry( stats, key );
+  stat_entry *entry = lookup_flat_hash_entry( stats, key );
   assert_string_equal( entry->key, key );
   uint64_t expected_value = 1;
   assert_memory_equal( &entry->value, &expected_value, sizeof( uint64_t ) );
@@ -187,7 +187,7 @@ test_increment_stat_succeeds_with_undefined_key() {
   const char *key = "key";
   increment_stat( key );
 
-  stat_entry *entry = lookup_hash_entry( stats, key );
+  stat_entry *entry = lookup_flat_hash_entry( stats, key );
   assert_string_equal( entry->key, key );
   uint64_t expected_value = 1;
   assert_memory_equal( &entry->value, &expected_value, sizeof( uint64_t ) );
@@ -213,6 +213,74 @@ test_increment_stat_fails_if_not_initialized() {
 }
 
 
+/********************************************************************************
+ * register_stat_counter() tests.
+ ********************************************************************************/
+
+static void
+test_register_stat_counter_succeeds() {
+  assert_true( init_stat() );
+
+  const char *key = "key";
+  stat_counter *counter = register_stat_counter( key );
+  assert_true( counter != NULL );
+  assert_true( register_stat_counter( key ) == counter );
+  increment_stat_counter( counter );
+  increment_stat( key );
+
+  stat_entry *entry = lookup_flat_hash_entry( stats, key );
+  assert_true( entry == counter );
+  assert_string_equal( entry->key, key );
+  uint64_t expected_value = 2;
+  assert_memory_equal( &entry->value, &expected_value, sizeof( uint64_t ) );
+
+  assert_true( finalize_stat() );
+}
+
+
+static void
+test_register_stat_counter_fails_if_not_initialized() {
+  expect_assert_failure( register_stat_counter( "key" ) );
+}
+
+
+static void
+test_foreach_stat_skips_counters_not_incremented() {
+  assert_true( init_stat() );
+
+  const char *keys[] = { "key0", "key1" };
+  register_stat_counter( keys[ 0 ] );
+  increment_stat_counter( register_stat_counter( keys[ 1 ] ) );
+
+  expect_string( mock_callback, key, keys[ 1 ] );
+  expect_value( mock_callback, value, 1 );
+  expect_value( mock_callback, user_data, NULL );
+
+  foreach_stat( mock_callback, NULL );
+
+  assert_true( finalize_stat() );
+}
+
+
+static void
+test_reset_stats_keeps_counters() {
+  assert_true( init_stat() );
+
+  const char *key = "key";
+  stat_counter *counter = register_stat_counter( key );
+  increment_stat_counter( counter );
+
+  reset_stats();
+
+  assert_true( lookup_flat_hash_entry( stats, key ) == counter );
+  uint64_t expected_value = 0;
+  assert_memory_equal( &counter->value, &expected_value, sizeof( uint64_t ) );
+  foreach_stat( mock_callback, NULL );
+
+  assert_true( finalize_stat() );
+}
+
+
 /********************************************************************************
  * reset_stats() tests.
  ********************************************************************************/
@@ -226,11 +294,11 @@ test_reset_stats_succeeds_with_single_entry() {
 
   reset_stats();
 
-  hash_iterator iter;
+  flat_hash_iterator iter;
   hash_entry *e = NULL;
-  init_hash_iterator( stats, &iter );
+  init_flat_hash_iterator( stats, &iter );
   int n_entries = 0;
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
     n_entries++;
   }
   assert_int_equal( n_entries, 0 );
@@ -249,11 +317,11 @@ test_reset_stats_succeeds_with_multiple_entries() {
 
   reset_stats();
 
-  hash_iterator iter;
+  flat_hash_iterator iter;
   hash_entry *e = NULL;
-  init_hash_iterator( stats, &iter );
+  init_flat_hash_iterator( stats, &iter );
   int n_entries = 0;
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
     n_entries++;
   }
   assert_int_equal( n_entries, 0 );
@@ -268,11 +336,11 @@ test_reset_stats_succeeds_without_entries() {
 
   reset_stats();
 
-  hash_iterator iter;
+  flat_hash_iterator iter;
   hash_entry *e = NULL;
-  init_hash_iterator( stats, &iter );
+  init_flat_hash_iterator( stats, &iter );
   int n_entries = 0;
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+  while ( ( e = iterate_flat_hash_next( &iter ) ) != NULL ) {
     n_entries++;
   }
   assert_int_equal( n_entries, 0 );
@@ -302,14 +370,14 @@ test_foreach_stat_succeeds() {
 
   void *user_data = ( void * ) ( intptr_t ) 0x1;
 
-  expect_string( mock_callback, key, keys[ 1 ] );
-  expect_value( mock_callback, value, 2 );
-  expect_value( mock_callback, user_data, user_data );
-
   expect_string( mock_callback, key, keys[ 0 ] );
   expect_value( mock_callback, value, 1 );
   expect_value( mock_callback, user_data, user_data );
 
+  expect_string( mock_callback, key, keys[ 1 ] );
+  expect_value( mock_callback, value, 2 );
+  expect_value( mock_callback, user_data, user_data );
+
   foreach_stat( mock_callback, user_data );
 
   assert_true( finalize_stat() );
@@ -404,6 +472,12 @@ main() {
     unit_test_setup_teardown( test_increment_stat_fails_if_key_is_NULL, reset, reset ),
     unit_test_setup_teardown( test_increment_stat_fails_if_not_initialized, reset, reset ),
 
+    // register_stat_counter() tests.
+    unit_test_setup_teardown( test_register_stat_counter_succeeds, reset, reset ),
+    unit_test_setup_teardown( test_register_stat_counter_fails_if_not_initialized, reset, reset ),
+    unit_test_setup_teardown( test_foreach_stat_skips_counters_not_incremented, reset, reset ),
+    unit_test_setup_teardown( test_reset_stats_keeps_counters, reset, reset ),
+
     // reset_stats() tests.
     unit_test_setup_teardown( test_reset_stats_succeeds_with_single_entry, reset, reset ),
     unit_test_setup_teardown( test_reset_stats_succeeds_with_multiple_entries, reset, reset ),
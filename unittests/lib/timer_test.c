@@ -22,10 +22,10 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include "checks.h"
 #include "cmockery_trema.h"
-#include "doubly_linked_list.h"
 #include "timer.h"
 
 
@@ -39,21 +39,31 @@ typedef struct timer_callback_info {
   struct timespec expires_at;
   struct timespec interval;
   void *user_data;
+  timer_id id;
+  uint64_t expires_tick;
+  int wheel_level;
+  int wheel_slot;
+  struct timer_callback_info *prev;
+  struct timer_callback_info *next;
+  struct timer_callback_info *hash_next;
 } timer_callback_info;
 
 
-extern dlist_element *timer_callbacks;
+extern timer_callback_info **timer_table;
+extern uint32_t timer_table_size;
 
 
 /********************************************************************************
  * Mocks.
  ********************************************************************************/
 
+static struct timespec mock_now = { 100, 0 };
+
 int
 mock_clock_gettime( clockid_t clk_id, struct timespec *tp ) {
   UNUSED( clk_id );
-  UNUSED( tp );
 
+  *tp = mock_now;
   return ( int ) mock();
 }
 
@@ -78,13 +88,9 @@ mock_debug( const char *format, ... ) {
 
 static timer_callback_info *
 find_timer_callback( void ( *callback )( void *user_data ) ) {
-  dlist_element *e;
-  timer_callback_info *cb;
-
-  cb = NULL;
-  for ( e = timer_callbacks->next; e; e = e->next ) {
-    cb = e->data;
-    if ( cb->function == callback ) {
+  for ( uint32_t i = 0; i < timer_table_size; i++ ) {
+    timer_callback_info *cb = timer_table[ i ];
+    if ( cb != NULL && cb->function == callback ) {
       return cb;
     }
   }
@@ -202,6 +208,165 @@ test_delete_timer_event() {
 }
 
 
+static void
+test_delete_timer_event_by_id() {
+  init_timer();
+
+  will_return_count( mock_clock_gettime, 0, -1 );
+
+  char user_data[] = "1";
+  struct itimerspec interval;
+  interval.it_value.tv_sec = 1;
+  interval.it_value.tv_nsec = 0;
+  interval.it_interval.tv_sec = 0;
+  interval.it_interval.tv_nsec = 0;
+  timer_id first = add_timer_event_callback( &interval, mock_timer_event_callback, user_data );
+  timer_id second = add_timer_event_callback( &interval, mock_timer_event_callback, user_data );
+  assert_true( first != INVALID_TIMER_ID );
+  assert_true( second != INVALID_TIMER_ID );
+  assert_true( first != second );
+
+  assert_true( delete_timer_event_by_id( second ) );
+  assert_false( delete_timer_event_by_id( second ) );
+
+  timer_callback_info *callback = find_timer_callback( mock_timer_event_callback );
+  assert_true( callback != NULL );
+  assert_true( callback->id == first );
+
+  assert_true( delete_timer_event_by_id( first ) );
+  assert_true( find_timer_callback( mock_timer_event_callback ) == NULL );
+  assert_false( delete_timer_event_by_id( INVALID_TIMER_ID ) );
+
+  finalize_timer();
+}
+
+
+static int expired_count;
+
+static void
+count_timer_event_callback( void *user_data ) {
+  ( *( int * ) user_data )++;
+  expired_count++;
+}
+
+
+static void
+delete_self_timer_event_callback( void *user_data ) {
+  count_timer_event_callback( user_data );
+  assert_true( delete_timer_event( delete_self_timer_event_callback, user_data ) );
+}
+
+
+static void
+test_execute_timer_events() {
+  init_timer();
+
+  will_return_count( mock_clock_gettime, 0, -1 );
+  mock_now.tv_sec = 100;
+  mock_now.tv_nsec = 0;
+  expired_count = 0;
+
+  int one_shot = 0;
+  int periodic = 0;
+  int self_deleting = 0;
+  int long_term = 0;
+  struct itimerspec interval;
+  memset( &interval, 0, sizeof( interval ) );
+  interval.it_value.tv_nsec = 1500000;
+  assert_true( add_timer_event_callback( &interval, count_timer_event_callback, &one_shot ) );
+  assert_true( add_periodic_event_callback( 1, count_timer_event_callback, &periodic ) );
+  assert_true( add_periodic_event_callback( 2, delete_self_timer_event_callback, &self_deleting ) );
+  assert_true( add_periodic_event_callback( 3600, count_timer_event_callback, &long_term ) );
+
+  int timeout_usec = -1;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( expired_count, 0 );
+  assert_int_equal( timeout_usec, 2000 );
+
+  mock_now.tv_nsec = 2000000;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( one_shot, 1 );
+  assert_int_equal( expired_count, 1 );
+
+  mock_now.tv_sec = 101;
+  mock_now.tv_nsec = 0;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( periodic, 1 );
+  assert_true( timeout_usec > 0 && timeout_usec <= 1000000 );
+
+  mock_now.tv_sec = 102;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( periodic, 2 );
+  assert_int_equal( self_deleting, 1 );
+
+  mock_now.tv_sec = 103;
+  mock_now.tv_nsec = 500000000;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( periodic, 3 );
+  assert_int_equal( self_deleting, 1 );
+  assert_int_equal( long_term, 0 );
+
+  mock_now.tv_sec = 3699;
+  mock_now.tv_nsec = 999999999;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( long_term, 0 );
+
+  mock_now.tv_sec = 3700;
+  mock_now.tv_nsec = 0;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( long_term, 1 );
+  assert_int_equal( one_shot, 1 );
+
+  assert_true( delete_timer_event( count_timer_event_callback, &periodic ) );
+  assert_true( delete_timer_event( count_timer_event_callback, &long_term ) );
+  assert_false( delete_timer_event( count_timer_event_callback, &one_shot ) );
+
+  finalize_timer();
+}
+
+
+static void
+test_execute_timer_event_beyond_wheel_range() {
+  init_timer();
+
+  will_return_count( mock_clock_gettime, 0, -1 );
+  mock_now.tv_sec = 100;
+  mock_now.tv_nsec = 0;
+  expired_count = 0;
+
+  // 1000 days is longer than the range of the timer wheel ( 2^36 ms ).
+  int far_future = 0;
+  struct itimerspec interval;
+  memset( &interval, 0, sizeof( interval ) );
+  interval.it_value.tv_sec = 1000 * 86400;
+  assert_true( add_timer_event_callback( &interval, count_timer_event_callback, &far_future ) );
+
+  int timeout_usec = -1;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( far_future, 0 );
+
+  for ( int day = 100; day < 1000; day += 100 ) {
+    mock_now.tv_sec = 100 + day * 86400;
+    execute_timer_events( &timeout_usec );
+    assert_int_equal( far_future, 0 );
+    assert_true( timeout_usec > 0 );
+  }
+
+  mock_now.tv_sec = 100 + 1000 * 86400 - 1;
+  mock_now.tv_nsec = 999999999;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( far_future, 0 );
+
+  mock_now.tv_sec = 100 + 1000 * 86400;
+  mock_now.tv_nsec = 0;
+  execute_timer_events( &timeout_usec );
+  assert_int_equal( far_future, 1 );
+  assert_int_equal( expired_count, 1 );
+
+  finalize_timer();
+}
+
+
 static void
 test_nonexistent_timer_event_callback() {
   assert_false( delete_timer_event( mock_timer_event_callback, NULL ) );
@@ -231,6 +396,9 @@ main() {
     unit_test( test_periodic_event_callback ),
     unit_test( test_add_timer_event_callback_fail_with_invalid_timespec ),
     unit_test( test_delete_timer_event ),
+    unit_test( test_delete_timer_event_by_id ),
+    unit_test( test_execute_timer_events ),
+    unit_test( test_execute_timer_event_beyond_wheel_range ),
     unit_test( test_nonexistent_timer_event_callback ),
     unit_test( test_clock_gettime_fail_einval ),
   };
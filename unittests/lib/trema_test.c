@@ -312,6 +312,47 @@ mock_finalize_stat() {
 }
 
 
+bool
+mock_add_stat_reporter( stat_reporter reporter ) {
+  UNUSED( reporter );
+
+  return true;
+}
+
+
+void
+mock_init_buffer_pool() {
+  // Do nothing.
+}
+
+
+void
+mock_finalize_buffer_pool() {
+  // Do nothing.
+}
+
+
+void
+mock_foreach_buffer_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  UNUSED( function );
+  UNUSED( user_data );
+}
+
+
+void
+mock_foreach_message_queue_pool_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  UNUSED( function );
+  UNUSED( user_data );
+}
+
+
+void
+mock_foreach_messenger_queue_stat( void function( const char *key, const uint64_t value, void *user_data ), void *user_data ) {
+  UNUSED( function );
+  UNUSED( user_data );
+}
+
+
 void
 mock_execute_timer_events() {
   // Do nothing.
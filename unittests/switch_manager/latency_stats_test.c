@@ -0,0 +1,265 @@
+/*
+ * Unit tests for latency_stats.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "trema.h"
+#include "latency_stats.h"
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+static latency_stats stats;
+
+
+static void
+setup() {
+  setup_leak_detector();
+  memset( &stats, 0, sizeof( stats ) );
+}
+
+
+static void
+teardown() {
+  teardown_leak_detector();
+}
+
+
+/*************************************************************************
+ * Helper.
+ *************************************************************************/
+
+#define MAX_KEYS 16
+
+typedef struct {
+  char keys[ MAX_KEYS ][ STAT_KEY_LENGTH ];
+  uint64_t values[ MAX_KEYS ];
+  int n_keys;
+} reported_stats;
+
+
+static void
+collect_stat( const char *key, const uint64_t value, void *user_data ) {
+  reported_stats *reported = user_data;
+
+  assert_true( reported->n_keys < MAX_KEYS );
+  snprintf( reported->keys[ reported->n_keys ], STAT_KEY_LENGTH, "%s", key );
+  reported->values[ reported->n_keys ] = value;
+  reported->n_keys++;
+}
+
+
+/*************************************************************************
+ * record_latency() tests.
+ *************************************************************************/
+
+static void
+test_record_latency_records_elapsed_time() {
+  uint64_t since = get_latency_clock() - 500;
+
+  record_latency( &stats, LATENCY_STATS, since );
+
+  assert_int_equal( stats.histograms[ LATENCY_STATS ].n_values, 1 );
+  assert_true( stats.histograms[ LATENCY_STATS ].max >= 500 );
+  assert_int_equal( stats.histograms[ LATENCY_ECHO ].n_values, 0 );
+}
+
+
+static void
+test_record_latency_ignores_unmeasured_requests() {
+  record_latency( &stats, LATENCY_STATS, 0 );
+
+  assert_int_equal( stats.histograms[ LATENCY_STATS ].n_values, 0 );
+}
+
+
+/*************************************************************************
+ * Barrier tests.
+ *************************************************************************/
+
+static void
+test_barrier_is_measured_from_first_flow_mod() {
+  latency_flow_mod_sent( &stats );
+  uint64_t first_flow_mod_at = stats.first_flow_mod_at;
+  assert_true( first_flow_mod_at != 0 );
+  latency_flow_mod_sent( &stats );
+
+  assert_true( latency_barrier_request_sent( &stats ) == first_flow_mod_at );
+  assert_int_equal( stats.first_flow_mod_at, 0 );
+}
+
+
+static void
+test_barrier_without_flow_mod_is_measured_from_now() {
+  uint64_t before = get_latency_clock();
+
+  uint64_t since = latency_barrier_request_sent( &stats );
+
+  assert_true( since >= before );
+  assert_true( since <= get_latency_clock() );
+}
+
+
+/*************************************************************************
+ * packet_in to packet_out tests.
+ *************************************************************************/
+
+static void
+test_packet_out_is_measured_from_packet_in_with_same_buffer_id() {
+  latency_packet_in_received( &stats, 10 );
+
+  latency_packet_out_sent( &stats, 10 );
+  assert_int_equal( stats.histograms[ LATENCY_PACKET_OUT ].n_values, 1 );
+
+  // The packet_in is measured only once.
+  latency_packet_out_sent( &stats, 10 );
+  assert_int_equal( stats.histograms[ LATENCY_PACKET_OUT ].n_values, 1 );
+}
+
+
+static void
+test_packet_out_with_other_buffer_id_is_not_measured() {
+  latency_packet_in_received( &stats, 10 );
+
+  latency_packet_out_sent( &stats, 11 );
+  latency_packet_out_sent( &stats, 10 + LATENCY_PACKET_IN_SLOTS );
+
+  assert_int_equal( stats.histograms[ LATENCY_PACKET_OUT ].n_values, 0 );
+}
+
+
+static void
+test_newer_packet_in_overwrites_slot() {
+  latency_packet_in_received( &stats, 10 );
+  latency_packet_in_received( &stats, 10 + LATENCY_PACKET_IN_SLOTS );
+
+  latency_packet_out_sent( &stats, 10 );
+  assert_int_equal( stats.histograms[ LATENCY_PACKET_OUT ].n_values, 0 );
+
+  latency_packet_out_sent( &stats, 10 + LATENCY_PACKET_IN_SLOTS );
+  assert_int_equal( stats.histograms[ LATENCY_PACKET_OUT ].n_values, 1 );
+}
+
+
+static void
+test_unbuffered_packets_are_not_measured() {
+  latency_packet_in_received( &stats, UINT32_MAX );
+  latency_packet_out_sent( &stats, UINT32_MAX );
+
+  assert_int_equal( stats.histograms[ LATENCY_PACKET_OUT ].n_values, 0 );
+  assert_int_equal( stats.packet_ins[ UINT32_MAX % LATENCY_PACKET_IN_SLOTS ].received_at, 0 );
+}
+
+
+/*************************************************************************
+ * foreach_latency_stat() tests.
+ *************************************************************************/
+
+static void
+test_foreach_latency_stat_reports_non_empty_histograms() {
+  record_histogram_value( &stats.histograms[ LATENCY_ECHO ], 100 );
+  record_histogram_value( &stats.histograms[ LATENCY_ECHO ], 20 );
+
+  reported_stats reported;
+  memset( &reported, 0, sizeof( reported ) );
+  foreach_latency_stat( &stats, 0x1, collect_stat, &reported );
+
+  assert_int_equal( reported.n_keys, 5 );
+  assert_string_equal( reported.keys[ 0 ], "switch.0x1.latency.echo.count" );
+  assert_int_equal( reported.values[ 0 ], 2 );
+  assert_string_equal( reported.keys[ 1 ], "switch.0x1.latency.echo.p50_usec" );
+  assert_int_equal( reported.values[ 1 ], 20 );
+  assert_string_equal( reported.keys[ 2 ], "switch.0x1.latency.echo.p99_usec" );
+  assert_string_equal( reported.keys[ 3 ], "switch.0x1.latency.echo.p999_usec" );
+  assert_string_equal( reported.keys[ 4 ], "switch.0x1.latency.echo.max_usec" );
+  assert_int_equal( reported.values[ 4 ], 100 );
+}
+
+
+static void
+test_foreach_latency_stat_reports_nothing_if_empty() {
+  reported_stats reported;
+  memset( &reported, 0, sizeof( reported ) );
+  foreach_latency_stat( &stats, 0x1, collect_stat, &reported );
+
+  assert_int_equal( reported.n_keys, 0 );
+}
+
+
+/*************************************************************************
+ * dump_latency_histograms() tests.
+ *************************************************************************/
+
+static void
+test_dump_latency_histograms_returns_buckets_as_text() {
+  record_histogram_value( &stats.histograms[ LATENCY_ECHO ], 10 );
+  record_histogram_value( &stats.histograms[ LATENCY_BARRIER ], 10 );
+  record_histogram_value( &stats.histograms[ LATENCY_BARRIER ], 10 );
+
+  buffer *buf = dump_latency_histograms( &stats );
+
+  const char expected[] = "# type lower_usec upper_usec count\n"
+                          "echo 10 10 1\n"
+                          "barrier 10 10 2\n";
+  assert_int_equal( buf->length, strlen( expected ) );
+  assert_memory_equal( buf->data, expected, buf->length );
+
+  free_buffer( buf );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_record_latency_records_elapsed_time, setup, teardown ),
+    unit_test_setup_teardown( test_record_latency_ignores_unmeasured_requests, setup, teardown ),
+
+    unit_test_setup_teardown( test_barrier_is_measured_from_first_flow_mod, setup, teardown ),
+    unit_test_setup_teardown( test_barrier_without_flow_mod_is_measured_from_now, setup, teardown ),
+
+    unit_test_setup_teardown( test_packet_out_is_measured_from_packet_in_with_same_buffer_id, setup, teardown ),
+    unit_test_setup_teardown( test_packet_out_with_other_buffer_id_is_not_measured, setup, teardown ),
+    unit_test_setup_teardown( test_newer_packet_in_overwrites_slot, setup, teardown ),
+    unit_test_setup_teardown( test_unbuffered_packets_are_not_measured, setup, teardown ),
+
+    unit_test_setup_teardown( test_foreach_latency_stat_reports_non_empty_histograms, setup, teardown ),
+    unit_test_setup_teardown( test_foreach_latency_stat_reports_nothing_if_empty, setup, teardown ),
+
+    unit_test_setup_teardown( test_dump_latency_histograms_returns_buckets_as_text, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,312 @@
+/*
+ * Unit tests for handing secure channels over to switch workers.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "trema.h"
+#include "switch_worker.h"
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+static void
+setup() {
+  setup_leak_detector();
+  init_event_handler();
+}
+
+
+static void
+teardown() {
+  finalize_event_handler();
+  teardown_leak_detector();
+}
+
+
+/*************************************************************************
+ * Helper.
+ *************************************************************************/
+
+static const char SERVICE_NAMES[] = "packet_in::controller\0state_notify::topology";
+static const char HELLO[] = "FEATURES REPLY";
+
+
+static switch_connection *
+create_connection( uint64_t datapath_id, size_t data_length ) {
+  size_t length = offsetof( switch_connection, data ) + sizeof( SERVICE_NAMES ) + data_length;
+  switch_connection *connection = xcalloc( 1, length );
+  connection->datapath_id = datapath_id;
+  connection->service_names_length = sizeof( SERVICE_NAMES );
+  connection->data_length = ( uint32_t ) data_length;
+  memcpy( connection->data, SERVICE_NAMES, sizeof( SERVICE_NAMES ) );
+  memcpy( connection->data + sizeof( SERVICE_NAMES ), HELLO, data_length < sizeof( HELLO ) ? data_length : sizeof( HELLO ) );
+
+  return connection;
+}
+
+
+static switch_connection *
+receive_connection( int socket, int *fd ) {
+  static uint64_t storage[ SWITCH_CONNECTION_MAX_LENGTH / sizeof( uint64_t ) ];
+  switch_connection *connection = ( switch_connection * ) storage;
+  assert_true( recv_switch_connection( socket, connection, sizeof( storage ), fd ) );
+
+  return connection;
+}
+
+
+static void
+start_worker( struct switch_worker *worker, int *peer ) {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, sockets ), 0 );
+  worker->pid = 0;
+  worker->socket = sockets[ 0 ];
+  init_switch_worker_handoffs( worker );
+  *peer = sockets[ 1 ];
+}
+
+
+static void
+stop_worker( struct switch_worker *worker, int peer ) {
+  finalize_switch_worker_handoffs( worker );
+  close( worker->socket );
+  close( peer );
+}
+
+
+/*************************************************************************
+ * select_switch_worker() tests.
+ *************************************************************************/
+
+static void
+test_select_switch_worker_shards_by_datapath_id() {
+  assert_int_equal( select_switch_worker( 0, 1 ), 0 );
+  assert_int_equal( select_switch_worker( 0xabc, 1 ), 0 );
+  assert_int_equal( select_switch_worker( 4, 4 ), 0 );
+  assert_int_equal( select_switch_worker( 7, 4 ), 3 );
+  assert_int_equal( select_switch_worker( UINT64_MAX, 256 ), 255 );
+}
+
+
+/*************************************************************************
+ * send_switch_connection() and recv_switch_connection() tests.
+ *************************************************************************/
+
+static void
+test_switch_connection_is_received_as_sent() {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_SEQPACKET, 0, sockets ), 0 );
+  int pipe_fds[ 2 ];
+  assert_int_equal( pipe( pipe_fds ), 0 );
+
+  switch_connection *sent = create_connection( 0x123456789abcdefULL, sizeof( HELLO ) );
+  assert_true( send_switch_connection( sockets[ 0 ], pipe_fds[ 1 ], sent ) );
+  xfree( sent );
+
+  int fd;
+  switch_connection *received = receive_connection( sockets[ 1 ], &fd );
+  assert_true( fd >= 0 );
+  assert_true( received->datapath_id == 0x123456789abcdefULL );
+  assert_int_equal( received->service_names_length, sizeof( SERVICE_NAMES ) );
+  assert_int_equal( received->data_length, sizeof( HELLO ) );
+  assert_memory_equal( received->data, SERVICE_NAMES, sizeof( SERVICE_NAMES ) );
+  assert_string_equal( received->data + sizeof( SERVICE_NAMES ), HELLO );
+
+  // The received descriptor refers to the same channel.
+  char buf[ 4 ];
+  assert_int_equal( write( fd, "OK", 3 ), 3 );
+  assert_int_equal( read( pipe_fds[ 0 ], buf, sizeof( buf ) ), 3 );
+  assert_string_equal( buf, "OK" );
+
+  close( fd );
+  close( pipe_fds[ 0 ] );
+  close( pipe_fds[ 1 ] );
+  close( sockets[ 0 ] );
+  close( sockets[ 1 ] );
+}
+
+
+static void
+test_recv_switch_connection_rejects_unterminated_service_names() {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_SEQPACKET, 0, sockets ), 0 );
+  int pipe_fds[ 2 ];
+  assert_int_equal( pipe( pipe_fds ), 0 );
+
+  switch_connection *sent = create_connection( 1, 0 );
+  sent->data[ sent->service_names_length - 1 ] = 'X';
+  assert_true( send_switch_connection( sockets[ 0 ], pipe_fds[ 1 ], sent ) );
+  xfree( sent );
+
+  int fd;
+  receive_connection( sockets[ 1 ], &fd );
+  assert_int_equal( fd, -1 );
+
+  close( pipe_fds[ 0 ] );
+  close( pipe_fds[ 1 ] );
+  close( sockets[ 0 ] );
+  close( sockets[ 1 ] );
+}
+
+
+static void
+test_recv_switch_connection_fails_if_socket_is_closed() {
+  int sockets[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_SEQPACKET, 0, sockets ), 0 );
+  close( sockets[ 0 ] );
+
+  static uint64_t storage[ SWITCH_CONNECTION_MAX_LENGTH / sizeof( uint64_t ) ];
+  int fd;
+  assert_false( recv_switch_connection( sockets[ 1 ], ( switch_connection * ) storage, sizeof( storage ), &fd ) );
+
+  close( sockets[ 1 ] );
+}
+
+
+/*************************************************************************
+ * hand_over_switch_connection() tests.
+ *************************************************************************/
+
+#define N_WORKERS 2
+#define N_SWITCHES 16
+#define LARGE_DATA_LENGTH ( 64 * 1024 )
+
+
+static void
+test_hand_over_switch_connection_reaches_selected_worker() {
+  struct switch_worker workers[ N_WORKERS ];
+  int peers[ N_WORKERS ];
+  for ( int i = 0; i < N_WORKERS; i++ ) {
+    start_worker( &workers[ i ], &peers[ i ] );
+  }
+
+  for ( uint64_t datapath_id = 0; datapath_id < N_SWITCHES; datapath_id++ ) {
+    int pipe_fds[ 2 ];
+    assert_int_equal( pipe( pipe_fds ), 0 );
+    close( pipe_fds[ 0 ] );
+    struct switch_worker *worker = &workers[ select_switch_worker( datapath_id, N_WORKERS ) ];
+    assert_true( hand_over_switch_connection( worker, pipe_fds[ 1 ], create_connection( datapath_id, sizeof( HELLO ) ) ) );
+    assert_int_equal( worker->n_handoffs, 0 );
+  }
+
+  for ( int i = 0; i < N_WORKERS; i++ ) {
+    for ( int n = 0; n < N_SWITCHES / N_WORKERS; n++ ) {
+      int fd;
+      switch_connection *received = receive_connection( peers[ i ], &fd );
+      assert_true( fd >= 0 );
+      assert_int_equal( select_switch_worker( received->datapath_id, N_WORKERS ), i );
+      assert_true( received->datapath_id == ( uint64_t ) ( n * N_WORKERS + i ) );
+      close( fd );
+    }
+  }
+
+  for ( int i = 0; i < N_WORKERS; i++ ) {
+    stop_worker( &workers[ i ], peers[ i ] );
+  }
+}
+
+
+static void
+test_hand_over_switch_connection_queues_while_worker_is_busy() {
+  struct switch_worker worker;
+  int peer;
+  start_worker( &worker, &peer );
+
+  // Large handovers fill the socket buffer long before N_SWITCHES.
+  for ( uint64_t datapath_id = 0; datapath_id < N_SWITCHES; datapath_id++ ) {
+    int pipe_fds[ 2 ];
+    assert_int_equal( pipe( pipe_fds ), 0 );
+    close( pipe_fds[ 0 ] );
+    assert_true( hand_over_switch_connection( &worker, pipe_fds[ 1 ], create_connection( datapath_id, LARGE_DATA_LENGTH ) ) );
+  }
+  assert_true( worker.n_handoffs > 0 );
+  assert_true( writable( worker.socket ) );
+
+  for ( uint64_t datapath_id = 0; datapath_id < N_SWITCHES; datapath_id++ ) {
+    int fd;
+    switch_connection *received = receive_connection( peer, &fd );
+    assert_true( fd >= 0 );
+    assert_true( received->datapath_id == datapath_id );
+    assert_int_equal( received->data_length, LARGE_DATA_LENGTH );
+    close( fd );
+    run_event_handler_once( 0 );
+  }
+  assert_int_equal( worker.n_handoffs, 0 );
+  assert_false( writable( worker.socket ) );
+
+  stop_worker( &worker, peer );
+}
+
+
+static void
+test_finalize_switch_worker_handoffs_discards_queued_connections() {
+  struct switch_worker worker;
+  int peer;
+  start_worker( &worker, &peer );
+
+  for ( uint64_t datapath_id = 0; datapath_id < N_SWITCHES; datapath_id++ ) {
+    int pipe_fds[ 2 ];
+    assert_int_equal( pipe( pipe_fds ), 0 );
+    close( pipe_fds[ 0 ] );
+    assert_true( hand_over_switch_connection( &worker, pipe_fds[ 1 ], create_connection( datapath_id, LARGE_DATA_LENGTH ) ) );
+  }
+  assert_true( worker.n_handoffs > 0 );
+
+  stop_worker( &worker, peer );
+  assert_int_equal( worker.n_handoffs, 0 );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test( test_select_switch_worker_shards_by_datapath_id ),
+
+    unit_test_setup_teardown( test_switch_connection_is_received_as_sent, setup, teardown ),
+    unit_test_setup_teardown( test_recv_switch_connection_rejects_unterminated_service_names, setup, teardown ),
+    unit_test_setup_teardown( test_recv_switch_connection_fails_if_socket_is_closed, setup, teardown ),
+
+    unit_test_setup_teardown( test_hand_over_switch_connection_reaches_selected_worker, setup, teardown ),
+    unit_test_setup_teardown( test_hand_over_switch_connection_queues_while_worker_is_busy, setup, teardown ),
+    unit_test_setup_teardown( test_finalize_switch_worker_handoffs_discards_queued_connections, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,177 @@
+/*
+ * Unit tests for xid_table.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "trema.h"
+#include "xid_table.h"
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+static xid_table_t table;
+static messenger_service_id service = MESSENGER_INVALID_SERVICE_ID;
+
+
+static void
+setup() {
+  init_xid_table( &table );
+  service = get_messenger_service_id( "application" );
+}
+
+
+static void
+teardown() {
+  finalize_xid_table( &table );
+  release_messenger_service_id( service );
+}
+
+
+/*************************************************************************
+ * Tests.
+ *************************************************************************/
+
+static void
+test_insert_and_lookup_xid_entry() {
+  uint32_t xid = insert_xid_entry( &table, 0x1234, service );
+
+  xid_entry_t *entry = lookup_xid_entry( &table, xid );
+  assert_true( entry != NULL );
+  assert_int_equal( entry->original_xid, 0x1234 );
+  assert_int_equal( entry->service, service );
+  assert_int_equal( entry->index, xid & 0xfff );
+
+  assert_true( lookup_xid_entry( &table, 0x1234 ) == NULL );
+}
+
+
+static void
+test_delete_xid_entry() {
+  uint32_t xid = insert_xid_entry( &table, 0x1234, service );
+
+  delete_xid_entry( &table, lookup_xid_entry( &table, xid ) );
+
+  assert_true( lookup_xid_entry( &table, xid ) == NULL );
+}
+
+
+static void
+test_reused_slot_does_not_match_old_xid() {
+  uint32_t old_xid = insert_xid_entry( &table, 1, service );
+  delete_xid_entry( &table, lookup_xid_entry( &table, old_xid ) );
+  for ( int i = 1; i < 4096; i++ ) {
+    insert_xid_entry( &table, 2, service );
+  }
+
+  uint32_t new_xid = insert_xid_entry( &table, 3, service );
+
+  assert_int_equal( new_xid & 0xfff, old_xid & 0xfff );
+  assert_true( new_xid != old_xid );
+  assert_true( lookup_xid_entry( &table, old_xid ) == NULL );
+  assert_int_equal( lookup_xid_entry( &table, new_xid )->original_xid, 3 );
+}
+
+
+static void
+test_busy_switch_does_not_evict_entries_of_other_switches() {
+  static xid_table_t other_table;
+  init_xid_table( &other_table );
+  uint32_t pending_xid = insert_xid_entry( &other_table, 0x1234, service );
+
+  for ( int i = 0; i < XID_MAX_ENTRIES * 2; i++ ) {
+    insert_xid_entry( &table, ( uint32_t ) i, service );
+  }
+
+  assert_int_equal( table.n_evictions, XID_MAX_ENTRIES );
+  assert_int_equal( other_table.n_evictions, 0 );
+  xid_entry_t *entry = lookup_xid_entry( &other_table, pending_xid );
+  assert_true( entry != NULL );
+  assert_int_equal( entry->original_xid, 0x1234 );
+
+  finalize_xid_table( &other_table );
+}
+
+
+static void
+test_xid_entry_holds_service_reference() {
+  messenger_service_id id = get_messenger_service_id( "transient" );
+  uint32_t xid = insert_xid_entry( &table, 0x1234, id );
+  release_messenger_service_id( id );
+  assert_string_equal( get_messenger_service_name( id ), "transient" );
+
+  delete_xid_entry( &table, lookup_xid_entry( &table, xid ) );
+
+  assert_true( get_messenger_service_name( id ) == NULL );
+}
+
+
+static void
+test_finalize_xid_table_keeps_entry_index() {
+  insert_xid_entry( &table, 0x1233, service );
+  uint32_t xid = insert_xid_entry( &table, 0x1234, service );
+  xid_entry_t *entry = lookup_xid_entry( &table, xid );
+  int index = entry->index;
+  assert_int_equal( index, 1 );
+
+  finalize_xid_table( &table );
+
+  assert_int_equal( entry->xid, 0 );
+  assert_int_equal( entry->original_xid, 0 );
+  assert_int_equal( entry->service, MESSENGER_INVALID_SERVICE_ID );
+  assert_int_equal( entry->index, index );
+  assert_true( lookup_xid_entry( &table, xid ) == NULL );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_insert_and_lookup_xid_entry, setup, teardown ),
+    unit_test_setup_teardown( test_delete_xid_entry, setup, teardown ),
+    unit_test_setup_teardown( test_reused_slot_does_not_match_old_xid, setup, teardown ),
+    unit_test_setup_teardown( test_busy_switch_does_not_evict_entries_of_other_switches, setup, teardown ),
+    unit_test_setup_teardown( test_xid_entry_holds_service_reference, setup, teardown ),
+    unit_test_setup_teardown( test_finalize_xid_table_keeps_entry_index, setup, teardown ),
+  };
+  // Evictions are counted in the stats.
+  init_stat();
+  int ret = run_tests( tests );
+  finalize_stat();
+
+  return ret;
+}
+
+
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */